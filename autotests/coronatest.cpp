@@ -20,9 +20,12 @@
 #include "coronatest.h"
 #include <ksycoca.h>
 #include <kactioncollection.h>
+#include <KConfig>
+#include <KConfigGroup>
 #include <QStandardPaths>
 #include <QAction>
 #include <QApplication>
+#include <QElapsedTimer>
 
 Plasma::Applet *SimpleLoader::internalLoadApplet(const QString &name, uint appletId,
                                    const QVariantList &args)
@@ -42,7 +45,12 @@ Plasma::Applet *SimpleLoader::internalLoadApplet(const QString &name, uint apple
 SimpleCorona::SimpleCorona(QObject *parent)
     : Plasma::Corona(parent)
 {
-    Plasma::PluginLoader::setPluginLoader(new SimpleLoader);
+    // the plugin loader can be set only once per process
+    static bool loaderSet = false;
+    if (!loaderSet) {
+        Plasma::PluginLoader::setPluginLoader(new SimpleLoader);
+        loaderSet = true;
+    }
 }
 
 SimpleCorona::~SimpleCorona()
@@ -100,6 +108,50 @@ SimpleNoScreenContainment::SimpleNoScreenContainment(QObject *parent , const QSt
     //This containment will *never* be isUiReady()
 }
 
+static const int s_benchmarkAppletCount = 20;
+
+static bool copyDirectory(const QString &source, const QString &destination)
+{
+    QDir dir(source);
+    if (!QDir().mkpath(destination)) {
+        return false;
+    }
+
+    foreach (const QFileInfo &info, dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QString target = destination + QLatin1Char('/') + info.fileName();
+        if (info.isDir() ? !copyDirectory(info.filePath(), target) : !QFile::copy(info.filePath(), target)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// installs copies of data/testpackage as applet packages with distinct names
+static bool installBenchmarkPackages()
+{
+    const QString packagesDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/plasma/plasmoids/");
+
+    for (int i = 1; i <= s_benchmarkAppletCount; ++i) {
+        const QString name = QStringLiteral("org.kde.testpackage.benchmark%1").arg(i);
+        if (!copyDirectory(QFINDTESTDATA("data/testpackage"), packagesDir + name)) {
+            return false;
+        }
+
+        QFile metadata(packagesDir + name + QStringLiteral("/metadata.desktop"));
+        if (!metadata.open(QIODevice::ReadWrite | QIODevice::Text)) {
+            return false;
+        }
+        QByteArray contents = metadata.readAll();
+        contents.replace("X-KDE-PluginInfo-Name=org.kde.testpackage", "X-KDE-PluginInfo-Name=" + name.toUtf8());
+        if (!metadata.resize(0) || !metadata.seek(0) || metadata.write(contents) != contents.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static void runKBuildSycoca()
 {
     QProcess proc;
@@ -132,12 +184,17 @@ void CoronaTest::initTestCase()
 
     QVERIFY(m_configDir.mkpath(QStringLiteral(".")));
 
+    m_dataDir = QDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/plasma/plasmoids"));
+    m_dataDir.removeRecursively();
+    QVERIFY(installBenchmarkPackages());
+
     QVERIFY(QFile::copy(QStringLiteral(":/plasma-test-appletsrc"), m_configDir.filePath(QStringLiteral("plasma-test-appletsrc"))));
 }
 
 void CoronaTest::cleanupTestCase()
 {
     m_configDir.removeRecursively();
+    m_dataDir.removeRecursively();
     delete m_corona;
 }
 
@@ -203,6 +260,72 @@ void CoronaTest::addRemoveApplets()
     QCOMPARE(m_corona->containments().at(0)->applets().count(), 2);
 }
 
+void CoronaTest::benchmarkLoadLayout_data()
+{
+    QTest::addColumn<bool>("preload");
+
+    // the baseline creates the applets one after the other, as before the preloader
+    QTest::newRow("serial") << false;
+    QTest::newRow("preloaded") << true;
+}
+
+void CoronaTest::benchmarkLoadLayout()
+{
+    QFETCH(bool, preload);
+    if (preload) {
+        qunsetenv("PLASMA_NO_LAYOUT_PRELOADING");
+    } else {
+        qputenv("PLASMA_NO_LAYOUT_PRELOADING", "1");
+    }
+
+    // a layout with many applets whose packages have to be looked up and prepared
+    const int containmentCount = 10;
+    {
+        KConfig config(m_configDir.filePath(QStringLiteral("plasma-benchmark-appletsrc")), KConfig::SimpleConfig);
+        KConfigGroup containments(&config, "Containments");
+        for (int i = 1; i <= containmentCount; ++i) {
+            const int containmentId = i * 100;
+            KConfigGroup containment(&containments, QString::number(containmentId));
+            containment.writeEntry("plugin", "simplenoscreencontainment");
+
+            KConfigGroup applets(&containment, "Applets");
+            for (int j = 1; j <= s_benchmarkAppletCount; ++j) {
+                KConfigGroup applet(&applets, QString::number(containmentId + j));
+                applet.writeEntry("plugin", QStringLiteral("org.kde.testpackage.benchmark%1").arg(j));
+            }
+        }
+    }
+
+    SimpleCorona corona;
+    QSignalSpy startupSpy(&corona, SIGNAL(startupCompleted()));
+
+    // only the restore until startupCompleted is measured, not the teardown
+    const int iterations = 10;
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        startupSpy.clear();
+
+        timer.start();
+        corona.loadLayout(QStringLiteral("plasma-benchmark-appletsrc"));
+        QVERIFY(!startupSpy.isEmpty() || startupSpy.wait(10000));
+        elapsed += timer.nsecsElapsed();
+
+        QCOMPARE(corona.containments().count(), containmentCount);
+        foreach (Plasma::Containment *containment, corona.containments()) {
+            QCOMPARE(containment->applets().count(), s_benchmarkAppletCount);
+            QVERIFY(containment->applets().first()->pluginMetaData().isValid());
+        }
+
+        qDeleteAll(corona.containments());
+        QVERIFY(corona.containments().isEmpty());
+    }
+
+    qunsetenv("PLASMA_NO_LAYOUT_PRELOADING");
+
+    QTest::setBenchmarkResult(qreal(elapsed) / iterations / 1000000, QTest::WalltimeMilliseconds);
+}
+
 //this test has to be the last, since systemimmutability
 //can't be programmatically unlocked
 void CoronaTest::immutability()
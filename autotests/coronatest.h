@@ -87,11 +87,14 @@ private Q_SLOTS:
     void checkOrder();
     void startupCompletion();
     void addRemoveApplets();
+    void benchmarkLoadLayout_data();
+    void benchmarkLoadLayout();
     void immutability();
 
 private:
     SimpleCorona *m_corona;
     QDir m_configDir;
+    QDir m_dataDir;
 };
 
 #endif
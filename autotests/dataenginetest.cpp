@@ -0,0 +1,225 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "dataenginetest.h"
+
+#include <plasma/datacontainer.h>
+
+TestEngine::TestEngine(QObject *parent)
+    : Plasma::DataEngine(parent),
+      sourceChecks(0)
+{
+}
+
+bool TestEngine::updateSourceEvent(const QString &source)
+{
+    if (pendingData.isEmpty()) {
+        return false;
+    }
+
+    setData(source, pendingData);
+    pendingData.clear();
+    return true;
+}
+
+void TestEngine::timerEvent(QTimerEvent *event)
+{
+    // without a polling interval, the only timer of the engine is the one checking the sources
+    ++sourceChecks;
+    Plasma::DataEngine::timerEvent(event);
+}
+
+void UpdatesVisualization::dataUpdated(const QString &source, const Plasma::DataEngine::Data &data)
+{
+    Q_UNUSED(source)
+
+    this->data = data;
+    ++updates;
+}
+
+static QVariantMap statistics(Plasma::DataContainer *container)
+{
+    QVariantMap statistics;
+    QMetaObject::invokeMethod(container, "statistics", Q_RETURN_ARG(QVariantMap, statistics));
+    return statistics;
+}
+
+void KeysVisualization::dataKeysChanged(const QString &source, const Plasma::DataEngine::Data &data,
+                                        const QStringList &changedKeys, const QStringList &removedKeys)
+{
+    Q_UNUSED(source)
+
+    QStringList changed = changedKeys;
+    changed.sort();
+    QStringList removed = removedKeys;
+    removed.sort();
+
+    this->data = data;
+    this->changedKeys << changed;
+    this->removedKeys << removed;
+}
+
+void DataEngineTest::keysChangedDirect()
+{
+    TestEngine engine;
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    engine.setData(QStringLiteral("source"), QStringLiteral("b"), 2);
+    engine.setData(QStringLiteral("source"), QStringLiteral("c"), 3);
+
+    // a visualization connecting to an existing source gets all the keys right away
+    KeysVisualization visualization;
+    engine.connectSource(QStringLiteral("source"), &visualization);
+    QCOMPARE(visualization.changedKeys.count(), 1);
+    QCOMPARE(visualization.changedKeys.last(), QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c"));
+    QVERIFY(visualization.removedKeys.last().isEmpty());
+
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 10);
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 11);
+    engine.setData(QStringLiteral("source"), QStringLiteral("d"), 4);
+    engine.removeData(QStringLiteral("source"), QStringLiteral("b"));
+
+    // changes between two updates are coalesced in a single call
+    QTRY_COMPARE(visualization.changedKeys.count(), 2);
+    QCOMPARE(visualization.changedKeys.last(), QStringList() << QStringLiteral("a") << QStringLiteral("d"));
+    QCOMPARE(visualization.removedKeys.last(), QStringList() << QStringLiteral("b"));
+    QCOMPARE(visualization.data.value(QStringLiteral("a")).toInt(), 11);
+    QVERIFY(!visualization.data.contains(QStringLiteral("b")));
+
+    // a key set and removed before the update is only reported as removed
+    engine.setData(QStringLiteral("source"), QStringLiteral("e"), 5);
+    engine.removeData(QStringLiteral("source"), QStringLiteral("e"));
+    engine.setData(QStringLiteral("source"), QStringLiteral("c"), 30);
+
+    QTRY_COMPARE(visualization.changedKeys.count(), 3);
+    QCOMPARE(visualization.changedKeys.last(), QStringList() << QStringLiteral("c"));
+    QCOMPARE(visualization.removedKeys.last(), QStringList() << QStringLiteral("e"));
+}
+
+void DataEngineTest::keysChangedRelayed()
+{
+    TestEngine engine;
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    engine.setData(QStringLiteral("source"), QStringLiteral("b"), 2);
+
+    KeysVisualization direct;
+    engine.connectSource(QStringLiteral("source"), &direct);
+    KeysVisualization relayed;
+    engine.connectSource(QStringLiteral("source"), &relayed, 100);
+    QCOMPARE(relayed.changedKeys.count(), 1);
+    QCOMPARE(relayed.changedKeys.last(), QStringList() << QStringLiteral("a") << QStringLiteral("b"));
+
+    // the relay polls the engine, which sets the data in updateSourceEvent
+    engine.pendingData.insert(QStringLiteral("a"), 10);
+    engine.pendingData.insert(QStringLiteral("b"), QVariant());
+    engine.pendingData.insert(QStringLiteral("c"), 3);
+
+    QTRY_COMPARE(relayed.changedKeys.count(), 2);
+    QCOMPARE(relayed.changedKeys.last(), QStringList() << QStringLiteral("a") << QStringLiteral("c"));
+    QCOMPARE(relayed.removedKeys.last(), QStringList() << QStringLiteral("b"));
+    QCOMPARE(relayed.data.value(QStringLiteral("a")).toInt(), 10);
+    QVERIFY(!relayed.data.contains(QStringLiteral("b")));
+
+    // the direct visualization tracks its own keys
+    QTRY_COMPARE(direct.changedKeys.count(), 2);
+    QCOMPARE(direct.changedKeys.last(), QStringList() << QStringLiteral("a") << QStringLiteral("c"));
+    QCOMPARE(direct.removedKeys.last(), QStringList() << QStringLiteral("b"));
+
+    engine.pendingData.insert(QStringLiteral("d"), 4);
+
+    QTRY_COMPARE(relayed.changedKeys.count(), 3);
+    QCOMPARE(relayed.changedKeys.last(), QStringList() << QStringLiteral("d"));
+    QVERIFY(relayed.removedKeys.last().isEmpty());
+}
+
+void DataEngineTest::unchangedValues()
+{
+    TestEngine engine;
+    QVERIFY(engine.isDataComparisonEnabled());
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    engine.setData(QStringLiteral("source"), QStringLiteral("b"), QStringLiteral("text"));
+    QTRY_COMPARE(engine.sourceChecks, 1);
+
+    UpdatesVisualization visualization;
+    engine.connectSource(QStringLiteral("source"), &visualization);
+    QCOMPARE(visualization.updates, 1);
+
+    Plasma::DataContainer *container = engine.containerForSource(QStringLiteral("source"));
+    QVERIFY(container);
+    QCOMPARE(statistics(container).value(QStringLiteral("set")).toULongLong(), 2ull);
+    QCOMPARE(statistics(container).value(QStringLiteral("skipped")).toULongLong(), 0ull);
+
+    QVariantMap data;
+    data.insert(QStringLiteral("a"), 1);
+    data.insert(QStringLiteral("b"), QStringLiteral("text"));
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    engine.setData(QStringLiteral("source"), data);
+    engine.removeData(QStringLiteral("source"), QStringLiteral("missing"));
+
+    // nothing changed: no update gets scheduled, and the visualization isn't called
+    QTest::qWait(50);
+    QCOMPARE(engine.sourceChecks, 1);
+    QCOMPARE(visualization.updates, 1);
+    QCOMPARE(statistics(container).value(QStringLiteral("set")).toULongLong(), 6ull);
+    QCOMPARE(statistics(container).value(QStringLiteral("skipped")).toULongLong(), 4ull);
+
+    // an equal value of another type is a change
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), QStringLiteral("1"));
+    QTRY_COMPARE(visualization.updates, 2);
+    QCOMPARE(engine.sourceChecks, 2);
+    QCOMPARE(visualization.data.value(QStringLiteral("a")).userType(), int(QMetaType::QString));
+    QCOMPARE(statistics(container).value(QStringLiteral("skipped")).toULongLong(), 4ull);
+}
+
+void DataEngineTest::comparisonDisabled()
+{
+    TestEngine engine;
+    engine.setDataComparisonEnabled(false);
+    QVERIFY(!engine.isDataComparisonEnabled());
+
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    QTRY_COMPARE(engine.sourceChecks, 1);
+
+    UpdatesVisualization visualization;
+    engine.connectSource(QStringLiteral("source"), &visualization);
+    QCOMPARE(visualization.updates, 1);
+
+    // every value set updates the visualizations, as before the comparison existed
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    QTRY_COMPARE(visualization.updates, 2);
+    QCOMPARE(engine.sourceChecks, 2);
+
+    engine.removeData(QStringLiteral("source"), QStringLiteral("missing"));
+    QTRY_COMPARE(visualization.updates, 3);
+    QCOMPARE(engine.sourceChecks, 3);
+
+    Plasma::DataContainer *container = engine.containerForSource(QStringLiteral("source"));
+    QCOMPARE(statistics(container).value(QStringLiteral("set")).toULongLong(), 3ull);
+    QCOMPARE(statistics(container).value(QStringLiteral("skipped")).toULongLong(), 0ull);
+
+    // enabling it again applies to the existing sources
+    engine.setDataComparisonEnabled(true);
+    engine.setData(QStringLiteral("source"), QStringLiteral("a"), 1);
+    QTest::qWait(50);
+    QCOMPARE(engine.sourceChecks, 3);
+    QCOMPARE(visualization.updates, 3);
+    QCOMPARE(statistics(container).value(QStringLiteral("skipped")).toULongLong(), 1ull);
+}
+
+QTEST_MAIN(DataEngineTest)
+
@@ -0,0 +1,88 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#ifndef DATAENGINETEST_H
+#define DATAENGINETEST_H
+
+#include <QtTest/QtTest>
+
+#include <plasma/dataengine.h>
+
+class TestEngine : public Plasma::DataEngine
+{
+    Q_OBJECT
+
+public:
+    explicit TestEngine(QObject *parent = nullptr);
+
+    using Plasma::DataEngine::setData;
+    using Plasma::DataEngine::removeData;
+    using Plasma::DataEngine::setDataComparisonEnabled;
+    using Plasma::DataEngine::isDataComparisonEnabled;
+
+    // applied to the source at the next poll, invalid values remove the key
+    QVariantMap pendingData;
+    // times the sources got checked for updates, after scheduleSourcesUpdated
+    int sourceChecks;
+
+protected:
+    bool updateSourceEvent(const QString &source) Q_DECL_OVERRIDE;
+    void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
+};
+
+class UpdatesVisualization : public QObject
+{
+    Q_OBJECT
+
+public:
+    UpdatesVisualization() : updates(0) {}
+
+    Plasma::DataEngine::Data data;
+    int updates;
+
+public Q_SLOTS:
+    void dataUpdated(const QString &source, const Plasma::DataEngine::Data &data);
+};
+
+class KeysVisualization : public QObject
+{
+    Q_OBJECT
+
+public:
+    Plasma::DataEngine::Data data;
+    QList<QStringList> changedKeys;
+    QList<QStringList> removedKeys;
+
+public Q_SLOTS:
+    void dataKeysChanged(const QString &source, const Plasma::DataEngine::Data &data,
+                         const QStringList &changedKeys, const QStringList &removedKeys);
+};
+
+class DataEngineTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void keysChangedDirect();
+    void keysChangedRelayed();
+    void unchangedValues();
+    void comparisonDisabled();
+};
+
+#endif
@@ -18,9 +18,61 @@
 *********************************************************************************/
 
 #include "framesvgtest.h"
+#include <QBitmap>
 #include <QStandardPaths>
 
+enum FrameDocumentHint {
+    PlainFrame = 0,
+    StretchBorders = 1,
+    MaskElements = 2,
+    // implies MaskElements, as the hint is only honored with a mask
+    ComposeOverBorder = 4
+};
 
+// The nine elements of a 32x32 frame, with rounded corners and sides
+// partially transparent across their width, drawn at x offset ox.
+// Mask elements have square corners, to be told apart from the visible ones.
+static QString frameElements(const QString &prefix, int ox, bool square)
+{
+    const QString transparent = QStringLiteral("<rect x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\" style=\"fill:#000000;fill-opacity:0\"/>");
+    const QString opaque = QStringLiteral("<rect x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\" fill=\"#000000\"/>");
+    const QString path = QStringLiteral("<path d=\"%1\" fill=\"#000000\"/>");
+
+    const auto element = [&prefix](const QString &id, const QString &contents) {
+        return QStringLiteral("<g id=\"%1%2\">%3</g>\n").arg(prefix, id, contents);
+    };
+    const auto corner = [&](const QString &id, int x, int y, const QString &arc) {
+        return element(id, transparent.arg(ox + x).arg(y).arg(8).arg(8) +
+                           (square ? opaque.arg(ox + x).arg(y).arg(8).arg(8) : path.arg(arc)));
+    };
+
+    return corner(QStringLiteral("topleft"), 0, 0, QStringLiteral("M%1,0 A8,8 0 0 0 %2,8 L%1,8 Z").arg(ox + 8).arg(ox)) +
+           element(QStringLiteral("top"), transparent.arg(ox + 8).arg(0).arg(16).arg(8) + opaque.arg(ox + 8).arg(3).arg(16).arg(5)) +
+           corner(QStringLiteral("topright"), 24, 0, QStringLiteral("M%1,0 A8,8 0 0 1 %2,8 L%1,8 Z").arg(ox + 24).arg(ox + 32)) +
+           element(QStringLiteral("left"), transparent.arg(ox).arg(8).arg(8).arg(16) + opaque.arg(ox + 3).arg(8).arg(5).arg(16)) +
+           element(QStringLiteral("center"), opaque.arg(ox + 8).arg(8).arg(16).arg(16)) +
+           element(QStringLiteral("right"), transparent.arg(ox + 24).arg(8).arg(8).arg(16) + opaque.arg(ox + 24).arg(8).arg(5).arg(16)) +
+           corner(QStringLiteral("bottomleft"), 0, 24, QStringLiteral("M%1,24 A8,8 0 0 0 %2,32 L%2,24 Z").arg(ox).arg(ox + 8)) +
+           element(QStringLiteral("bottom"), transparent.arg(ox + 8).arg(24).arg(16).arg(8) + opaque.arg(ox + 8).arg(24).arg(16).arg(5)) +
+           corner(QStringLiteral("bottomright"), 24, 24, QStringLiteral("M%1,24 A8,8 0 0 1 %2,32 L%2,24 Z").arg(ox + 32).arg(ox + 24));
+}
+
+static QByteArray frameDocument(int hints)
+{
+    QString document = QStringLiteral("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"200\" height=\"200\">\n");
+    document += frameElements(QString(), 0, false);
+    if (hints & (MaskElements | ComposeOverBorder)) {
+        document += frameElements(QStringLiteral("mask-"), 50, true);
+    }
+    if (hints & StretchBorders) {
+        document += QStringLiteral("<rect id=\"hint-stretch-borders\" x=\"150\" y=\"150\" width=\"1\" height=\"1\"/>\n");
+    }
+    if (hints & ComposeOverBorder) {
+        document += QStringLiteral("<rect id=\"hint-compose-over-border\" x=\"160\" y=\"150\" width=\"1\" height=\"1\"/>\n");
+    }
+    document += QStringLiteral("</svg>\n");
+    return document.toUtf8();
+}
 
 void FrameSvgTest::initTestCase()
 {
@@ -92,4 +144,130 @@ void FrameSvgTest::setTheme()
     delete frameSvg;
 }
 
+void FrameSvgTest::mask_data()
+{
+    QTest::addColumn<int>("hints");
+    QTest::addColumn<int>("borders");
+    QTest::addColumn<QSize>("size");
+
+    const struct {
+        const char *name;
+        int hints;
+    } documents[] = {
+        {"plain", PlainFrame},
+        {"stretch", StretchBorders},
+        {"mask", MaskElements},
+        {"compose", ComposeOverBorder}
+    };
+    const struct {
+        const char *name;
+        int borders;
+    } borderSets[] = {
+        {"all", Plasma::FrameSvg::AllBorders},
+        {"none", Plasma::FrameSvg::NoBorder},
+        {"topleft", Plasma::FrameSvg::TopBorder | Plasma::FrameSvg::LeftBorder},
+        {"nottop", Plasma::FrameSvg::LeftBorder | Plasma::FrameSvg::RightBorder | Plasma::FrameSvg::BottomBorder}
+    };
+    const QSize sizes[] = {QSize(32, 32), QSize(100, 60), QSize(257, 31)};
+
+    for (const auto &document : documents) {
+        for (const auto &borderSet : borderSets) {
+            for (const QSize &size : sizes) {
+                const QByteArray tag = QByteArray(document.name) + '-' + borderSet.name + '-' +
+                                       QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+                QTest::newRow(tag.constData()) << document.hints << borderSet.borders << size;
+            }
+        }
+    }
+}
+
+void FrameSvgTest::mask()
+{
+    QFETCH(int, hints);
+    QFETCH(int, borders);
+    QFETCH(QSize, size);
+
+    // a file per row, so nothing cached for a previous row is picked up
+    QVERIFY(m_documentsDir.isValid());
+    const QString path = m_documentsDir.path() + QLatin1Char('/') + QLatin1String(QTest::currentDataTag()) + QLatin1String(".svg");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(frameDocument(hints));
+    file.close();
+
+    Plasma::FrameSvg frameSvg;
+    frameSvg.setImagePath(path);
+    QVERIFY(frameSvg.isValid());
+    frameSvg.setEnabledBorders(Plasma::FrameSvg::EnabledBorders(borders));
+    frameSvg.resizeFrame(size);
+
+    // the mask composed from the elements is the one of the painted frame
+    const QRegion mask = frameSvg.mask();
+    const QRegion expected(QBitmap(frameSvg.alphaMask().mask()));
+    QVERIFY(!expected.isEmpty());
+    QCOMPARE(mask, expected);
+}
+
+void FrameSvgTest::requestPixmap()
+{
+    // a new file, nothing about it is in the cache of the theme
+    QVERIFY(m_documentsDir.isValid());
+    const QString path = m_documentsDir.path() + QLatin1String("/requestPixmap.svg");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(frameDocument(PlainFrame));
+    file.close();
+
+    Plasma::Svg svg;
+    svg.setImagePath(path);
+    svg.setContainsMultipleImages(true);
+    QVERIFY(svg.isValid());
+    QSignalSpy spy(&svg, &Plasma::Svg::pixmapReady);
+    QVERIFY(spy.isValid());
+
+    // renderings are only cached once the cache is newer than the file
+    svg.image(QSize(10, 10), QStringLiteral("center"));
+    const QSize size(123, 45);
+    QTRY_VERIFY(svg.requestPixmap(size, QStringLiteral("center")));
+
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toString(), QStringLiteral("center"));
+    QCOMPARE(spy.at(0).at(1).toSize(), size);
+
+    // from then on it's in the cache
+    QVERIFY(!svg.requestPixmap(size, QStringLiteral("center")));
+    QCOMPARE(svg.image(size, QStringLiteral("center")).size(), size);
+
+    // a rendering with the colors the svg had when it was requested isn't ready
+    spy.clear();
+    const QSize otherSize(124, 46);
+    QVERIFY(svg.requestPixmap(otherSize, QStringLiteral("center")));
+    svg.setColorGroup(Plasma::Theme::ComplementaryColorGroup);
+    QVERIFY(!spy.wait(1000));
+
+    // the one with the current colors is
+    QVERIFY(svg.requestPixmap(otherSize, QStringLiteral("center")));
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(1).toSize(), otherSize);
+    QVERIFY(!svg.requestPixmap(otherSize, QStringLiteral("center")));
+}
+
+void FrameSvgTest::benchmarkResizeMask()
+{
+    Plasma::FrameSvg frameSvg;
+    frameSvg.setImagePath(QFINDTESTDATA("data/background.svgz"));
+    QVERIFY(frameSvg.isValid());
+
+    // like a dialog being resized, every size gets its mask computed once
+    int size = 200;
+    QBENCHMARK {
+        size = size >= 1000 ? 200 : size + 8;
+        frameSvg.resizeFrame(QSizeF(size, size));
+        const QRegion mask = frameSvg.mask();
+        QVERIFY(QRect(0, 0, size, size).contains(mask.boundingRect()));
+    }
+}
+
 QTEST_MAIN(FrameSvgTest)
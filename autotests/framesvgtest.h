@@ -20,6 +20,7 @@
 #define FRAMESVGTEST_H
 
 #include <QtTest/QtTest>
+#include <QTemporaryDir>
 
 
 #include "plasma/framesvg.h"
@@ -39,10 +40,15 @@ private Q_SLOTS:
     void contentsRect();
     void setTheme();
     void repaintBlocked();
+    void mask_data();
+    void mask();
+    void requestPixmap();
+    void benchmarkResizeMask();
 
 private:
     Plasma::FrameSvg *m_frameSvg;
     QDir m_cacheDir;
+    QTemporaryDir m_documentsDir;
 };
 
 #endif
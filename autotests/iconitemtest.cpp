@@ -552,5 +552,135 @@ void IconItemTest::roundToIconSize()
     QVERIFY(item->property("paintedHeight").toInt() == 25);
 }
 
+static QVariantMap iconCacheStatistics(QQuickItem *item)
+{
+    QVariantMap statistics;
+    QMetaObject::invokeMethod(item, "iconCacheStatistics", Q_RETURN_ARG(QVariantMap, statistics));
+    return statistics;
+}
+
+void IconItemTest::sharedIcon()
+{
+    // an item without icon, to look at the cache once the others are gone
+    QQuickItem *probe = createIconItem();
+
+    QQuickItem *item1 = createIconItem();
+    item1->setProperty("source", "user-away");
+    grabImage(item1);
+    const QVariantMap first = iconCacheStatistics(item1);
+    QVERIFY(!first.value("cacheKey").toString().isEmpty());
+    QCOMPARE(first.value("references").toInt(), 1);
+
+    QQuickItem *item2 = createIconItem();
+    item2->setProperty("source", "user-away");
+    grabImage(item2);
+    const QVariantMap second = iconCacheStatistics(item2);
+
+    // the second item got the icon of the first one from the cache
+    QVERIFY(second.value("hits").toULongLong() > first.value("hits").toULongLong());
+    QCOMPARE(second.value("entries"), first.value("entries"));
+    QCOMPARE(second.value("cacheKey"), first.value("cacheKey"));
+    QCOMPARE(second.value("references").toInt(), 2);
+    QCOMPARE(second.value("imageCacheKey"), iconCacheStatistics(item1).value("imageCacheKey"));
+
+    // and both are painted with the same texture
+    QVERIFY(second.value("texture").toULongLong() != 0);
+    QCOMPARE(second.value("texture"), iconCacheStatistics(item1).value("texture"));
+
+    delete item1;
+    QCOMPARE(iconCacheStatistics(item2).value("references").toInt(), 1);
+    QCOMPARE(iconCacheStatistics(probe).value("entries"), first.value("entries"));
+
+    delete item2;
+    QCOMPARE(iconCacheStatistics(probe).value("entries").toInt(), first.value("entries").toInt() - 1);
+}
+
+void IconItemTest::asynchronous()
+{
+    QQuickItem *item = createIconItem();
+    item->setProperty("usesPlasmaTheme", false);
+    item->setProperty("asynchronous", true);
+    item->setProperty("source", "tst-plasma-framework-test-icon");
+
+    // nothing is shown until the icon is decoded
+    QVERIFY(imageIsEmpty(grabImage(item)));
+
+    QTRY_VERIFY(!iconCacheStatistics(item).value("cacheKey").toString().isEmpty());
+    QCOMPARE(iconCacheStatistics(item).value("pendingKey").toString(), QString());
+    QVERIFY(!imageIsEmpty(grabImage(item)));
+}
+
+void IconItemTest::asynchronousCancel()
+{
+    QQuickItem *probe = createIconItem();
+    const int entries = iconCacheStatistics(probe).value("entries").toInt();
+
+    QQuickItem *item = createIconItem();
+    item->setProperty("usesPlasmaTheme", false);
+    item->setProperty("asynchronous", true);
+    item->setProperty("source", "konversation");
+    grabImage(item);
+
+    // another icon is asked for while the first one is being decoded
+    item->setProperty("source", "tst-plasma-framework-test-icon");
+    QTRY_VERIFY(iconCacheStatistics(item).value("cacheKey").toString().contains(QLatin1String("tst-plasma-framework-test-icon")));
+    QCOMPARE(iconCacheStatistics(probe).value("entries").toInt(), entries + 1);
+
+    // the item goes away while its icon is being decoded
+    QQuickItem *item2 = createIconItem();
+    item2->setProperty("usesPlasmaTheme", false);
+    item2->setProperty("asynchronous", true);
+    item2->setProperty("source", "konversation");
+    grabImage(item2);
+    delete item2;
+
+    // let the decoding finish, the icon isn't kept for nobody
+    QTest::qWait(200);
+    QCOMPARE(iconCacheStatistics(probe).value("entries").toInt(), entries + 1);
+
+    delete item;
+    QCOMPARE(iconCacheStatistics(probe).value("entries").toInt(), entries);
+}
+
+void IconItemTest::asynchronousOverlays()
+{
+    const QStringList overlays = {QStringLiteral("konversation")};
+
+    QQuickItem *item1 = createIconItem();
+    item1->setProperty("usesPlasmaTheme", false);
+    item1->setProperty("overlays", overlays);
+    item1->setProperty("source", "tst-plasma-framework-test-icon");
+
+    QQuickItem *item2 = createIconItem();
+    item2->setProperty("usesPlasmaTheme", false);
+    item2->setProperty("asynchronous", true);
+    item2->setProperty("overlays", overlays);
+    item2->setProperty("source", "tst-plasma-framework-test-icon");
+
+    // overlays can't be drawn in the threads decoding the icons,
+    // the icon is loaded right away instead
+    const QImage image = grabImage(item2);
+    QVERIFY(!imageIsEmpty(image));
+    QCOMPARE(iconCacheStatistics(item2).value("pendingKey").toString(), QString());
+    QCOMPARE(image, grabImage(item1));
+}
+
+void IconItemTest::asynchronousFailure()
+{
+    QQuickItem *item = createIconItem();
+    item->setProperty("usesPlasmaTheme", false);
+    item->setProperty("asynchronous", true);
+    item->setProperty("source", "tst-plasma-framework-broken-icon");
+
+    // the file can't be decoded, the icon is loaded the usual way
+    QTRY_VERIFY(!iconCacheStatistics(item).value("failedKey").toString().isEmpty());
+    QCOMPARE(iconCacheStatistics(item).value("pendingKey").toString(), QString());
+
+    // and it isn't asked for again
+    item->polish();
+    grabImage(item);
+    QCOMPARE(iconCacheStatistics(item).value("pendingKey").toString(), QString());
+}
+
 QTEST_MAIN(IconItemTest)
 
@@ -58,6 +58,11 @@ private Q_SLOTS:
     void implicitSize();
     void nonSquareImplicitSize();
     void roundToIconSize();
+    void sharedIcon();
+    void asynchronous();
+    void asynchronousCancel();
+    void asynchronousOverlays();
+    void asynchronousFailure();
 
 private:
     QQuickItem *createIconItem();
@@ -21,6 +21,11 @@
 
 #include <qtest.h>
 #include <QDebug>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
 //#include <QJsonObject>
 #include <QtTest/QSignalSpy>
 
@@ -35,6 +40,8 @@ QTEST_MAIN(PluginTest)
 PluginTest::PluginTest()
     : m_buildonly(false)
 {
+    // packages get installed in the test data location
+    QStandardPaths::setTestModeEnabled(true);
 }
 
 void PluginTest::listEngines()
@@ -72,6 +79,65 @@ void PluginTest::listContainmentsOfType()
 
 }
 
+static bool writeContainmentPackage(const QString &dir, const QString &name)
+{
+    if (!QDir().mkpath(dir)) {
+        return false;
+    }
+
+    QJsonObject plugin;
+    plugin.insert(QStringLiteral("Id"), QStringLiteral("org.kde.plasma.indextest"));
+    plugin.insert(QStringLiteral("Name"), name);
+    plugin.insert(QStringLiteral("ServiceTypes"), QJsonArray({QStringLiteral("Plasma/Applet"), QStringLiteral("Plasma/Containment")}));
+
+    QJsonObject metadata;
+    metadata.insert(QStringLiteral("KPlugin"), plugin);
+    metadata.insert(QStringLiteral("X-Plasma-ContainmentType"), QStringLiteral("IndexTest"));
+
+    QFile file(dir + QStringLiteral("/metadata.json"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write(QJsonDocument(metadata).toJson()) > 0;
+}
+
+void PluginTest::indexFollowsInstalls()
+{
+    const QString type = QStringLiteral("IndexTest");
+    const QString packageDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) +
+                               QStringLiteral("/plasma/plasmoids/org.kde.plasma.indextest");
+    QDir(packageDir).removeRecursively();
+
+    QVERIFY(Plasma::PluginLoader::listContainmentsOfType(type).isEmpty());
+
+    // the modification times of some file systems have a resolution of one second;
+    // waiting also lets the event loop run, the index checks the files once per pass
+    QTest::qWait(1100);
+
+    // installed
+    QVERIFY(writeContainmentPackage(packageDir, QStringLiteral("Index Test")));
+    QTest::qWait(0);
+    KPluginInfo::List plugins = Plasma::PluginLoader::listContainmentsOfType(type);
+    QCOMPARE(plugins.count(), 1);
+    QCOMPARE(plugins.first().name(), QStringLiteral("Index Test"));
+
+    QTest::qWait(1100);
+
+    // upgraded in place
+    QVERIFY(writeContainmentPackage(packageDir, QStringLiteral("Index Test Upgraded")));
+    QTest::qWait(0);
+    plugins = Plasma::PluginLoader::listContainmentsOfType(type);
+    QCOMPARE(plugins.count(), 1);
+    QCOMPARE(plugins.first().name(), QStringLiteral("Index Test Upgraded"));
+
+    QTest::qWait(1100);
+
+    // removed
+    QVERIFY(QDir(packageDir).removeRecursively());
+    QTest::qWait(0);
+    QVERIFY(Plasma::PluginLoader::listContainmentsOfType(type).isEmpty());
+}
+
 static const auto source = QStringLiteral("Europe/Sofia");
 
 void EngineTest::dataUpdated(const QString &s, const Plasma::DataEngine::Data &data) {
@@ -34,6 +34,7 @@ private Q_SLOTS:
     void listAppletCategories();
     void listContainmentActions();
     void listContainmentsOfType();
+    void indexFollowsInstalls();
 
     void loadDataEngine();
 
@@ -19,10 +19,12 @@
 #include <sortfiltermodeltest.h>
 
 #include <declarativeimports/core/datamodel.h>
+#include <declarativeimports/core/datasource.h>
 
 // KDE
 
 // Qt
+#include <QQmlPropertyMap>
 #include <QStandardItemModel>
 #include <QStringListModel>
 #include <QSignalSpy>
@@ -32,6 +34,22 @@ using namespace Plasma;
 
 QTEST_MAIN(SortFilterModelTest)
 
+class TestDataModel : public DataModel
+{
+public:
+    using DataModel::setItems;
+
+    // one source per item pair, the source name being the number of the items
+    void addSources(int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            QVariantMap item;
+            item[QStringLiteral("name")] = i;
+            setItems(QStringLiteral("source%1").arg(i, 5, 10, QLatin1Char('0')), QVariantList() << item << item);
+        }
+    }
+};
+
 void SortFilterModelTest::setModel()
 {
     // TODO: Actually test model change
@@ -116,3 +134,190 @@ void SortFilterModelTest::mapRowFromSource()
     QCOMPARE(filterModel.mapRowFromSource(-1), -1);
 }
 
+
+void SortFilterModelTest::dataModelSources()
+{
+    TestDataModel model;
+    model.setKeyRoleFilter(QStringLiteral("items"));
+    model.addSources(10);
+    QCOMPARE(model.rowCount(), 20);
+
+    const int role = model.roleNames().key("name");
+    const int sourceRole = model.roleNames().key("DataEngineSource");
+    QCOMPARE(model.data(model.index(0, 0), role).toInt(), 0);
+    QCOMPARE(model.data(model.index(5, 0), role).toInt(), 2);
+    QCOMPARE(model.data(model.index(19, 0), role).toInt(), 9);
+    QCOMPARE(model.data(model.index(19, 0), sourceRole).toString(), QStringLiteral("source00009"));
+
+    // the rows of the following sources move back
+    QVariantMap item;
+    item[QStringLiteral("name")] = 42;
+    model.setItems(QStringLiteral("source00003"), QVariantList() << item);
+    QCOMPARE(model.rowCount(), 19);
+    QCOMPARE(model.data(model.index(6, 0), role).toInt(), 42);
+    QCOMPARE(model.data(model.index(7, 0), role).toInt(), 4);
+
+    // and come back when a source is added before them
+    model.setItems(QStringLiteral("source00003a"), QVariantList() << item << item);
+    QCOMPARE(model.rowCount(), 21);
+    QCOMPARE(model.data(model.index(8, 0), role).toInt(), 42);
+    QCOMPARE(model.data(model.index(9, 0), role).toInt(), 4);
+    QCOMPARE(model.data(model.index(9, 0), sourceRole).toString(), QStringLiteral("source00004"));
+}
+
+void SortFilterModelTest::dataModelSourceFilter()
+{
+    DataSource source;
+    const QStringList names = QStringList() << QStringLiteral("cpu/0") << QStringLiteral("cpu/1") << QStringLiteral("cpu/10")
+                                            << QStringLiteral("memory") << QStringLiteral("memory/swap") << QStringLiteral("net.eth0");
+    for (const QString &name : names) {
+        QVariantMap item;
+        item[QStringLiteral("name")] = name;
+        QVariantMap data;
+        data[QStringLiteral("items")] = QVariantList() << item;
+        source.data()->insert(name, data);
+    }
+
+    TestDataModel model;
+    model.setKeyRoleFilter(QStringLiteral("items"));
+    model.setDataSource(&source);
+    QCOMPARE(model.rowCount(), names.count());
+
+    // literals, prefixes and other expressions all match whole names, as QRegExp::exactMatch() did
+    const int sourceRole = model.roleNames().key("DataEngineSource");
+    const QStringList filters = QStringList() << QStringLiteral("memory") << QStringLiteral("cpu/1") << QStringLiteral("cpu/.*")
+                                              << QStringLiteral("memory.*") << QStringLiteral("net.eth0") << QStringLiteral("cpu/[0-9]")
+                                              << QString();
+    for (const QString &filter : filters) {
+        model.setSourceFilter(filter);
+
+        QStringList expected;
+        for (const QString &name : names) {
+            if (filter.isEmpty() || QRegExp(filter).exactMatch(name)) {
+                expected << name;
+            }
+        }
+
+        QStringList sources;
+        for (int row = 0; row < model.rowCount(); ++row) {
+            sources << model.data(model.index(row, 0), sourceRole).toString();
+        }
+        sources.sort();
+        QCOMPARE(sources, expected);
+    }
+}
+
+static QVariantMap condition(const QString &role, const QString &type, const QVariant &value)
+{
+    QVariantMap map;
+    map[QStringLiteral("role")] = role;
+    map[type] = value;
+    return map;
+}
+
+void SortFilterModelTest::filterConditions()
+{
+    QStandardItemModel model;
+    QHash<int, QByteArray> roles;
+    roles[Qt::UserRole] = "name";
+    roles[Qt::UserRole + 1] = "size";
+    model.setItemRoleNames(roles);
+
+    const QStringList names = QStringList() << QStringLiteral("Firefox") << QStringLiteral("Files")
+                                            << QStringLiteral("Konsole") << QStringLiteral("firewall");
+    const QList<int> sizes = QList<int>() << 50 << 5 << 20 << 100;
+    for (int i = 0; i < names.count(); ++i) {
+        QStandardItem *item = new QStandardItem;
+        item->setData(names.at(i), Qt::UserRole);
+        item->setData(sizes.at(i), Qt::UserRole + 1);
+        model.appendRow(item);
+    }
+
+    SortFilterModel filterModel;
+    filterModel.setModel(&model);
+
+    // names starting with "fi", either small or big
+    QVariantMap any;
+    any[QStringLiteral("any")] = QVariantList() << condition(QStringLiteral("size"), QStringLiteral("maximum"), 10)
+                                                << condition(QStringLiteral("size"), QStringLiteral("minimum"), 100);
+    filterModel.setFilterConditions(QVariantList() << condition(QStringLiteral("name"), QStringLiteral("prefix"), QStringLiteral("fi"))
+                                                   << any);
+    filterModel.setSortRoles(QStringList() << QStringLiteral("size"));
+    QCOMPARE(filterModel.count(), 2);
+    QCOMPARE(filterModel.get(0).value(QStringLiteral("name")).toString(), QStringLiteral("Files"));
+    QCOMPARE(filterModel.get(1).value(QStringLiteral("name")).toString(), QStringLiteral("firewall"));
+
+    filterModel.setFilterConditions(QVariantList() << condition(QStringLiteral("name"), QStringLiteral("contains"), QStringLiteral("O")));
+    QCOMPARE(filterModel.count(), 2);
+    QCOMPARE(filterModel.get(0).value(QStringLiteral("name")).toString(), QStringLiteral("Konsole"));
+    QCOMPARE(filterModel.get(1).value(QStringLiteral("name")).toString(), QStringLiteral("Firefox"));
+
+    // the sort keys of a changed row are computed again
+    model.item(2)->setData(200, Qt::UserRole + 1);
+    QCOMPARE(filterModel.get(0).value(QStringLiteral("name")).toString(), QStringLiteral("Firefox"));
+    QCOMPARE(filterModel.get(1).value(QStringLiteral("name")).toString(), QStringLiteral("Konsole"));
+}
+
+static QVariantMap identityItem(const QString &name, int value)
+{
+    QVariantMap item;
+    item[QStringLiteral("name")] = name;
+    item[QStringLiteral("value")] = value;
+    return item;
+}
+
+void SortFilterModelTest::dataModelIdentityRole()
+{
+    TestDataModel model;
+    model.setKeyRoleFilter(QStringLiteral("items"));
+    model.setIdentityRole(QStringLiteral("name"));
+    model.addSources(1);
+    model.setItems(QStringLiteral("test"), QVariantList() << identityItem(QStringLiteral("a"), 1)
+                                                          << identityItem(QStringLiteral("b"), 2)
+                                                          << identityItem(QStringLiteral("c"), 3));
+
+    QSignalSpy removed(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy moved(&model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    QSignalSpy inserted(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    QSignalSpy changed(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+
+    model.setItems(QStringLiteral("test"), QVariantList() << identityItem(QStringLiteral("c"), 3)
+                                                          << identityItem(QStringLiteral("a"), 4)
+                                                          << identityItem(QStringLiteral("d"), 5));
+
+    // the rows of the source come after the two of source00000
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(removed.at(0).at(1).toInt(), 3);
+    QCOMPARE(moved.count(), 1);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(inserted.at(0).at(1).toInt(), 4);
+
+    const int nameRole = model.roleNames().key("name");
+    const int valueRole = model.roleNames().key("value");
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.at(0).at(0).value<QModelIndex>().row(), 3);
+    QCOMPARE(changed.at(0).at(2).value<QVector<int> >(), QVector<int>() << valueRole);
+
+    QCOMPARE(model.rowCount(), 5);
+    QCOMPARE(model.data(model.index(2, 0), nameRole).toString(), QStringLiteral("c"));
+    QCOMPARE(model.data(model.index(3, 0), nameRole).toString(), QStringLiteral("a"));
+    QCOMPARE(model.data(model.index(3, 0), valueRole).toInt(), 4);
+    QCOMPARE(model.data(model.index(4, 0), nameRole).toString(), QStringLiteral("d"));
+}
+
+void SortFilterModelTest::benchmarkDataModelSources()
+{
+    TestDataModel model;
+    model.setKeyRoleFilter(QStringLiteral("items"));
+    model.addSources(5000);
+    QCOMPARE(model.rowCount(), 10000);
+
+    const int role = model.roleNames().key("name");
+    QCOMPARE(model.data(model.index(9999, 0), role).toInt(), 4999);
+
+    QBENCHMARK {
+        for (int row = 0; row < model.rowCount(); ++row) {
+            model.data(model.index(row, 0), role);
+        }
+    }
+}
@@ -32,6 +32,11 @@ private Q_SLOTS:
     void setEmptyModel();
     void mapRowToSource();
     void mapRowFromSource();
+    void filterConditions();
+    void dataModelSources();
+    void dataModelSourceFilter();
+    void dataModelIdentityRole();
+    void benchmarkDataModelSources();
 };
 
 #endif /* SORTFILTERMODELTEST_H */
@@ -18,6 +18,8 @@
 *********************************************************************************/
 
 #include "storagetest.h"
+#include <QElapsedTimer>
+#include <QEventLoop>
 #include <QStandardPaths>
 
 #include "plasma/private/storage_p.h"
@@ -95,5 +97,53 @@ void StorageTest::deleteEntry()
     }
 }
 
+void StorageTest::benchmarkSave()
+{
+    // many sources stored at once, as DataContainers do, each one in its group
+    const int groups = 50;
+    const int keys = 20;
+    const int iterations = 10;
+    QVariantMap data;
+    for (int i = 0; i < keys; ++i) {
+        data.insert(QStringLiteral("Key %1").arg(i), i);
+    }
+
+    Storage storage;
+
+    // what matters is how many rows get written in a second
+    QElapsedTimer timer;
+    timer.start();
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        int finished = 0;
+        bool success = true;
+        QEventLoop loop;
+        for (int i = 0; i < groups; ++i) {
+            QVariantMap op = storage.operationDescription(QStringLiteral("save"));
+            op[QStringLiteral("group")] = QStringLiteral("Benchmark %1").arg(i);
+            StorageJob *storageJob = qobject_cast<StorageJob *>(storage.startOperationCall(op));
+            QVERIFY(storageJob);
+            storageJob->setData(data);
+            connect(storageJob, &KJob::finished, &loop, [&finished, &success, &loop](KJob *job) {
+                success = success && static_cast<StorageJob *>(job)->result().toBool();
+                if (++finished == groups) {
+                    loop.quit();
+                }
+            });
+        }
+
+        // the jobs only finish once the storage thread reports back
+        if (finished < groups) {
+            loop.exec();
+        }
+        QCOMPARE(finished, groups);
+        QVERIFY(success);
+    }
+
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+    const qint64 rows = qint64(iterations) * groups * keys;
+    QTest::setBenchmarkResult(rows * 1000.0 / elapsed, QTest::Events);
+    qDebug() << rows << "rows saved in" << elapsed << "ms," << rows * 1000 / elapsed << "rows/s";
+}
+
 QTEST_MAIN(StorageTest)
 
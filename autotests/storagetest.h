@@ -33,6 +33,7 @@ private Q_SLOTS:
     void store();
     void retrieve();
     void deleteEntry();
+    void benchmarkSave();
 
 private:
     QVariantMap m_data;
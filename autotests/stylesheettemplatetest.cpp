@@ -0,0 +1,92 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "stylesheettemplatetest.h"
+
+#include <QColor>
+
+#include "plasma/private/stylesheettemplate_p.h"
+
+using namespace Plasma;
+
+static StyleSheetTemplate::Palette testPalette()
+{
+    StyleSheetTemplate::Palette palette(StyleSheetTemplate::PlaceholderCount);
+    for (int i = 0; i < StyleSheetTemplate::FontSize; ++i) {
+        palette[i] = QColor::fromHsv(i * 9, 200, 200).name();
+    }
+    palette[StyleSheetTemplate::FontSize] = QStringLiteral("10pt");
+    palette[StyleSheetTemplate::FontFamily] = QStringLiteral("Noto Sans");
+    palette[StyleSheetTemplate::SmallFontSize] = QStringLiteral("8pt");
+    return palette;
+}
+
+// what processStyleSheet did before the templates: one QString::replace per placeholder,
+// in the arbitrary order of a QHash, so the result must not depend on the order
+static QString replacePlaceholders(QString css, const StyleSheetTemplate::Palette &palette, bool reversed)
+{
+    for (int i = 0; i < StyleSheetTemplate::PlaceholderCount; ++i) {
+        const int placeholder = reversed ? StyleSheetTemplate::PlaceholderCount - 1 - i : i;
+        css.replace(StyleSheetTemplate::placeholderName(StyleSheetTemplate::Placeholder(placeholder)), palette.at(placeholder));
+    }
+    return css;
+}
+
+void StyleSheetTemplateTest::render_data()
+{
+    QTest::addColumn<QString>("css");
+
+    QString all;
+    for (int i = 0; i < StyleSheetTemplate::PlaceholderCount; ++i) {
+        const QString name = StyleSheetTemplate::placeholderName(StyleSheetTemplate::Placeholder(i));
+        QTest::newRow(qPrintable(name)) << QStringLiteral(".a{color:%1;}\n.b{fill:%1;stroke:%1}%1").arg(name);
+        all += name;
+    }
+
+    QTest::newRow("all adjacent") << all;
+    QTest::newRow("svg") << QStringLiteral(".ColorScheme-Text{color:%textcolor;}.ColorScheme-ButtonText{color:%buttontextcolor;}"
+                                           ".ColorScheme-ViewHover{color:%viewhovercolor;}.ColorScheme-Complementary{color:%complementarytextcolor;}");
+    QTest::newRow("font") << QStringLiteral("body{font-family:\"%fontfamily\";font-size:%fontsize;} small{font-size:%smallfontsize}");
+    QTest::newRow("no placeholder") << QStringLiteral("a{color:red;width:100%}");
+    QTest::newRow("unknown placeholders") << QStringLiteral("%foo %textcolour %TEXTCOLOR %linkx %");
+    QTest::newRow("percent before placeholder") << QStringLiteral("%%textcolor%%%link%");
+    QTest::newRow("empty") << QString();
+}
+
+void StyleSheetTemplateTest::render()
+{
+    QFETCH(QString, css);
+
+    const StyleSheetTemplate::Palette palette = testPalette();
+    const StyleSheetTemplate styleSheetTemplate(css);
+
+    QCOMPARE(styleSheetTemplate.render(palette), replacePlaceholders(css, palette, false));
+    QCOMPARE(styleSheetTemplate.render(palette), replacePlaceholders(css, palette, true));
+}
+
+void StyleSheetTemplateTest::emptyTemplate()
+{
+    QVERIFY(StyleSheetTemplate().isEmpty());
+    QVERIFY(StyleSheetTemplate(QString()).isEmpty());
+    QVERIFY(!StyleSheetTemplate(QStringLiteral("%textcolor")).isEmpty());
+    QVERIFY(StyleSheetTemplate().render(testPalette()).isEmpty());
+}
+
+QTEST_MAIN(StyleSheetTemplateTest)
+
@@ -0,0 +1,233 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "svgrectscachetest.h"
+
+#include "plasma/private/svgrectscache_p.h"
+
+using namespace Plasma;
+
+static const QString s_iconTheme = QStringLiteral("/usr/share/icons/breeze");
+static const QString s_image = QStringLiteral("/usr/share/plasma/desktoptheme/default/widgets/background.svgz");
+static const QString s_otherImage = QStringLiteral("/usr/share/plasma/desktoptheme/default/widgets/panel-background.svgz");
+
+// offsets of the header fields in the file
+enum {
+    VersionOffset = 4,
+    EntryCountOffset = 16,
+    StringSizeOffset = 20,
+    HeaderSize = 24,
+    EntrySize = 40
+};
+
+static quint32 readField(const QByteArray &data, int offset)
+{
+    quint32 value;
+    memcpy(&value, data.constData() + offset, sizeof(value));
+    return value;
+}
+
+void SvgRectsCacheTest::init()
+{
+    QVERIFY(m_dir.isValid());
+    m_filePath = m_dir.path() + QLatin1Char('/') + QLatin1String(QTest::currentTestFunction()) + QLatin1String(".rects");
+    QFile::remove(m_filePath);
+}
+
+void SvgRectsCacheTest::binaryFormat()
+{
+    SvgRectsCache cache;
+    QVERIFY(!cache.open(m_filePath, s_iconTheme));
+    QVERIFY(cache.isOpen());
+
+    cache.insert(s_image, QStringLiteral("center"), QRectF(8, 8, 16, 16));
+    cache.insert(s_image, QStringLiteral("topleft"), QRectF(0, 0, 8, 8));
+    cache.insert(s_image, QStringLiteral("hint-stretch-borders"), QRectF());
+    cache.insert(s_otherImage, QStringLiteral("center"), QRectF(1, 2, 3, 4));
+    QVERIFY(cache.hasPendingChanges());
+    QVERIFY(cache.hasPendingChanges(s_image));
+    QVERIFY(cache.save());
+    QVERIFY(!cache.hasPendingChanges());
+
+    QFile file(m_filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.readAll();
+    QVERIFY(data.startsWith("PSRC"));
+    QCOMPARE(readField(data, VersionOffset), quint32(1));
+    QCOMPARE(readField(data, EntryCountOffset), quint32(4));
+    // the names of all the entries, invalid ones included
+    const quint32 stringSize = QString(QStringLiteral("center") + QStringLiteral("topleft") + QStringLiteral("hint-stretch-borders") + QStringLiteral("center")).size();
+    QCOMPARE(readField(data, StringSizeOffset), stringSize);
+    QCOMPARE(data.size(), int(HeaderSize + 4 * EntrySize + stringSize * sizeof(QChar)));
+
+    // another process maps the same index
+    SvgRectsCache other;
+    QVERIFY(other.open(m_filePath, s_iconTheme));
+    QVERIFY(!other.hasPendingChanges());
+
+    QRectF rect;
+    QCOMPARE(other.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(8, 8, 16, 16));
+    QCOMPARE(other.find(s_otherImage, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(1, 2, 3, 4));
+    QCOMPARE(other.find(s_image, QStringLiteral("hint-stretch-borders"), rect), SvgRectsCache::KnownInvalid);
+    QCOMPARE(other.find(s_image, QStringLiteral("bottom"), rect), SvgRectsCache::NotFound);
+
+    // invalid elements aren't listed
+    QStringList keys = other.keys(s_image);
+    keys.sort();
+    QCOMPARE(keys, QStringList({QStringLiteral("center"), QStringLiteral("topleft")}));
+}
+
+void SvgRectsCacheTest::mergeOnSave()
+{
+    SvgRectsCache first;
+    SvgRectsCache second;
+    first.open(m_filePath, s_iconTheme);
+    second.open(m_filePath, s_iconTheme);
+
+    first.insert(s_image, QStringLiteral("center"), QRectF(8, 8, 16, 16));
+    QVERIFY(first.save());
+
+    // the second process saves what it learned without losing what the first one wrote
+    second.insert(s_image, QStringLiteral("top"), QRectF(8, 0, 16, 8));
+    second.insert(s_otherImage, QStringLiteral("center"), QRectF(1, 2, 3, 4));
+    QVERIFY(second.save());
+
+    // and a changed rect replaces the one on disk
+    first.insert(s_image, QStringLiteral("top"), QRectF(8, 0, 16, 6));
+    QVERIFY(first.save());
+
+    SvgRectsCache cache;
+    QVERIFY(cache.open(m_filePath, s_iconTheme));
+    QRectF rect;
+    QCOMPARE(cache.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(8, 8, 16, 16));
+    QCOMPARE(cache.find(s_image, QStringLiteral("top"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(8, 0, 16, 6));
+    QCOMPARE(cache.find(s_otherImage, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(1, 2, 3, 4));
+    QCOMPARE(cache.keys(s_image).size(), 2);
+}
+
+void SvgRectsCacheTest::invalidation()
+{
+    SvgRectsCache cache;
+    cache.open(m_filePath, s_iconTheme);
+    cache.insert(s_image, QStringLiteral("center"), QRectF(8, 8, 16, 16));
+    cache.insert(s_image, QStringLiteral("top"), QRectF(8, 0, 16, 8));
+    cache.insert(s_otherImage, QStringLiteral("center"), QRectF(1, 2, 3, 4));
+    QVERIFY(cache.save());
+
+    // the image changed: what was known about it is gone, before and after saving
+    cache.invalidate(s_image);
+    cache.insert(s_image, QStringLiteral("top"), QRectF(0, 0, 32, 8));
+
+    QRectF rect;
+    QCOMPARE(cache.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::NotFound);
+    QCOMPARE(cache.keys(s_image), QStringList({QStringLiteral("top")}));
+    QVERIFY(cache.save());
+
+    SvgRectsCache other;
+    QVERIFY(other.open(m_filePath, s_iconTheme));
+    QCOMPARE(other.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::NotFound);
+    QCOMPARE(other.find(s_image, QStringLiteral("top"), rect), SvgRectsCache::Found);
+    QCOMPARE(rect, QRectF(0, 0, 32, 8));
+    QCOMPARE(other.find(s_otherImage, QStringLiteral("center"), rect), SvgRectsCache::Found);
+}
+
+void SvgRectsCacheTest::versioning()
+{
+    {
+        SvgRectsCache cache;
+        cache.open(m_filePath, s_iconTheme);
+        cache.insert(s_image, QStringLiteral("center"), QRectF(8, 8, 16, 16));
+        QVERIFY(cache.save());
+    }
+
+    // an index made for another icon theme isn't used
+    {
+        SvgRectsCache cache;
+        QVERIFY(!cache.open(m_filePath, QStringLiteral("/usr/share/icons/oxygen")));
+        QRectF rect;
+        QCOMPARE(cache.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::NotFound);
+    }
+
+    // nor an index with another layout
+    QFile file(m_filePath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(VersionOffset));
+    const quint32 version = 0;
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    file.close();
+
+    SvgRectsCache cache;
+    QVERIFY(!cache.open(m_filePath, s_iconTheme));
+    QRectF rect;
+    QCOMPARE(cache.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::NotFound);
+
+    // the stale index is replaced at the next save, even without anything new
+    QVERIFY(cache.hasPendingChanges());
+    QVERIFY(cache.save());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.readAll();
+    QCOMPARE(readField(data, VersionOffset), quint32(1));
+    QCOMPARE(readField(data, EntryCountOffset), quint32(0));
+
+    SvgRectsCache other;
+    QVERIFY(other.open(m_filePath, s_iconTheme));
+}
+
+void SvgRectsCacheTest::invalidElementsLimit()
+{
+    const int limit = 1000;
+
+    SvgRectsCache cache;
+    cache.open(m_filePath, s_iconTheme);
+    cache.insert(s_image, QStringLiteral("center"), QRectF(8, 8, 16, 16));
+    for (int i = 0; i <= limit; ++i) {
+        cache.insert(s_image, QStringLiteral("missing%1").arg(i), QRectF());
+    }
+
+    // past the limit, the oldest invalid element is forgotten rather than the newest
+    QRectF rect;
+    QCOMPARE(cache.find(s_image, QStringLiteral("missing0"), rect), SvgRectsCache::NotFound);
+    QCOMPARE(cache.find(s_image, QStringLiteral("missing1"), rect), SvgRectsCache::KnownInvalid);
+    QCOMPARE(cache.find(s_image, QStringLiteral("missing%1").arg(limit), rect), SvgRectsCache::KnownInvalid);
+    QCOMPARE(cache.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    QVERIFY(cache.save());
+
+    // the ones on disk make room for the new ones
+    cache.insert(s_image, QStringLiteral("missing%1").arg(limit + 1), QRectF());
+    QVERIFY(cache.save());
+
+    SvgRectsCache other;
+    QVERIFY(other.open(m_filePath, s_iconTheme));
+    QCOMPARE(other.find(s_image, QStringLiteral("missing%1").arg(limit + 1), rect), SvgRectsCache::KnownInvalid);
+    QCOMPARE(other.find(s_image, QStringLiteral("center"), rect), SvgRectsCache::Found);
+    int invalid = 0;
+    for (int i = 0; i <= limit + 1; ++i) {
+        if (other.find(s_image, QStringLiteral("missing%1").arg(i), rect) == SvgRectsCache::KnownInvalid) {
+            ++invalid;
+        }
+    }
+    QCOMPARE(invalid, limit);
+}
+
+QTEST_MAIN(SvgRectsCacheTest)
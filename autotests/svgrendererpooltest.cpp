@@ -0,0 +1,402 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "svgrendererpooltest.h"
+
+#include <QBuffer>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include "plasma/svg.h"
+#include "plasma/private/svgrenderer_p.h"
+
+using Plasma::SharedSvgRenderer;
+using Plasma::SvgRendererPool;
+
+static const QChar s_normalCrc(1);
+static const QChar s_selectedCrc(2);
+
+static QByteArray plainDocument()
+{
+    return QByteArrayLiteral("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"16\" height=\"16\">"
+                             "<rect id=\"rect\" width=\"16\" height=\"16\" fill=\"#ff0000\"/>"
+                             "</svg>");
+}
+
+static QByteArray colorSchemeDocument()
+{
+    return QByteArrayLiteral("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"16\" height=\"16\">"
+                             "<style id=\"current-color-scheme\" type=\"text/css\">.ColorScheme-Text { color:#000000; }</style>"
+                             "<rect id=\"rect\" width=\"16\" height=\"16\" class=\"ColorScheme-Text\" fill=\"currentColor\"/>"
+                             "</svg>");
+}
+
+// adds a renderer for path to the pool and stops using it
+static SharedSvgRenderer *addIdle(SvgRendererPool &pool, const QString &path, const QByteArray &contents = plainDocument())
+{
+    const SharedSvgRenderer::Ptr renderer(new SharedSvgRenderer(contents, QString(), nullptr));
+    pool.insert(renderer, path, s_normalCrc);
+    pool.release(renderer);
+    return renderer.data();
+}
+
+static qint64 plainCost()
+{
+    return SharedSvgRenderer(plainDocument(), QString(), nullptr).cost();
+}
+
+void SvgRendererPoolTest::initTestCase()
+{
+    QStandardPaths::enableTestMode(true);
+}
+
+void SvgRendererPoolTest::lruEviction()
+{
+    SvgRendererPool pool;
+    pool.setBudget(2 * plainCost());
+
+    addIdle(pool, QStringLiteral("a"));
+    SharedSvgRenderer *b = addIdle(pool, QStringLiteral("b"));
+    addIdle(pool, QStringLiteral("c"));
+
+    // a is the least recently used
+    SvgRendererPool::Statistics statistics = pool.statistics();
+    QCOMPARE(statistics.idle, 2);
+    QCOMPARE(statistics.evicted, 1);
+    QCOMPARE(statistics.evictedBytes, plainCost());
+    QVERIFY(!pool.find(QStringLiteral("a"), s_normalCrc));
+
+    // using b again makes c the least recently used
+    {
+        const SharedSvgRenderer::Ptr renderer = pool.find(QStringLiteral("b"), s_normalCrc);
+        QCOMPARE(renderer.data(), b);
+        pool.release(renderer);
+    }
+    addIdle(pool, QStringLiteral("d"));
+
+    statistics = pool.statistics();
+    QCOMPARE(statistics.idle, 2);
+    QCOMPARE(statistics.evicted, 2);
+    QVERIFY(!pool.find(QStringLiteral("c"), s_normalCrc));
+}
+
+void SvgRendererPoolTest::resurrectIdle()
+{
+    SvgRendererPool pool;
+    pool.setBudget(4 * plainCost());
+
+    SharedSvgRenderer *idle = addIdle(pool, QStringLiteral("a"));
+    QCOMPARE(pool.statistics().idle, 1);
+    QCOMPARE(pool.statistics().idleBytes, plainCost());
+
+    {
+        SharedSvgRenderer::Ptr renderer = pool.find(QStringLiteral("a"), s_normalCrc);
+        QCOMPARE(renderer.data(), idle);
+
+        const SvgRendererPool::Statistics statistics = pool.statistics();
+        QCOMPARE(statistics.live, 1);
+        QCOMPARE(statistics.idle, 0);
+        QCOMPARE(statistics.idleBytes, qint64(0));
+        QCOMPARE(statistics.liveBytes, plainCost());
+
+        // it's idle only once the last user releases it
+        const SharedSvgRenderer::Ptr other = pool.find(QStringLiteral("a"), s_normalCrc);
+        pool.release(renderer);
+        renderer.reset();
+        QCOMPARE(pool.statistics().idle, 0);
+        pool.release(other);
+    }
+
+    QCOMPARE(pool.statistics().idle, 1);
+    QCOMPARE(pool.statistics().evicted, 0);
+}
+
+void SvgRendererPoolTest::budget()
+{
+    SvgRendererPool pool;
+    pool.setBudget(3 * plainCost());
+
+    addIdle(pool, QStringLiteral("a"));
+    addIdle(pool, QStringLiteral("b"));
+    addIdle(pool, QStringLiteral("c"));
+    QCOMPARE(pool.statistics().idle, 3);
+    QCOMPARE(pool.statistics().idleBytes, 3 * plainCost());
+
+    // a used renderer doesn't count in the budget
+    const SharedSvgRenderer::Ptr used(new SharedSvgRenderer(plainDocument(), QString(), nullptr));
+    pool.insert(used, QStringLiteral("used"), s_normalCrc);
+
+    pool.setBudget(plainCost());
+    QCOMPARE(pool.statistics().idle, 1);
+    QCOMPARE(pool.statistics().evicted, 2);
+    QVERIFY(pool.statistics().idleBytes <= pool.budget());
+
+    pool.setBudget(0);
+    QCOMPARE(pool.statistics().idle, 0);
+    QCOMPARE(pool.statistics().live, 1);
+    QCOMPARE(pool.find(QStringLiteral("used"), s_normalCrc).data(), used.data());
+}
+
+void SvgRendererPoolTest::styleSheets()
+{
+    SvgRendererPool pool;
+    pool.setBudget(16 * plainCost());
+
+    // documents without a color scheme are shared by all the stylesheets
+    SharedSvgRenderer *plain = addIdle(pool, QStringLiteral("plain"));
+    QCOMPARE(pool.find(QStringLiteral("plain"), s_selectedCrc).data(), plain);
+
+    SharedSvgRenderer *styled = addIdle(pool, QStringLiteral("styled"), colorSchemeDocument());
+    QVERIFY(styled->usesStyleSheet());
+    QCOMPARE(pool.find(QStringLiteral("styled"), s_normalCrc).data(), styled);
+    QVERIFY(!pool.find(QStringLiteral("styled"), s_selectedCrc));
+}
+
+void SvgRendererPoolTest::clearIdle()
+{
+    SvgRendererPool pool;
+    pool.setBudget(16 * plainCost());
+
+    addIdle(pool, QStringLiteral("a"));
+    const SharedSvgRenderer::Ptr used(new SharedSvgRenderer(plainDocument(), QString(), nullptr));
+    pool.insert(used, QStringLiteral("used"), s_normalCrc);
+
+    pool.clearIdle();
+    QCOMPARE(pool.statistics().idle, 0);
+    QCOMPARE(pool.statistics().evicted, 1);
+    QVERIFY(!pool.find(QStringLiteral("a"), s_normalCrc));
+
+    // the renderers in use stay shared
+    QCOMPARE(pool.statistics().live, 1);
+    QCOMPARE(pool.find(QStringLiteral("used"), s_normalCrc).data(), used.data());
+}
+
+void SvgRendererPoolTest::forget()
+{
+    SvgRendererPool pool;
+    pool.setBudget(16 * plainCost());
+
+    addIdle(pool, QStringLiteral("/theme/a.svg"));
+    addIdle(pool, QStringLiteral("/other/b.svg"));
+    const SharedSvgRenderer::Ptr used(new SharedSvgRenderer(plainDocument(), QString(), nullptr));
+    pool.insert(used, QStringLiteral("/theme/used.svg"), s_normalCrc);
+
+    pool.forget(QStringLiteral("/theme/"));
+    QCOMPARE(pool.statistics().idle, 1);
+    QCOMPARE(pool.statistics().live, 0);
+    QVERIFY(!pool.find(QStringLiteral("/theme/a.svg"), s_normalCrc));
+    QVERIFY(!pool.find(QStringLiteral("/theme/used.svg"), s_normalCrc));
+    QVERIFY(pool.find(QStringLiteral("/other/b.svg"), s_normalCrc));
+
+    // releasing a renderer the pool forgot about doesn't make it idle
+    {
+        const SharedSvgRenderer::Ptr lastUser = used;
+        pool.release(used);
+    }
+    QCOMPARE(pool.statistics().idle, 1);
+
+    // the file got a color scheme with the new theme: renderers aren't shared anymore
+    addIdle(pool, QStringLiteral("/theme/a.svg"), colorSchemeDocument());
+    QVERIFY(pool.find(QStringLiteral("/theme/a.svg"), s_normalCrc));
+    QVERIFY(!pool.find(QStringLiteral("/theme/a.svg"), s_selectedCrc));
+
+    // an empty directory forgets everything
+    pool.forget(QString());
+    QCOMPARE(pool.statistics().idle, 0);
+    QCOMPARE(pool.statistics().live, 0);
+}
+
+// the statistics of the pool used by all the Svgs of the process
+static QVariantMap svgPoolStatistics(Plasma::Svg *svg)
+{
+    QVariantMap statistics;
+    QMetaObject::invokeMethod(svg, "rendererPoolStatistics", Q_RETURN_ARG(QVariantMap, statistics));
+    return statistics;
+}
+
+void SvgRendererPoolTest::colorGroups()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.path() + QStringLiteral("/colorscheme.svg");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(colorSchemeDocument());
+    file.close();
+
+    QScopedPointer<Plasma::Svg> svg(new Plasma::Svg);
+    svg->setUsingRenderingCache(false);
+    svg->setImagePath(path);
+    svg->resize(16, 16);
+    QVERIFY(!svg->pixmap().isNull());
+
+    const QVariantMap initial = svgPoolStatistics(svg.data());
+    QVERIFY(!initial.isEmpty());
+    const int live = initial.value(QStringLiteral("live")).toInt();
+    const int idle = initial.value(QStringLiteral("idle")).toInt();
+    QVERIFY(live >= 1);
+
+    // every color group has its own stylesheet, so its own renderer:
+    // the one of the previous group becomes idle
+    svg->setColorGroup(Plasma::Theme::ComplementaryColorGroup);
+    QVERIFY(!svg->pixmap().isNull());
+    QVariantMap statistics = svgPoolStatistics(svg.data());
+    QCOMPARE(statistics.value(QStringLiteral("live")).toInt(), live);
+    QCOMPARE(statistics.value(QStringLiteral("idle")).toInt(), idle + 1);
+
+    // going back takes the idle renderer again
+    svg->setColorGroup(Plasma::Theme::NormalColorGroup);
+    QVERIFY(!svg->pixmap().isNull());
+    statistics = svgPoolStatistics(svg.data());
+    QCOMPARE(statistics.value(QStringLiteral("live")).toInt(), live);
+    QCOMPARE(statistics.value(QStringLiteral("idle")).toInt(), idle + 1);
+
+    // nothing is left in use once the svg goes away
+    Plasma::Svg other;
+    svg.reset();
+    statistics = svgPoolStatistics(&other);
+    QCOMPARE(statistics.value(QStringLiteral("live")).toInt(), live - 1);
+    QCOMPARE(statistics.value(QStringLiteral("idle")).toInt(), idle + 2);
+}
+
+// how SharedSvgRenderer injected the stylesheet before the single pass
+static QByteArray legacyStyleSheetInjection(const QByteArray &contents, const QString &styleSheet)
+{
+    if (styleSheet.isEmpty() || !contents.contains("current-color-scheme")) {
+        return contents;
+    }
+
+    QByteArray processedContents;
+    QXmlStreamReader reader(contents);
+
+    QBuffer buffer(&processedContents);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter writer(&buffer);
+    while (!reader.atEnd()) {
+        if (reader.readNext() == QXmlStreamReader::StartElement &&
+            reader.qualifiedName() == QLatin1String("style") &&
+            reader.attributes().value(QLatin1String("id")) == QLatin1String("current-color-scheme")) {
+            writer.writeStartElement(QLatin1String("style"));
+            writer.writeAttributes(reader.attributes());
+            writer.writeCharacters(styleSheet);
+            writer.writeEndElement();
+            while (reader.tokenType() != QXmlStreamReader::EndElement) {
+                reader.readNext();
+            }
+        } else if (reader.tokenType() != QXmlStreamReader::Invalid) {
+            writer.writeCurrentToken(reader);
+        }
+    }
+    buffer.close();
+
+    return processedContents;
+}
+
+// and how it found the size hinted elements
+static QStringList legacySizeHintedIds(const QByteArray &contents)
+{
+    const QString contentsAsString(QString::fromLatin1(contents));
+    QRegExp idExpr(QLatin1String("id\\s*=\\s*(['\"])(\\d+-\\d+-.*)\\1"));
+    idExpr.setMinimal(true);
+
+    QStringList ids;
+    int pos = 0;
+    while ((pos = idExpr.indexIn(contentsAsString, pos)) != -1) {
+        ids << idExpr.cap(2);
+        pos += idExpr.matchedLength();
+    }
+
+    return ids;
+}
+
+static QImage renderDocument(QSvgRenderer &renderer)
+{
+    QImage image(32, 32, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    renderer.render(&painter);
+    painter.end();
+    return image;
+}
+
+void SvgRendererPoolTest::styleSheetInjection_data()
+{
+    QTest::addColumn<QByteArray>("contents");
+
+    const QByteArray elements = QByteArrayLiteral(
+        "<g id=\"group\">"
+        "<rect id=\"rect\" width=\"32\" height=\"32\" class=\"ColorScheme-Text\" fill=\"currentColor\"/>"
+        "<rect id='16-16-rect' width=\"16\" height=\"16\" class=\"ColorScheme-Highlight\" style=\"fill:currentColor\"/>"
+        "<rect id = \"22-22-rect\" x=\"8\" y=\"8\" width=\"22\" height=\"22\" fill=\"#00ff00\" fill-opacity=\"0.5\"/>"
+        "<rect id=\"1-x-rect\" x=\"4\" y=\"4\" width=\"2\" height=\"2\" fill=\"#0000ff\"/>"
+        "</g>");
+    const QByteArray style = QByteArrayLiteral(
+        "<style id=\"current-color-scheme\" type=\"text/css\">"
+        ".ColorScheme-Text { color:#000000; } .ColorScheme-Highlight { color:#3daee9; }"
+        "</style>");
+    const QByteArray header = QByteArrayLiteral(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<!-- a comment -->"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"32\" height=\"32\">");
+
+    QTest::newRow("style in defs") << header + "<defs>" + style + "</defs>" + elements + "</svg>";
+    QTest::newRow("style in svg") << header + style + elements + "</svg>";
+    QTest::newRow("cdata style") << header + "<defs><style id=\"current-color-scheme\" type=\"text/css\"><![CDATA["
+                                             ".ColorScheme-Text { color:#000000; }]]></style></defs>" + elements + "</svg>";
+    QTest::newRow("no color scheme") << header + elements + "</svg>";
+    QTest::newRow("no size hints") << colorSchemeDocument();
+}
+
+void SvgRendererPoolTest::styleSheetInjection()
+{
+    QFETCH(QByteArray, contents);
+
+    const QString styleSheet = QStringLiteral(".ColorScheme-Text { color:#ff0000; } .ColorScheme-Highlight { color:#00ffff; }");
+
+    QHash<QString, QRectF> interestingElements;
+    SharedSvgRenderer renderer(contents, styleSheet, &interestingElements);
+    QVERIFY(renderer.isValid());
+
+    QSvgRenderer legacyRenderer(legacyStyleSheetInjection(contents, styleSheet));
+    QVERIFY(legacyRenderer.isValid());
+    QCOMPARE(renderDocument(renderer), renderDocument(legacyRenderer));
+
+    QStringList legacyIds;
+    for (const QString &id : legacySizeHintedIds(contents)) {
+        if (legacyRenderer.boundsOnElement(id).isValid()) {
+            legacyIds << id;
+        }
+    }
+    QStringList ids = interestingElements.keys();
+    ids.sort();
+    legacyIds.sort();
+    QCOMPARE(ids, legacyIds);
+    for (const QString &id : qAsConst(ids)) {
+        QCOMPARE(interestingElements.value(id), legacyRenderer.boundsOnElement(id));
+    }
+
+    // without size hints to collect, the stylesheet is injected all the same
+    SharedSvgRenderer unscanned(contents, styleSheet, nullptr);
+    QCOMPARE(renderDocument(unscanned), renderDocument(legacyRenderer));
+}
+
+QTEST_MAIN(SvgRendererPoolTest)
+
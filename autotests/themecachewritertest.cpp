@@ -0,0 +1,201 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "themecachewritertest.h"
+
+#include <kimagecache.h>
+
+#include "plasma/private/themecachewriter_p.h"
+
+using namespace Plasma;
+
+static const char s_cacheName[] = "plasma-themecachewritertest";
+
+// an image that takes a while to be encoded, noise doesn't compress
+static QImage noiseImage(int size)
+{
+    QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < size; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size; ++x) {
+            line[x] = qrand() | 0xff000000;
+        }
+    }
+    return image;
+}
+
+static QImage solidImage(int size, const QColor &color)
+{
+    QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(color);
+    return image;
+}
+
+void ThemeCacheWriterTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void ThemeCacheWriterTest::init()
+{
+    KImageCache::deleteCache(QLatin1String(s_cacheName));
+    m_cache = new KImageCache(QLatin1String(s_cacheName), 256 * 1024 * 1024);
+}
+
+void ThemeCacheWriterTest::cleanup()
+{
+    delete m_cache;
+    m_cache = 0;
+    KImageCache::deleteCache(QLatin1String(s_cacheName));
+}
+
+void ThemeCacheWriterTest::visibleWhileWriting()
+{
+    ThemeCacheWriter writer;
+    writer.setCache(m_cache);
+
+    const QString key = QStringLiteral("noise");
+    const QImage image = noiseImage(1024);
+    writer.write(key, image);
+
+    // at any time the entry is either pending or in the cache, never in between
+    for (;;) {
+        const QImage pending = writer.pendingImage(key);
+        if (pending.isNull()) {
+            QVERIFY(m_cache->contains(key));
+            break;
+        }
+        QCOMPARE(pending.cacheKey(), image.cacheKey());
+        QVERIFY(writer.isPending(key));
+    }
+
+    writer.flush();
+    QVERIFY(!writer.isPending(key));
+    QImage cached;
+    QVERIFY(m_cache->findImage(key, &cached));
+    QCOMPARE(cached.size(), image.size());
+}
+
+void ThemeCacheWriterTest::supersede()
+{
+    ThemeCacheWriter writer;
+    writer.setCache(m_cache);
+
+    // keeps the writer busy while the same key gets queued twice
+    writer.write(QStringLiteral("busy"), noiseImage(1024));
+    writer.write(QStringLiteral("key"), solidImage(16, Qt::red));
+    writer.write(QStringLiteral("key"), solidImage(16, Qt::blue));
+    QCOMPARE(writer.pendingImage(QStringLiteral("key")).pixel(0, 0), QColor(Qt::blue).rgba());
+
+    writer.flush();
+
+    const ThemeCacheWriter::Statistics stats = writer.statistics();
+    QCOMPARE(stats.superseded, 1);
+    QCOMPARE(stats.written, 2);
+
+    // only the last image made it in the cache
+    QImage cached;
+    QVERIFY(m_cache->findImage(QStringLiteral("key"), &cached));
+    QCOMPARE(cached.pixel(0, 0), QColor(Qt::blue).rgba());
+}
+
+void ThemeCacheWriterTest::backPressure()
+{
+    ThemeCacheWriter writer;
+    writer.setCache(m_cache);
+
+    // 4 MiB each, much more than what is allowed to wait
+    const int count = 20;
+    const QImage image = solidImage(1024, Qt::green);
+    for (int i = 0; i < count; ++i) {
+        writer.write(QString::number(i), image);
+    }
+
+    // write() waited for the writer instead of queueing everything
+    const ThemeCacheWriter::Statistics stats = writer.statistics();
+    QVERIFY(stats.peakPendingBytes <= 32 * 1024 * 1024 + image.byteCount());
+
+    writer.flush();
+    QCOMPARE(writer.statistics().written, count);
+    for (int i = 0; i < count; ++i) {
+        QVERIFY(m_cache->contains(QString::number(i)));
+    }
+}
+
+void ThemeCacheWriterTest::flushOnSetCache()
+{
+    ThemeCacheWriter writer;
+    writer.setCache(m_cache);
+
+    for (int i = 0; i < 10; ++i) {
+        writer.write(QString::number(i), solidImage(64, Qt::yellow));
+    }
+    writer.write(QStringLiteral("data"), QByteArray("some data"));
+
+    // what the theme does when the application quits
+    writer.setCache(0);
+
+    for (int i = 0; i < 10; ++i) {
+        QVERIFY(!writer.isPending(QString::number(i)));
+        QVERIFY(m_cache->contains(QString::number(i)));
+    }
+    QByteArray data;
+    QVERIFY(m_cache->find(QStringLiteral("data"), &data));
+    QCOMPARE(data, QByteArray("some data"));
+    QVERIFY(writer.lastModifiedTime() == 0);
+
+    // without a cache nothing gets queued
+    writer.write(QStringLiteral("late"), solidImage(64, Qt::yellow));
+    QVERIFY(!writer.isPending(QStringLiteral("late")));
+    QVERIFY(!m_cache->contains(QStringLiteral("late")));
+}
+
+void ThemeCacheWriterTest::metrics()
+{
+    ThemeCacheWriter writer;
+    writer.setCache(m_cache);
+    QCOMPARE(writer.statistics().written, 0);
+    QCOMPARE(writer.statistics().writtenBytes, qint64(0));
+
+    const QImage small = solidImage(32, Qt::red);
+    const QImage noise = noiseImage(512);
+    const QByteArray data(1000, 'x');
+    writer.write(QStringLiteral("small"), small);
+    writer.write(QStringLiteral("noise"), noise);
+    writer.write(QStringLiteral("data"), data);
+    // null images are not written
+    writer.write(QStringLiteral("null"), QImage());
+    writer.flush();
+
+    const ThemeCacheWriter::Statistics stats = writer.statistics();
+    QCOMPARE(stats.written, 3);
+    QCOMPARE(stats.superseded, 0);
+    // sizes are counted before the images get encoded
+    QCOMPARE(stats.writtenBytes, qint64(small.byteCount() + noise.byteCount() + data.size()));
+    QVERIFY(stats.peakPendingBytes > 0);
+    QVERIFY(stats.peakPendingBytes <= stats.writtenBytes);
+    QVERIFY(stats.writeTime >= 0);
+    QVERIFY(writer.lastModifiedTime() > 0);
+
+    const QString summary = writer.statisticsString();
+    QVERIFY2(summary.startsWith(QLatin1String("3 entries written, 0 superseded")), qPrintable(summary));
+}
+
+QTEST_GUILESS_MAIN(ThemeCacheWriterTest)
+
@@ -18,10 +18,15 @@
 *********************************************************************************/
 
 #include "themetest.h"
+#include "plasma/framesvg.h"
 #include <QStandardPaths>
 #include <QApplication>
+#include <QTemporaryDir>
 
+#include <KConfig>
+#include <KConfigGroup>
 #include <KIconLoader>
+#include <KImageCache>
 #include <KIconTheme>
 #include <KWindowSystem>
 
@@ -32,6 +37,7 @@
 
 #define QLSEP QLatin1Char('_')
 #define CACHE_ID_WITH_SIZE(size, id, state, devicePixelRatio) QString::number(int(size.width())) % QLSEP % QString::number(int(size.height())) % QLSEP % id % QLSEP % QString::number(state) % QLSEP % QString::number(int(devicePixelRatio))
+#define CACHE_ID_NATURAL_SIZE(id, state, devicePixelRatio) QLatin1String("Natural") % QLSEP % id % QLSEP % QString::number(state) % QLSEP % QString::number(int(devicePixelRatio))
 
 void ThemeTest::initTestCase()
 {
@@ -242,5 +248,277 @@ void ThemeTest::testCompositingChange()
 #endif
 }
 
+static QString rectsCachePath(const QString &suffix)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/plasma-svgelements-testtheme_v5.20") + suffix;
+}
+
+void ThemeTest::rectsCacheRoundTrip()
+{
+    const QString image = QFINDTESTDATA("data/plasma/desktoptheme/testtheme/element.svg");
+    const QString indexPath = rectsCachePath(QStringLiteral(".rects"));
+
+    m_theme->insertIntoRectsCache(image, QStringLiteral("roundtrip"), QRectF(1, 2, 3, 4));
+    m_theme->insertIntoRectsCache(image, QStringLiteral("round_trip"), QRectF());
+    QFile::remove(indexPath);
+
+    // the rects of an image are written once it's released
+    m_theme->releaseRectsCache(image);
+    QTRY_VERIFY(QFile::exists(indexPath));
+
+    // and read back by a new instance of the theme
+    delete m_theme;
+    m_theme = new Plasma::Theme(QStringLiteral("testtheme"), this);
+
+    QRectF rect;
+    QVERIFY(m_theme->findInRectsCache(image, QStringLiteral("roundtrip"), rect));
+    QCOMPARE(rect, QRectF(1, 2, 3, 4));
+    QVERIFY(m_theme->findInRectsCache(image, QStringLiteral("round_trip"), rect));
+    QVERIFY(!rect.isValid());
+    QVERIFY(m_theme->listCachedRectKeys(image).contains(QStringLiteral("roundtrip")));
+}
+
+void ThemeTest::rectsCacheMigration()
+{
+    const QString image = QFINDTESTDATA("data/plasma/desktoptheme/testtheme/element.svg");
+    const QString indexPath = rectsCachePath(QStringLiteral(".rects"));
+    const QString oldCachePath = rectsCachePath(QString());
+    const auto *iconTheme = KIconLoader::global()->theme();
+    QVERIFY(iconTheme);
+
+    delete m_theme;
+    m_theme = nullptr;
+    QFile::remove(indexPath);
+
+    // a cache in the KConfig format used before the index
+    {
+        KConfig oldCache(oldCachePath, KConfig::SimpleConfig);
+        KConfigGroup(&oldCache, "Global").writeEntry("currentIconThemePath", iconTheme->dir());
+        KConfigGroup imageGroup(&oldCache, image);
+        imageGroup.writeEntry("migratedSize", QRectF(5, 6, 7, 8));
+        imageGroup.writeEntry("invalidElements", QStringList({QStringLiteral("migrated_missing")}));
+    }
+    QVERIFY(QFile::exists(oldCachePath));
+
+    m_theme = new Plasma::Theme(QStringLiteral("testtheme"), this);
+
+    QRectF rect;
+    QVERIFY(m_theme->findInRectsCache(image, QStringLiteral("migrated"), rect));
+    QCOMPARE(rect, QRectF(5, 6, 7, 8));
+    QVERIFY(m_theme->findInRectsCache(image, QStringLiteral("migrated_missing"), rect));
+    QVERIFY(!rect.isValid());
+
+    // everything is in the index, the old cache is gone
+    QVERIFY(QFile::exists(indexPath));
+    QVERIFY(!QFile::exists(oldCachePath));
+}
+
+void ThemeTest::sizeHintsScannedOnce()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QByteArray contents = QByteArrayLiteral(
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"32\" height=\"32\">"
+        "<rect id=\"rect\" width=\"32\" height=\"32\" fill=\"#ff0000\"/>"
+        "<rect id=\"16-16-rect\" x=\"1\" y=\"2\" width=\"16\" height=\"16\" fill=\"#00ff00\"/>"
+        "</svg>");
+    const QString coldPath = dir.path() + QStringLiteral("/cold.svg");
+    const QString warmPath = dir.path() + QStringLiteral("/warm.svg");
+    for (const QString &path : {coldPath, warmPath}) {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+    }
+
+    // the element ids of the rects cache, '#' can't be part of a real id
+    const QString scannedId = CACHE_ID_NATURAL_SIZE(QStringLiteral("#sizehints"), Plasma::Svg::Normal, 1);
+    const QString hintedId = CACHE_ID_NATURAL_SIZE(QStringLiteral("16-16-rect"), Plasma::Svg::Normal, 1);
+    QRectF rect;
+
+    // the first time an image is loaded, its size hints are collected and the image marked as scanned
+    {
+        Plasma::Svg svg;
+        svg.setTheme(m_theme);
+        svg.setImagePath(coldPath);
+        QVERIFY(svg.hasElement(QStringLiteral("rect")));
+    }
+    QVERIFY(m_theme->findInRectsCache(coldPath, scannedId, rect));
+    QVERIFY(m_theme->findInRectsCache(coldPath, hintedId, rect));
+    QCOMPARE(rect, QRectF(1, 2, 16, 16));
+
+    // on a warm start the size hints come from the cache: the document isn't scanned again
+    m_theme->insertIntoRectsCache(warmPath, scannedId, QRectF(0, 0, 1, 1));
+    {
+        Plasma::Svg svg;
+        svg.setTheme(m_theme);
+        svg.setImagePath(warmPath);
+        QVERIFY(svg.hasElement(QStringLiteral("rect")));
+    }
+    QVERIFY(!m_theme->findInRectsCache(warmPath, hintedId, rect));
+}
+
+static QVariantMap pixmapCacheCounters(Plasma::Theme *theme)
+{
+    QVariantMap counters;
+    QMetaObject::invokeMethod(theme, "pixmapCacheCounters", Q_RETURN_ARG(QVariantMap, counters));
+    return counters;
+}
+
+static quint64 counter(Plasma::Theme *theme, const char *name)
+{
+    return pixmapCacheCounters(theme).value(QLatin1String(name)).toULongLong();
+}
+
+void ThemeTest::memoryCacheCounters()
+{
+    QPixmap pix(32, 32);
+    pix.fill(Qt::blue);
+    QPixmap found;
+
+    // inserted pixmaps are served from memory
+    m_theme->insertIntoCache(QStringLiteral("memoryCounters"), pix);
+    const quint64 memoryHits = counter(m_theme, "memoryHits");
+    QVERIFY(m_theme->findInCache(QStringLiteral("memoryCounters"), found));
+    QCOMPARE(found.size(), pix.size());
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits + 1);
+
+    const quint64 misses = counter(m_theme, "misses");
+    QVERIFY(!m_theme->findInCache(QStringLiteral("memoryCountersMissing"), found));
+    QCOMPARE(counter(m_theme, "misses"), misses + 1);
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits + 1);
+
+    // pixmaps written by another process are found in the shared cache, then kept in memory
+    {
+        KImageCache cache(QStringLiteral("plasma_theme_testtheme_v5.20"), 16384 * 1024);
+        QVERIFY(cache.insertPixmap(QStringLiteral("memoryCountersShared"), pix));
+    }
+    const quint64 sharedHits = counter(m_theme, "sharedHits");
+    QVERIFY(m_theme->findInCache(QStringLiteral("memoryCountersShared"), found));
+    QCOMPARE(counter(m_theme, "sharedHits"), sharedHits + 1);
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits + 1);
+
+    QVERIFY(m_theme->findInCache(QStringLiteral("memoryCountersShared"), found));
+    QCOMPARE(counter(m_theme, "sharedHits"), sharedHits + 1);
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits + 2);
+}
+
+void ThemeTest::memoryCacheEviction()
+{
+    QPixmap small(64, 64);
+    small.fill(Qt::green);
+    const int smallCost = small.width() * small.height() * small.depth() / 8 / 1024;
+    QVERIFY(smallCost > 0);
+
+    // the budget is read when the theme is loaded
+    KConfigGroup cachePolicies(KSharedConfig::openConfig(QStringLiteral("plasmarc")), "CachePolicies");
+    cachePolicies.writeEntry("MemoryPixmapCacheKb", 4 * smallCost);
+    delete m_theme;
+    m_theme = new Plasma::Theme(QStringLiteral("testtheme"), this);
+    cachePolicies.deleteEntry("MemoryPixmapCacheKb");
+    QCOMPARE(counter(m_theme, "memoryMaxCost"), quint64(4 * smallCost));
+
+    m_theme->insertIntoCache(QStringLiteral("evictionA"), small);
+    m_theme->insertIntoCache(QStringLiteral("evictionB"), small);
+    m_theme->insertIntoCache(QStringLiteral("evictionC"), small);
+    QCOMPARE(counter(m_theme, "memoryCount"), 3ull);
+    QCOMPARE(counter(m_theme, "memoryCost"), quint64(3 * smallCost));
+
+    // A is used again, so B and C are the least recently used
+    QPixmap found;
+    QVERIFY(m_theme->findInCache(QStringLiteral("evictionA"), found));
+
+    // the cost is the size of the pixmap: a big one evicts as many as it takes to fit
+    QPixmap big(128, 72);
+    big.fill(Qt::yellow);
+    m_theme->insertIntoCache(QStringLiteral("evictionBig"), big);
+    QCOMPARE(counter(m_theme, "memoryCount"), 2ull);
+    QVERIFY(counter(m_theme, "memoryCost") <= quint64(4 * smallCost));
+
+    quint64 memoryHits = counter(m_theme, "memoryHits");
+    QVERIFY(m_theme->findInCache(QStringLiteral("evictionA"), found));
+    QVERIFY(m_theme->findInCache(QStringLiteral("evictionBig"), found));
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits + 2);
+
+    // evicted pixmaps are still found, just not in memory
+    memoryHits = counter(m_theme, "memoryHits");
+    QVERIFY(m_theme->findInCache(QStringLiteral("evictionB"), found));
+    QCOMPARE(found.size(), small.size());
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits);
+
+    // a pixmap bigger than the whole budget isn't kept in memory at all
+    QPixmap huge(160, 160);
+    huge.fill(Qt::black);
+    const quint64 count = counter(m_theme, "memoryCount");
+    m_theme->insertIntoCache(QStringLiteral("evictionHuge"), huge);
+    QCOMPARE(counter(m_theme, "memoryCount"), count);
+    QVERIFY(m_theme->findInCache(QStringLiteral("evictionHuge"), found));
+    QCOMPARE(counter(m_theme, "memoryHits"), memoryHits);
+}
+
+// lookups of the pixmap cache that missed while painting a frame
+static quint64 frameCacheMisses(Plasma::Theme *theme, const QString &prefix, QPixmap *pixmap)
+{
+    Plasma::FrameSvg frame;
+    frame.setTheme(theme);
+    frame.setImagePath(QStringLiteral("widgets/warmup"));
+    frame.setElementPrefix(prefix);
+    frame.resizeFrame(QSizeF(100, 60));
+
+    const quint64 misses = counter(theme, "misses");
+    *pixmap = frame.framePixmap();
+    return counter(theme, "misses") - misses;
+}
+
+void ThemeTest::warmUpFrames()
+{
+    KConfigGroup cachePolicies(KSharedConfig::openConfig(QStringLiteral("plasmarc")), "CachePolicies");
+    cachePolicies.writeEntry("WarmUpFrames", QStringList({QStringLiteral("widgets/warmup")}));
+    cachePolicies.writeEntry("WarmUpDevicePixelRatios", QList<int>({1}));
+
+    // a frame is warmed up once per pixmap cache, start from an empty one
+    delete m_theme;
+    m_theme = nullptr;
+    KImageCache cache(QStringLiteral("plasma_theme_testtheme_v5.20"), 16384 * 1024);
+    cache.clear();
+    m_theme = new Plasma::Theme(QStringLiteral("testtheme"), this);
+
+    const QString path = m_theme->imagePath(QStringLiteral("widgets/warmup"));
+    QVERIFY(!path.isEmpty());
+
+    // the marker is written after the elements of the frame
+    QTRY_VERIFY(cache.contains(QStringLiteral("warmup_1_widgets/warmup_") + path));
+    cachePolicies.deleteEntry("WarmUpFrames");
+    cachePolicies.deleteEntry("WarmUpDevicePixelRatios");
+
+    // the frame without prefix finds its four corners and four sides ready,
+    // the ones of the prefix that isn't warmed up have to be rendered
+    QPixmap pixmap;
+    const quint64 warmMisses = frameCacheMisses(m_theme, QString(), &pixmap);
+    QCOMPARE(pixmap.size(), QSize(100, 60));
+    const quint64 coldMisses = frameCacheMisses(m_theme, QStringLiteral("cold"), &pixmap);
+    QCOMPARE(pixmap.size(), QSize(100, 60));
+    QCOMPARE(coldMisses - warmMisses, 8ull);
+}
+
+void ThemeTest::cacheFlushedOnExit()
+{
+    const QString key = QStringLiteral("cacheFlushedOnExit");
+    QPixmap pix(64, 64);
+    pix.fill(Qt::red);
+
+    // queued for the writer thread
+    m_theme->insertIntoCache(key, pix);
+
+    // quitting writes out whatever is still waiting
+    QMetaObject::invokeMethod(qApp, "aboutToQuit");
+
+    KImageCache cache(QStringLiteral("plasma_theme_testtheme_v5.20"), 16384 * 1024);
+    QPixmap cached;
+    QVERIFY(cache.findPixmap(key, &cached));
+    QCOMPARE(cached.size(), pix.size());
+    QCOMPARE(cached.toImage().pixel(0, 0), QColor(Qt::red).rgba());
+}
+
 QTEST_MAIN(ThemeTest)
 
@@ -36,6 +36,14 @@ private Q_SLOTS:
     void loadSvgIcon();
     void testColors();
     void testCompositingChange();
+    void rectsCacheRoundTrip();
+    void rectsCacheMigration();
+    void sizeHintsScannedOnce();
+    void memoryCacheCounters();
+    void memoryCacheEviction();
+    void warmUpFrames();
+    // disables the caches of the theme, keep it last
+    void cacheFlushedOnExit();
 
 private:
     Plasma::Svg *m_svg;
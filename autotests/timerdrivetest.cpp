@@ -0,0 +1,224 @@
+/********************************************************************************
+*   Copyright 2018 agent <agent@local>                                          *
+*                                                                               *
+*   This library is free software; you can redistribute it and/or               *
+*   modify it under the terms of the GNU Library General Public                 *
+*   License as published by the Free Software Foundation; either                *
+*   version 2 of the License, or (at your option) any later version.            *
+*                                                                               *
+*   This library is distributed in the hope that it will be useful,             *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU            *
+*   Library General Public License for more details.                            *
+*                                                                               *
+*   You should have received a copy of the GNU Library General Public License   *
+*   along with this library; see the file COPYING.LIB.  If not, write to        *
+*   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,        *
+*   Boston, MA 02110-1301, USA.                                                 *
+*********************************************************************************/
+
+#include "timerdrivetest.h"
+
+#include <functional>
+
+#include "plasma/private/sharedtimer_p.h"
+
+using namespace Plasma;
+
+class TestClient : public TimerDriveClient
+{
+public:
+    void timeout() Q_DECL_OVERRIDE
+    {
+        ++count;
+        if (onTimeout) {
+            onTimeout();
+        }
+    }
+
+    int count = 0;
+    std::function<void()> onTimeout;
+};
+
+void TimerDriveTest::coalescing()
+{
+    TimerWheel wheel;
+    TestClient a, b, c, later;
+    wheel.insert(&a, 10);
+    wheel.insert(&b, 10);
+    wheel.insert(&c, 10);
+    wheel.insert(&later, 11);
+    QCOMPARE(wheel.nextTick(), qint64(10));
+
+    wheel.advance(9);
+    QCOMPARE(wheel.firedCount(), quint64(0));
+
+    // a single wakeup fires the whole slot
+    wheel.advance(wheel.nextTick());
+    QCOMPARE(a.count, 1);
+    QCOMPARE(b.count, 1);
+    QCOMPARE(c.count, 1);
+    QCOMPARE(later.count, 0);
+    QCOMPARE(wheel.nextTick(), qint64(11));
+
+    // registering again replaces the previous timer
+    wheel.insert(&later, 20);
+    wheel.advance(19);
+    QCOMPARE(later.count, 0);
+    wheel.advance(20);
+    QCOMPARE(later.count, 1);
+    QVERIFY(wheel.isEmpty());
+    QCOMPARE(wheel.nextTick(), qint64(-1));
+}
+
+void TimerDriveTest::cascade()
+{
+    TimerWheel wheel;
+    TestClient client;
+
+    // level 2: only the start of its time span is known
+    wheel.insert(&client, 5000);
+    QCOMPARE(wheel.expiry(&client), qint64(5000));
+    QCOMPARE(wheel.nextTick(), qint64(4096));
+
+    // spread over level 1
+    wheel.advance(4096);
+    QCOMPARE(client.count, 0);
+    QCOMPARE(wheel.expiry(&client), qint64(5000));
+    QCOMPARE(wheel.nextTick(), qint64(4992));
+
+    // then over level 0
+    wheel.advance(4992);
+    QCOMPARE(client.count, 0);
+    QCOMPARE(wheel.nextTick(), qint64(5000));
+
+    wheel.advance(4999);
+    QCOMPARE(client.count, 0);
+    wheel.advance(5000);
+    QCOMPARE(client.count, 1);
+
+    // level 3, walking through all the levels in one go
+    wheel.insert(&client, 300000);
+    QCOMPARE(wheel.nextTick(), qint64(262144));
+    wheel.advance(299999);
+    QCOMPARE(client.count, 1);
+    QCOMPARE(wheel.nextTick(), qint64(300000));
+    wheel.advance(300000);
+    QCOMPARE(client.count, 2);
+}
+
+void TimerDriveTest::capped()
+{
+    TimerWheel wheel;
+    TestClient past, future;
+
+    // timers in the past fire in the next slot
+    wheel.skipTo(100);
+    wheel.insert(&past, 50);
+    QCOMPARE(wheel.expiry(&past), qint64(101));
+
+    wheel.insert(&future, Q_INT64_C(1) << 40);
+    QCOMPARE(wheel.expiry(&future), qint64(100 + (1 << 24)));
+}
+
+void TimerDriveTest::registerFromTimeout()
+{
+    TimerWheel wheel;
+    TestClient periodic;
+    periodic.onTimeout = [&]() {
+        wheel.insert(&periodic, wheel.currentTick() + 3);
+    };
+
+    wheel.insert(&periodic, 3);
+    wheel.advance(10);
+    QCOMPARE(periodic.count, 3);
+    QCOMPARE(wheel.expiry(&periodic), qint64(12));
+
+    // registering for the slot being fired moves to the next one
+    TestClient again;
+    again.onTimeout = [&]() {
+        if (again.count == 1) {
+            wheel.insert(&again, wheel.currentTick());
+        }
+    };
+    wheel.insert(&again, 11);
+    wheel.advance(11);
+    QCOMPARE(again.count, 1);
+    QCOMPARE(wheel.expiry(&again), qint64(12));
+    wheel.advance(12);
+    QCOMPARE(again.count, 2);
+    QCOMPARE(periodic.count, 4);
+}
+
+void TimerDriveTest::removeWhileFiring()
+{
+    TimerWheel wheel;
+    TestClient first, second;
+    first.onTimeout = [&]() {
+        wheel.remove(&second);
+    };
+    second.onTimeout = [&]() {
+        wheel.remove(&first);
+    };
+
+    wheel.insert(&first, 5);
+    wheel.insert(&second, 5);
+    wheel.advance(5);
+
+    // whichever is fired first removes the other
+    QCOMPARE(first.count + second.count, 1);
+    QCOMPARE(wheel.firedCount(), quint64(1));
+}
+
+void TimerDriveTest::driveCoalescing()
+{
+    TimerDrive *drive = TimerDrive::self();
+    TestClient starter, a, b;
+    quint64 wakeups = 0;
+    qint64 expiryA = 0;
+    qint64 expiryB = 0;
+
+    // registered while firing, both count from the slot being fired
+    starter.onTimeout = [&]() {
+        drive->registerTimer(&a, 0);
+        drive->registerTimer(&b, 20);
+        expiryA = drive->expiry(&a);
+        expiryB = drive->expiry(&b);
+        wakeups = drive->wakeupCount();
+    };
+    drive->registerTimer(&starter, 0);
+    QTRY_COMPARE(starter.count, 1);
+    QCOMPARE(expiryA, expiryB);
+
+    QTRY_COMPARE(a.count, 1);
+    QCOMPARE(b.count, 1);
+    QCOMPARE(drive->wakeupCount(), wakeups + 1);
+}
+
+void TimerDriveTest::alignedBuckets()
+{
+    TimerDrive *drive = TimerDrive::self();
+    TestClient a, b, c;
+
+    const qint64 target = QDateTime::currentMSecsSinceEpoch() + 60 * 60 * 1000;
+    drive->registerAlignedTimer(&a, target);
+    drive->registerAlignedTimer(&b, target);
+    QVERIFY(drive->expiry(&a) > 0);
+    QCOMPARE(drive->expiry(&a), drive->expiry(&b));
+
+    // an hour later is an hour of slots later
+    drive->registerAlignedTimer(&c, target + 60 * 60 * 1000);
+    QCOMPARE(drive->expiry(&c) - drive->expiry(&a), qint64(60 * 60 * 1000 / 50));
+
+    // a plain timer replaces the aligned one
+    drive->registerTimer(&b, 0);
+    QVERIFY(drive->expiry(&b) < drive->expiry(&a));
+
+    drive->unregisterTimer(&a);
+    drive->unregisterTimer(&b);
+    drive->unregisterTimer(&c);
+    QCOMPARE(drive->expiry(&a), qint64(-1));
+}
+
+QTEST_GUILESS_MAIN(TimerDriveTest)
+
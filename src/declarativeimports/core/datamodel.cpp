@@ -22,8 +22,12 @@
 
 #include <QQmlContext>
 #include <QQmlEngine>
+#include <QSet>
 #include <QTimer>
 
+#include <algorithm>
+#include <limits>
+
 namespace Plasma
 {
 
@@ -61,6 +65,16 @@ void SortFilterModel::syncRoleNames()
     setRoleNames(sourceModel()->roleNames());
     setFilterRole(m_filterRole);
     setSortRole(m_sortRole);
+
+    QVector<int> sortRoleIds;
+    for (const QString &role : qAsConst(m_sortRoles)) {
+        sortRoleIds << roleNameToId(role);
+    }
+    if (sortRoleIds != m_sortRoleIds) {
+        m_sortRoleIds = sortRoleIds;
+        clearSortKeys();
+        invalidate();
+    }
 }
 
 int SortFilterModel::roleNameToId(const QString &name) const
@@ -76,8 +90,21 @@ void SortFilterModel::setModel(QAbstractItemModel *model)
 
     if (sourceModel()) {
         disconnect(sourceModel(), SIGNAL(modelReset()), this, SLOT(syncRoleNames()));
+        disconnect(sourceModel(), 0, this, SLOT(sourceDataChanged(QModelIndex,QModelIndex,QVector<int>)));
+        disconnect(sourceModel(), 0, this, SLOT(clearSortKeys()));
     }
 
+    //connected before the proxy connects to the model, so the sort keys are up to date when it sorts again
+    if (model) {
+        connect(model, &QAbstractItemModel::dataChanged, this, &SortFilterModel::sourceDataChanged);
+        connect(model, &QAbstractItemModel::rowsInserted, this, &SortFilterModel::clearSortKeys);
+        connect(model, &QAbstractItemModel::rowsRemoved, this, &SortFilterModel::clearSortKeys);
+        connect(model, &QAbstractItemModel::rowsMoved, this, &SortFilterModel::clearSortKeys);
+        connect(model, &QAbstractItemModel::layoutChanged, this, &SortFilterModel::clearSortKeys);
+        connect(model, &QAbstractItemModel::modelReset, this, &SortFilterModel::clearSortKeys);
+    }
+    clearSortKeys();
+
     QSortFilterProxyModel::setSourceModel(model);
 
     if (model) {
@@ -90,6 +117,16 @@ void SortFilterModel::setModel(QAbstractItemModel *model)
 
 bool SortFilterModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const
 {
+    //the native conditions first, rows they reject don't go through JavaScript
+    if (!m_conditions.isEmpty()) {
+        const QModelIndex idx = sourceModel()->index(source_row, 0, source_parent);
+        for (const Condition &condition : qAsConst(m_conditions)) {
+            if (!matches(condition, idx)) {
+                return false;
+            }
+        }
+    }
+
     if (m_filterCallback.isCallable()) {
         QJSValueList args;
         args << QJSValue(source_row);
@@ -104,6 +141,131 @@ bool SortFilterModel::filterAcceptsRow(int source_row, const QModelIndex& source
     return QSortFilterProxyModel::filterAcceptsRow(source_row, source_parent);
 }
 
+bool SortFilterModel::matches(const Condition &condition, const QModelIndex &index) const
+{
+    if (condition.type == Condition::Any) {
+        for (const Condition &alternative : condition.any) {
+            if (matches(alternative, index)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const QVariant value = index.data(condition.role);
+
+    switch (condition.type) {
+    case Condition::Prefix:
+        return value.toString().startsWith(condition.text, Qt::CaseInsensitive);
+    case Condition::Contains:
+        return value.toString().contains(condition.text, Qt::CaseInsensitive);
+    case Condition::Equals:
+        return value == condition.value;
+    case Condition::Range: {
+        bool ok = false;
+        const double number = value.toDouble(&ok);
+        return ok && number >= condition.minimum && number <= condition.maximum;
+    }
+    default:
+        return false;
+    }
+}
+
+bool SortFilterModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
+{
+    if (m_sortRoleIds.isEmpty()) {
+        return QSortFilterProxyModel::lessThan(source_left, source_right);
+    }
+
+    const QVector<QVariant> left = sortKeys(source_left);
+    const QVector<QVariant> right = sortKeys(source_right);
+
+    for (int i = 0; i < left.count(); ++i) {
+        const QVariant &a = left.at(i);
+        const QVariant &b = right.at(i);
+
+        int result;
+        if (a.userType() == QMetaType::Double && b.userType() == QMetaType::Double) {
+            const double x = a.toDouble();
+            const double y = b.toDouble();
+            result = x < y ? -1 : (y < x ? 1 : 0);
+        } else {
+            result = QString::compare(a.toString(), b.toString());
+        }
+
+        if (result != 0) {
+            return result < 0;
+        }
+    }
+
+    return false;
+}
+
+QVector<QVariant> SortFilterModel::sortKeys(const QModelIndex &sourceIndex) const
+{
+    //only the rows of a flat model are cached
+    const bool cache = !sourceIndex.parent().isValid();
+    if (cache) {
+        const int rows = sourceModel()->rowCount();
+        if (m_sortKeys.count() != rows) {
+            m_sortKeys.clear();
+            m_sortKeys.resize(rows);
+        }
+        if (!m_sortKeys.at(sourceIndex.row()).isEmpty()) {
+            return m_sortKeys.at(sourceIndex.row());
+        }
+    }
+
+    QVector<QVariant> keys;
+    keys.reserve(m_sortRoleIds.count());
+    for (int role : qAsConst(m_sortRoleIds)) {
+        const QVariant value = sourceIndex.data(role);
+        switch (value.userType()) {
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Float:
+        case QMetaType::Double:
+            keys << value.toDouble();
+            break;
+        default:
+            keys << value.toString().toCaseFolded();
+        }
+    }
+
+    if (cache) {
+        m_sortKeys[sourceIndex.row()] = keys;
+    }
+    return keys;
+}
+
+void SortFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if (m_sortKeys.isEmpty() || topLeft.parent().isValid()) {
+        return;
+    }
+
+    if (!roles.isEmpty()) {
+        bool sortRoleChanged = false;
+        for (int role : qAsConst(m_sortRoleIds)) {
+            sortRoleChanged = sortRoleChanged || roles.contains(role);
+        }
+        if (!sortRoleChanged) {
+            return;
+        }
+    }
+
+    for (int row = topLeft.row(); row <= bottomRight.row() && row < m_sortKeys.count(); ++row) {
+        m_sortKeys[row].clear();
+    }
+}
+
+void SortFilterModel::clearSortKeys()
+{
+    m_sortKeys.clear();
+}
+
 void SortFilterModel::setFilterRegExp(const QString &exp)
 {
     if (exp == filterRegExp()) {
@@ -154,10 +316,95 @@ void SortFilterModel::setFilterCallback(const QJSValue& callback)
     Q_EMIT filterCallbackChanged(callback);
 }
 
+bool SortFilterModel::compileCondition(const QVariantMap &map, Condition *condition)
+{
+    condition->roleName = map.value(QStringLiteral("role")).toString();
+    condition->role = Qt::DisplayRole;
+    condition->minimum = -std::numeric_limits<double>::infinity();
+    condition->maximum = std::numeric_limits<double>::infinity();
+
+    if (map.contains(QStringLiteral("any"))) {
+        condition->type = Condition::Any;
+        foreach (const QVariant &alternative, map.value(QStringLiteral("any")).toList()) {
+            Condition c;
+            if (!compileCondition(alternative.toMap(), &c)) {
+                return false;
+            }
+            condition->any << c;
+        }
+    } else if (map.contains(QStringLiteral("prefix"))) {
+        condition->type = Condition::Prefix;
+        condition->text = map.value(QStringLiteral("prefix")).toString();
+    } else if (map.contains(QStringLiteral("contains"))) {
+        condition->type = Condition::Contains;
+        condition->text = map.value(QStringLiteral("contains")).toString();
+    } else if (map.contains(QStringLiteral("equals"))) {
+        condition->type = Condition::Equals;
+        condition->value = map.value(QStringLiteral("equals"));
+    } else if (map.contains(QStringLiteral("minimum")) || map.contains(QStringLiteral("maximum"))) {
+        condition->type = Condition::Range;
+        bool ok = true;
+        if (map.contains(QStringLiteral("minimum"))) {
+            condition->minimum = map.value(QStringLiteral("minimum")).toDouble(&ok);
+        }
+        if (ok && map.contains(QStringLiteral("maximum"))) {
+            condition->maximum = map.value(QStringLiteral("maximum")).toDouble(&ok);
+        }
+        return ok;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool SortFilterModel::resolveConditionRoles(QVector<Condition> &conditions)
+{
+    bool changed = false;
+    for (Condition &condition : conditions) {
+        const int role = roleNameToId(condition.roleName.isEmpty() ? m_filterRole : condition.roleName);
+        changed = changed || role != condition.role;
+        condition.role = role;
+        changed = resolveConditionRoles(condition.any) || changed;
+    }
+    return changed;
+}
+
+void SortFilterModel::setFilterConditions(const QVariantList &conditions)
+{
+    if (conditions == m_filterConditions) {
+        return;
+    }
+
+    m_filterConditions = conditions;
+    m_conditions.clear();
+    for (const QVariant &value : conditions) {
+        Condition condition;
+        if (compileCondition(value.toMap(), &condition)) {
+            m_conditions << condition;
+        } else {
+            qWarning() << "Invalid filter condition" << value;
+        }
+    }
+    resolveConditionRoles(m_conditions);
+    invalidateFilter();
+
+    Q_EMIT filterConditionsChanged();
+}
+
+QVariantList SortFilterModel::filterConditions() const
+{
+    return m_filterConditions;
+}
+
 void SortFilterModel::setFilterRole(const QString &role)
 {
-    QSortFilterProxyModel::setFilterRole(roleNameToId(role));
     m_filterRole = role;
+    //roles may have been added or removed as well
+    if (resolveConditionRoles(m_conditions)) {
+        invalidateFilter();
+    }
+    QSortFilterProxyModel::setFilterRole(roleNameToId(role));
 }
 
 QString SortFilterModel::filterRole() const
@@ -168,7 +415,10 @@ QString SortFilterModel::filterRole() const
 void SortFilterModel::setSortRole(const QString &role)
 {
     m_sortRole = role;
-    if (role.isEmpty()) {
+    if (!m_sortRoles.isEmpty()) {
+        //sortRoles take over
+        return;
+    } else if (role.isEmpty()) {
         sort(-1, Qt::AscendingOrder);
     } else if (sourceModel()) {
         QSortFilterProxyModel::setSortRole(roleNameToId(role));
@@ -181,6 +431,41 @@ QString SortFilterModel::sortRole() const
     return m_sortRole;
 }
 
+void SortFilterModel::setSortRoles(const QStringList &roles)
+{
+    if (roles == m_sortRoles) {
+        return;
+    }
+
+    m_sortRoles = roles;
+    m_sortRoleIds.clear();
+    for (const QString &role : roles) {
+        m_sortRoleIds << roleNameToId(role);
+    }
+    clearSortKeys();
+
+    if (m_sortRoles.isEmpty()) {
+        setSortRole(m_sortRole);
+        if (!m_sortRole.isEmpty() && sourceModel()) {
+            invalidate();
+        }
+    } else if (sourceModel()) {
+        if (sortColumn() == 0) {
+            //already sorted, but differently
+            invalidate();
+        } else {
+            sort(0, sortOrder());
+        }
+    }
+
+    Q_EMIT sortRolesChanged();
+}
+
+QStringList SortFilterModel::sortRoles() const
+{
+    return m_sortRoles;
+}
+
 void SortFilterModel::setSortOrder(const Qt::SortOrder order)
 {
     sort(0, order);
@@ -218,7 +503,8 @@ int SortFilterModel::mapRowFromSource(int row) const
 DataModel::DataModel(QObject *parent)
     : QAbstractItemModel(parent),
       m_dataSource(0),
-      m_maxRoleId(Qt::UserRole + 1)
+      m_maxRoleId(Qt::UserRole + 1),
+      m_itemCount(0)
 {
     //There is one reserved role name: DataEngineSource
     m_roleNames[m_maxRoleId] = QByteArrayLiteral("DataEngineSource");
@@ -240,39 +526,24 @@ DataModel::~DataModel()
 
 void DataModel::dataUpdated(const QString &sourceName, const QVariantMap &data)
 {
-    if (!m_sourceFilter.isEmpty() && m_sourceFilterRE.isValid() && !m_sourceFilterRE.exactMatch(sourceName)) {
+    if (!acceptsSource(sourceName)) {
         return;
     }
 
     if (m_keyRoleFilter.isEmpty()) {
         //an item is represented by a source: keys are roles m_roleLevel == FirstLevel
-        QVariantList list;
-
-        if (!m_dataSource->data()->isEmpty()) {
-            foreach (const QString &key, m_dataSource->data()->keys()) {
-                if (!m_sourceFilter.isEmpty() && m_sourceFilterRE.isValid() && !m_sourceFilterRE.exactMatch(key)) {
-                    continue;
-                }
-                QVariant value = m_dataSource->data()->value(key);
-                if (value.isValid() && value.canConvert<Plasma::DataEngine::Data>()) {
-                    Plasma::DataEngine::Data data = value.value<Plasma::DataEngine::Data>();
-                    data[QStringLiteral("DataEngineSource")] = key;
-                    list.append(data);
-                }
-            }
-        }
-        setItems(QString(), list);
+        setItems(QString(), sourceItems());
     } else {
         //a key that matches the one we want exists and is a list of DataEngine::Data
         if (data.contains(m_keyRoleFilter) &&
                 data.value(m_keyRoleFilter).canConvert<QVariantList>()) {
             setItems(sourceName, data.value(m_keyRoleFilter).value<QVariantList>());
-        } else if (m_keyRoleFilterRE.isValid()) {
+        } else if (m_keyRoleNameFilter.isActive()) {
             //try to match the key we want with a regular expression if set
             QVariantList list;
             QVariantMap::const_iterator i;
             for (i = data.constBegin(); i != data.constEnd(); ++i) {
-                if (m_keyRoleFilterRE.exactMatch(i.key())) {
+                if (m_keyRoleNameFilter.matches(i.key())) {
                     list.append(i.value());
                 }
             }
@@ -329,7 +600,7 @@ void DataModel::setKeyRoleFilter(const QString &key)
     }
 
     m_keyRoleFilter = key;
-    m_keyRoleFilterRE = QRegExp(m_keyRoleFilter);
+    m_keyRoleNameFilter.setPattern(m_keyRoleFilter);
 }
 
 QString DataModel::keyRoleFilter() const
@@ -344,14 +615,133 @@ void DataModel::setSourceFilter(const QString &key)
     }
 
     m_sourceFilter = key;
-    m_sourceFilterRE = QRegExp(key);
-    /*
-     FIXME: if the user changes the source filter, it won't immediately be reflected in the
-     available data
-    if (m_sourceFilterRE.isValid()) {
-        .. iterate through all items and weed out the ones that don't match ..
+    m_sourceNameFilter.setPattern(key);
+    applySourceFilter();
+}
+
+bool DataModel::acceptsSource(const QString &sourceName) const
+{
+    return !m_sourceNameFilter.isActive() || m_sourceNameFilter.matches(sourceName);
+}
+
+QVariantList DataModel::sourceItems() const
+{
+    QVariantList list;
+
+    foreach (const QString &key, m_dataSource->data()->keys()) {
+        if (!acceptsSource(key)) {
+            continue;
+        }
+        QVariant value = m_dataSource->data()->value(key);
+        if (value.isValid() && value.canConvert<Plasma::DataEngine::Data>()) {
+            Plasma::DataEngine::Data data = value.value<Plasma::DataEngine::Data>();
+            data[QStringLiteral("DataEngineSource")] = key;
+            list.append(data);
+        }
+    }
+
+    return list;
+}
+
+void DataModel::applySourceFilter()
+{
+    if (!m_dataSource) {
+        return;
+    }
+
+    if (m_keyRoleFilter.isEmpty()) {
+        //every item comes from a different source, update only the rows of the sources which changed
+        const QVariantList list = sourceItems();
+        if (!m_items.contains(QString()) || !diffItems(QString(), list, QStringLiteral("DataEngineSource"))) {
+            setItems(QString(), list);
+        }
+        return;
+    }
+
+    foreach (const QString &sourceName, m_items.keys()) {
+        if (!acceptsSource(sourceName)) {
+            removeSource(sourceName);
+        }
+    }
+
+    foreach (const QString &sourceName, m_dataSource->data()->keys()) {
+        if (!m_items.contains(sourceName) && acceptsSource(sourceName)) {
+            dataUpdated(sourceName, m_dataSource->data()->value(sourceName).value<Plasma::DataEngine::Data>());
+        }
+    }
+}
+
+DataModel::NameFilter::NameFilter()
+    : m_type(Empty)
+{
+}
+
+//whether the pattern only matches itself
+static bool isLiteralPattern(const QString &pattern)
+{
+    static const QString metaCharacters = QStringLiteral("\\^$.|?*+()[]{}");
+    for (const QChar c : pattern) {
+        if (metaCharacters.contains(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DataModel::NameFilter::setPattern(const QString &pattern)
+{
+    m_matches.clear();
+    m_text.clear();
+    m_expression = QRegularExpression();
+
+    if (pattern.isEmpty()) {
+        m_type = Empty;
+    } else if (isLiteralPattern(pattern)) {
+        m_type = Literal;
+        m_text = pattern;
+    } else if (pattern.endsWith(QLatin1String(".*")) && isLiteralPattern(pattern.left(pattern.length() - 2))) {
+        m_type = Prefix;
+        m_text = pattern.left(pattern.length() - 2);
+    } else {
+        //the whole name has to match
+        m_expression = QRegularExpression(QLatin1String("\\A(?:") + pattern + QLatin1String(")\\z"));
+        if (m_expression.isValid()) {
+            m_type = Expression;
+            m_expression.optimize();
+        } else {
+            m_type = Invalid;
+        }
+    }
+}
+
+bool DataModel::NameFilter::isActive() const
+{
+    return m_type != Empty && m_type != Invalid;
+}
+
+bool DataModel::NameFilter::matches(const QString &name) const
+{
+    switch (m_type) {
+    case Literal:
+        return name == m_text;
+    case Prefix:
+        return name.startsWith(m_text);
+    case Expression: {
+        auto it = m_matches.constFind(name);
+        if (it != m_matches.constEnd()) {
+            return it.value();
+        }
+        //names are usually a bounded set, but don't grow forever
+        if (m_matches.count() > 1000) {
+            m_matches.clear();
+        }
+        const bool match = m_expression.match(name).hasMatch();
+        m_matches.insert(name, match);
+        return match;
+    }
+    default:
+        return false;
     }
-    */
 }
 
 QString DataModel::sourceFilter() const
@@ -359,21 +749,29 @@ QString DataModel::sourceFilter() const
     return m_sourceFilter;
 }
 
+void DataModel::setIdentityRole(const QString &role)
+{
+    m_identityRole = role;
+}
+
+QString DataModel::identityRole() const
+{
+    return m_identityRole;
+}
+
 void DataModel::setItems(const QString &sourceName, const QVariantList &list)
 {
+    if (!m_identityRole.isEmpty() && m_items.contains(sourceName) && diffItems(sourceName, list, m_identityRole)) {
+        return;
+    }
+
     const int oldLength = m_items.value(sourceName).count();
     const int delta = list.length() - oldLength;
     const bool firstRun = m_items.isEmpty();
 
     //At what row number the first item associated to this source starts
-    int sourceIndex = 0;
-    QMap<QString, QVector<QVariant> >::const_iterator i;
-    for (i = m_items.constBegin(); i != m_items.constEnd(); ++i) {
-        if (i.key() == sourceName) {
-            break;
-        }
-        sourceIndex += i.value().count();
-    }
+    const int position = sourcePosition(sourceName);
+    const int sourceIndex = sourceOffset(position);
     //signal as inserted the rows at the end, all the other rows will signal a dataupdated.
     //better than a model reset because doesn't cause deletion and re-creation of every list item on a qml ListView, repeaters etc.
     //the first run it gets reset because otherwise setRoleNames gets broken
@@ -387,38 +785,15 @@ void DataModel::setItems(const QString &sourceName, const QVariantList &list)
     //convert to vector, so data() will be O(1)
     m_items[sourceName] = list.toVector();
 
-    if (!list.isEmpty()) {
-        if (list.first().canConvert<QVariantMap>()) {
-            foreach (const QVariant &item, list) {
-                const QVariantMap &vh = item.value<QVariantMap>();
-                QMapIterator<QString, QVariant> it(vh);
-                while (it.hasNext()) {
-                    it.next();
-                    const QString &roleName = it.key();
-                    if (!m_roleIds.contains(roleName)) {
-                        ++m_maxRoleId;
-                        m_roleNames[m_maxRoleId] = roleName.toLatin1();
-                        m_roleIds[roleName] = m_maxRoleId;
-                    }
-                }
-            }
-        } else {
-            foreach (const QVariant &item, list) {
-                const QVariantMap &vh = item.value<QVariantMap>();
-                QMapIterator<QString, QVariant> it(vh);
-                while (it.hasNext()) {
-                    it.next();
-                    const QString &roleName = it.key();
-                    if (!m_roleIds.contains(roleName)) {
-                        ++m_maxRoleId;
-                        m_roleNames[m_maxRoleId] = roleName.toLatin1();
-                        m_roleIds[roleName] = m_maxRoleId;
-                    }
-                }
-            }
-        }
+    if (position < m_sourceNames.count() && m_sourceNames.at(position) == sourceName) {
+        updateIndex(position, delta);
+    } else {
+        //a new source, all the following ones move
+        rebuildIndex();
     }
 
+    discoverRoles(sourceName, m_items.value(sourceName));
+
     setRoleNames(m_roleNames);
 
     if (firstRun) {
@@ -432,6 +807,204 @@ void DataModel::setItems(const QString &sourceName, const QVariantList &list)
                      createIndex(sourceIndex + qMin(list.length(), oldLength), 0));
 }
 
+void DataModel::discoverRoles(const QString &sourceName, const QVector<QVariant> &items)
+{
+    //items of a source usually all have the same keys, only look up the roles of new ones
+    QStringList &schema = m_sourceSchemas[sourceName];
+
+    foreach (const QVariant &item, items) {
+        const QVariantMap &vh = item.value<QVariantMap>();
+
+        bool sameSchema = vh.count() == schema.count();
+        int i = 0;
+        for (auto it = vh.constBegin(); sameSchema && it != vh.constEnd(); ++it, ++i) {
+            sameSchema = it.key() == schema.at(i);
+        }
+        if (sameSchema) {
+            continue;
+        }
+
+        QMapIterator<QString, QVariant> it(vh);
+        while (it.hasNext()) {
+            it.next();
+            const QString &roleName = it.key();
+            if (!m_roleIds.contains(roleName)) {
+                ++m_maxRoleId;
+                m_roleNames[m_maxRoleId] = roleName.toLatin1();
+                m_roleIds[roleName] = m_maxRoleId;
+            }
+        }
+        schema = vh.keys();
+    }
+}
+
+bool DataModel::itemIdentities(const QVector<QVariant> &items, const QString &identityRole, QVector<QString> *ids, QHash<QString, int> *rows) const
+{
+    ids->reserve(items.count());
+    for (int row = 0; row < items.count(); ++row) {
+        const QVariant identity = items.at(row).value<QVariantMap>().value(identityRole);
+        const QString id = identity.toString();
+        if (!identity.isValid() || rows->contains(id)) {
+            return false;
+        }
+        ids->append(id);
+        rows->insert(id, row);
+    }
+    return true;
+}
+
+//the values which can stay where they are, as a longest increasing subsequence
+static QSet<int> longestIncreasingRun(const QVector<int> &values)
+{
+    //tails[n]: index of the smallest value ending an increasing run of length n + 1
+    QVector<int> tails;
+    QVector<int> previous(values.count(), -1);
+
+    for (int i = 0; i < values.count(); ++i) {
+        auto it = std::lower_bound(tails.begin(), tails.end(), values.at(i), [&values](int index, int value) {
+            return values.at(index) < value;
+        });
+        if (it != tails.begin()) {
+            previous[i] = *(it - 1);
+        }
+        if (it == tails.end()) {
+            tails.append(i);
+        } else {
+            *it = i;
+        }
+    }
+
+    QSet<int> run;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i)) {
+        run.insert(values.at(i));
+    }
+    return run;
+}
+
+bool DataModel::diffItems(const QString &sourceName, const QVariantList &list, const QString &identityRole)
+{
+    const QVector<QVariant> newItems = list.toVector();
+
+    QVector<QString> ids;
+    QHash<QString, int> oldRows;
+    QVector<QString> newIds;
+    QHash<QString, int> newRows;
+    if (!itemIdentities(m_items.value(sourceName), identityRole, &ids, &oldRows) ||
+        !itemIdentities(newItems, identityRole, &newIds, &newRows)) {
+        //without unique identities the whole source gets updated
+        return false;
+    }
+
+    discoverRoles(sourceName, newItems);
+    setRoleNames(m_roleNames);
+
+    const int position = sourcePosition(sourceName);
+    const int sourceIndex = sourceOffset(position);
+    QVector<QVariant> &items = m_items[sourceName];
+
+    //remove the items which are gone, from the end so the rows before stay valid
+    for (int last = ids.count() - 1; last >= 0;) {
+        if (newRows.contains(ids.at(last))) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > 0 && !newRows.contains(ids.at(first - 1))) {
+            --first;
+        }
+
+        beginRemoveRows(QModelIndex(), sourceIndex + first, sourceIndex + last);
+        items.remove(first, last - first + 1);
+        ids.remove(first, last - first + 1);
+        updateIndex(position, first - last - 1);
+        endRemoveRows();
+
+        last = first - 1;
+    }
+
+    //move the items out of order right after the item preceding them in the new list
+    QVector<int> order;
+    order.reserve(ids.count());
+    for (const QString &id : qAsConst(ids)) {
+        order.append(newRows.value(id));
+    }
+    const QSet<int> stable = longestIncreasingRun(order);
+
+    int predecessor = -1;
+    for (int row = 0; row < newIds.count(); ++row) {
+        const QString &id = newIds.at(row);
+        if (!oldRows.contains(id)) {
+            continue;
+        }
+
+        if (!stable.contains(row)) {
+            const int from = ids.indexOf(id);
+            const int after = predecessor >= 0 ? ids.indexOf(newIds.at(predecessor)) : -1;
+            if (from != after + 1) {
+                beginMoveRows(QModelIndex(), sourceIndex + from, sourceIndex + from, QModelIndex(), sourceIndex + after + 1);
+                const int to = from < after ? after : after + 1;
+                items.move(from, to);
+                ids.move(from, to);
+                endMoveRows();
+            }
+        }
+        predecessor = row;
+    }
+
+    //the items left are in the new order, add the new ones among them
+    for (int first = 0; first < newIds.count();) {
+        if (oldRows.contains(newIds.at(first))) {
+            ++first;
+            continue;
+        }
+        int last = first;
+        while (last + 1 < newIds.count() && !oldRows.contains(newIds.at(last + 1))) {
+            ++last;
+        }
+
+        beginInsertRows(QModelIndex(), sourceIndex + first, sourceIndex + last);
+        for (int row = first; row <= last; ++row) {
+            items.insert(row, newItems.at(row));
+            ids.insert(row, newIds.at(row));
+        }
+        updateIndex(position, last - first + 1);
+        endInsertRows();
+
+        first = last + 1;
+    }
+
+    //only signal the roles which actually changed
+    for (int row = 0; row < newItems.count(); ++row) {
+        if (!oldRows.contains(newIds.at(row))) {
+            continue;
+        }
+
+        const QVariantMap oldItem = items.at(row).value<QVariantMap>();
+        const QVariantMap newItem = newItems.at(row).value<QVariantMap>();
+        items[row] = newItems.at(row);
+        if (oldItem == newItem) {
+            continue;
+        }
+
+        QVector<int> roles;
+        for (auto it = newItem.constBegin(); it != newItem.constEnd(); ++it) {
+            if (oldItem.value(it.key()) != it.value()) {
+                roles.append(m_roleIds.value(it.key()));
+            }
+        }
+        for (auto it = oldItem.constBegin(); it != oldItem.constEnd(); ++it) {
+            if (!newItem.contains(it.key())) {
+                roles.append(m_roleIds.value(it.key()));
+            }
+        }
+
+        const QModelIndex idx = createIndex(sourceIndex + row, 0);
+        emit dataChanged(idx, idx, roles);
+    }
+
+    return true;
+}
+
 void DataModel::removeSource(const QString &sourceName)
 {
     //FIXME: find a way to remove only the proper things also in the case where sources are items
@@ -442,6 +1015,7 @@ void DataModel::removeSource(const QString &sourceName)
             if (m_items.value(QString())[i].value<QVariantMap>().value(QStringLiteral("DataEngineSource")) == sourceName) {
                 beginRemoveRows(QModelIndex(), i, i);
                 m_items[QString()].remove(i);
+                updateIndex(sourcePosition(QString()), -1);
                 endRemoveRows();
                 break;
             }
@@ -449,13 +1023,8 @@ void DataModel::removeSource(const QString &sourceName)
     } else {
         if (m_items.contains(sourceName)) {
             //At what row number the first item associated to this source starts
-            int sourceIndex = 0;
-            for (auto i = m_items.constBegin(); i != m_items.constEnd(); ++i) {
-                if (i.key() == sourceName) {
-                    break;
-                }
-                sourceIndex += i.value().count();
-            }
+            const int position = sourcePosition(sourceName);
+            const int sourceIndex = sourceOffset(position);
 
             //source name as key of the map
 
@@ -464,6 +1033,9 @@ void DataModel::removeSource(const QString &sourceName)
                 beginRemoveRows(QModelIndex(), sourceIndex, sourceIndex + count - 1);
             }
             m_items.remove(sourceName);
+            m_sourceSchemas.remove(sourceName);
+            //the source stays in the index, with no rows
+            updateIndex(position, -count);
             if (count > 0) {
                 endRemoveRows();
             }
@@ -478,20 +1050,9 @@ QVariant DataModel::data(const QModelIndex &index, int role) const
         return QVariant();
     }
 
-    int count = 0;
-    int actualRow = 0;
-    QString source;
-    QMap<QString, QVector<QVariant> >::const_iterator i;
-    for (i = m_items.constBegin(); i != m_items.constEnd(); ++i) {
-        const int oldCount = count;
-        count += i.value().count();
-
-        if (index.row() < count) {
-            source = i.key();
-            actualRow = index.row() - oldCount;
-            break;
-        }
-    }
+    int offset = 0;
+    const QString source = m_sourceNames.at(findSource(index.row(), &offset));
+    const int actualRow = index.row() - offset;
 
     //is it the reserved role: DataEngineSource ?
     //also, if each source is an item DataEngineSource is a role between all the others, otherwise we know it from the role variable
@@ -502,6 +1063,72 @@ QVariant DataModel::data(const QModelIndex &index, int role) const
     }
 }
 
+void DataModel::rebuildIndex()
+{
+    m_sourceNames = m_items.keys().toVector();
+    m_sourceIndex.resize(m_sourceNames.count());
+    m_itemCount = 0;
+
+    int i = 0;
+    for (auto it = m_items.constBegin(); it != m_items.constEnd(); ++it, ++i) {
+        m_sourceIndex[i] = it.value().count();
+        m_itemCount += it.value().count();
+    }
+
+    //every node gets the sum of the ones it covers, in linear time
+    for (i = 1; i <= m_sourceIndex.count(); ++i) {
+        const int parent = i + (i & -i);
+        if (parent <= m_sourceIndex.count()) {
+            m_sourceIndex[parent - 1] += m_sourceIndex[i - 1];
+        }
+    }
+}
+
+int DataModel::sourcePosition(const QString &sourceName) const
+{
+    //where the source is, or would be inserted
+    return std::lower_bound(m_sourceNames.constBegin(), m_sourceNames.constEnd(), sourceName) - m_sourceNames.constBegin();
+}
+
+void DataModel::updateIndex(int position, int delta)
+{
+    for (int i = position + 1; i <= m_sourceIndex.count(); i += i & -i) {
+        m_sourceIndex[i - 1] += delta;
+    }
+    m_itemCount += delta;
+}
+
+int DataModel::sourceOffset(int position) const
+{
+    int offset = 0;
+    for (int i = position; i > 0; i -= i & -i) {
+        offset += m_sourceIndex[i - 1];
+    }
+    return offset;
+}
+
+int DataModel::findSource(int row, int *offset) const
+{
+    //descend the tree looking for the last source starting at or before row
+    int step = 1;
+    while (step * 2 <= m_sourceIndex.count()) {
+        step *= 2;
+    }
+
+    int position = 0;
+    int sum = 0;
+    for (; step > 0; step /= 2) {
+        const int next = position + step;
+        if (next <= m_sourceIndex.count() && sum + m_sourceIndex[next - 1] <= row) {
+            position = next;
+            sum += m_sourceIndex[next - 1];
+        }
+    }
+
+    *offset = sum;
+    return position;
+}
+
 QVariant DataModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     Q_UNUSED(section)
@@ -22,6 +22,7 @@
 
 #include <QAbstractItemModel>
 #include <QJSValue>
+#include <QRegularExpression>
 #include <QSortFilterProxyModel>
 #include <QVector>
 
@@ -62,11 +63,30 @@ class SortFilterModel : public QSortFilterProxyModel
      * of filterRole as second argument. The callable's return value is evaluated as boolean to determine
      * whether the row is accepted (true) or filtered out (false). It overrides the default implementation
      * that uses filterRegExp or filterString; while filterCallable is set those two properties are
-     * ignored. Attempts to write a non-callable to this property are silently ignored, but you can set
-     * it to null.
+     * ignored. It is only called for the rows matching filterConditions. Attempts to write a non-callable
+     * to this property are silently ignored, but you can set it to null.
      */
     Q_PROPERTY(QJSValue filterCallback READ filterCallback WRITE setFilterCallback NOTIFY filterCallbackChanged REVISION 1)
 
+    /**
+     * A list of conditions the items have to match, evaluated natively without calling into
+     * JavaScript. Every condition is an object with a "role" (filterRole if not given) and one of:
+     * - "prefix": the value of the role starts with this string, ignoring case
+     * - "contains": the value of the role contains this string, ignoring case
+     * - "equals": the value of the role is equal to this value
+     * - "minimum" and/or "maximum": the value of the role is a number in this range, bounds included
+     * - "any": a list of conditions, of which at least one has to match
+     * Items have to match all the conditions of the list, and then filterCallback when it is set,
+     * filterRegExp or filterString otherwise. The conditions are checked first, the rows they
+     * reject are not passed to filterCallback.
+     * @code
+     * filterConditions: [{role: "name", contains: searchField.text},
+     *                    {any: [{role: "size", maximum: 1024}, {role: "pinned", equals: true}]}]
+     * @endcode
+     * @since 5.44
+     */
+    Q_PROPERTY(QVariantList filterConditions READ filterConditions WRITE setFilterConditions NOTIFY filterConditionsChanged REVISION 1)
+
     /**
      * The role of the sourceModel on which filterRegExp must be applied.
      */
@@ -77,6 +97,14 @@ class SortFilterModel : public QSortFilterProxyModel
      */
     Q_PROPERTY(QString sortRole READ sortRole WRITE setSortRole)
 
+    /**
+     * Roles of the sourceModel used for sorting, items with the same value for a role being
+     * sorted by the next one. Numbers are compared as such, everything else as strings,
+     * ignoring case. Overrides sortRole when not empty.
+     * @since 5.44
+     */
+    Q_PROPERTY(QStringList sortRoles READ sortRoles WRITE setSortRoles NOTIFY sortRolesChanged REVISION 1)
+
     /**
      * One of Qt.Ascending or Qt.Descending
      */
@@ -104,12 +132,18 @@ public:
     void setFilterCallback(const QJSValue &callback);
     QJSValue filterCallback() const;
 
+    void setFilterConditions(const QVariantList &conditions);
+    QVariantList filterConditions() const;
+
     void setFilterRole(const QString &role);
     QString filterRole() const;
 
     void setSortRole(const QString &role);
     QString sortRole() const;
 
+    void setSortRoles(const QStringList &roles);
+    QStringList sortRoles() const;
+
     void setSortOrder(const Qt::SortOrder order);
 
     int count() const
@@ -136,20 +170,59 @@ Q_SIGNALS:
     void filterRegExpChanged(const QString &);
     Q_REVISION(1) void filterStringChanged(const QString &);
     Q_REVISION(1) void filterCallbackChanged(const QJSValue &);
+    Q_REVISION(1) void filterConditionsChanged();
+    Q_REVISION(1) void sortRolesChanged();
 
 protected:
     int roleNameToId(const QString &name) const;
     bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const Q_DECL_OVERRIDE;
+    bool lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const Q_DECL_OVERRIDE;
 
 protected Q_SLOTS:
     void syncRoleNames();
 
+private Q_SLOTS:
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void clearSortKeys();
+
 private:
+    // filterConditions, compiled
+    struct Condition {
+        enum Type {
+            Prefix,
+            Contains,
+            Equals,
+            Range,
+            Any
+        };
+
+        Type type;
+        QString roleName;
+        int role;
+        QString text;
+        QVariant value;
+        double minimum;
+        double maximum;
+        QVector<Condition> any;
+    };
+
+    static bool compileCondition(const QVariantMap &map, Condition *condition);
+    bool resolveConditionRoles(QVector<Condition> &conditions);
+    bool matches(const Condition &condition, const QModelIndex &index) const;
+    // the values of sortRoles for a row of the source model, as compared
+    QVector<QVariant> sortKeys(const QModelIndex &sourceIndex) const;
+
     QString m_filterRole;
     QString m_sortRole;
     QString m_filterString;
     QJSValue m_filterCallback;
     QHash<QString, int> m_roleIds;
+    QVariantList m_filterConditions;
+    QVector<Condition> m_conditions;
+    QStringList m_sortRoles;
+    QVector<int> m_sortRoleIds;
+    // by source row, empty until needed
+    mutable QVector<QVector<QVariant> > m_sortKeys;
 };
 
 /**
@@ -176,6 +249,15 @@ class DataModel : public QAbstractItemModel
      */
     Q_PROPERTY(QString sourceFilter READ sourceFilter WRITE setSourceFilter)
 
+    /**
+     * The role identifying an item among the ones of the same source, e.g. "DataEngineSource"
+     * when keyRoleFilter is empty. When set, and all the items of a source have a different value
+     * for it, an update of the source is signaled as the insertions, removals and moves of rows
+     * it actually does, and only the roles which changed get signaled as changed.
+     * @since 5.44
+     */
+    Q_PROPERTY(QString identityRole READ identityRole WRITE setIdentityRole)
+
     /**
      * How many items are in this model
      */
@@ -200,6 +282,9 @@ public:
     void setSourceFilter(const QString &key);
     QString sourceFilter() const;
 
+    void setIdentityRole(const QString &role);
+    QString identityRole() const;
+
     //Reimplemented
     QVariant data(const QModelIndex &index, int role) const Q_DECL_OVERRIDE;
     QVariant headerData(int section, Qt::Orientation orientation,
@@ -238,24 +323,71 @@ private Q_SLOTS:
     void removeSource(const QString &sourceName);
 
 private:
+    // a key or source filter: names have to match the whole regular expression. Literal names
+    // and prefixes are compared directly, and the results are remembered until the pattern changes
+    class NameFilter
+    {
+    public:
+        NameFilter();
+
+        void setPattern(const QString &pattern);
+        // whether there is a valid pattern to match
+        bool isActive() const;
+        bool matches(const QString &name) const;
+
+    private:
+        enum Type {
+            Empty,
+            Invalid,
+            Literal,
+            Prefix,
+            Expression
+        };
+
+        Type m_type;
+        QString m_text;
+        QRegularExpression m_expression;
+        mutable QHash<QString, bool> m_matches;
+    };
+
+    bool acceptsSource(const QString &sourceName) const;
+    QVariantList sourceItems() const;
+    void applySourceFilter();
+
+    // index of the first row of every source, kept as a Fenwick tree
+    // over the item counts of the sources in the order of m_items
+    void rebuildIndex();
+    int sourcePosition(const QString &sourceName) const;
+    void updateIndex(int position, int delta);
+    int sourceOffset(int position) const;
+    int findSource(int row, int *offset) const;
+
+    void discoverRoles(const QString &sourceName, const QVector<QVariant> &items);
+    bool itemIdentities(const QVector<QVariant> &items, const QString &identityRole, QVector<QString> *ids, QHash<QString, int> *rows) const;
+    // updates the items of a known source row by row, by their identity
+    bool diffItems(const QString &sourceName, const QVariantList &list, const QString &identityRole);
+
     DataSource *m_dataSource;
     QString m_keyRoleFilter;
-    QRegExp m_keyRoleFilterRE;
+    NameFilter m_keyRoleNameFilter;
     QString m_sourceFilter;
-    QRegExp m_sourceFilterRE;
+    NameFilter m_sourceNameFilter;
+    QString m_identityRole;
     QMap<QString, QVector<QVariant> > m_items;
+    // keys of the last item of every source whose roles were looked up
+    QHash<QString, QStringList> m_sourceSchemas;
     QHash<int, QByteArray> m_roleNames;
     QHash<QString, int> m_roleIds;
     int m_maxRoleId;
+    // sorted like m_items, removed sources are kept with no items until the next rebuild
+    QVector<QString> m_sourceNames;
+    QVector<int> m_sourceIndex;
+    int m_itemCount;
 };
 
 int DataModel::countItems() const
 {
-    int count = 0;
-    foreach (const QVector<QVariant> &v, m_items) {
-        count += v.count();
-    }
-    return count;
+    return m_itemCount;
 }
 
 }
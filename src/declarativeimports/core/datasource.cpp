@@ -180,6 +180,42 @@ void DataSource::dataUpdated(const QString &sourceName, const Plasma::DataEngine
     }
 }
 
+void DataSource::dataKeysChanged(const QString &sourceName, const Plasma::DataEngine::Data &data,
+                                 const QStringList &changedKeys, const QStringList &removedKeys)
+{
+    if (!m_connectedSources.contains(sourceName)) {
+        if (m_dataEngine) {
+            m_dataEngine->disconnectSource(sourceName, this);
+        }
+        return;
+    }
+
+    if (!m_data->contains(sourceName)) {
+        m_data->insert(sourceName, data);
+        emit dataChanged();
+        emit newData(sourceName, data);
+        return;
+    }
+
+    //nothing changed since the last update, don't make the bindings reevaluate
+    if (changedKeys.isEmpty() && removedKeys.isEmpty()) {
+        return;
+    }
+
+    //patch the map we already have rather than converting the whole data again
+    QVariantMap sourceData = m_data->value(sourceName).toMap();
+    for (const QString &key : changedKeys) {
+        sourceData.insert(key, data.value(key));
+    }
+    for (const QString &key : removedKeys) {
+        sourceData.remove(key);
+    }
+
+    m_data->insert(sourceName, sourceData);
+    emit dataChanged();
+    emit newData(sourceName, data);
+}
+
 void DataSource::modelChanged(const QString &sourceName, QAbstractItemModel *model)
 {
     if (!model) {
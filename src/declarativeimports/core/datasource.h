@@ -159,6 +159,8 @@ public:
 
 public Q_SLOTS:
     void dataUpdated(const QString &sourceName, const Plasma::DataEngine::Data &data);
+    void dataKeysChanged(const QString &sourceName, const Plasma::DataEngine::Data &data,
+                         const QStringList &changedKeys, const QStringList &removedKeys);
     void modelChanged(const QString &sourceName, QAbstractItemModel *model);
 
 protected Q_SLOTS:
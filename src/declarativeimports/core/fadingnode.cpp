@@ -91,7 +91,7 @@ void FadingMaterialShader::initialize()
 }
 
 
-FadingNode::FadingNode(QSGTexture *source, QSGTexture *target):
+FadingNode::FadingNode(const QSharedPointer<QSGTexture> &source, const QSharedPointer<QSGTexture> &target):
     m_source(source),
     m_target(target)
 {
@@ -120,8 +120,9 @@ void FadingNode::setRect(const QRectF &bounds)
 void FadingNode::setProgress(qreal progress)
 {
     QSGSimpleMaterial<FadingMaterialState> *m = static_cast<QSGSimpleMaterial<FadingMaterialState>*>(material());
-    m->state()->source = m_source.data();
-    m->state()->target = m_target.data();
+    // the shader samples the whole texture, not a part of an atlas
+    m->state()->source = m_source->isAtlasTexture() ? m_source->removedFromAtlas() : m_source.data();
+    m->state()->target = m_target->isAtlasTexture() ? m_target->removedFromAtlas() : m_target.data();
     m->state()->progress = progress;
     markDirty(QSGNode::DirtyMaterial);
 }
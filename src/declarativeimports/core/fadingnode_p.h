@@ -23,6 +23,7 @@
 #include <QSGGeometryNode>
 #include <QSGTexture>
 #include <QRectF>
+#include <QSharedPointer>
 
 /**
  * This node fades between two textures using a shader
@@ -32,9 +33,9 @@ class FadingNode : public QSGGeometryNode
 {
 public:
     /**
-     * Ownership of the textures is transferred to the node
+     * The textures may be shared with other nodes, and be part of an atlas
      */
-    FadingNode(QSGTexture *source, QSGTexture *target);
+    FadingNode(const QSharedPointer<QSGTexture> &source, const QSharedPointer<QSGTexture> &target);
     ~FadingNode();
 
     /**
@@ -43,8 +44,8 @@ public:
     void setProgress(qreal progress);
     void setRect(const QRectF &bounds);
 private:
-    QScopedPointer<QSGTexture> m_source;
-    QScopedPointer<QSGTexture> m_target;
+    QSharedPointer<QSGTexture> m_source;
+    QSharedPointer<QSGTexture> m_target;
 };
 
 #endif // PLASMAFADINGNODE_H
@@ -156,8 +156,10 @@ public:
 
             QString elementId = prefix + FrameSvgHelpers::borderToElementId(m_border);
 
-            //re-render the SVG at new size
-            updateTexture(nodeRect.size(), elementId);
+            //re-render the SVG at new size, the old texture gets stretched until the new one is rendered
+            if (!texture() || !m_frameSvg->frameSvg()->requestPixmap(nodeRect.size(), elementId)) {
+                updateTexture(nodeRect.size(), elementId);
+            }
             textureRect = texture()->normalizedTextureSubRect();
         } else if (texture()) { // for fast stretch.
             textureRect = texture()->normalizedTextureSubRect();
@@ -270,6 +272,7 @@ FrameSvgItem::FrameSvgItem(QQuickItem *parent)
     connect(&Units::instance(), &Units::devicePixelRatioChanged, this, &FrameSvgItem::updateDevicePixelRatio);
     connect(m_frameSvg, &Svg::fromCurrentThemeChanged, this, &FrameSvgItem::fromCurrentThemeChanged);
     connect(m_frameSvg, &Svg::statusChanged, this, &FrameSvgItem::statusChanged);
+    connect(m_frameSvg, &Svg::pixmapReady, this, &FrameSvgItem::pixmapReady);
 }
 
 FrameSvgItem::~FrameSvgItem()
@@ -498,6 +501,13 @@ void FrameSvgItem::doUpdate()
     emit repaintNeeded();
 }
 
+void FrameSvgItem::pixmapReady()
+{
+    //the stretched parts will pick the new rendering from the cache
+    m_sizeChanged = true;
+    update();
+}
+
 Plasma::FrameSvg *FrameSvgItem::frameSvg() const
 {
     return m_frameSvg;
@@ -248,6 +248,7 @@ Q_SIGNALS:
 private Q_SLOTS:
     void doUpdate();
     void updateDevicePixelRatio();
+    void pixmapReady();
 
 private:
     void applyPrefixes();
@@ -0,0 +1,260 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "iconcache_p.h"
+
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QStringBuilder>
+#include <QThread>
+
+#include <kiconeffect.h>
+
+#include <plasma/theme.h>
+
+class IconCacheSingleton
+{
+public:
+    IconCache self;
+};
+
+Q_GLOBAL_STATIC(IconCacheSingleton, privateIconCacheSelf)
+
+class IconDecodeJob : public QRunnable
+{
+public:
+    IconDecodeJob(IconCache *cache, const QString &key, const QString &path, const QSize &size,
+                  KIconLoader::States state)
+        : m_cache(cache),
+          m_key(key),
+          m_path(path),
+          m_size(size),
+          m_state(state)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        // the item may have gone, or want another size, by the time we get here
+        if (!m_cache->isRequested(m_key)) {
+            m_cache->addResult(m_key, QImage(), m_state, true);
+            return;
+        }
+
+        QImageReader reader(m_path);
+        const QSize imageSize = reader.size();
+        if (imageSize.isValid()) {
+            reader.setScaledSize(imageSize.scaled(m_size, Qt::KeepAspectRatio));
+        }
+        const QImage image = reader.read();
+
+        m_cache->addResult(m_key, image, m_state, false);
+    }
+
+private:
+    IconCache *m_cache;
+    QString m_key;
+    QString m_path;
+    QSize m_size;
+    KIconLoader::States m_state;
+};
+
+IconCache::IconCache()
+    : QObject(),
+      m_theme(new Plasma::Theme(this)),
+      m_generation(0),
+      m_hits(0),
+      m_misses(0)
+{
+    // icons get requested while the GUI thread is busy creating items
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    // the colors of the theme end up in the icons from the plasma theme
+    connect(m_theme, &Plasma::Theme::themeChanged, this, &IconCache::clear);
+    connect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged, this, &IconCache::clear);
+    connect(KIconLoader::global(), &KIconLoader::iconChanged, this, &IconCache::clear);
+}
+
+IconCache::~IconCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+IconCache *IconCache::self()
+{
+    return &privateIconCacheSelf()->self;
+}
+
+QString IconCache::key(const QString &id) const
+{
+    return QString::number(m_generation) % QLatin1Char('_') % id;
+}
+
+bool IconCache::acquire(const QString &key, Icon *icon)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    ++it->refs;
+    *icon = it->icon;
+    return true;
+}
+
+IconCache::Icon IconCache::insert(const QString &key, const QPixmap &pixmap)
+{
+    Entry &entry = m_entries[key];
+    if (entry.refs == 0) {
+        entry.icon.pixmap = pixmap;
+        // for raster pixmaps, the image shares the same data
+        entry.icon.image = pixmap.toImage();
+    }
+
+    ++entry.refs;
+    return entry.icon;
+}
+
+void IconCache::release(const QString &key)
+{
+    QHash<QString, Entry>::iterator it = m_entries.find(key);
+    if (it != m_entries.end() && --it->refs <= 0) {
+        m_entries.erase(it);
+    }
+}
+
+void IconCache::requestIcon(const QString &key, const QString &path, const QSize &size, KIconLoader::States state)
+{
+    QMutexLocker locker(&m_requestsMutex);
+    if (m_requests[key]++ > 0) {
+        return;
+    }
+    locker.unlock();
+
+    m_pool.start(new IconDecodeJob(this, key, path, size, state));
+}
+
+void IconCache::cancelRequest(const QString &key)
+{
+    QMutexLocker locker(&m_requestsMutex);
+    QHash<QString, int>::iterator it = m_requests.find(key);
+    if (it != m_requests.end() && --(*it) <= 0) {
+        m_requests.erase(it);
+    }
+}
+
+bool IconCache::isRequested(const QString &key) const
+{
+    QMutexLocker locker(&m_requestsMutex);
+    return m_requests.contains(key);
+}
+
+void IconCache::addResult(const QString &key, const QImage &image, KIconLoader::States state, bool skipped)
+{
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        m_results.append({key, image, state, skipped});
+    }
+
+    QMetaObject::invokeMethod(this, "flushResults", Qt::QueuedConnection);
+}
+
+void IconCache::flushResults()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        results.swap(m_results);
+    }
+
+    for (const Result &result : qAsConst(results)) {
+        // a cancelled request may have been made again in the meantime, with its own job
+        if (result.skipped) {
+            continue;
+        }
+
+        int waiting = 0;
+        {
+            QMutexLocker locker(&m_requestsMutex);
+            waiting = m_requests.take(result.key);
+        }
+
+        if (waiting <= 0) {
+            continue;
+        }
+
+        if (!result.image.isNull()) {
+            Entry &entry = m_entries[result.key];
+            if (entry.refs == 0) {
+                // the effect of the icon loader is shared with this thread, it can't be used from the pool
+                entry.icon.image = result.state == KIconLoader::DefaultState ? result.image :
+                                   KIconLoader::global()->iconEffect()->apply(result.image, KIconLoader::Desktop, result.state);
+                entry.icon.pixmap = QPixmap::fromImage(entry.icon.image);
+            }
+        }
+
+        emit iconReady(result.key, !result.image.isNull());
+
+        // the items waiting for it have acquired it by now, nobody else will
+        QHash<QString, Entry>::iterator it = m_entries.find(result.key);
+        if (it != m_entries.end() && it->refs <= 0) {
+            m_entries.erase(it);
+        }
+    }
+}
+
+QSharedPointer<QSGTexture> IconCache::texture(QQuickWindow *window, const QImage &image, QQuickWindow::CreateTextureOptions options)
+{
+    // windows may have their own render thread
+    QMutexLocker locker(&m_texturesMutex);
+    return m_textures.loadTexture(window, image, options);
+}
+
+int IconCache::count() const
+{
+    return m_entries.count();
+}
+
+int IconCache::references(const QString &key) const
+{
+    return m_entries.value(key).refs;
+}
+
+quint64 IconCache::hits() const
+{
+    return m_hits;
+}
+
+quint64 IconCache::misses() const
+{
+    return m_misses;
+}
+
+void IconCache::clear()
+{
+    // items still showing an old icon release it with an old key, which isn't found
+    ++m_generation;
+    m_entries.clear();
+}
+
+#include "moc_iconcache_p.cpp"
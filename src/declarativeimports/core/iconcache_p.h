@@ -0,0 +1,184 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ICONCACHE_P_H
+#define ICONCACHE_P_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QPixmap>
+#include <QQuickWindow>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+#include <kiconloader.h>
+
+#include <QuickAddons/ImageTexturesCache>
+
+namespace Plasma
+{
+class Theme;
+}
+
+/**
+ * Icons rendered by the IconItems of the process, shared between all the
+ * items showing the same icon at the same size and in the same state.
+ *
+ * Entries are reference counted: an item acquires the entry of the icon it
+ * shows, and releases it when it shows something else or goes away. Items
+ * sharing an entry share the same QImage, so they also share the same
+ * texture in every window.
+ *
+ * Icons can also be decoded in a thread pool, for the items loading
+ * their icons asynchronously.
+ *
+ * All the entries are dropped when the theme or the icon theme changes.
+ */
+class IconCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Icon {
+        QPixmap pixmap;
+        QImage image;
+    };
+
+    static IconCache *self();
+
+    /**
+     * @return the key of the cache entry for @p id, only valid until the themes change
+     */
+    QString key(const QString &id) const;
+
+    /**
+     * Looks up the entry with @p key and, if found, references it.
+     * @return whether the entry was found
+     */
+    bool acquire(const QString &key, Icon *icon);
+
+    /**
+     * Adds an entry, referenced once
+     * @return the icon as stored in the cache
+     */
+    Icon insert(const QString &key, const QPixmap &pixmap);
+
+    /**
+     * Releases a reference to the entry @p key, which is removed
+     * when it's no longer used
+     */
+    void release(const QString &key);
+
+    /**
+     * Decodes the image file @p path at @p size in a thread pool, applies
+     * the effect of @p state to it back in this thread, then adds it as the
+     * entry @p key and emits iconReady. The entry isn't referenced: the items
+     * waiting for it are expected to acquire it when they get iconReady, it
+     * is dropped right after if none did.
+     * Requests for an icon already being decoded are merged.
+     */
+    void requestIcon(const QString &key, const QString &path, const QSize &size, KIconLoader::States state);
+
+    /**
+     * Withdraws a request made with requestIcon, the icon isn't decoded
+     * if nobody else asked for it
+     */
+    void cancelRequest(const QString &key);
+
+    // called from the pool threads
+    bool isRequested(const QString &key) const;
+    void addResult(const QString &key, const QImage &image, KIconLoader::States state, bool skipped);
+
+    /**
+     * @return the texture of @p image for @p window, shared with the
+     * other items showing the same image in that window. Safe to call
+     * from the render thread.
+     */
+    QSharedPointer<QSGTexture> texture(QQuickWindow *window, const QImage &image, QQuickWindow::CreateTextureOptions options);
+
+    /**
+     * @return how many entries the cache holds
+     */
+    int count() const;
+
+    /**
+     * @return how many items reference the entry @p key, 0 if there's no such entry
+     */
+    int references(const QString &key) const;
+
+    /**
+     * @return how many times an icon was found in the cache
+     */
+    quint64 hits() const;
+
+    /**
+     * @return how many times an icon had to be rendered
+     */
+    quint64 misses() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when an icon requested with requestIcon has been added to the
+     * cache, or couldn't be decoded if @p success is false
+     */
+    void iconReady(const QString &key, bool success);
+
+private Q_SLOTS:
+    void clear();
+    void flushResults();
+
+private:
+    friend class IconCacheSingleton;
+    IconCache();
+    ~IconCache();
+
+    struct Entry {
+        Entry() : refs(0) {}
+
+        Icon icon;
+        int refs;
+    };
+
+    struct Result {
+        QString key;
+        QImage image;
+        KIconLoader::States state;
+        bool skipped;
+    };
+
+    QHash<QString, Entry> m_entries;
+    Plasma::Theme *m_theme;
+    // bumped when the themes change, keys of older generations never match
+    uint m_generation;
+    quint64 m_hits;
+    quint64 m_misses;
+    QMutex m_texturesMutex;
+    ImageTexturesCache m_textures;
+
+    QThreadPool m_pool;
+    // how many items wait for every requested icon
+    QHash<QString, int> m_requests;
+    mutable QMutex m_requestsMutex;
+    QList<Result> m_results;
+    QMutex m_resultsMutex;
+};
+
+#endif
@@ -26,12 +26,14 @@
 #include <QPixmap>
 #include <QSGSimpleTextureNode>
 #include <QQuickWindow>
+#include <QStringBuilder>
 
 #include <kiconloader.h>
 #include <kiconeffect.h>
 #include <KIconTheme>
 
 #include "fadingnode_p.h"
+#include "iconcache_p.h"
 #include <QuickAddons/ManagedTextureNode>
 #include "units.h"
 
@@ -44,6 +46,7 @@ IconItem::IconItem(QQuickItem *parent)
       m_animated(true),
       m_usesPlasmaTheme(true),
       m_roundToIconSize(true),
+      m_asynchronous(false),
       m_textureChanged(false),
       m_sizeChanged(false),
       m_allowNextAnimation(false),
@@ -78,6 +81,11 @@ IconItem::IconItem(QQuickItem *parent)
 
 IconItem::~IconItem()
 {
+    setPendingKey(QString());
+
+    if (!m_cacheKey.isEmpty()) {
+        IconCache::self()->release(m_cacheKey);
+    }
 }
 
 void IconItem::updateImplicitSize()
@@ -171,6 +179,7 @@ void IconItem::setSource(const QVariant &source)
                 m_svgIcon->setStatus(m_status);
                 m_svgIcon->setDevicePixelRatio((window() ? window()->devicePixelRatio() : qApp->devicePixelRatio()));
                 connect(m_svgIcon, &Plasma::Svg::repaintNeeded, this, &IconItem::schedulePixmapUpdate);
+                connect(m_svgIcon, &Plasma::Svg::pixmapReady, this, &IconItem::svgPixmapReady);
             }
 
             if (m_usesPlasmaTheme) {
@@ -235,6 +244,14 @@ void IconItem::setSource(const QVariant &source)
         m_svgIcon = 0;
     }
 
+    if (m_asynchronous) {
+        //don't show the previous source while the new one loads
+        setPendingKey(QString());
+        setIconPixmap(QPixmap(), QImage(), QString());
+        m_animation->stop();
+        update();
+    }
+
     if (width() > 0 && height() > 0) {
         schedulePixmapUpdate();
     }
@@ -384,6 +401,27 @@ void IconItem::setRoundToIconSize(bool roundToIconSize)
     schedulePixmapUpdate();
 }
 
+bool IconItem::isAsynchronous() const
+{
+    return m_asynchronous;
+}
+
+void IconItem::setAsynchronous(bool asynchronous)
+{
+    if (m_asynchronous == asynchronous) {
+        return;
+    }
+
+    m_asynchronous = asynchronous;
+    emit asynchronousChanged();
+
+    if (!m_asynchronous && (!m_pendingKey.isEmpty() || m_pendingSvgSize.isValid())) {
+        //load what is still pending right away
+        setPendingKey(QString());
+        schedulePixmapUpdate();
+    }
+}
+
 bool IconItem::isValid() const
 {
     return !m_icon.isNull() || m_svgIcon || !m_imageIcon.isNull();
@@ -472,6 +510,7 @@ QSGNode* IconItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *update
 
     if (m_iconPixmap.isNull() || width() == 0 || height() == 0) {
         delete oldNode;
+        m_texture.clear();
         return nullptr;
     }
 
@@ -481,9 +520,11 @@ QSGNode* IconItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *update
         if (!animatingNode || m_textureChanged) {
             delete oldNode;
 
-            QSGTexture *source = window()->createTextureFromImage(m_iconPixmap.toImage());
-            QSGTexture *target = window()->createTextureFromImage(m_oldIconPixmap.toImage());
+            //both icons are usually shown by other items as well
+            const QSharedPointer<QSGTexture> source = IconCache::self()->texture(window(), m_iconImage, QQuickWindow::TextureCanUseAtlas);
+            const QSharedPointer<QSGTexture> target = IconCache::self()->texture(window(), m_oldIconImage, QQuickWindow::TextureCanUseAtlas);
             animatingNode = new FadingNode(source, target);
+            m_texture = source;
             m_sizeChanged = true;
             m_textureChanged = false;
         }
@@ -505,7 +546,9 @@ QSGNode* IconItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *update
             delete oldNode;
             textureNode = new ManagedTextureNode;
             textureNode->setFiltering(m_smooth ? QSGTexture::Linear : QSGTexture::Nearest);
-            textureNode->setTexture(QSharedPointer<QSGTexture>(window()->createTextureFromImage(m_iconPixmap.toImage(), QQuickWindow::TextureCanUseAtlas)));
+            const QSharedPointer<QSGTexture> texture = IconCache::self()->texture(window(), m_iconImage, QQuickWindow::TextureCanUseAtlas);
+            textureNode->setTexture(texture);
+            m_texture = texture;
             m_sizeChanged = true;
             m_textureChanged = false;
         }
@@ -535,6 +578,7 @@ void IconItem::onEnabledChanged()
 void IconItem::animationFinished()
 {
     m_oldIconPixmap = QPixmap();
+    m_oldIconImage = QImage();
     m_textureChanged = true;
     update();
 }
@@ -555,18 +599,19 @@ void IconItem::loadPixmap()
         size = Units::roundToIconSize(size);
     }
 
-    //final pixmap to paint
-    QPixmap result;
+    const qreal devicePixelRatio = window() ? window()->devicePixelRatio() : qApp->devicePixelRatio();
+
+    //what is going to be painted, to look for it in the cache
+    QString id;
     if (size <= 0) {
-        m_iconPixmap = QPixmap();
+        setPendingKey(QString());
+        setIconPixmap(QPixmap(), QImage(), QString());
         m_animation->stop();
         update();
         return;
     } else if (m_svgIcon) {
         m_svgIcon->resize(size, size);
-        if (!m_svgIconName.isEmpty() && m_svgIcon->hasElement(m_svgIconName)) {
-            result = m_svgIcon->pixmap(m_svgIconName);
-        } else if (!m_svgIconName.isEmpty()) {
+        if (!m_svgIconName.isEmpty() && !m_svgIcon->hasElement(m_svgIconName)) {
             const auto *iconTheme = KIconLoader::global()->theme();
             if (iconTheme) {
                 QString iconPath = iconTheme->iconPath(m_svgIconName + QLatin1String(".svg"), size, KIconLoader::MatchBest);
@@ -580,44 +625,94 @@ void IconItem::loadPixmap()
             } else {
                 qWarning() << "KIconLoader has no theme set";
             }
-
-            result = m_svgIcon->pixmap();
+        }
+        if (!m_svgIconName.isEmpty()) {
+            id = QLatin1String("svg:") % m_svgIcon->imagePath() % QLatin1Char(':') % m_svgIconName %
+                 QLatin1Char(':') % QString::number(m_colorGroup) % QLatin1Char(':') % QString::number(m_status);
         }
     } else if (!m_icon.isNull()) {
-        result = m_icon.pixmap(QSize(size, size) * (window() ? window()->devicePixelRatio() : qApp->devicePixelRatio()));
+        //only icons from the icon theme are known to be the same
+        if (!m_icon.name().isEmpty()) {
+            //icons decoded asynchronously don't go through KIconLoader, don't mix them up
+            id = (m_asynchronous ? QLatin1String("asyncicon:") : QLatin1String("icon:")) % m_icon.name();
+        }
     } else if (!m_imageIcon.isNull()) {
-        result = QPixmap::fromImage(m_imageIcon);
+        //copies of the same image have the same cacheKey
+        id = QLatin1String("image:") % QString::number(m_imageIcon.cacheKey());
     } else {
-        m_iconPixmap = QPixmap();
+        setPendingKey(QString());
+        setIconPixmap(QPixmap(), QImage(), QString());
         m_animation->stop();
         update();
         return;
     }
 
-    // Strangely KFileItem::overlays() returns empty string-values, so
-    // we need to check first whether an overlay must be drawn at all.
-    // It is more efficient to do it here, as KIconLoader::drawOverlays()
-    // assumes that an overlay will be drawn and has some additional
-    // setup time.
-    foreach (const QString& overlay, m_overlays) {
-        if (!overlay.isEmpty()) {
-            // There is at least one overlay, draw all overlays above m_pixmap
-            // and cancel the check
-            KIconLoader::global()->drawOverlays(m_overlays, result, KIconLoader::Desktop);
-            break;
-        }
+    QString cacheKey;
+    IconCache::Icon icon;
+    bool cached = false;
+    if (!id.isEmpty()) {
+        const QString state = !isEnabled() ? QStringLiteral("disabled") : (m_active ? QStringLiteral("active") : QStringLiteral("normal"));
+        cacheKey = IconCache::self()->key(id % QLatin1Char(':') % QString::number(size) % QLatin1Char('@') % QString::number(devicePixelRatio) %
+                                          QLatin1Char(':') % state % QLatin1Char(':') % m_overlays.join(QLatin1Char(',')));
+        cached = IconCache::self()->acquire(cacheKey, &icon);
     }
 
-    if (!isEnabled()) {
-        result = KIconLoader::global()->iconEffect()->apply(result, KIconLoader::Desktop, KIconLoader::DisabledState);
-    } else if (m_active) {
-        result = KIconLoader::global()->iconEffect()->apply(result, KIconLoader::Desktop, KIconLoader::ActiveState);
+    if (!cached) {
+        //keep what is currently shown until the icon is ready
+        if (m_asynchronous && requestAsyncLoad(cacheKey, size, devicePixelRatio)) {
+            return;
+        }
+
+        //final pixmap to paint
+        QPixmap result;
+        if (m_svgIcon) {
+            if (!m_svgIconName.isEmpty() && m_svgIcon->hasElement(m_svgIconName)) {
+                result = m_svgIcon->pixmap(m_svgIconName);
+            } else if (!m_svgIconName.isEmpty()) {
+                result = m_svgIcon->pixmap();
+            }
+        } else if (!m_icon.isNull()) {
+            result = m_icon.pixmap(QSize(size, size) * devicePixelRatio);
+        } else {
+            result = QPixmap::fromImage(m_imageIcon);
+        }
+
+        // Strangely KFileItem::overlays() returns empty string-values, so
+        // we need to check first whether an overlay must be drawn at all.
+        // It is more efficient to do it here, as KIconLoader::drawOverlays()
+        // assumes that an overlay will be drawn and has some additional
+        // setup time.
+        foreach (const QString& overlay, m_overlays) {
+            if (!overlay.isEmpty()) {
+                // There is at least one overlay, draw all overlays above m_pixmap
+                // and cancel the check
+                KIconLoader::global()->drawOverlays(m_overlays, result, KIconLoader::Desktop);
+                break;
+            }
+        }
+
+        if (!isEnabled()) {
+            result = KIconLoader::global()->iconEffect()->apply(result, KIconLoader::Desktop, KIconLoader::DisabledState);
+        } else if (m_active) {
+            result = KIconLoader::global()->iconEffect()->apply(result, KIconLoader::Desktop, KIconLoader::ActiveState);
+        }
+
+        if (cacheKey.isEmpty() || result.isNull()) {
+            cacheKey.clear();
+            icon.pixmap = result;
+            icon.image = result.toImage();
+        } else {
+            icon = IconCache::self()->insert(cacheKey, result);
+        }
     }
 
+    setPendingKey(QString());
+
     const QSize oldPaintedSize = paintedSize();
 
     m_oldIconPixmap = m_iconPixmap;
-    m_iconPixmap = result;
+    m_oldIconImage = m_iconImage;
+    setIconPixmap(icon.pixmap, icon.image, cacheKey);
     m_textureChanged = true;
 
     if (oldPaintedSize != paintedSize()) {
@@ -647,6 +742,141 @@ void IconItem::loadPixmap()
     update();
 }
 
+void IconItem::setIconPixmap(const QPixmap &pixmap, const QImage &image, const QString &cacheKey)
+{
+    //the new entry has already been acquired, in case it's the same
+    if (!m_cacheKey.isEmpty()) {
+        IconCache::self()->release(m_cacheKey);
+    }
+
+    m_iconPixmap = pixmap;
+    m_iconImage = image;
+    m_cacheKey = cacheKey;
+}
+
+bool IconItem::requestAsyncLoad(const QString &cacheKey, int size, qreal devicePixelRatio)
+{
+    //overlays are drawn by KIconLoader, which can only be used from this thread
+    for (const QString &overlay : qAsConst(m_overlays)) {
+        if (!overlay.isEmpty()) {
+            return false;
+        }
+    }
+
+    if (m_svgIcon) {
+        if (m_svgIconName.isEmpty()) {
+            return false;
+        }
+
+        const QSize svgSize(size, size);
+        bool requested = false;
+        if (m_svgIcon->hasElement(m_svgIconName)) {
+            //single elements are rendered at their natural size
+            if (!m_svgIcon->containsMultipleImages()) {
+                return false;
+            }
+            requested = m_svgIcon->requestPixmap(svgSize, m_svgIconName);
+        } else {
+            requested = m_svgIcon->requestPixmap(svgSize);
+        }
+
+        setPendingKey(QString());
+        if (requested) {
+            m_pendingSvgSize = svgSize;
+        }
+        return requested;
+    }
+
+    //only icons of the icon theme are known to be files we can decode ourselves
+    if (m_icon.isNull() || m_icon.name().isEmpty() || cacheKey.isEmpty() || cacheKey == m_failedKey) {
+        return false;
+    }
+
+    if (cacheKey == m_pendingKey) {
+        return true;
+    }
+
+    const QString path = KIconLoader::global()->iconPath(m_icon.name(), -qRound(size * devicePixelRatio), true);
+    if (path.isEmpty()) {
+        return false;
+    }
+
+    KIconLoader::States state = KIconLoader::DefaultState;
+    if (!isEnabled()) {
+        state = KIconLoader::DisabledState;
+    } else if (m_active) {
+        state = KIconLoader::ActiveState;
+    }
+
+    setPendingKey(cacheKey);
+    IconCache::self()->requestIcon(cacheKey, path, QSize(size, size) * devicePixelRatio, state);
+    return true;
+}
+
+void IconItem::setPendingKey(const QString &key)
+{
+    m_pendingSvgSize = QSize();
+
+    if (key == m_pendingKey) {
+        return;
+    }
+
+    if (!m_pendingKey.isEmpty()) {
+        IconCache::self()->cancelRequest(m_pendingKey);
+    }
+
+    if (m_pendingKey.isEmpty()) {
+        connect(IconCache::self(), &IconCache::iconReady, this, &IconItem::iconReady);
+    } else if (key.isEmpty()) {
+        disconnect(IconCache::self(), &IconCache::iconReady, this, &IconItem::iconReady);
+    }
+
+    m_pendingKey = key;
+}
+
+void IconItem::svgPixmapReady(const QString &elementId, const QSize &size)
+{
+    Q_UNUSED(elementId)
+
+    if (size == m_pendingSvgSize) {
+        m_pendingSvgSize = QSize();
+        schedulePixmapUpdate();
+    }
+}
+
+void IconItem::iconReady(const QString &key, bool success)
+{
+    if (key != m_pendingKey) {
+        return;
+    }
+
+    if (!success) {
+        m_failedKey = key;
+    }
+
+    //the request is already done with, it must not be cancelled anymore
+    disconnect(IconCache::self(), &IconCache::iconReady, this, &IconItem::iconReady);
+    m_pendingKey.clear();
+
+    //the entry isn't referenced by anyone yet, take it before it goes away
+    loadPixmap();
+}
+
+QVariantMap IconItem::iconCacheStatistics() const
+{
+    QVariantMap statistics;
+    statistics[QStringLiteral("hits")] = IconCache::self()->hits();
+    statistics[QStringLiteral("misses")] = IconCache::self()->misses();
+    statistics[QStringLiteral("entries")] = IconCache::self()->count();
+    statistics[QStringLiteral("cacheKey")] = m_cacheKey;
+    statistics[QStringLiteral("pendingKey")] = m_pendingKey;
+    statistics[QStringLiteral("failedKey")] = m_failedKey;
+    statistics[QStringLiteral("references")] = m_cacheKey.isEmpty() ? 0 : IconCache::self()->references(m_cacheKey);
+    statistics[QStringLiteral("imageCacheKey")] = m_iconImage.cacheKey();
+    statistics[QStringLiteral("texture")] = qulonglong(quintptr(m_texture.data()));
+    return statistics;
+}
+
 void IconItem::itemChange(ItemChange change, const ItemChangeData &value)
 {
     if (change == ItemVisibleHasChanged && value.boolValue) {
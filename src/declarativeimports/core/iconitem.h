@@ -24,12 +24,14 @@
 #include <QIcon>
 #include <QQuickItem>
 #include <QPixmap>
+#include <QSharedPointer>
 #include <QVariant>
 #include <QTimer>
 
 #include <plasma/svg.h>
 
 class QPropertyAnimation;
+class QSGTexture;
 
 /**
  * @class IconItem
@@ -102,6 +104,15 @@ class IconItem : public QQuickItem
      */
     Q_PROPERTY(bool roundToIconSize READ roundToIconSize WRITE setRoundToIconSize NOTIFY roundToIconSizeChanged)
 
+    /**
+     * If set, icons that still have to be rendered are decoded and rendered
+     * in a separate thread, the item showing nothing (or the previous icon,
+     * when resized) until they're ready. Icons with overlays are always
+     * rendered right away. Default is false.
+     * @since 5.44
+     */
+    Q_PROPERTY(bool asynchronous READ isAsynchronous WRITE setAsynchronous NOTIFY asynchronousChanged)
+
     /**
      * True if a valid icon is set. False otherwise.
      */
@@ -151,6 +162,9 @@ public:
     bool roundToIconSize() const;
     void setRoundToIconSize(bool roundToIconSize);
 
+    bool isAsynchronous() const;
+    void setAsynchronous(bool asynchronous);
+
     bool isValid() const;
 
     int paintedWidth() const;
@@ -179,6 +193,7 @@ Q_SIGNALS:
     void animatedChanged();
     void usesPlasmaThemeChanged();
     void roundToIconSizeChanged();
+    void asynchronousChanged();
     void validChanged();
     void colorGroupChanged();
     void paintedSizeChanged();
@@ -191,9 +206,16 @@ private Q_SLOTS:
     void animationFinished();
     void valueChanged(const QVariant &value);
     void onEnabledChanged();
+    void svgPixmapReady(const QString &elementId, const QSize &size);
+    void iconReady(const QString &key, bool success);
+    //how the item uses the IconCache, for the autotests
+    QVariantMap iconCacheStatistics() const;
 
 private:
     void loadPixmap();
+    void setIconPixmap(const QPixmap &pixmap, const QImage &image, const QString &cacheKey);
+    bool requestAsyncLoad(const QString &cacheKey, int size, qreal devicePixelRatio);
+    void setPendingKey(const QString &key);
     QSize paintedSize(const QSizeF &containerSize = QSizeF()) const;
     void updateImplicitSize();
 
@@ -214,6 +236,7 @@ private:
     bool m_animated;
     bool m_usesPlasmaTheme;
     bool m_roundToIconSize;
+    bool m_asynchronous;
 
     bool m_textureChanged;
     bool m_sizeChanged;
@@ -224,6 +247,19 @@ private:
 
     QPixmap m_iconPixmap;
     QPixmap m_oldIconPixmap;
+    QImage m_oldIconImage;
+    //same data as m_iconPixmap, shared with the other items showing the same icon
+    QImage m_iconImage;
+    //entry of m_iconPixmap in the IconCache, if any
+    QString m_cacheKey;
+    //icon being decoded by the IconCache
+    QString m_pendingKey;
+    //icon the IconCache failed to decode, to be loaded synchronously
+    QString m_failedKey;
+    //texture painted in the last frame, set from the render thread
+    QWeakPointer<QSGTexture> m_texture;
+    //size the svg is being rendered at
+    QSize m_pendingSvgSize;
 
     QStringList m_overlays;
 
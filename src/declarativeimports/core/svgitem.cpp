@@ -61,6 +61,7 @@ void SvgItem::setElementId(const QString &elementID)
     }
 
     m_elementID = elementID;
+    m_image = QImage();
     emit elementIdChanged();
     emit naturalSizeChanged();
 
@@ -89,12 +90,14 @@ void SvgItem::setSvg(Plasma::Svg *svg)
         disconnect(m_svg.data(), 0, this, 0);
     }
     m_svg = svg;
+    m_image = QImage();
     updateDevicePixelRatio();
 
     if (svg) {
         connect(svg, &Svg::repaintNeeded, this, &SvgItem::updateNeeded);
         connect(svg, &Svg::repaintNeeded, this, &SvgItem::naturalSizeChanged);
         connect(svg, &Svg::sizeChanged, this, &SvgItem::naturalSizeChanged);
+        connect(svg, &Svg::pixmapReady, this, &SvgItem::pixmapReady);
     }
 
     if (implicitWidth() <= 0) {
@@ -187,6 +190,19 @@ void SvgItem::updateNeeded()
     scheduleImageUpdate();
 }
 
+void SvgItem::pixmapReady(const QString &elementId, const QSize &size)
+{
+    //the Svg only reports renderings still matching its device pixel ratio and colors
+    if (elementId != m_elementID || size != m_pendingSize) {
+        return;
+    }
+
+    m_pendingSize = QSize();
+    m_textureChanged = true;
+    m_image = m_svg.data()->image(size, m_elementID);
+    update();
+}
+
 void SvgItem::updateDevicePixelRatio()
 {
     if (m_svg) {
@@ -213,9 +229,18 @@ void SvgItem::updatePolish()
 
     if (m_svg) {
         //setContainsMultipleImages has to be done there since m_frameSvg can be shared with somebody else
-        m_textureChanged = true;
         m_svg.data()->setContainsMultipleImages(!m_elementID.isEmpty());
-        m_image = m_svg.data()->image(QSize(width(), height()), m_elementID);
+
+        //while resizing keep showing the last image until the new one gets rendered
+        const QSize size(width(), height());
+        if (!m_image.isNull() && m_svg.data()->requestPixmap(size, m_elementID)) {
+            m_pendingSize = size;
+            return;
+        }
+
+        m_pendingSize = QSize();
+        m_textureChanged = true;
+        m_image = m_svg.data()->image(size, m_elementID);
     }
 }
 
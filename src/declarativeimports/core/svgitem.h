@@ -95,6 +95,7 @@ protected Q_SLOTS:
 /// @cond INTERNAL_DOCS
     void updateNeeded();
     void updateDevicePixelRatio();
+    void pixmapReady(const QString &elementId, const QSize &size);
 /// @endcond
 
 private:
@@ -107,6 +108,8 @@ private:
     bool m_smooth;
     bool m_textureChanged;
     QImage m_image;
+    //size of the rendering requested to the svg, the current image is kept meanwhile
+    QSize m_pendingSize;
 };
 }
 
@@ -20,11 +20,16 @@
 // KF5
 #include <kwindowsystem.h>
 // Qt
+#include <QAbstractNativeEventFilter>
 #include <QGuiApplication>
+#include <QHash>
 #include <QIcon>
 #include <QOpenGLContext>
 #include <QQuickWindow>
 #include <QRunnable>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
 
 // X11
 #if HAVE_XCB_COMPOSITE
@@ -112,6 +117,216 @@ void DiscardEglPixmapRunnable::run()
     }
 }
 #endif//HAVE_EGL
+
+/**
+ * Single native event filter for all the WindowThumbnails of the process,
+ * handing the events of a window to the thumbnails showing it.
+ *
+ * The redirection, the damage object and the pixmap of a window are shared
+ * by all its thumbnails, and damage is coalesced into one update of the
+ * thumbnails per pass of the event loop.
+ *
+ * The GLX pixmap or EGL image of the window and its texture stay per
+ * thumbnail: they belong to the GL context of the render thread of the
+ * QQuickWindow the thumbnail is in, and are created, bound and released
+ * from there, while the dispatcher only runs in the GUI thread.
+ */
+class WindowThumbnailDispatcher : public QAbstractNativeEventFilter
+{
+public:
+    WindowThumbnailDispatcher();
+
+    bool isComposite() const;
+    void registerThumbnail(WindowThumbnail *thumbnail, xcb_window_t winId);
+    void unregisterThumbnail(WindowThumbnail *thumbnail, xcb_window_t winId);
+    xcb_pixmap_t pixmap(xcb_window_t winId);
+
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long int *result) Q_DECL_OVERRIDE;
+
+private:
+    struct WindowData {
+        WindowData() : damage(XCB_NONE), pixmap(XCB_PIXMAP_NONE) {}
+
+        QVector<WindowThumbnail *> thumbnails;
+        xcb_damage_damage_t damage;
+        xcb_pixmap_t pixmap;
+    };
+
+    void flushDamage();
+
+    bool m_composite;
+    uint8_t m_damageEventBase;
+    QHash<xcb_window_t, WindowData> m_windows;
+    QSet<xcb_window_t> m_damagedWindows;
+    QTimer m_flushTimer;
+};
+
+Q_GLOBAL_STATIC(WindowThumbnailDispatcher, s_dispatcher)
+
+WindowThumbnailDispatcher::WindowThumbnailDispatcher()
+    : QAbstractNativeEventFilter(),
+      m_composite(false),
+      m_damageEventBase(0)
+{
+    xcb_connection_t *c = QX11Info::connection();
+    xcb_prefetch_extension_data(c, &xcb_composite_id);
+    const auto *compositeReply = xcb_get_extension_data(c, &xcb_composite_id);
+    m_composite = (compositeReply && compositeReply->present);
+
+    xcb_prefetch_extension_data(c, &xcb_damage_id);
+    const auto *reply = xcb_get_extension_data(c, &xcb_damage_id);
+    m_damageEventBase = reply->first_event;
+    if (reply->present) {
+        xcb_damage_query_version_unchecked(c, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+    }
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    QObject::connect(&m_flushTimer, &QTimer::timeout, [this]() {
+        flushDamage();
+    });
+
+    if (m_composite) {
+        QCoreApplication::instance()->installNativeEventFilter(this);
+    }
+}
+
+bool WindowThumbnailDispatcher::isComposite() const
+{
+    return m_composite;
+}
+
+void WindowThumbnailDispatcher::registerThumbnail(WindowThumbnail *thumbnail, xcb_window_t winId)
+{
+    WindowData &window = m_windows[winId];
+    if (window.thumbnails.contains(thumbnail)) {
+        return;
+    }
+    window.thumbnails.append(thumbnail);
+    if (window.thumbnails.count() > 1) {
+        return;
+    }
+
+    xcb_connection_t *c = QX11Info::connection();
+
+    // need to get the window attributes for the existing event mask
+    const auto attribsCookie = xcb_get_window_attributes_unchecked(c, winId);
+
+    // redirect the window
+    xcb_composite_redirect_window(c, winId, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+
+    // generate the damage handle
+    window.damage = xcb_generate_id(c);
+    xcb_damage_create(c, window.damage, winId, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+    QScopedPointer<xcb_get_window_attributes_reply_t, QScopedPointerPodDeleter> attr(xcb_get_window_attributes_reply(c, attribsCookie, nullptr));
+    uint32_t events = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    if (!attr.isNull()) {
+        events = events | attr->your_event_mask;
+    }
+    // the event mask will not be removed again. We cannot track whether another component also needs STRUCTURE_NOTIFY (e.g. KWindowSystem).
+    // if we would remove the event mask again, other areas will break.
+    xcb_change_window_attributes(c, winId, XCB_CW_EVENT_MASK, &events);
+}
+
+void WindowThumbnailDispatcher::unregisterThumbnail(WindowThumbnail *thumbnail, xcb_window_t winId)
+{
+    auto it = m_windows.find(winId);
+    if (it == m_windows.end() || !it->thumbnails.removeOne(thumbnail) || !it->thumbnails.isEmpty()) {
+        return;
+    }
+
+    // the last thumbnail of the window is gone
+    xcb_connection_t *c = QX11Info::connection();
+    if (it->pixmap != XCB_PIXMAP_NONE) {
+        xcb_free_pixmap(c, it->pixmap);
+    }
+    xcb_composite_unredirect_window(c, winId, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    xcb_damage_destroy(c, it->damage);
+
+    m_windows.erase(it);
+    m_damagedWindows.remove(winId);
+}
+
+xcb_pixmap_t WindowThumbnailDispatcher::pixmap(xcb_window_t winId)
+{
+    auto it = m_windows.find(winId);
+    if (it == m_windows.end()) {
+        return XCB_PIXMAP_NONE;
+    }
+
+    if (it->pixmap == XCB_PIXMAP_NONE) {
+        xcb_connection_t *c = QX11Info::connection();
+        xcb_pixmap_t pix = xcb_generate_id(c);
+        auto cookie = xcb_composite_name_window_pixmap_checked(c, winId, pix);
+        QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> error(xcb_request_check(c, cookie));
+        if (error) {
+            return XCB_PIXMAP_NONE;
+        }
+        it->pixmap = pix;
+    }
+
+    return it->pixmap;
+}
+
+bool WindowThumbnailDispatcher::nativeEventFilter(const QByteArray &eventType, void *message, long int *result)
+{
+    Q_UNUSED(result)
+    if (eventType != QByteArrayLiteral("xcb_generic_event_t")) {
+        // currently we are only interested in XCB events
+        return false;
+    }
+
+    xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
+    const uint8_t responseType = event->response_type & ~0x80;
+    xcb_window_t winId = XCB_WINDOW_NONE;
+    if (responseType == m_damageEventBase + XCB_DAMAGE_NOTIFY) {
+        winId = reinterpret_cast<xcb_damage_notify_event_t *>(event)->drawable;
+        if (m_windows.contains(winId)) {
+            m_damagedWindows.insert(winId);
+            if (!m_flushTimer.isActive()) {
+                m_flushTimer.start();
+            }
+        }
+        return false;
+    } else if (responseType == XCB_CONFIGURE_NOTIFY) {
+        winId = reinterpret_cast<xcb_configure_notify_event_t *>(event)->window;
+    } else if (responseType == XCB_MAP_NOTIFY) {
+        winId = reinterpret_cast<xcb_map_notify_event_t *>(event)->window;
+    } else {
+        return false;
+    }
+
+    auto it = m_windows.constFind(winId);
+    if (it != m_windows.constEnd()) {
+        // the list may change while the thumbnails handle it
+        const QVector<WindowThumbnail *> thumbnails = it->thumbnails;
+        for (WindowThumbnail *thumbnail : thumbnails) {
+            thumbnail->windowReconfigured();
+        }
+    }
+
+    // do not filter out any events, other components may be interested in them
+    return false;
+}
+
+void WindowThumbnailDispatcher::flushDamage()
+{
+    xcb_connection_t *c = QX11Info::connection();
+    for (xcb_window_t winId : qAsConst(m_damagedWindows)) {
+        auto it = m_windows.constFind(winId);
+        if (it == m_windows.constEnd()) {
+            continue;
+        }
+
+        // report the damage happening from now on, once for all the thumbnails
+        xcb_damage_subtract(c, it->damage, XCB_NONE, XCB_NONE);
+        for (WindowThumbnail *thumbnail : it->thumbnails) {
+            thumbnail->windowDamaged();
+        }
+    }
+    m_damagedWindows.clear();
+}
 #endif //HAVE_XCB_COMPOSITE
 
 WindowTextureNode::WindowTextureNode()
@@ -131,7 +346,6 @@ void WindowTextureNode::reset(QSGTexture *texture)
 
 WindowThumbnail::WindowThumbnail(QQuickItem *parent)
     : QQuickItem(parent)
-    , QAbstractNativeEventFilter()
     , m_xcb(false)
     , m_composite(false)
     , m_winId(0)
@@ -139,10 +353,16 @@ WindowThumbnail::WindowThumbnail(QQuickItem *parent)
     , m_thumbnailAvailable(false)
     , m_damaged(false)
     , m_depth(0)
+    , m_live(true)
+    , m_maximumUpdateRate(0)
+    , m_damagePending(false)
+    , m_binds(0)
+    , m_damageEvents(0)
+    , m_bindsPerSecond(0)
+    , m_damagePerSecond(0)
 #if HAVE_XCB_COMPOSITE
     , m_openGLFunctionsResolved(false)
-    , m_damageEventBase(0)
-    , m_damage(XCB_NONE)
+    , m_redirecting(false)
     , m_pixmap(XCB_PIXMAP_NONE)
     , m_texture(0)
 #if HAVE_GLX
@@ -160,10 +380,20 @@ WindowThumbnail::WindowThumbnail(QQuickItem *parent)
 #endif
 {
     setFlag(ItemHasContents);
+    m_updateTimer.setSingleShot(true);
+    connect(&m_updateTimer, &QTimer::timeout, this, &WindowThumbnail::applyDamage);
+    m_statisticsTimer.setInterval(1000);
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &WindowThumbnail::updateStatistics);
     connect(this, &QQuickItem::windowChanged, [this](QQuickWindow * window) {
         if (!window) {
             return;
         }
+        // damage is kept for later while the window is hidden
+        connect(window, &QWindow::visibleChanged, this, [this, window](bool visible) {
+            if (visible && window == this->window() && m_damagePending) {
+                scheduleUpdate();
+            }
+        });
         // restart the redirection, it might not have been active yet
         stopRedirecting();
         startRedirecting();
@@ -189,29 +419,17 @@ WindowThumbnail::WindowThumbnail(QQuickItem *parent)
     });
     if (QGuiApplication *gui = dynamic_cast<QGuiApplication *>(QCoreApplication::instance())) {
         m_xcb = (gui->platformName() == QStringLiteral("xcb"));
-        if (m_xcb) {
-            gui->installNativeEventFilter(this);
 #if HAVE_XCB_COMPOSITE
-            xcb_connection_t *c = QX11Info::connection();
-            xcb_prefetch_extension_data(c, &xcb_composite_id);
-            const auto *compositeReply = xcb_get_extension_data(c, &xcb_composite_id);
-            m_composite = (compositeReply && compositeReply->present);
-
-            xcb_prefetch_extension_data(c, &xcb_damage_id);
-            const auto *reply = xcb_get_extension_data(c, &xcb_damage_id);
-            m_damageEventBase = reply->first_event;
-            if (reply->present) {
-                xcb_damage_query_version_unchecked(c, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
-            }
-#endif
+        if (m_xcb) {
+            m_composite = s_dispatcher->isComposite();
         }
+#endif
     }
 }
 
 WindowThumbnail::~WindowThumbnail()
 {
     if (m_xcb) {
-        QCoreApplication::instance()->removeNativeEventFilter(this);
         stopRedirecting();
     }
 }
@@ -301,6 +519,62 @@ bool WindowThumbnail::thumbnailAvailable() const
     return m_thumbnailAvailable;
 }
 
+bool WindowThumbnail::isLive() const
+{
+    return m_live;
+}
+
+void WindowThumbnail::setLive(bool live)
+{
+    if (m_live == live) {
+        return;
+    }
+    m_live = live;
+    emit liveChanged();
+
+    if (m_live) {
+        // catch up with what happened to the window in the meantime
+        scheduleUpdate();
+    }
+}
+
+int WindowThumbnail::maximumUpdateRate() const
+{
+    return m_maximumUpdateRate;
+}
+
+void WindowThumbnail::setMaximumUpdateRate(int rate)
+{
+    rate = qMax(0, rate);
+    if (m_maximumUpdateRate == rate) {
+        return;
+    }
+    m_maximumUpdateRate = rate;
+    emit maximumUpdateRateChanged();
+
+    if (m_updateTimer.isActive()) {
+        m_updateTimer.stop();
+        scheduleUpdate();
+    }
+}
+
+int WindowThumbnail::bindsPerSecond() const
+{
+    return m_bindsPerSecond;
+}
+
+int WindowThumbnail::damagePerSecond() const
+{
+    return m_damagePerSecond;
+}
+
+void WindowThumbnail::refresh()
+{
+    m_updateTimer.stop();
+    m_damagePending = true;
+    applyDamage();
+}
+
 QSGNode *WindowThumbnail::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData)
 {
     Q_UNUSED(updatePaintNodeData)
@@ -326,39 +600,66 @@ QSGNode *WindowThumbnail::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData
     return node;
 }
 
-bool WindowThumbnail::nativeEventFilter(const QByteArray &eventType, void *message, long int *result)
+void WindowThumbnail::windowDamaged()
 {
-    Q_UNUSED(result)
-    if (!m_xcb || !m_composite || eventType != QByteArrayLiteral("xcb_generic_event_t")) {
-        // currently we are only interested in XCB events
-        return false;
+    ++m_damageEvents;
+
+    // a snapshot only gets updated when refreshed
+    if (!m_live && m_thumbnailAvailable) {
+        return;
     }
-#if HAVE_XCB_COMPOSITE
-    xcb_generic_event_t *event = static_cast<xcb_generic_event_t *>(message);
-    const uint8_t responseType = event->response_type & ~0x80;
-    if (responseType == m_damageEventBase + XCB_DAMAGE_NOTIFY) {
-        if (reinterpret_cast<xcb_damage_notify_event_t *>(event)->drawable == m_winId) {
-            m_damaged = true;
-            update();
-        }
-    } else if (responseType == XCB_CONFIGURE_NOTIFY) {
-        if (reinterpret_cast<xcb_configure_notify_event_t *>(event)->window == m_winId) {
-            releaseResources();
-            m_damaged = true;
-            update();
-        }
-    } else if (responseType == XCB_MAP_NOTIFY) {
-        if (reinterpret_cast<xcb_configure_notify_event_t *>(event)->window == m_winId) {
-            releaseResources();
-            m_damaged = true;
-            update();
+    scheduleUpdate();
+}
+
+void WindowThumbnail::scheduleUpdate()
+{
+    m_damagePending = true;
+
+    // nobody would see it, wait for the window to be shown again
+    if (!window() || !window()->isVisible() || m_updateTimer.isActive()) {
+        return;
+    }
+
+    if (m_maximumUpdateRate > 0 && m_lastUpdate.isValid()) {
+        const qint64 remaining = 1000 / m_maximumUpdateRate - m_lastUpdate.elapsed();
+        if (remaining > 0) {
+            m_updateTimer.start(remaining);
+            return;
         }
     }
-#else
-    Q_UNUSED(message)
-#endif
-    // do not filter out any events, there might be further WindowThumbnails for the same window
-    return false;
+
+    applyDamage();
+}
+
+void WindowThumbnail::applyDamage()
+{
+    if (!m_damagePending) {
+        return;
+    }
+    m_damagePending = false;
+    m_lastUpdate.start();
+    m_damaged = true;
+    update();
+}
+
+void WindowThumbnail::updateStatistics()
+{
+    const int binds = m_binds.fetchAndStoreRelaxed(0);
+    const int damage = m_damageEvents;
+    m_damageEvents = 0;
+
+    if (binds != m_bindsPerSecond || damage != m_damagePerSecond) {
+        m_bindsPerSecond = binds;
+        m_damagePerSecond = damage;
+        emit statisticsChanged();
+    }
+}
+
+void WindowThumbnail::windowReconfigured()
+{
+    releaseResources();
+    m_damaged = true;
+    update();
 }
 
 void WindowThumbnail::iconToTexture(WindowTextureNode *textureNode)
@@ -489,6 +790,7 @@ void WindowThumbnail::resolveEGLFunctions()
 void WindowThumbnail::bindEGLTexture()
 {
     ((glEGLImageTargetTexture2DOES_func)(m_glEGLImageTargetTexture2DOES))(GL_TEXTURE_2D, (GLeglImageOES)m_image);
+    m_binds.ref();
     resetDamaged();
 }
 #endif // HAVE_EGL
@@ -539,18 +841,12 @@ void WindowThumbnail::windowToTexture(WindowTextureNode *textureNode)
 #if HAVE_XCB_COMPOSITE
 xcb_pixmap_t WindowThumbnail::pixmapForWindow()
 {
-    if (!m_composite) {
+    if (!m_composite || !m_redirecting) {
         return XCB_PIXMAP_NONE;
     }
 
-    xcb_connection_t *c = QX11Info::connection();
-    xcb_pixmap_t pix = xcb_generate_id(c);
-    auto cookie = xcb_composite_name_window_pixmap_checked(c, m_winId, pix);
-    QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> error(xcb_request_check(c, cookie));
-    if (error) {
-        return XCB_PIXMAP_NONE;
-    }
-    return pix;
+    // the GUI thread is blocked while we are called from updatePaintNode
+    return s_dispatcher->pixmap(m_winId);
 }
 
 #if HAVE_GLX
@@ -571,6 +867,7 @@ void WindowThumbnail::bindGLXTexture()
     Display *d = QX11Info::display();
     ((glXReleaseTexImageEXT_func)(m_releaseTexImage))(d, m_glxPixmap, GLX_FRONT_LEFT_EXT);
     ((glXBindTexImageEXT_func)(m_bindTexImage))(d, m_glxPixmap, GLX_FRONT_LEFT_EXT, NULL);
+    m_binds.ref();
     resetDamaged();
 }
 
@@ -820,13 +1117,8 @@ bool WindowThumbnail::loadGLXTexture()
 
 void WindowThumbnail::resetDamaged()
 {
+    // the damage itself is subtracted by the dispatcher
     m_damaged = false;
-#if HAVE_XCB_COMPOSITE
-    if (m_damage == XCB_NONE) {
-        return;
-    }
-    xcb_damage_subtract(QX11Info::connection(), m_damage, XCB_NONE, XCB_NONE);
-#endif
 }
 
 void WindowThumbnail::stopRedirecting()
@@ -835,20 +1127,19 @@ void WindowThumbnail::stopRedirecting()
         return;
     }
 #if HAVE_XCB_COMPOSITE
-    xcb_connection_t *c = QX11Info::connection();
-    if (m_pixmap != XCB_PIXMAP_NONE) {
-        xcb_free_pixmap(c, m_pixmap);
-        m_pixmap = XCB_PIXMAP_NONE;
-    }
-    if (m_winId == XCB_WINDOW_NONE) {
+    m_pixmap = XCB_PIXMAP_NONE;
+    if (!m_redirecting) {
         return;
     }
-    xcb_composite_unredirect_window(c, m_winId, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
-    if (m_damage == XCB_NONE) {
-        return;
-    }
-    xcb_damage_destroy(c, m_damage);
-    m_damage = XCB_NONE;
+    s_dispatcher->unregisterThumbnail(this, m_winId);
+    m_redirecting = false;
+
+    m_updateTimer.stop();
+    m_damagePending = false;
+    m_statisticsTimer.stop();
+    m_damageEvents = 0;
+    m_binds.store(0);
+    updateStatistics();
 #endif
 }
 
@@ -861,33 +1152,14 @@ void WindowThumbnail::startRedirecting()
     if (m_winId == XCB_WINDOW_NONE) {
         return;
     }
-    xcb_connection_t *c = QX11Info::connection();
-
-    // need to get the window attributes for the existing event mask
-    const auto attribsCookie = xcb_get_window_attributes_unchecked(c, m_winId);
-
-    // redirect the window
-    xcb_composite_redirect_window(c, m_winId, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
-
-    // generate the damage handle
-    m_damage = xcb_generate_id(c);
-    xcb_damage_create(c, m_damage, m_winId, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
-
-    QScopedPointer<xcb_get_window_attributes_reply_t, QScopedPointerPodDeleter> attr(xcb_get_window_attributes_reply(c, attribsCookie, nullptr));
-    uint32_t events = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
-    if (!attr.isNull()) {
-        events = events | attr->your_event_mask;
-    }
-    // the event mask will not be removed again. We cannot track whether another component also needs STRUCTURE_NOTIFY (e.g. KWindowSystem).
-    // if we would remove the event mask again, other areas will break.
-    xcb_change_window_attributes(c, m_winId, XCB_CW_EVENT_MASK, &events);
+    s_dispatcher->registerThumbnail(this, m_winId);
+    m_redirecting = true;
+    m_statisticsTimer.start();
     // force to update the texture
     m_damaged = true;
 #endif
 }
 
-
-
 void WindowThumbnail::setThumbnailAvailable(bool thumbnailAvailable)
 {
     if (m_thumbnailAvailable != thumbnailAvailable) {
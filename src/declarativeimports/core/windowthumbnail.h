@@ -24,9 +24,11 @@
 #include <cstdint>
 
 // Qt
-#include <QAbstractNativeEventFilter>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QSGSimpleTextureNode>
 #include <QQuickItem>
+#include <QTimer>
 // xcb
 #if HAVE_XCB_COMPOSITE
 #include <xcb/damage.h>
@@ -45,6 +47,7 @@ namespace Plasma
 {
 
 class WindowTextureNode;
+class WindowThumbnailDispatcher;
 
 /**
  * @brief Renders a thumbnail for the window specified by the @c winId property.
@@ -65,6 +68,10 @@ class WindowTextureNode;
  * If the window closes, the thumbnail does not get destroyed, which allows to have
  * a window close animation.
  *
+ * The thumbnail is not updated while the item or the window it belongs to is
+ * hidden. How often it gets updated can be limited with @c maximumUpdateRate,
+ * and static previews can set @c live to false to only take a snapshot.
+ *
  * Example usage:
  * @code
  * WindowThumbnail {
@@ -73,7 +80,7 @@ class WindowTextureNode;
  * @endcode
  *
  */
-class WindowThumbnail : public QQuickItem, public QAbstractNativeEventFilter
+class WindowThumbnail : public QQuickItem
 {
     Q_OBJECT
     Q_PROPERTY(uint winId READ winId WRITE setWinId NOTIFY winIdChanged)
@@ -81,10 +88,37 @@ class WindowThumbnail : public QQuickItem, public QAbstractNativeEventFilter
     Q_PROPERTY(qreal paintedHeight READ paintedHeight NOTIFY paintedSizeChanged)
     Q_PROPERTY(bool thumbnailAvailable READ thumbnailAvailable NOTIFY thumbnailAvailableChanged)
 
+    /**
+     * Whether the thumbnail follows the changes of the window. If false, a
+     * snapshot is taken once and only updated by refresh(). Default is true.
+     * @since 5.44
+     */
+    Q_PROPERTY(bool live READ isLive WRITE setLive NOTIFY liveChanged)
+
+    /**
+     * The maximum number of times per second the thumbnail gets updated
+     * when the window changes, 0 for no limit. Default is 0.
+     * @since 5.44
+     */
+    Q_PROPERTY(int maximumUpdateRate READ maximumUpdateRate WRITE setMaximumUpdateRate NOTIFY maximumUpdateRateChanged)
+
+    /**
+     * How many times the window contents got bound to the texture of the
+     * thumbnail during the last second.
+     * @since 5.44
+     */
+    Q_PROPERTY(int bindsPerSecond READ bindsPerSecond NOTIFY statisticsChanged)
+
+    /**
+     * How many damage notifications were received for the window
+     * during the last second.
+     * @since 5.44
+     */
+    Q_PROPERTY(int damagePerSecond READ damagePerSecond NOTIFY statisticsChanged)
+
 public:
     WindowThumbnail(QQuickItem *parent = nullptr);
     virtual ~WindowThumbnail();
-    bool nativeEventFilter(const QByteArray &eventType, void *message, long int *result) Q_DECL_OVERRIDE;
     QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData) Q_DECL_OVERRIDE;
 
     uint32_t winId() const;
@@ -94,21 +128,49 @@ public:
     qreal paintedHeight() const;
     bool thumbnailAvailable() const;
 
+    bool isLive() const;
+    void setLive(bool live);
+
+    int maximumUpdateRate() const;
+    void setMaximumUpdateRate(int rate);
+
+    int bindsPerSecond() const;
+    int damagePerSecond() const;
+
+    /**
+     * Updates the thumbnail with the current contents of the window,
+     * also when it is not live.
+     * @since 5.44
+     */
+    Q_INVOKABLE void refresh();
+
 Q_SIGNALS:
     void winIdChanged();
     void paintedSizeChanged();
     void thumbnailAvailableChanged();
+    void liveChanged();
+    void maximumUpdateRateChanged();
+    void statisticsChanged();
 
 protected:
     void releaseResources() Q_DECL_OVERRIDE;
 
 private:
+    friend class WindowThumbnailDispatcher;
+
     void iconToTexture(WindowTextureNode *textureNode);
     void windowToTexture(WindowTextureNode *textureNode);
     void startRedirecting();
     void stopRedirecting();
     void resetDamaged();
     void setThumbnailAvailable(bool thumbnailAvailable);
+    // called by the dispatcher for the events of the window
+    void windowDamaged();
+    void windowReconfigured();
+    // schedules the update of the texture, within the limits of the refresh policy
+    void scheduleUpdate();
+    void applyDamage();
+    void updateStatistics();
 
     bool m_xcb;
     bool m_composite;
@@ -117,11 +179,24 @@ private:
     bool m_thumbnailAvailable;
     bool m_damaged;
     int m_depth;
+    bool m_live;
+    int m_maximumUpdateRate;
+    // damage not applied yet because of the refresh policy
+    bool m_damagePending;
+    QElapsedTimer m_lastUpdate;
+    QTimer m_updateTimer;
+    QTimer m_statisticsTimer;
+    // incremented from the render thread
+    QAtomicInt m_binds;
+    int m_damageEvents;
+    int m_bindsPerSecond;
+    int m_damagePerSecond;
 #if HAVE_XCB_COMPOSITE
     xcb_pixmap_t pixmapForWindow();
     bool m_openGLFunctionsResolved;
-    uint8_t m_damageEventBase;
-    xcb_damage_damage_t m_damage;
+    // whether the window is redirected for us by the dispatcher
+    bool m_redirecting;
+    // owned by the dispatcher, shared with the other thumbnails of the window
     xcb_pixmap_t m_pixmap;
 
 /*The following must *only* be used from the render thread*/
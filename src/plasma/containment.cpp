@@ -52,6 +52,7 @@
 #include "debug_p.h"
 
 #include "private/applet_p.h"
+#include "private/layoutpreloader_p.h"
 
 #include "plasma/plasma.h"
 
@@ -284,6 +285,17 @@ void Containment::restoreContents(KConfigGroup &group)
     }
     qStableSort(appletConfigs.begin(), appletConfigs.end(), appletConfigLessThan);
 
+    // when restoring a whole layout, the Corona already started preparing our applets
+    QScopedPointer<LayoutPreloader> preloader;
+    if (!LayoutPreloader::current()) {
+        QStringList plugins;
+        foreach (const KConfigGroup &appletConfig, appletConfigs) {
+            plugins << appletConfig.readEntry("plugin", QString());
+        }
+        preloader.reset(new LayoutPreloader);
+        preloader->preload(plugins);
+    }
+
     QMutableListIterator<KConfigGroup> it(appletConfigs);
     while (it.hasNext()) {
         KConfigGroup &appletConfig = it.next();
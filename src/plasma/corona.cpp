@@ -41,6 +41,7 @@
 #include "packagestructure.h"
 #include "private/applet_p.h"
 #include "private/containment_p.h"
+#include "private/layoutpreloader_p.h"
 #include "private/package_p.h"
 #include "private/timetracker.h"
 #include "debug_p.h"
@@ -548,6 +549,32 @@ QList<Plasma::Containment *> CoronaPrivate::importLayout(const KConfigGroup &con
     QStringList groups = containmentsGroup.groupList();
     qSort(groups.begin(), groups.end());
 
+    // prepare the plugins of the whole layout in the background,
+    // while the containments get created one after the other
+    LayoutPreloader preloader;
+    QStringList plugins;
+    foreach (const QString &group, groups) {
+        KConfigGroup containmentConfig(&containmentsGroup, group);
+        if (containmentConfig.entryMap().isEmpty()) {
+            continue;
+        }
+
+        QString plugin = containmentConfig.readEntry("plugin", QString());
+        if (plugin.isEmpty() || plugin == QLatin1String("default")) {
+            // same as addContainment
+            plugin = desktopDefaultsConfig.readEntry("Containment", "org.kde.desktopcontainment");
+        }
+        if (plugin != QLatin1String("null")) {
+            plugins << plugin;
+        }
+
+        KConfigGroup appletsConfig(&containmentConfig, "Applets");
+        foreach (const QString &appletGroup, appletsConfig.groupList()) {
+            plugins << KConfigGroup(&appletsConfig, appletGroup).readEntry("plugin", QString());
+        }
+    }
+    preloader.preload(plugins);
+
     foreach (const QString &group, groups) {
         KConfigGroup containmentConfig(&containmentsGroup, group);
 
@@ -48,24 +48,7 @@ const DataEngine::Data DataContainer::data() const
 
 void DataContainer::setData(const QString &key, const QVariant &value)
 {
-    if (!value.isValid()) {
-        d->data.remove(key);
-    } else {
-        d->data.insert(key, value);
-    }
-
-    d->dirty = true;
-    d->updateTimer.start();
-
-    //check if storage is enabled and if storage is needed.
-    //If it is not set to be stored,then this is the first
-    //setData() since the last time it was stored. This
-    //gives us only one singleShot timer.
-    if (isStorageEnabled() || !needsToBeStored()) {
-        d->storageTimer.start(180000, this);
-    }
-
-    setNeedsToBeStored(true);
+    d->setData(key, value);
 }
 
 void DataContainer::setModel(QAbstractItemModel *model)
@@ -95,6 +78,10 @@ void DataContainer::removeAllData()
         return;
     }
 
+    for (auto it = d->data.constBegin(); it != d->data.constEnd(); ++it) {
+        d->keyChanged(it.key(), true);
+    }
+
     d->data.clear();
     d->dirty = true;
     d->updateTimer.start();
@@ -130,10 +117,7 @@ void DataContainer::connectVisualization(QObject *visualization, uint pollingInt
                 d->relays.remove(relay->m_interval);
                 delete relay;
             } else {
-                if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-                    disconnect(relay, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                               visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-                }
+                d->disconnectUpdates(relay, visualization);
                 //modelChanged is always emitted by the dataSource since there is no polling there
                 if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
                         disconnect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
@@ -148,10 +132,7 @@ void DataContainer::connectVisualization(QObject *visualization, uint pollingInt
             //qCDebug(LOG_PLASMA) << "     already connected, nothing to do";
             return;
         } else {
-            if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-                disconnect(this, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                           visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-            }
+            d->disconnectUpdates(this, visualization);
             if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
                 disconnect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
                     visualization, SLOT(modelChanged(QString,QAbstractItemModel*)));
@@ -165,10 +146,7 @@ void DataContainer::connectVisualization(QObject *visualization, uint pollingInt
     if (pollingInterval < 1) {
         //qCDebug(LOG_PLASMA) << "    connecting directly";
         d->relayObjects[visualization] = 0;
-        if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-            connect(this, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                    visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-        }
+        d->connectUpdates(this, visualization);
         if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
             connect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
                     visualization, SLOT(modelChanged(QString,QAbstractItemModel*)));
@@ -181,16 +159,15 @@ void DataContainer::connectVisualization(QObject *visualization, uint pollingInt
         bool immediateUpdate = connected || d->relayObjects.count() > 1;
         SignalRelay *relay = d->signalRelay(this, visualization, pollingInterval,
                                             alignment, immediateUpdate);
-        if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-            connect(relay, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                    visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-        }
+        d->connectUpdates(relay, visualization);
         //modelChanged is always emitted by the dataSource since there is no polling there
         if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
             connect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
                 visualization, SLOT(modelChanged(QString,QAbstractItemModel*)));
         }
     }
+
+    d->updateKeyTracking();
 }
 
 void DataContainer::setStorageEnabled(bool store)
@@ -299,6 +276,9 @@ void DataContainerPrivate::populateFromStoredData(KJob *job)
     // data if it is not already populated with new data.
     if (data.isEmpty() && !ret->data().isEmpty()) {
         data = ret->data();
+        for (auto it = data.constBegin(); it != data.constEnd(); ++it) {
+            keyChanged(it.key(), false);
+        }
         dirty = true;
         q->forceImmediateUpdate();
     }
@@ -317,10 +297,7 @@ void DataContainer::disconnectVisualization(QObject *visualization)
 
     if (objIt == d->relayObjects.end() || !objIt.value()) {
         // it is connected directly to the DataContainer itself
-        if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-            disconnect(this, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                       visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-        }
+        d->disconnectUpdates(this, visualization);
         if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
             disconnect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
                    visualization, SLOT(modelChanged(QString,QAbstractItemModel*)));
@@ -332,10 +309,7 @@ void DataContainer::disconnectVisualization(QObject *visualization)
             d->relays.remove(relay->m_interval);
             delete relay;
         } else {
-            if (visualization->metaObject()->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
-                disconnect(relay, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
-                           visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
-            }
+            d->disconnectUpdates(relay, visualization);
             //modelChanged is always emitted by the dataSource since there is no polling there
             if (visualization->metaObject()->indexOfSlot("modelChanged(QString,QAbstractItemModel*)") >= 0) {
                     disconnect(this, SIGNAL(modelChanged(QString,QAbstractItemModel*)),
@@ -345,6 +319,7 @@ void DataContainer::disconnectVisualization(QObject *visualization)
     }
 
     d->relayObjects.erase(objIt);
+    d->updateKeyTracking();
     d->checkUsage();
 }
 
@@ -352,7 +327,7 @@ void DataContainer::checkForUpdate()
 {
     //qCDebug(LOG_PLASMA) << objectName() << d->dirty;
     if (d->dirty) {
-        emit dataUpdated(objectName(), d->data);
+        d->emitDataUpdated();
 
         foreach (SignalRelay *relay, d->relays) {
             relay->checkQueueing();
@@ -366,7 +341,7 @@ void DataContainer::forceImmediateUpdate()
 {
     if (d->dirty) {
         d->dirty = false;
-        emit dataUpdated(objectName(), d->data);
+        d->emitDataUpdated();
     }
 
     foreach (SignalRelay *relay, d->relays) {
@@ -387,7 +362,8 @@ void DataContainer::setNeedsUpdate(bool update)
 bool DataContainer::isUsed() const
 {
     return !d->relays.isEmpty() ||
-           receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data))) > 0;
+           receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data))) > 0 ||
+           receivers(SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList))) > 0;
 }
 
 void DataContainerPrivate::checkUsage()
@@ -95,6 +95,10 @@ public:
      * @param value a QVariant holding the actual data. If a invalid
      *              QVariant is passed in and the key currently exists in the
      *              data, then the data entry is removed
+     *
+     * Unless the DataEngine the container belongs to disabled it with
+     * DataEngine::setDataComparisonEnabled(false), setting a value equal
+     * to the current one doesn't mark the container as updated.
      **/
     void setData(const QString &key, const QVariant &value);
 
@@ -210,6 +214,27 @@ Q_SIGNALS:
      **/
     void dataUpdated(const QString &source, const Plasma::DataEngine::Data &data);
 
+    /**
+     * Emitted together with dataUpdated(), also telling which keys changed
+     * since the previous update.
+     *
+     * Visualizations opt in to it by having a slot with the same signature
+     * instead of dataUpdated(): they are connected to this signal only, and
+     * changed keys get tracked only when there is such a visualization.
+     * When connected to a source that already has data, they are initialized
+     * with a call to their dataKeysChanged() slot listing all the keys as
+     * changed.
+     *
+     * @param source the objectName() of the DataContainer (and hence the name
+     *               of the source) that updated its data
+     * @param data the updated data
+     * @param changedKeys the keys that have been added or whose value has been set
+     * @param removedKeys the keys that have been removed
+     * @since 5.44
+     **/
+    void dataKeysChanged(const QString &source, const Plasma::DataEngine::Data &data,
+                         const QStringList &changedKeys, const QStringList &removedKeys);
+
     /**
      * A new model has been associated to this source,
      * visualizations can safely use it as long they are connected to this source.
@@ -286,6 +311,8 @@ private:
     Q_PRIVATE_SLOT(d, void storeJobFinished(KJob *job))
     Q_PRIVATE_SLOT(d, void populateFromStoredData(KJob *job))
     Q_PRIVATE_SLOT(d, void retrieve())
+    // how many values were set and how many of those were unchanged, for the autotests
+    Q_PRIVATE_SLOT(d, QVariantMap statistics())
 };
 
 } // Plasma namespace
@@ -181,13 +181,15 @@ void DataEngine::setData(const QString &source, const QString &key, const QVaria
         s = d->source(source);
     }
 
-    s->setData(key, value);
+    const bool changed = s->d->setData(key, value);
 
     if (isNew && source != d->waitingSourceRequest) {
         emit sourceAdded(source);
     }
 
-    d->scheduleSourcesUpdated();
+    if (changed || isNew) {
+        d->scheduleSourcesUpdated();
+    }
 }
 
 void DataEngine::setData(const QString &source, const QVariantMap &data)
@@ -199,9 +201,10 @@ void DataEngine::setData(const QString &source, const QVariantMap &data)
         s = d->source(source);
     }
 
+    bool changed = false;
     Data::const_iterator it = data.constBegin();
     while (it != data.constEnd()) {
-        s->setData(it.key(), it.value());
+        changed |= s->d->setData(it.key(), it.value());
         ++it;
     }
 
@@ -209,7 +212,9 @@ void DataEngine::setData(const QString &source, const QVariantMap &data)
         emit sourceAdded(source);
     }
 
-    d->scheduleSourcesUpdated();
+    if (changed || isNew) {
+        d->scheduleSourcesUpdated();
+    }
 }
 
 void DataEngine::removeAllData(const QString &source)
@@ -224,8 +229,7 @@ void DataEngine::removeAllData(const QString &source)
 void DataEngine::removeData(const QString &source, const QString &key)
 {
     DataContainer *s = d->source(source, false);
-    if (s) {
-        s->setData(key, QVariant());
+    if (s && s->d->setData(key, QVariant())) {
         d->scheduleSourcesUpdated();
     }
 }
@@ -268,6 +272,7 @@ void DataEngine::addSource(DataContainer *source)
     QObject::connect(source, SIGNAL(updateRequested(DataContainer*)),
                      this, SLOT(internalUpdateSource(DataContainer*)));
     QObject::connect(source, SIGNAL(destroyed(QObject*)), this, SLOT(sourceDestroyed(QObject*)));
+    source->d->compareValues = d->compareValues;
     d->sources.insert(source->objectName(), source);
     emit sourceAdded(source->objectName());
     d->scheduleSourcesUpdated();
@@ -278,6 +283,20 @@ void DataEngine::setMinimumPollingInterval(int minimumMs)
     d->minPollingInterval = minimumMs;
 }
 
+void DataEngine::setDataComparisonEnabled(bool enabled)
+{
+    d->compareValues = enabled;
+
+    foreach (DataContainer *s, d->sources) {
+        s->d->compareValues = enabled;
+    }
+}
+
+bool DataEngine::isDataComparisonEnabled() const
+{
+    return d->compareValues;
+}
+
 int DataEngine::minimumPollingInterval() const
 {
     return d->minPollingInterval;
@@ -417,6 +436,7 @@ DataEnginePrivate::DataEnginePrivate(DataEngine *e, const KPluginInfo &info, con
       updateTimerId(0),
       minPollingInterval(-1),
       valid(false),
+      compareValues(true),
       script(0),
       package(0)
 {
@@ -515,6 +535,7 @@ DataContainer *DataEnginePrivate::source(const QString &sourceName, bool createW
     //qCDebug(LOG_PLASMA) << "DataEngine " << q->objectName() << ": could not find DataContainer " << sourceName << ", creating";
     DataContainer *s = new DataContainer(q);
     s->setObjectName(sourceName);
+    s->d->compareValues = compareValues;
     sources.insert(sourceName, s);
     QObject::connect(s, SIGNAL(destroyed(QObject*)), q, SLOT(sourceDestroyed(QObject*)));
     QObject::connect(s, SIGNAL(updateRequested(DataContainer*)),
@@ -550,9 +571,17 @@ void DataEnginePrivate::connectSource(DataContainer *s, QObject *visualization,
     s->connectVisualization(visualization, pollingInterval, align);
 
     if (immediateCall) {
-        QMetaObject::invokeMethod(visualization, "dataUpdated",
-                                  Q_ARG(QString, s->objectName()),
-                                  Q_ARG(Plasma::DataEngine::Data, s->data()));
+        if (visualization->metaObject()->indexOfSlot("dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)") >= 0) {
+            QMetaObject::invokeMethod(visualization, "dataKeysChanged",
+                                      Q_ARG(QString, s->objectName()),
+                                      Q_ARG(Plasma::DataEngine::Data, s->data()),
+                                      Q_ARG(QStringList, s->data().keys()),
+                                      Q_ARG(QStringList, QStringList()));
+        } else {
+            QMetaObject::invokeMethod(visualization, "dataUpdated",
+                                      Q_ARG(QString, s->objectName()),
+                                      Q_ARG(Plasma::DataEngine::Data, s->data()));
+        }
         if (s->d->model) {
             QMetaObject::invokeMethod(visualization, "modelChanged",
                                       Q_ARG(QString, s->objectName()),
@@ -360,6 +360,24 @@ protected:
      **/
     int minimumPollingInterval() const;
 
+    /**
+     * Sets whether setting a value equal to the current one in a data source
+     * is ignored, rather than updating the visualizations connected to it.
+     * It is enabled by default; engines publishing values which don't
+     * compare reliably (e.g. custom types without comparison operators
+     * registered with QMetaType) can disable it.
+     *
+     * @param enabled whether unchanged values should be ignored
+     * @since 5.44
+     **/
+    void setDataComparisonEnabled(bool enabled);
+
+    /**
+     * @return whether unchanged values are ignored. @see setDataComparisonEnabled
+     * @since 5.44
+     **/
+    bool isDataComparisonEnabled() const;
+
     /**
      * Sets up an internal update tick for all data sources. On every update,
      * updateSourceEvent will be called for each applicable source.
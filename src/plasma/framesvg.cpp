@@ -40,7 +40,7 @@
 namespace Plasma
 {
 
-QHash<ThemePrivate *, QHash<QString, FrameData *> > FrameSvgPrivate::s_sharedFrames;
+QHash<ThemePrivate *, QHash<SvgCacheKey, FrameData *> > FrameSvgPrivate::s_sharedFrames;
 
 // Any attempt to generate a frame whose width or height is larger than this
 // will be rejected
@@ -317,15 +317,18 @@ QPixmap FrameSvg::alphaMask() const
 
 QRegion FrameSvg::mask() const
 {
-    QString id = d->cacheId(d->frame, QString());
+    const SvgCacheKey id = d->cacheId(d->frame, QString());
 
     QRegion* obj = d->frame->cachedMasks.object(id);
     QRegion result;
 
     if (!obj) {
-        obj = new QRegion(QBitmap(d->alphaMask().mask()));
-        result = *obj;
-        d->frame->cachedMasks.insert(id, obj);
+        // most frames can be put together from the masks of their elements,
+        // without painting the whole frame
+        if (!d->composeMask(d->lookupMaskFrame(), result)) {
+            result = QRegion(QBitmap(d->alphaMask().mask()));
+        }
+        d->frame->cachedMasks.insert(id, new QRegion(result));
     }
     else {
         result = *obj;
@@ -402,7 +405,7 @@ FrameSvgPrivate::~FrameSvgPrivate()
     // we remove all references from this widget to the frame, and delete it if we're the
     // last user
     if (frame && frame->removeRefs(q)) {
-        const QString key = cacheId(frame, frame->prefix);
+        const SvgCacheKey key = cacheId(frame, frame->prefix);
 #ifdef DEBUG_FRAMESVG_CACHE
 #ifndef NDEBUG
         // qCDebug(LOG_PLASMA) << "2. Removing it" << key << frame << frame->refcount() << s_sharedFrames[theme()->d].contains(key);
@@ -414,14 +417,14 @@ FrameSvgPrivate::~FrameSvgPrivate()
 
     //same thing for maskFrame
     if (maskFrame && maskFrame->removeRefs(q)) {
-        const QString key = cacheId(maskFrame, maskFrame->prefix);
+        const SvgCacheKey key = cacheId(maskFrame, maskFrame->prefix);
         s_sharedFrames[maskFrame->theme].remove(key);
         delete maskFrame;
     }
 
 
 #ifdef DEBUG_FRAMESVG_CACHE
-    QHashIterator<QString, FrameData *> it2(s_sharedFrames[theme()->d]);
+    QHashIterator<SvgCacheKey, FrameData *> it2(s_sharedFrames[theme()->d]);
     int shares = 0;
     while (it2.hasNext()) {
         it2.next();
@@ -453,70 +456,172 @@ FrameSvgPrivate::~FrameSvgPrivate()
 
 QPixmap FrameSvgPrivate::alphaMask()
 {
-    QString maskPrefix;
+    FrameData *fd = lookupMaskFrame();
 
-    if (q->hasElement(QLatin1String("mask-") % prefix % QLatin1String("center"))) {
-        maskPrefix = QStringLiteral("mask-");
+    if (fd->cachedBackground.isNull()) {
+        generateBackground(fd);
     }
 
-    if (maskPrefix.isNull()) {
-        if (frame->cachedBackground.isNull()) {
-            generateBackground(frame);
-            if (frame->cachedBackground.isNull()) {
-                return QPixmap();
-            }
+    return fd->cachedBackground;
+}
+
+FrameData *FrameSvgPrivate::lookupMaskFrame()
+{
+    if (!q->hasElement(QLatin1String("mask-") % prefix % QLatin1String("center"))) {
+        return frame;
+    }
+
+    // We are setting the prefix only temporary to generate
+    // the needed mask image
+    const QString maskRequestedPrefix = requestedPrefix.isEmpty() ? QStringLiteral("mask") : QLatin1String("mask-") % requestedPrefix;
+    const QString maskPrefix = QLatin1String("mask-") % prefix;
+
+    if (!maskFrame) {
+        const SvgCacheKey key = cacheId(frame, maskPrefix);
+        // see if we can find a suitable candidate in the shared frames
+        // if successful, ref and insert, otherwise create a new one
+        // and insert that into both the shared frames and our frames.
+        maskFrame = s_sharedFrames[q->theme()->d].value(key);
+
+        if (maskFrame) {
+            maskFrame->ref(q);
+        } else {
+            maskFrame = new FrameData(*frame, q);
+            maskFrame->prefix = maskPrefix;
+            maskFrame->requestedPrefix = maskRequestedPrefix;
+            maskFrame->theme = q->theme()->d;
+            maskFrame->imagePath = q->imagePath();
+            s_sharedFrames[q->theme()->d].insert(key, maskFrame);
         }
+        maskFrame->enabledBorders = frame->enabledBorders;
 
-        return frame->cachedBackground;
-    } else {
-        // We are setting the prefix only temporary to generate
-        // the needed mask image
-        const QString maskRequestedPrefix = requestedPrefix.isEmpty() ? QStringLiteral("mask") : maskPrefix % requestedPrefix;
-        maskPrefix = maskPrefix % prefix;
-
-        if (!maskFrame) {
-            const QString key = cacheId(frame, maskPrefix);
-            // see if we can find a suitable candidate in the shared frames
-            // if successful, ref and insert, otherwise create a new one
-            // and insert that into both the shared frames and our frames.
-            maskFrame = s_sharedFrames[q->theme()->d].value(key);
-
-            if (maskFrame) {
-                maskFrame->ref(q);
-            } else {
-                maskFrame = new FrameData(*frame, q);
-                maskFrame->prefix = maskPrefix;
-                maskFrame->requestedPrefix = maskRequestedPrefix;
-                maskFrame->theme = q->theme()->d;
-                maskFrame->imagePath = q->imagePath();
-                s_sharedFrames[q->theme()->d].insert(key, maskFrame);
-            }
-            maskFrame->enabledBorders = frame->enabledBorders;
+        updateSizes(maskFrame);
+    }
 
-            updateSizes(maskFrame);
+    const SvgCacheKey oldKey = cacheId(maskFrame, maskPrefix);
+    maskFrame->enabledBorders = frame->enabledBorders;
+    if (maskFrame->frameSize != frameSize(frame)) {
+        maskFrame->frameSize = frameSize(frame).toSize();
+        const SvgCacheKey newKey = cacheId(maskFrame, maskPrefix);
+        if (s_sharedFrames[q->theme()->d].contains(oldKey)) {
+            s_sharedFrames[q->theme()->d].remove(oldKey);
+            s_sharedFrames[q->theme()->d].insert(newKey, maskFrame);
         }
 
-        const QString oldKey = cacheId(maskFrame, maskPrefix);
-        maskFrame->enabledBorders = frame->enabledBorders;
-        if (maskFrame->cachedBackground.isNull() || maskFrame->frameSize != frameSize(frame)) {
-            maskFrame->frameSize = frameSize(frame).toSize();
-            const QString newKey = cacheId(maskFrame, maskPrefix);
-            if (s_sharedFrames[q->theme()->d].contains(oldKey)) {
-                s_sharedFrames[q->theme()->d].remove(oldKey);
-                s_sharedFrames[q->theme()->d].insert(newKey, maskFrame);
-            }
+        maskFrame->cachedBackground = QPixmap();
+    }
+
+    return maskFrame;
+}
+
+bool FrameSvgPrivate::composeMask(FrameData *frame, QRegion &mask)
+{
+    // when the center is painted over the borders, or an overlay is painted over
+    // the frame, only the whole painted frame tells which pixels are opaque
+    if (frame->composeOverBorder ||
+        (!frame->prefix.startsWith(QLatin1String("mask-")) && q->hasElement(frame->prefix % QLatin1String("overlay")))) {
+        return false;
+    }
+
+    mask = QRegion();
+
+    // same conditions as generateBackground and generateFrameBackground
+    const QSize size = frameSize(frame).toSize() * q->devicePixelRatio();
+    if (!q->hasElementPrefix(frame->requestedPrefix) || !size.isValid() ||
+        size.width() >= MAX_FRAME_SIZE || size.height() >= MAX_FRAME_SIZE) {
+        return true;
+    }
+
+    const QRect contentRect = contentGeometry(frame, size);
 
-            maskFrame->cachedBackground = QPixmap();
+    // the center is either fully opaque, so it covers whatever size it gets painted at, or not there at all
+    if (!contentRect.isEmpty()) {
+        const QSize centerSize = q->elementSize(frame->prefix % QLatin1String("center"));
+        const QRegion center = elementMask(frame, frame->prefix % QLatin1String("center"), centerSize);
+        if (center == QRegion(QRect(QPoint(0, 0), centerSize))) {
+            mask += contentRect;
+        } else if (!center.isEmpty()) {
+            return false;
+        }
+    }
+
+    // corners are painted at their natural size, whatever the size of the frame
+    const FrameSvg::EnabledBorders corners[] = {
+        FrameSvg::LeftBorder | FrameSvg::TopBorder, FrameSvg::RightBorder | FrameSvg::TopBorder,
+        FrameSvg::LeftBorder | FrameSvg::BottomBorder, FrameSvg::RightBorder | FrameSvg::BottomBorder
+    };
+    for (const FrameSvg::EnabledBorders corner : corners) {
+        const QString elementId = frame->prefix % FrameSvgHelpers::borderToElementId(corner);
+        if (frame->enabledBorders & corner && q->hasElement(elementId)) {
+            const QRect rect = FrameSvgHelpers::sectionRect(corner, contentRect, size);
+            mask += elementMask(frame, elementId, rect.size()).translated(rect.topLeft());
+        }
+    }
 
-            generateBackground(maskFrame);
+    // sides are tiled or stretched along the frame: as long as their mask doesn't change
+    // along that direction, it's made of the same rectangles at any length
+    const int leftHeight = q->elementSize(frame->prefix % QLatin1String("left")).height();
+    const int topWidth = q->elementSize(frame->prefix % QLatin1String("top")).width();
+    const struct {
+        FrameSvg::EnabledBorders border;
+        QSize size;
+    } sides[] = {
+        {FrameSvg::LeftBorder, QSize(frame->leftWidth, leftHeight) * q->devicePixelRatio()},
+        {FrameSvg::RightBorder, QSize(frame->rightWidth, leftHeight) * q->devicePixelRatio()},
+        {FrameSvg::TopBorder, QSize(topWidth, frame->topHeight) * q->devicePixelRatio()},
+        {FrameSvg::BottomBorder, QSize(topWidth, frame->bottomHeight) * q->devicePixelRatio()}
+    };
+    for (const auto &side : sides) {
+        const QString elementId = frame->prefix % FrameSvgHelpers::borderToElementId(side.border);
+        const QRect rect = FrameSvgHelpers::sectionRect(side.border, contentRect, size);
+        if (!(frame->enabledBorders & side.border) || !q->hasElement(elementId) || side.size.isEmpty() || rect.isEmpty()) {
+            continue;
+        }
 
-            if (maskFrame->cachedBackground.isNull()) {
-                return QPixmap();
+        const bool horizontal = side.border == FrameSvg::TopBorder || side.border == FrameSvg::BottomBorder;
+        const QVector<QRect> rects = elementMask(frame, elementId, side.size).rects();
+        for (const QRect &r : rects) {
+            if (horizontal) {
+                if (r.left() != 0 || r.width() != side.size.width()) {
+                    return false;
+                }
+                mask += QRect(rect.left(), rect.top() + r.top(), rect.width(), r.height()) & rect;
+            } else {
+                if (r.top() != 0 || r.height() != side.size.height()) {
+                    return false;
+                }
+                mask += QRect(rect.left() + r.left(), rect.top(), r.width(), rect.height()) & rect;
             }
         }
+    }
 
-        return maskFrame->cachedBackground;
+    return true;
+}
+
+QRegion FrameSvgPrivate::elementMask(FrameData *frame, const QString &elementId, const QSize &size)
+{
+    if (size.isEmpty()) {
+        return QRegion();
     }
+
+    const SvgCacheKey key = SvgCacheKey::create(0, SvgCacheKey::hashString(elementId), size, 0, q->devicePixelRatio(), 0, 0, 0, q->scaleFactor());
+    QHash<SvgCacheKey, QRegion>::const_iterator it = frame->elementMasks.constFind(key);
+    if (it != frame->elementMasks.constEnd()) {
+        return *it;
+    }
+
+    // painted the same way generateFrameBackground paints it
+    QPixmap pixmap(size);
+    pixmap.fill(Qt::transparent);
+    QPainter p(&pixmap);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+    q->paint(&p, QRect(QPoint(0, 0), size), elementId);
+    p.end();
+
+    const QRegion mask(pixmap.mask());
+    frame->elementMasks.insert(key, mask);
+    return mask;
 }
 
 void FrameSvgPrivate::generateBackground(FrameData *frame)
@@ -525,7 +630,7 @@ void FrameSvgPrivate::generateBackground(FrameData *frame)
         return;
     }
 
-    const QString id = cacheId(frame, frame->prefix);
+    const QString id = cacheId(frame, frame->prefix).toString(frame->imagePath, frame->prefix);
 
     bool frameCached = !frame->cachedBackground.isNull();
     bool overlayCached = false;
@@ -657,10 +762,11 @@ QRect FrameSvgPrivate::contentGeometry(FrameData* frame, const QSize& size) cons
 void FrameSvgPrivate::updateFrameData(UpdateType updateType)
 {
     FrameData *fd = frame;
-    QString newKey;
+    SvgCacheKey newKey;
+    bool hasNewKey = false;
 
     if (fd) {
-        const QString oldKey = cacheId(fd, fd->prefix);
+        const SvgCacheKey oldKey = cacheId(fd, fd->prefix);
 
         const QString oldPath = fd->imagePath;
         const FrameSvg::EnabledBorders oldBorders = fd->enabledBorders;
@@ -671,13 +777,13 @@ void FrameSvgPrivate::updateFrameData(UpdateType updateType)
         fd->imagePath = q->imagePath();
 
         newKey = cacheId(fd, prefix);
+        hasNewKey = true;
 
         //reset frame to old values
         fd->enabledBorders = oldBorders;
         fd->frameSize = currentSize;
         fd->imagePath = oldPath;
 
-        //FIXME: something more efficient than string comparison?
         if (oldKey == newKey) {
             return;
         }
@@ -724,7 +830,7 @@ void FrameSvgPrivate::updateFrameData(UpdateType updateType)
     fd->frameSize = pendingFrameSize;
     fd->imagePath = q->imagePath();
     //was fd just created empty now?
-    if (newKey.isEmpty()) {
+    if (!hasNewKey) {
         newKey = cacheId(fd, prefix);
     }
 
@@ -800,11 +906,15 @@ void FrameSvgPrivate::paintCorner(QPainter& p, FrameData* frame, Plasma::FrameSv
     }
 }
 
-QString FrameSvgPrivate::cacheId(FrameData *frame, const QString &prefixToSave) const
+SvgCacheKey FrameSvgPrivate::cacheId(FrameData *frame, const QString &prefixToSave) const
 {
-    const QSize size = frameSize(frame).toSize();
-    const QLatin1Char s('_');
-    return QString::number(frame->enabledBorders) % s % QString::number(size.width()) % s % QString::number(size.height()) % s % QString::number(q->scaleFactor()) % s % QString::number(q->devicePixelRatio()) % s % prefixToSave % s % frame->imagePath;
+    if (frame->imagePath != frame->hashedImagePath) {
+        frame->hashedImagePath = frame->imagePath;
+        frame->imagePathHash = SvgCacheKey::hashString(frame->imagePath);
+    }
+
+    return SvgCacheKey::create(frame->imagePathHash, SvgCacheKey::hashString(prefixToSave), frameSize(frame).toSize(),
+                               0, q->devicePixelRatio(), 0, 0, frame->enabledBorders, q->scaleFactor());
 }
 
 void FrameSvgPrivate::cacheFrame(const QString &prefixToSave, const QPixmap &background, const QPixmap &overlay)
@@ -818,7 +928,7 @@ void FrameSvgPrivate::cacheFrame(const QString &prefixToSave, const QPixmap &bac
         return;
     }
 
-    const QString id = cacheId(frame, prefixToSave);
+    const QString id = cacheId(frame, prefixToSave).toString(frame->imagePath, prefixToSave);
 
     //qCDebug(LOG_PLASMA)<<"Saving to cache frame"<<id;
 
@@ -950,6 +1060,11 @@ void FrameSvgPrivate::updateNeeded()
         return;
     }
     q->clearCache();
+    // the elements may look different now
+    frame->elementMasks.clear();
+    if (maskFrame) {
+        maskFrame->elementMasks.clear();
+    }
     updateSizes(frame);
 }
 
@@ -44,6 +44,8 @@
 #include "private/storage_p.h"
 #include "private/package_p.h"
 #include "private/packagestructure_p.h"
+#include "private/layoutpreloader_p.h"
+#include "private/pluginmetadataindex_p.h"
 #include <plasma/version.h>
 #include "debug_p.h"
 
@@ -62,6 +64,8 @@ public:
 
     static QSet<QString> knownCategories();
     static QString parentAppConstraint(const QString &parentApp = QString());
+    static QList<KPluginMetaData> filterPackages(const QString &packageFormat, const std::function<bool(const KPluginMetaData &)> &filter);
+    static KPluginInfo::List pluginInfoForParentApp(const QString &pluginDir, const QString &serviceType, const QString &parentApp);
 
     static QSet<QString> s_customCategories;
     QHash<QString, QWeakPointer<PackageStructure> > structures;
@@ -127,6 +131,31 @@ QString PluginLoaderPrivate::parentAppConstraint(const QString &parentApp)
     return QStringLiteral("[X-KDE-ParentApp] == '%1'").arg(parentApp);
 }
 
+QList<KPluginMetaData> PluginLoaderPrivate::filterPackages(const QString &packageFormat, const std::function<bool(const KPluginMetaData &)> &filter)
+{
+    QList<KPluginMetaData> packages;
+    foreach (const KPluginMetaData &md, PluginMetaDataIndex::self()->packages(packageFormat)) {
+        if (filter(md)) {
+            packages << md;
+        }
+    }
+
+    return packages;
+}
+
+KPluginInfo::List PluginLoaderPrivate::pluginInfoForParentApp(const QString &pluginDir, const QString &serviceType, const QString &parentApp)
+{
+    // same as the "not exist [X-KDE-ParentApp]" and "[X-KDE-ParentApp] == parentApp" trader constraints
+    QVector<KPluginMetaData> plugins;
+    foreach (const KPluginMetaData &md, PluginMetaDataIndex::self()->plugins(pluginDir, serviceType)) {
+        if (md.value(QStringLiteral("X-KDE-ParentApp")) == parentApp) {
+            plugins << md;
+        }
+    }
+
+    return KPluginInfo::fromMetaData(plugins);
+}
+
 PluginLoader::PluginLoader()
     : d(new PluginLoaderPrivate)
 {
@@ -181,24 +210,15 @@ Applet *PluginLoader::loadApplet(const QString &name, uint appletId, const QVari
     }
 
 
-    //if name wasn't a path, pluginName == name
-    const auto pluginName = name.splitRef(QLatin1Char('/')).last();
-
-    // Look for C++ plugins first
-    auto filter = [&pluginName](const KPluginMetaData &md) -> bool
-    {
-        return md.pluginId() == pluginName;
-    };
-    QVector<KPluginMetaData> plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_plasmoidsPluginDir, filter);
-    if (plugins.isEmpty()) {
-        // COMPAT CODE for applets installed into the toplevel plugins dir by mistake.
-        plugins = KPluginLoader::findPlugins(QString(), filter);
-    }
-
-    const KPackage::Package p = KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Applet"), name);
+    // while a layout is being restored, this has likely been prepared already
+    LayoutPreloader *preloader = LayoutPreloader::current();
+    const LayoutPreloader::PreparedApplet prepared = preloader ? preloader->applet(name)
+            : LayoutPreloader::findApplet(name, KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Applet")));
+    const KPluginMetaData &plugin = prepared.plugin;
+    KPackage::Package p = prepared.package;
 
-    if (!plugins.isEmpty()) {
-        KPluginLoader loader(plugins.first().fileName());
+    if (plugin.isValid()) {
+        KPluginLoader loader(plugin.fileName());
         if (!isPluginVersionCompatible(loader)) {
             return 0;
         }
@@ -243,14 +263,10 @@ DataEngine *PluginLoader::loadDataEngine(const QString &name)
     }
 
     // Look for C++ plugins first
-    auto filter = [&name](const KPluginMetaData &md) -> bool
-    {
-        return md.pluginId() == name;
-    };
-    QVector<KPluginMetaData> plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_dataEnginePluginDir, filter);
+    const KPluginMetaData plugin = PluginMetaDataIndex::self()->plugin(PluginLoaderPrivate::s_dataEnginePluginDir, name);
 
-    if (!plugins.isEmpty()) {
-        KPluginLoader loader(plugins.first().fileName());
+    if (plugin.isValid()) {
+        KPluginLoader loader(plugin.fileName());
         const QVariantList argsWithMetaData = QVariantList() << loader.metaData().toVariantMap();
         KPluginFactory *factory = loader.factory();
         if (factory) {
@@ -261,6 +277,10 @@ DataEngine *PluginLoader::loadDataEngine(const QString &name)
         return engine;
     }
 
+    if (!PluginMetaDataIndex::self()->package(QStringLiteral("Plasma/DataEngine"), name).isValid()) {
+        return 0;
+    }
+
     const KPackage::Package p = KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/DataEngine"), name);
     if (!p.isValid()) {
         return 0;
@@ -273,22 +293,15 @@ QStringList PluginLoader::listAllEngines(const QString &parentApp)
 {
     QStringList engines;
     // Look for C++ plugins first
-    auto filter = [&parentApp](const KPluginMetaData &md) -> bool
-    {
-        return md.value(QStringLiteral("X-KDE-ParentApp")) == parentApp;
-    };
-    QVector<KPluginMetaData> plugins;
-    if (parentApp.isEmpty()) {
-        plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_dataEnginePluginDir);
-    } else {
-        plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_dataEnginePluginDir, filter);
-    }
+    const QVector<KPluginMetaData> plugins = PluginMetaDataIndex::self()->plugins(PluginLoaderPrivate::s_dataEnginePluginDir);
 
     foreach (auto& plugin, plugins) {
-        engines << plugin.pluginId();
+        if (parentApp.isEmpty() || plugin.value(QStringLiteral("X-KDE-ParentApp")) == parentApp) {
+            engines << plugin.pluginId();
+        }
     }
 
-    const QList<KPluginMetaData> packagePlugins = KPackage::PackageLoader::self()->listPackages(QStringLiteral("Plasma/DataEngine"));
+    const QList<KPluginMetaData> packagePlugins = PluginMetaDataIndex::self()->packages(QStringLiteral("Plasma/DataEngine"));
     for (auto& plugin : packagePlugins) {
         engines << plugin.pluginId();
     }
@@ -306,27 +319,19 @@ KPluginInfo::List PluginLoader::listEngineInfoByCategory(const QString &category
     KPluginInfo::List list;
 
     // Look for C++ plugins first
-    auto filterNormal = [&category](const KPluginMetaData &md) -> bool
-    {
-        return md.value(QStringLiteral("X-KDE-PluginInfo-Category")) == category;
-    };
-    auto filterParentApp = [&category, &parentApp](const KPluginMetaData &md) -> bool
-    {
-        return md.value(QStringLiteral("X-KDE-ParentApp")) == parentApp
-            && md.value(QStringLiteral("X-KDE-PluginInfo-Category")) == category;
-    };
     QVector<KPluginMetaData> plugins;
-    if (parentApp.isEmpty()) {
-        plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_dataEnginePluginDir, filterNormal);
-    } else {
-        plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_dataEnginePluginDir, filterParentApp);
+    foreach (const KPluginMetaData &md, PluginMetaDataIndex::self()->plugins(PluginLoaderPrivate::s_dataEnginePluginDir)) {
+        if ((parentApp.isEmpty() || md.value(QStringLiteral("X-KDE-ParentApp")) == parentApp)
+            && md.value(QStringLiteral("X-KDE-PluginInfo-Category")) == category) {
+            plugins << md;
+        }
     }
 
     list = KPluginInfo::fromMetaData(plugins);
 
 
     //TODO FIXME: PackageLoader needs to have a function to inject packageStructures
-    const QList<KPluginMetaData> packagePlugins = KPackage::PackageLoader::self()->listPackages(QStringLiteral("Plasma/DataEngine"));
+    const QList<KPluginMetaData> packagePlugins = PluginMetaDataIndex::self()->packages(QStringLiteral("Plasma/DataEngine"));
     list << KPluginInfo::fromMetaData(packagePlugins.toVector());
 
     return list;
@@ -348,14 +353,10 @@ Service *PluginLoader::loadService(const QString &name, const QVariantList &args
 
 
     // Look for C++ plugins first
-    auto filter = [&name](const KPluginMetaData &md) -> bool
-    {
-        return md.pluginId() == name;
-    };
-    QVector<KPluginMetaData> plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_servicesPluginDir, filter);
+    const KPluginMetaData plugin = PluginMetaDataIndex::self()->plugin(PluginLoaderPrivate::s_servicesPluginDir, name);
 
-    if (!plugins.isEmpty()) {
-        KPluginLoader loader(plugins.first().fileName());
+    if (plugin.isValid()) {
+        KPluginLoader loader(plugin.fileName());
         if (!isPluginVersionCompatible(loader)) {
             return 0;
         }
@@ -388,14 +389,10 @@ ContainmentActions *PluginLoader::loadContainmentActions(Containment *parent, co
 
 
     // Look for C++ plugins first
-    auto filter = [&name](const KPluginMetaData &md) -> bool
-    {
-        return md.pluginId() == name;
-    };
-    QVector<KPluginMetaData> plugins = KPluginLoader::findPlugins(PluginLoaderPrivate::s_containmentActionsPluginDir, filter);
+    const KPluginMetaData plugin = PluginMetaDataIndex::self()->plugin(PluginLoaderPrivate::s_containmentActionsPluginDir, name);
 
-    if (!plugins.isEmpty()) {
-        KPluginLoader loader(plugins.first().fileName());
+    if (plugin.isValid()) {
+        KPluginLoader loader(plugin.fileName());
         const QVariantList argsWithMetaData = QVariantList() << loader.metaData().toVariantMap();
         KPluginFactory *factory = loader.factory();
         if (factory) {
@@ -518,7 +515,7 @@ QList<KPluginMetaData> PluginLoader::listAppletMetaData(const QString &category,
     if (!d->isDefaultLoader && (parentApp.isEmpty() || parentApp == QCoreApplication::instance()->applicationName())) {
         list = KPluginInfo::toMetaData(internalAppletInfo(category)).toList();
     }
-    return KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter);
+    return PluginLoaderPrivate::filterPackages(QStringLiteral("Plasma/Applet"), filter);
 }
 
 KPluginInfo::List PluginLoader::listAppletInfo(const QString &category, const QString &parentApp)
@@ -545,7 +542,7 @@ QList<KPluginMetaData> PluginLoader::listAppletMetaDataForMimeType(const QString
     {
         return KPluginMetaData::readStringList(md.rawData(), QStringLiteral("X-Plasma-DropMimeTypes")).contains(mimeType);
     };
-    return KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter);
+    return PluginLoaderPrivate::filterPackages(QStringLiteral("Plasma/Applet"), filter);
 }
 
 KPluginInfo::List PluginLoader::listAppletInfoForMimeType(const QString &mimeType)
@@ -566,7 +563,7 @@ QList<KPluginMetaData> PluginLoader::listAppletMetaDataForUrl(const QUrl &url)
         const QString pa = md.value(QStringLiteral("X-KDE-ParentApp"));
         return (pa.isEmpty() || pa == parentApp) && !KPluginMetaData::readStringList(md.rawData(), QStringLiteral("X-Plasma-DropUrlPatterns")).isEmpty();
     };
-    const QList<KPluginMetaData> allApplets = KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter);
+    const QList<KPluginMetaData> allApplets = PluginLoaderPrivate::filterPackages(QStringLiteral("Plasma/Applet"), filter);
 
     QList<KPluginMetaData> filtered;
     foreach (const KPluginMetaData &md, allApplets) {
@@ -602,7 +599,7 @@ QStringList PluginLoader::listAppletCategories(const QString &parentApp, bool vi
             && (excluded.isEmpty() || excluded.contains(md.value(QStringLiteral("X-KDE-PluginInfo-Category"))))
             && (!visibleOnly || !md.isHidden());
     };
-    const QList<KPluginMetaData> allApplets = KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter);
+    const QList<KPluginMetaData> allApplets = PluginLoaderPrivate::filterPackages(QStringLiteral("Plasma/Applet"), filter);
 
 
     QStringList categories;
@@ -635,12 +632,7 @@ QString PluginLoader::appletCategory(const QString &appletName)
         return QString();
     }
 
-    const KPackage::Package p = KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Applet"), appletName);
-    if (!p.isValid()) {
-        return QString();
-    }
-
-    return p.metadata().category();
+    return PluginMetaDataIndex::self()->package(QStringLiteral("Plasma/Applet"), appletName).category();
 }
 
 KPluginInfo::List PluginLoader::listContainments(const QString &category,
@@ -655,39 +647,37 @@ KPluginInfo::List PluginLoader::listContainmentsOfType(const QString &type,
 {
     KConfigGroup group(KSharedConfig::openConfig(), "General");
     const QStringList excluded = group.readEntry("ExcludeCategories", QStringList());
-    auto filter = [&type, &category, &parentApp](const KPluginMetaData &md) -> bool
-    {
-        if (!md.serviceTypes().contains(QStringLiteral("Plasma/Containment"))) {
-            return false;
-        }
+    QList<KPluginMetaData> containments;
+    foreach (const KPluginMetaData &md, PluginMetaDataIndex::self()->packages(QStringLiteral("Plasma/Applet"), QStringLiteral("Plasma/Containment"))) {
         const QString pa = md.value(QStringLiteral("X-KDE-ParentApp"));
         if (!pa.isEmpty() && pa != parentApp) {
-            return false;
+            continue;
         }
 
         if (!type.isEmpty() && md.value(QStringLiteral("X-Plasma-ContainmentType")) != type) {
-            return false;
+            continue;
         }
 
         if (!category.isEmpty() && md.value(QStringLiteral("X-KDE-PluginInfo-Category")) != category) {
-            return false;
+            continue;
         }
 
-        return true;
-    };
+        containments << md;
+    }
 
-    return KPluginInfo::fromMetaData(KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter).toVector());
+    return KPluginInfo::fromMetaData(containments.toVector());
 }
 
 KPluginInfo::List PluginLoader::listContainmentsForMimeType(const QString &mimeType)
 {
-    auto filter = [&mimeType](const KPluginMetaData &md) -> bool
-    {
-        return md.serviceTypes().contains(QLatin1String("Plasma/Containment"))
-            && KPluginMetaData::readStringList(md.rawData(), QStringLiteral("X-Plasma-DropMimeTypes")).contains(mimeType);
-    };
+    QVector<KPluginMetaData> containments;
+    foreach (const KPluginMetaData &md, PluginMetaDataIndex::self()->packages(QStringLiteral("Plasma/Applet"), QStringLiteral("Plasma/Containment"))) {
+        if (KPluginMetaData::readStringList(md.rawData(), QStringLiteral("X-Plasma-DropMimeTypes")).contains(mimeType)) {
+            containments << md;
+        }
+    }
 
-    return KPluginInfo::fromMetaData(KPackage::PackageLoader::self()->findPackages(QStringLiteral("Plasma/Applet"), QString(), filter).toVector());
+    return KPluginInfo::fromMetaData(containments);
 }
 
 QStringList PluginLoader::listContainmentTypes()
@@ -713,14 +703,7 @@ KPluginInfo::List PluginLoader::listDataEngineInfo(const QString &parentApp)
         list = internalDataEngineInfo();
     }
 
-    QString constraint;
-    if (parentApp.isEmpty()) {
-        constraint = QStringLiteral("not exist [X-KDE-ParentApp]");
-    } else {
-        constraint = QLatin1String("[X-KDE-ParentApp] == '") + parentApp + QLatin1Char('\'');
-    }
-
-    list.append(KPluginTrader::self()->query(PluginLoaderPrivate::s_dataEnginePluginDir, QStringLiteral("Plasma/DataEngine"), constraint));
+    list.append(PluginLoaderPrivate::pluginInfoForParentApp(PluginLoaderPrivate::s_dataEnginePluginDir, QStringLiteral("Plasma/DataEngine"), parentApp));
     return list;
 }
 
@@ -739,7 +722,7 @@ KPluginInfo::List PluginLoader::listContainmentActionsInfo(const QString &parent
         constraint = QLatin1String("[X-KDE-ParentApp] == '") + parentApp + QLatin1Char('\'');
     }
 
-    list.append(KPluginTrader::self()->query(PluginLoaderPrivate::s_containmentActionsPluginDir, QStringLiteral("Plasma/ContainmentActions"), constraint));
+    list.append(PluginLoaderPrivate::pluginInfoForParentApp(PluginLoaderPrivate::s_containmentActionsPluginDir, QStringLiteral("Plasma/ContainmentActions"), parentApp));
 
     QSet<QString> knownPlugins;
     foreach (const KPluginInfo &p, list) {
@@ -20,6 +20,10 @@
 #include "datacontainer.h" //krazy:exclude=includes
 #include "datacontainer_p.h" //krazy:exclude=includes
 
+#include <QDateTime>
+
+#include "sharedtimer_p.h"
+
 namespace Plasma
 {
 
@@ -44,6 +48,131 @@ SignalRelay *DataContainerPrivate::signalRelay(const DataContainer *dc, QObject
     return relay;
 }
 
+bool DataContainerPrivate::setData(const QString &key, const QVariant &value)
+{
+    ++setCount;
+
+    if (!value.isValid()) {
+        if (data.remove(key) > 0) {
+            keyChanged(key, true);
+        } else if (compareValues) {
+            ++skippedCount;
+            return false;
+        }
+    } else {
+        if (compareValues) {
+            DataEngine::Data::const_iterator it = data.constFind(key);
+            //QVariant converts between types when comparing,
+            //so a value changing its type is a change as well
+            if (it != data.constEnd() && it->userType() == value.userType() && *it == value) {
+                ++skippedCount;
+                return false;
+            }
+        }
+
+        data.insert(key, value);
+        keyChanged(key, false);
+    }
+
+    dirty = true;
+    updateTimer.start();
+
+    //check if storage is enabled and if storage is needed.
+    //If it is not set to be stored,then this is the first
+    //setData() since the last time it was stored. This
+    //gives us only one singleShot timer.
+    //The timer is aligned to the next 3 minutes boundary, so the
+    //containers changed in the meantime are all stored in one batch.
+    if (q->isStorageEnabled() || !q->needsToBeStored()) {
+        storageTimer.start(180000 - QDateTime::currentMSecsSinceEpoch() % 180000, q);
+    }
+
+    q->setNeedsToBeStored(true);
+    return true;
+}
+
+QVariantMap DataContainerPrivate::statistics() const
+{
+    QVariantMap map;
+    map[QStringLiteral("set")] = setCount;
+    map[QStringLiteral("skipped")] = skippedCount;
+    return map;
+}
+
+static void recordKeyChange(QSet<QString> &changedKeys, QSet<QString> &removedKeys, const QString &key, bool removed)
+{
+    if (removed) {
+        changedKeys.remove(key);
+        removedKeys.insert(key);
+    } else {
+        removedKeys.remove(key);
+        changedKeys.insert(key);
+    }
+}
+
+void DataContainerPrivate::keyChanged(const QString &key, bool removed)
+{
+    if (trackKeys) {
+        recordKeyChange(changedKeys, removedKeys, key, removed);
+    }
+
+    foreach (SignalRelay *relay, relays) {
+        if (relay->m_trackKeys) {
+            recordKeyChange(relay->m_changedKeys, relay->m_removedKeys, key, removed);
+        }
+    }
+}
+
+void DataContainerPrivate::updateKeyTracking()
+{
+    trackKeys = q->receivers(SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList))) > 0;
+    if (!trackKeys) {
+        changedKeys.clear();
+        removedKeys.clear();
+    }
+
+    foreach (SignalRelay *relay, relays) {
+        relay->updateKeyTracking();
+    }
+}
+
+void DataContainerPrivate::emitDataUpdated()
+{
+    emit q->dataUpdated(q->objectName(), data);
+
+    if (trackKeys) {
+        const QStringList changed = changedKeys.toList();
+        const QStringList removed = removedKeys.toList();
+        changedKeys.clear();
+        removedKeys.clear();
+        emit q->dataKeysChanged(q->objectName(), data, changed, removed);
+    }
+}
+
+void DataContainerPrivate::connectUpdates(QObject *sender, QObject *visualization)
+{
+    const QMetaObject *metaObject = visualization->metaObject();
+    if (metaObject->indexOfSlot("dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)") >= 0) {
+        QObject::connect(sender, SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)),
+                         visualization, SLOT(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)));
+    } else if (metaObject->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
+        QObject::connect(sender, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
+                         visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
+    }
+}
+
+void DataContainerPrivate::disconnectUpdates(QObject *sender, QObject *visualization)
+{
+    const QMetaObject *metaObject = visualization->metaObject();
+    if (metaObject->indexOfSlot("dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)") >= 0) {
+        QObject::disconnect(sender, SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)),
+                            visualization, SLOT(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)));
+    } else if (metaObject->indexOfSlot("dataUpdated(QString,Plasma::DataEngine::Data)") >= 0) {
+        QObject::disconnect(sender, SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)),
+                            visualization, SLOT(dataUpdated(QString,Plasma::DataEngine::Data)));
+    }
+}
+
 bool DataContainerPrivate::hasUpdates()
 {
     if (cached) {
@@ -62,47 +191,51 @@ SignalRelay::SignalRelay(DataContainer *parent, DataContainerPrivate *data, uint
       d(data),
       m_interval(ival),
       m_align(align),
-      m_resetTimer(true),
-      m_queued(true)
+      m_queued(true),
+      m_trackKeys(false)
 {
-    //qCDebug(LOG_PLASMA) << "signal relay with time of" << m_timerId << "being set up";
-    m_timerId = startTimer(immediateUpdate ? 0 : m_interval);
+    //qCDebug(LOG_PLASMA) << "signal relay with time of" << m_interval << "being set up";
+    TimerDrive::self()->registerTimer(this, immediateUpdate ? 0 : m_interval);
     if (m_align != Plasma::Types::NoAlignment) {
         checkAlignment();
     }
 }
 
+SignalRelay::~SignalRelay()
+{
+    if (TimerDrive *drive = TimerDrive::self()) {
+        drive->unregisterTimer(this);
+    }
+}
+
 int SignalRelay::receiverCount() const
 {
-    return receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)));
+    return receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data))) +
+           receivers(SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)));
 }
 
 bool SignalRelay::isUnused() const
 {
-    return receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data))) < 1;
+    return receiverCount() < 1;
 }
 
 void SignalRelay::checkAlignment()
 {
-    int newTime = 0;
+    const QDateTime now = QDateTime::currentDateTime();
+    const QTime t = now.time();
+    QDateTime next;
 
-    QTime t = QTime::currentTime();
     if (m_align == Plasma::Types::AlignToMinute) {
-        int seconds = t.second();
-        newTime = ((60 - seconds) * 1000) + 500;
+        next = QDateTime(now.date(), QTime(t.hour(), t.minute())).addSecs(60);
     } else if (m_align == Plasma::Types::AlignToHour) {
-        int minutes = t.minute();
-        int seconds = t.second();
-        if (minutes > 1 || seconds > 10) {
-            newTime = ((60 - minutes) * 1000 * 60) +
-                      ((60 - seconds) * 1000) + 500;
+        if (t.minute() > 1 || t.second() > 10) {
+            next = QDateTime(now.date(), QTime(t.hour(), 0)).addSecs(60 * 60);
         }
     }
 
-    if (newTime) {
-        killTimer(m_timerId);
-        m_timerId = startTimer(newTime);
-        m_resetTimer = true;
+    // relays aligned to the same minute or hour share the same slot of the drive
+    if (next.isValid()) {
+        TimerDrive::self()->registerAlignedTimer(this, next.toMSecsSinceEpoch() + 500);
     }
 }
 
@@ -110,7 +243,7 @@ void SignalRelay::checkQueueing()
 {
     //qCDebug(LOG_PLASMA) << m_queued;
     if (m_queued) {
-        emit dataUpdated(dc->objectName(), d->data);
+        emitDataUpdated();
         m_queued = false;
         //TODO: should we re-align our timer at this point, to avoid
         //      constant queueing due to more-or-less constant time
@@ -122,28 +255,40 @@ void SignalRelay::checkQueueing()
         //      we need more real world data before making such a change
         //      change
         //
-        // killTimer(m_timerId);
-        // m_timerId = startTime(m_interval);
+        // TimerDrive::self()->registerTimer(this, m_interval);
     }
 }
 
 void SignalRelay::forceImmediateUpdate()
 {
-    emit dataUpdated(dc->objectName(), d->data);
+    emitDataUpdated();
 }
 
-void SignalRelay::timerEvent(QTimerEvent *event)
+void SignalRelay::updateKeyTracking()
 {
-    if (event->timerId() != m_timerId) {
-        QObject::timerEvent(event);
-        return;
+    m_trackKeys = receivers(SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList))) > 0;
+    if (!m_trackKeys) {
+        m_changedKeys.clear();
+        m_removedKeys.clear();
     }
+}
+
+void SignalRelay::emitDataUpdated()
+{
+    emit dataUpdated(dc->objectName(), d->data);
 
-    if (m_resetTimer) {
-        killTimer(m_timerId);
-        m_timerId = startTimer(m_interval);
-        m_resetTimer = false;
+    if (m_trackKeys) {
+        const QStringList changed = m_changedKeys.toList();
+        const QStringList removed = m_removedKeys.toList();
+        m_changedKeys.clear();
+        m_removedKeys.clear();
+        emit dataKeysChanged(dc->objectName(), d->data, changed, removed);
     }
+}
+
+void SignalRelay::timeout()
+{
+    TimerDrive::self()->registerTimer(this, m_interval);
 
     if (m_align != Plasma::Types::NoAlignment) {
         checkAlignment();
@@ -152,7 +297,7 @@ void SignalRelay::timerEvent(QTimerEvent *event)
     emit dc->updateRequested(dc);
     if (d->hasUpdates()) {
         //qCDebug(LOG_PLASMA) << "emitting data updated directly" << d->data;
-        emit dataUpdated(dc->objectName(), d->data);
+        emitDataUpdated();
         m_queued = false;
     } else {
         // the source wasn't actually updated; so let's put ourselves in the queue
@@ -22,12 +22,14 @@
 
 #include "servicejob.h"
 #include "storage_p.h"
+#include "sharedtimer_p.h"
 
 #include <QtCore/QTimerEvent>
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QBasicTimer>
 
 #include <QAbstractItemModel>
+#include <QSet>
 
 class QTimer;
 
@@ -43,10 +45,14 @@ public:
         : q(container),
           storage(NULL),
           storageCount(0),
+          setCount(0),
+          skippedCount(0),
           dirty(false),
           cached(false),
           enableStorage(false),
-          isStored(true)
+          isStored(true),
+          trackKeys(false),
+          compareValues(true)
     {
     }
 
@@ -81,6 +87,39 @@ public:
     void store();
     void retrieve();
 
+    QVariantMap statistics() const;
+
+    /**
+     * Sets @p value for @p key, marking the container as dirty and scheduling
+     * its storage only if the data actually changed.
+     * @return true if the data changed
+     */
+    bool setData(const QString &key, const QVariant &value);
+
+    /**
+     * Records that @p key changed or has been removed, for the visualizations
+     * connected to dataKeysChanged, directly or through a relay
+     */
+    void keyChanged(const QString &key, bool removed);
+
+    /**
+     * Checks which relays, and the container itself, have visualizations
+     * connected to dataKeysChanged, so changed keys get tracked only for those
+     */
+    void updateKeyTracking();
+
+    /**
+     * Emits the update signals of the container for the directly connected visualizations
+     */
+    void emitDataUpdated();
+
+    /**
+     * Connects the update signal of @p sender to @p visualization, preferring
+     * dataKeysChanged when the visualization has such a slot
+     */
+    static void connectUpdates(QObject *sender, QObject *visualization);
+    static void disconnectUpdates(QObject *sender, QObject *visualization);
+
     DataContainer *q;
     DataEngine::Data data;
     QMap<QObject *, SignalRelay *> relayObjects;
@@ -90,20 +129,28 @@ public:
     QBasicTimer storageTimer;
     QBasicTimer checkUsageTimer;
     QWeakPointer<QAbstractItemModel> model;
+    QSet<QString> changedKeys;
+    QSet<QString> removedKeys;
     int  storageCount;
+    // instrumentation: calls to setData and how many of those didn't change anything
+    quint64 setCount;
+    quint64 skippedCount;
     bool dirty : 1;
     bool cached : 1;
     bool enableStorage : 1;
     bool isStored : 1;
+    bool trackKeys : 1;
+    bool compareValues : 1;
 };
 
-class SignalRelay : public QObject
+class SignalRelay : public QObject, public TimerDriveClient
 {
     Q_OBJECT
 
 public:
     SignalRelay(DataContainer *parent, DataContainerPrivate *data,
                 uint ival, Plasma::Types::IntervalAlignment align, bool immediateUpdate);
+    ~SignalRelay();
 
     int receiverCount() const;
     bool isUnused() const;
@@ -111,20 +158,26 @@ public:
     void checkAlignment();
     void checkQueueing();
     void forceImmediateUpdate();
+    void emitDataUpdated();
+    void updateKeyTracking();
+
+    /**
+     * Called by the TimerDrive when the interval, or the alignment, elapsed
+     */
+    void timeout() Q_DECL_OVERRIDE;
 
     DataContainer *dc;
     DataContainerPrivate *d;
     uint m_interval;
     Plasma::Types::IntervalAlignment m_align;
-    int m_timerId;
-    bool m_resetTimer;
+    QSet<QString> m_changedKeys;
+    QSet<QString> m_removedKeys;
     bool m_queued;
+    bool m_trackKeys;
 
 Q_SIGNALS:
     void dataUpdated(const QString &, const Plasma::DataEngine::Data &);
-
-protected:
-    void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
+    void dataKeysChanged(const QString &, const Plasma::DataEngine::Data &, const QStringList &, const QStringList &);
 };
 
 } // Plasma namespace
@@ -98,6 +98,7 @@ public:
     QElapsedTimer updateTimer;
     DataEngine::SourceDict sources;
     bool valid;
+    bool compareValues;
     DataEngineScript *script;
     QString serviceName;
     Package *package;
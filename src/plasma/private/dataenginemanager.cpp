@@ -31,6 +31,7 @@
 #include "private/componentinstaller_p.h"
 #include "private/dataengine_p.h"
 #include "private/datacontainer_p.h"
+#include "private/sharedtimer_p.h"
 #include "scripting/scriptengine.h"
 #include "debug_p.h"
 
@@ -173,6 +174,8 @@ void DataEngineManager::timerEvent(QTimerEvent *)
 
     QHashIterator<QString, DataEngine *> it(d->engines);
     out << "================================== " << QLocale().toString(QDateTime::currentDateTime()) << endl;
+    out << "Relay timer wakeups: " << TimerDrive::self()->wakeupCount()
+        << ", relay timeouts: " << TimerDrive::self()->firedCount() << endl;
     while (it.hasNext()) {
         it.next();
         DataEngine *engine = it.value();
@@ -185,7 +188,9 @@ void DataEngineManager::timerEvent(QTimerEvent *)
             out << "                * " << dc->objectName() << endl;
             out << "                       Data count: " << dc->d->data.count() << endl;
             out << "                       Stored: " << dc->isStorageEnabled() << ' ' << endl;
-            const int directs = dc->receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data)));
+            out << "                       Unchanged values skipped: " << dc->d->skippedCount << " of " << dc->d->setCount << endl;
+            const int directs = dc->receivers(SIGNAL(dataUpdated(QString,Plasma::DataEngine::Data))) +
+                                dc->receivers(SIGNAL(dataKeysChanged(QString,Plasma::DataEngine::Data,QStringList,QStringList)));
             if (directs > 0) {
                 out << "                       Direction Connections: " << directs << ' ' << endl;
             }
@@ -29,6 +29,8 @@
 
 #include <Plasma/Theme>
 
+#include "private/svgcachekey_p.h"
+
 namespace Plasma
 {
 
@@ -37,6 +39,8 @@ class FrameData
 public:
     FrameData(FrameSvg *svg, const QString &p)
         : imagePath(svg->imagePath()),
+          hashedImagePath(imagePath),
+          imagePathHash(SvgCacheKey::hashString(imagePath)),
           prefix(p),
           enabledBorders(FrameSvg::AllBorders),
           frameSize(-1, -1),
@@ -59,9 +63,12 @@ public:
 
     FrameData(const FrameData &other, FrameSvg *svg)
         : imagePath(other.imagePath),
+          hashedImagePath(other.hashedImagePath),
+          imagePathHash(other.imagePathHash),
           prefix(other.prefix),
           enabledBorders(other.enabledBorders),
           cachedMasks(MAX_CACHED_MASKS),
+          elementMasks(other.elementMasks),
           frameSize(other.frameSize),
           topHeight(0),
           leftWidth(0),
@@ -90,12 +97,17 @@ public:
     int refcount() const;
 
     QString imagePath;
+    //imagePath as interned in the cache keys
+    QString hashedImagePath;
+    quint64 imagePathHash;
     QString prefix;
     QString requestedPrefix;
     FrameSvg::EnabledBorders enabledBorders;
     QPixmap cachedBackground;
-    QCache<QString, QRegion> cachedMasks;
+    QCache<SvgCacheKey, QRegion> cachedMasks;
     static const int MAX_CACHED_MASKS = 10;
+    //masks of the single elements, mask() is put together from these
+    QHash<SvgCacheKey, QRegion> elementMasks;
 
     QSize frameSize;
 
@@ -153,6 +165,9 @@ public:
     ~FrameSvgPrivate();
 
     QPixmap alphaMask();
+    FrameData *lookupMaskFrame();
+    bool composeMask(FrameData *frame, QRegion &mask);
+    QRegion elementMask(FrameData *frame, const QString &elementId, const QSize &size);
 
     enum UpdateType {
         UpdateFrame,
@@ -161,7 +176,7 @@ public:
 
     void generateBackground(FrameData *frame);
     void generateFrameBackground(FrameData *frame);
-    QString cacheId(FrameData *frame, const QString &prefixToUse) const;
+    SvgCacheKey cacheId(FrameData *frame, const QString &prefixToUse) const;
     void cacheFrame(const QString &prefixToSave, const QPixmap &background, const QPixmap &overlay);
     void updateSizes(FrameData *frame) const;
     void updateNeeded();
@@ -191,7 +206,7 @@ public:
     //this can differ from frame->frameSize if we are in a transition
     QSize pendingFrameSize;
 
-    static QHash<ThemePrivate *, QHash<QString, FrameData *> > s_sharedFrames;
+    static QHash<ThemePrivate *, QHash<SvgCacheKey, FrameData *> > s_sharedFrames;
 
     bool cacheAll : 1;
     bool repaintBlocked : 1;
@@ -0,0 +1,219 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "layoutpreloader_p.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include <KPluginLoader>
+#include <kpackage/packageloader.h>
+
+#include "private/pluginmetadataindex_p.h"
+
+namespace Plasma
+{
+
+// same as PluginLoaderPrivate::s_plasmoidsPluginDir
+static const QString s_appletsPluginDir = QStringLiteral("plasma/applets");
+
+static LayoutPreloader *s_currentPreloader = nullptr;
+
+class LayoutPreloader::Job : public QRunnable
+{
+public:
+    Job(LayoutPreloader *preloader, const QString &name)
+        : m_preloader(preloader),
+          m_name(name)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        m_preloader->prepare(m_name);
+    }
+
+private:
+    LayoutPreloader *m_preloader;
+    QString m_name;
+};
+
+LayoutPreloader::LayoutPreloader()
+    : m_structure(KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Applet"))),
+      m_active(!s_currentPreloader && !qEnvironmentVariableIsSet("PLASMA_NO_LAYOUT_PRELOADING"))
+{
+    // the main thread is busy creating the applets meanwhile
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    if (m_active) {
+        s_currentPreloader = this;
+    }
+}
+
+LayoutPreloader::~LayoutPreloader()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    if (m_active) {
+        s_currentPreloader = nullptr;
+    }
+}
+
+LayoutPreloader *LayoutPreloader::current()
+{
+    return s_currentPreloader;
+}
+
+void LayoutPreloader::preload(const QStringList &pluginNames)
+{
+    // PluginLoader only uses the active preloader
+    if (!m_active) {
+        return;
+    }
+
+    for (const QString &name : pluginNames) {
+        QMutexLocker locker(&m_mutex);
+        if (name.isEmpty() || m_entries.contains(name)) {
+            continue;
+        }
+
+        // the index may have to read the disk or use the PackageLoader,
+        // which aren't safe to use from the workers
+        Entry entry;
+        lookUp(name, &entry.applet.plugin, &entry.packagePath);
+        m_entries.insert(name, entry);
+        m_pool.start(new Job(this, name));
+    }
+}
+
+LayoutPreloader::PreparedApplet LayoutPreloader::applet(const QString &name)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_entries.contains(name)) {
+        locker.unlock();
+        return findApplet(name, m_structure);
+    }
+
+    if (m_entries.value(name).state == Entry::Queued) {
+        // don't wait for a worker to get to it
+        locker.unlock();
+        prepare(name);
+        locker.relock();
+    }
+
+    while (m_entries.value(name).state != Entry::Done) {
+        m_prepared.wait(&m_mutex);
+    }
+
+    Entry &entry = m_entries[name];
+    if (!entry.taken) {
+        entry.taken = true;
+        PreparedApplet applet = entry.applet;
+        // the package is the applet's own from now on
+        entry.applet.package = KPackage::Package();
+        return applet;
+    }
+
+    PreparedApplet applet;
+    applet.plugin = entry.applet.plugin;
+    applet.package = m_structure;
+    const QString packagePath = entry.packagePath;
+    locker.unlock();
+
+    if (!packagePath.isEmpty()) {
+        applet.package.setPath(packagePath);
+    }
+    return applet;
+}
+
+LayoutPreloader::PreparedApplet LayoutPreloader::findApplet(const QString &name, const KPackage::Package &structure)
+{
+    PreparedApplet applet;
+    QString packagePath;
+    lookUp(name, &applet.plugin, &packagePath);
+
+    applet.package = structure;
+    if (!packagePath.isEmpty()) {
+        applet.package.setPath(packagePath);
+    }
+    return applet;
+}
+
+void LayoutPreloader::lookUp(const QString &name, KPluginMetaData *plugin, QString *packagePath)
+{
+    //if name wasn't a path, pluginName == name
+    const QString pluginName = name.splitRef(QLatin1Char('/')).last().toString();
+
+    // Look for C++ plugins first
+    *plugin = PluginMetaDataIndex::self()->plugin(s_appletsPluginDir, pluginName);
+    if (!plugin->isValid()) {
+        // COMPAT CODE for applets installed into the toplevel plugins dir by mistake.
+        *plugin = PluginMetaDataIndex::self()->plugin(QString(), pluginName);
+    }
+
+    if (name.contains(QLatin1Char('/'))) {
+        *packagePath = name;
+    } else {
+        // the index already knows where the package is, if any
+        const KPluginMetaData package = PluginMetaDataIndex::self()->package(QStringLiteral("Plasma/Applet"), name);
+        if (package.isValid()) {
+            *packagePath = QFileInfo(package.metaDataFileName()).absolutePath();
+        }
+    }
+}
+
+void LayoutPreloader::prepare(const QString &name)
+{
+    KPluginMetaData plugin;
+    QString packagePath;
+    {
+        QMutexLocker locker(&m_mutex);
+        Entry &entry = m_entries[name];
+        if (entry.state != Entry::Queued) {
+            return;
+        }
+        entry.state = Entry::Running;
+        plugin = entry.applet.plugin;
+        packagePath = entry.packagePath;
+    }
+
+    // setting the path parses the metadata of the package
+    KPackage::Package package(m_structure);
+    if (!packagePath.isEmpty()) {
+        package.setPath(packagePath);
+    }
+
+    // the library stays loaded, the main thread only has to create the factory
+    if (plugin.isValid()) {
+        KPluginLoader loader(plugin.fileName());
+        loader.load();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Entry &entry = m_entries[name];
+    entry.applet.package = package;
+    entry.state = Entry::Done;
+    m_prepared.wakeAll();
+}
+
+}
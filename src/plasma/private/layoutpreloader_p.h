@@ -0,0 +1,120 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_LAYOUTPRELOADER_P_H
+#define PLASMA_LAYOUTPRELOADER_P_H
+
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <KPluginMetaData>
+#include <kpackage/package.h>
+
+namespace Plasma
+{
+
+/**
+ * Prepares in worker threads what PluginLoader::loadApplet needs to create
+ * the applets of a layout being restored: their C++ plugin library gets
+ * loaded and their package gets set up, with its metadata parsed.
+ *
+ * Only thread safe work is done by the workers: the plugins and packages are
+ * looked up in the PluginMetaDataIndex by the main thread, and applets and
+ * containments are still created in the main thread, in the order the layout
+ * lists them, while the ones coming next are being prepared.
+ *
+ * A preloader is active, and used by PluginLoader, while it is in scope.
+ * Preloaders may be nested, in which case the outermost one gets used.
+ * Setting PLASMA_NO_LAYOUT_PRELOADING in the environment disables them,
+ * so the applets are looked up one after the other as they get created.
+ */
+class LayoutPreloader
+{
+public:
+    struct PreparedApplet {
+        KPluginMetaData plugin;
+        KPackage::Package package;
+    };
+
+    LayoutPreloader();
+    ~LayoutPreloader();
+
+    /**
+     * @return the preloader active in this process, if any
+     */
+    static LayoutPreloader *current();
+
+    /**
+     * Starts preparing the applets with the given plugin names,
+     * those already known are skipped. Does nothing if the preloader
+     * isn't the active one.
+     */
+    void preload(const QStringList &pluginNames);
+
+    /**
+     * @return the plugin and package of the applet @p name: if it's still
+     *         being prepared this waits for it, if it wasn't started yet
+     *         it's prepared right away
+     */
+    PreparedApplet applet(const QString &name);
+
+    /**
+     * Looks up the plugin and package of the applet @p name, as
+     * PluginLoader::loadApplet does
+     * @param structure an empty package of the Plasma/Applet format
+     */
+    static PreparedApplet findApplet(const QString &name, const KPackage::Package &structure);
+
+private:
+    class Job;
+    friend class Job;
+
+    struct Entry {
+        enum State {
+            Queued,
+            Running,
+            Done
+        };
+
+        Entry() : state(Queued), taken(false) {}
+
+        State state;
+        // the prepared package is handed out once, later applets with the same plugin get their own
+        bool taken;
+        QString packagePath;
+        PreparedApplet applet;
+    };
+
+    static void lookUp(const QString &name, KPluginMetaData *plugin, QString *packagePath);
+    void prepare(const QString &name);
+
+    QThreadPool m_pool;
+    QMutex m_mutex;
+    QWaitCondition m_prepared;
+    QHash<QString, Entry> m_entries;
+    KPackage::Package m_structure;
+    bool m_active;
+};
+
+}
+
+#endif
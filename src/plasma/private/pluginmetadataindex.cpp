@@ -0,0 +1,374 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "pluginmetadataindex_p.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <KPluginLoader>
+#include <kpackage/package.h>
+#include <kpackage/packageloader.h>
+
+#include "debug_p.h"
+
+namespace Plasma
+{
+
+// bump when the format of the cache files changes
+static const int s_indexVersion = 3;
+
+Q_GLOBAL_STATIC(PluginMetaDataIndex, s_pluginMetaDataIndex)
+
+PluginMetaDataIndex::PluginMetaDataIndex()
+    : m_pass(1),
+      m_nextPassScheduled(false)
+{
+    // the index may be created by a thread of the layout preloader
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+}
+
+PluginMetaDataIndex::~PluginMetaDataIndex()
+{
+}
+
+PluginMetaDataIndex *PluginMetaDataIndex::self()
+{
+    return s_pluginMetaDataIndex();
+}
+
+QVector<KPluginMetaData> PluginMetaDataIndex::plugins(const QString &pluginDir)
+{
+    QMutexLocker locker(&m_mutex);
+    return upToDateSection(pluginDir, false).entries;
+}
+
+QVector<KPluginMetaData> PluginMetaDataIndex::plugins(const QString &pluginDir, const QString &serviceType)
+{
+    QMutexLocker locker(&m_mutex);
+    const Section &s = upToDateSection(pluginDir, false);
+
+    QVector<KPluginMetaData> plugins;
+    // QMultiHash returns the most recently inserted first
+    const QList<int> indexes = s.byServiceType.values(serviceType);
+    for (auto it = indexes.crbegin(); it != indexes.crend(); ++it) {
+        plugins << s.entries.at(*it);
+    }
+    return plugins;
+}
+
+KPluginMetaData PluginMetaDataIndex::plugin(const QString &pluginDir, const QString &pluginId)
+{
+    QMutexLocker locker(&m_mutex);
+    Section &s = section(pluginDir, false);
+    const int index = upToDateEntry(s, pluginId);
+    return index >= 0 ? s.entries.at(index) : KPluginMetaData();
+}
+
+QList<KPluginMetaData> PluginMetaDataIndex::packages(const QString &packageFormat)
+{
+    QMutexLocker locker(&m_mutex);
+    return upToDateSection(packageFormat, true).entries.toList();
+}
+
+QList<KPluginMetaData> PluginMetaDataIndex::packages(const QString &packageFormat, const QString &serviceType)
+{
+    QMutexLocker locker(&m_mutex);
+    const Section &s = upToDateSection(packageFormat, true);
+
+    QList<KPluginMetaData> packages;
+    const QList<int> indexes = s.byServiceType.values(serviceType);
+    for (auto it = indexes.crbegin(); it != indexes.crend(); ++it) {
+        packages << s.entries.at(*it);
+    }
+    return packages;
+}
+
+KPluginMetaData PluginMetaDataIndex::package(const QString &packageFormat, const QString &pluginId)
+{
+    QMutexLocker locker(&m_mutex);
+    Section &s = section(packageFormat, true);
+    const int index = upToDateEntry(s, pluginId);
+    return index >= 0 ? s.entries.at(index) : KPluginMetaData();
+}
+
+PluginMetaDataIndex::Section &PluginMetaDataIndex::section(const QString &name, bool isPackage)
+{
+    const QString key = (isPackage ? QStringLiteral("packages:") : QStringLiteral("plugins:")) + name;
+    Section &s = m_sections[key];
+
+    s.name = name;
+    s.isPackage = isPackage;
+
+    const bool check = needsCheck(s.dirsCheckedPass);
+    if (s.loaded && !check) {
+        return s;
+    }
+
+    const QStringList stamp = currentStamp(s);
+    if (s.loaded && stamp == s.stamp) {
+        return s;
+    }
+
+    // the first time, another process may have already built the section
+    if (s.loaded || !load(s, stamp)) {
+        build(s, stamp);
+        save(s);
+    }
+
+    s.loaded = true;
+    return s;
+}
+
+PluginMetaDataIndex::Section &PluginMetaDataIndex::upToDateSection(const QString &name, bool isPackage)
+{
+    Section &s = section(name, isPackage);
+    if (!needsCheck(s.entriesCheckedPass)) {
+        return s;
+    }
+
+    for (int i = 0; i < s.entries.count(); ++i) {
+        if (entryStamp(s.entries.at(i), isPackage) != s.entryStamps.at(i)) {
+            rebuild(s);
+            break;
+        }
+    }
+
+    return s;
+}
+
+int PluginMetaDataIndex::upToDateEntry(Section &section, const QString &pluginId)
+{
+    int index = section.byId.value(pluginId, -1);
+
+    // upgraded in place, its metadata may have changed
+    if (index >= 0 && section.entriesCheckedPass != m_pass && entryStamp(section.entries.at(index), section.isPackage) != section.entryStamps.at(index)) {
+        rebuild(section);
+        index = section.byId.value(pluginId, -1);
+    }
+
+    return index;
+}
+
+qint64 PluginMetaDataIndex::entryStamp(const KPluginMetaData &md, bool isPackage)
+{
+    if (!isPackage) {
+        const QFileInfo library(md.fileName());
+        return library.exists() ? library.lastModified().toMSecsSinceEpoch() : -1;
+    }
+
+    // the metadata file, and the package directory for files added or removed
+    const QFileInfo metaDataFile(md.metaDataFileName());
+    if (!metaDataFile.exists()) {
+        return -1;
+    }
+
+    const QFileInfo packageDir(metaDataFile.absolutePath());
+    return qMax(metaDataFile.lastModified().toMSecsSinceEpoch(), packageDir.lastModified().toMSecsSinceEpoch());
+}
+
+void PluginMetaDataIndex::rebuild(Section &section)
+{
+    build(section, section.stamp);
+    save(section);
+}
+
+bool PluginMetaDataIndex::needsCheck(quint64 &checkedPass)
+{
+    // without an event loop there are no passes, every lookup checks
+    if (!QCoreApplication::instance()) {
+        return true;
+    }
+
+    if (checkedPass == m_pass) {
+        return false;
+    }
+
+    checkedPass = m_pass;
+    if (!m_nextPassScheduled) {
+        m_nextPassScheduled = true;
+        QMetaObject::invokeMethod(this, "nextPass", Qt::QueuedConnection);
+    }
+    return true;
+}
+
+void PluginMetaDataIndex::nextPass()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_pass;
+    m_nextPassScheduled = false;
+}
+
+const QStringList &PluginMetaDataIndex::directories(Section &section)
+{
+    if (section.dirsResolved) {
+        return section.dirs;
+    }
+
+    // all the places the section may be found in, including the ones that don't
+    // exist yet, so that the first plugin or package installed there is noticed
+    if (section.isPackage) {
+        const QString root = KPackage::PackageLoader::self()->loadPackage(section.name).defaultPackageRoot();
+        if (QDir::isAbsolutePath(root)) {
+            section.dirs << root;
+        } else if (!root.isEmpty()) {
+            for (const QString &location : QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation)) {
+                section.dirs << location + QLatin1Char('/') + root;
+            }
+        }
+    } else {
+        // the same directories KPluginLoader::findPlugins looks into
+        for (const QString &libraryPath : QCoreApplication::libraryPaths()) {
+            section.dirs << (section.name.isEmpty() ? libraryPath : libraryPath + QLatin1Char('/') + section.name);
+        }
+    }
+
+    section.dirsResolved = true;
+    return section.dirs;
+}
+
+QStringList PluginMetaDataIndex::currentStamp(Section &section)
+{
+    // installing or removing something changes the modification time of its directory
+    QStringList stamp;
+    for (const QString &dir : directories(section)) {
+        const QFileInfo info(dir);
+        stamp << dir + QLatin1Char(':') + QString::number(info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1);
+    }
+
+    return stamp;
+}
+
+QString PluginMetaDataIndex::cacheFile(const Section &section) const
+{
+    QString name = section.name.isEmpty() ? QStringLiteral("toplevel") : section.name;
+    name.replace(QLatin1Char('/'), QLatin1Char('_'));
+
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+           QStringLiteral("/plasma-pluginindex/") + (section.isPackage ? QStringLiteral("packages-") : QStringLiteral("plugins-")) +
+           name + QStringLiteral(".index");
+}
+
+bool PluginMetaDataIndex::load(Section &section, const QStringList &stamp)
+{
+    QFile file(cacheFile(section));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QJsonObject index = QJsonDocument::fromBinaryData(file.readAll()).object();
+    if (index.value(QStringLiteral("version")).toInt() != s_indexVersion ||
+        index.value(QStringLiteral("stamp")).toVariant().toStringList() != stamp) {
+        return false;
+    }
+
+    QVector<KPluginMetaData> entries;
+    QVector<qint64> entryStamps;
+    const QJsonArray array = index.value(QStringLiteral("entries")).toArray();
+    entries.reserve(array.size());
+    entryStamps.reserve(array.size());
+    for (const QJsonValue &value : array) {
+        const QJsonObject entry = value.toObject();
+        entries << KPluginMetaData(entry.value(QStringLiteral("data")).toObject(),
+                                   entry.value(QStringLiteral("file")).toString(),
+                                   entry.value(QStringLiteral("metaDataFile")).toString());
+        entryStamps << qint64(entry.value(QStringLiteral("mtime")).toDouble());
+    }
+
+    section.stamp = stamp;
+    setEntries(section, entries);
+    section.entryStamps = entryStamps;
+    return true;
+}
+
+void PluginMetaDataIndex::build(Section &section, const QStringList &stamp)
+{
+    section.stamp = stamp;
+
+    if (section.isPackage) {
+        setEntries(section, KPackage::PackageLoader::self()->listPackages(section.name).toVector());
+    } else {
+        setEntries(section, KPluginLoader::findPlugins(section.name));
+    }
+}
+
+void PluginMetaDataIndex::save(const Section &section)
+{
+    QJsonArray entries;
+    for (const KPluginMetaData &md : section.entries) {
+        QJsonObject entry;
+        entry.insert(QStringLiteral("file"), md.fileName());
+        entry.insert(QStringLiteral("metaDataFile"), md.metaDataFileName());
+        entry.insert(QStringLiteral("data"), md.rawData());
+        entry.insert(QStringLiteral("mtime"), double(section.entryStamps.at(entries.count())));
+        entries.append(entry);
+    }
+
+    QJsonObject index;
+    index.insert(QStringLiteral("version"), s_indexVersion);
+    index.insert(QStringLiteral("stamp"), QJsonArray::fromStringList(section.stamp));
+    index.insert(QStringLiteral("entries"), entries);
+
+    const QString path = cacheFile(section);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(LOG_PLASMA) << "Unable to write the plugin index" << path;
+        return;
+    }
+
+    file.write(QJsonDocument(index).toBinaryData());
+    file.commit();
+}
+
+void PluginMetaDataIndex::setEntries(Section &section, const QVector<KPluginMetaData> &entries)
+{
+    section.entries = entries;
+    section.entryStamps.resize(entries.count());
+    section.byId.clear();
+    section.byServiceType.clear();
+
+    for (int i = 0; i < entries.count(); ++i) {
+        const KPluginMetaData &md = entries.at(i);
+        section.entryStamps[i] = entryStamp(md, section.isPackage);
+        // like the lookups it replaces, the first match wins
+        if (!section.byId.contains(md.pluginId())) {
+            section.byId.insert(md.pluginId(), i);
+        }
+        for (const QString &serviceType : md.serviceTypes()) {
+            section.byServiceType.insert(serviceType, i);
+        }
+    }
+}
+
+}
+
+#include "moc_pluginmetadataindex_p.cpp"
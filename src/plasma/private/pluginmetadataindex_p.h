@@ -0,0 +1,126 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_PLUGINMETADATAINDEX_P_H
+#define PLASMA_PLUGINMETADATAINDEX_P_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+#include <KPluginMetaData>
+
+namespace Plasma
+{
+
+/**
+ * Process wide index of the metadata of the plugins and packages PluginLoader
+ * looks for, so that loading an applet or listing the available ones doesn't
+ * walk the plugin directories and parse all their metadata every time.
+ *
+ * Every section of the index (the C++ plugins of a plugin directory, or the
+ * packages of a package format) is built once, then saved in the cache
+ * directory for the next processes. A section is valid for as long as the
+ * directories it was built from keep the same modification time, which
+ * changes when plugins or packages get installed or removed, and as long as
+ * the files of its entries keep theirs, which change when a plugin or package
+ * is upgraded in place. Lookups of a single entry only check the files of
+ * that entry, listings check all of them.
+ *
+ * Within an application, the files are checked once per pass of the event
+ * loop: the lookups done in the same pass, e.g. by all the applets of a
+ * layout being loaded, trust what the first one found. Changes on disk are
+ * seen from the next pass.
+ */
+class PluginMetaDataIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    PluginMetaDataIndex();
+    ~PluginMetaDataIndex();
+
+    static PluginMetaDataIndex *self();
+
+    /**
+     * @return the C++ plugins in @p pluginDir, as KPluginLoader::findPlugins(pluginDir) finds them
+     */
+    QVector<KPluginMetaData> plugins(const QString &pluginDir);
+    QVector<KPluginMetaData> plugins(const QString &pluginDir, const QString &serviceType);
+    KPluginMetaData plugin(const QString &pluginDir, const QString &pluginId);
+
+    /**
+     * @return the packages of @p packageFormat, as KPackage::PackageLoader::listPackages(packageFormat) lists them
+     */
+    QList<KPluginMetaData> packages(const QString &packageFormat);
+    QList<KPluginMetaData> packages(const QString &packageFormat, const QString &serviceType);
+    KPluginMetaData package(const QString &packageFormat, const QString &pluginId);
+
+private:
+    struct Section {
+        Section() : dirsCheckedPass(0), entriesCheckedPass(0), isPackage(false), loaded(false), dirsResolved(false) {}
+
+        QString name;
+        //the directories the section is built from, existing or not
+        QStringList dirs;
+        QStringList stamp;
+        QVector<KPluginMetaData> entries;
+        //modification time of the files of each entry when it was indexed
+        QVector<qint64> entryStamps;
+        QHash<QString, int> byId;
+        QMultiHash<QString, int> byServiceType;
+        //event loop pass in which the directories, and the files of all the entries, were last checked
+        quint64 dirsCheckedPass;
+        quint64 entriesCheckedPass;
+        bool isPackage;
+        bool loaded;
+        bool dirsResolved;
+    };
+
+    Section &section(const QString &name, bool isPackage);
+    //like section(), also checking that every entry is up to date
+    Section &upToDateSection(const QString &name, bool isPackage);
+    int upToDateEntry(Section &section, const QString &pluginId);
+    //whether the files of the section have to be checked, given the pass they were last checked in
+    bool needsCheck(quint64 &checkedPass);
+    const QStringList &directories(Section &section);
+    QStringList currentStamp(Section &section);
+    static qint64 entryStamp(const KPluginMetaData &md, bool isPackage);
+    void rebuild(Section &section);
+    QString cacheFile(const Section &section) const;
+    bool load(Section &section, const QStringList &stamp);
+    void build(Section &section, const QStringList &stamp);
+    void save(const Section &section);
+    void setEntries(Section &section, const QVector<KPluginMetaData> &entries);
+
+private Q_SLOTS:
+    void nextPass();
+
+private:
+    QMutex m_mutex;
+    QHash<QString, Section> m_sections;
+    quint64 m_pass;
+    bool m_nextPassScheduled;
+};
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "sharedtimer_p.h"
+
+#include <QBasicTimer>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QTimerEvent>
+
+namespace Plasma
+{
+
+// duration of a slot of the wheel, in ms
+static const int s_slotLength = 50;
+
+TimerWheel::TimerWheel()
+    : m_currentTick(0),
+      m_fired(0),
+      m_dispatching(false)
+{
+}
+
+void TimerWheel::insert(TimerDriveClient *client, qint64 tick)
+{
+    remove(client);
+
+    // four levels cover about 9 days of 50ms slots, longer timers are capped to that
+    const qint64 base = m_currentTick + 1;
+    const qint64 range = Q_INT64_C(1) << (SlotBits * Levels);
+    const qint64 expires = qBound(base, tick, base + range - 1);
+
+    const qint64 delta = expires - base;
+    int level = 0;
+    while (level < Levels - 1 && delta >= (Q_INT64_C(1) << (SlotBits * (level + 1)))) {
+        ++level;
+    }
+
+    const int slot = (expires >> (SlotBits * level)) & SlotMask;
+    m_wheel[level][slot].append(client);
+    m_timers.insert(client, {expires, level, slot});
+}
+
+void TimerWheel::remove(TimerDriveClient *client)
+{
+    m_firing.remove(client);
+
+    QHash<TimerDriveClient *, Position>::iterator it = m_timers.find(client);
+    if (it == m_timers.end()) {
+        return;
+    }
+
+    m_wheel[it->level][it->slot].removeOne(client);
+    m_timers.erase(it);
+}
+
+qint64 TimerWheel::expiry(TimerDriveClient *client) const
+{
+    QHash<TimerDriveClient *, Position>::const_iterator it = m_timers.constFind(client);
+    return it == m_timers.constEnd() ? -1 : it->expires;
+}
+
+void TimerWheel::cascade(qint64 tick)
+{
+    // when a level wraps around, the next slot of the level above is spread
+    // over the level below, and so on
+    for (int level = 1; level < Levels; ++level) {
+        const int slot = (tick >> (SlotBits * level)) & SlotMask;
+        QVector<TimerDriveClient *> clients;
+        clients.swap(m_wheel[level][slot]);
+        for (TimerDriveClient *client : clients) {
+            const qint64 expires = m_timers.value(client).expires;
+            m_timers.remove(client);
+            insert(client, expires);
+        }
+
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+void TimerWheel::advance(qint64 tick)
+{
+    m_dispatching = true;
+
+    while (m_currentTick < tick) {
+        if (m_timers.isEmpty()) {
+            m_currentTick = tick;
+            break;
+        }
+
+        const qint64 next = m_currentTick + 1;
+        if ((next & SlotMask) == 0) {
+            cascade(next);
+        }
+        m_currentTick = next;
+
+        QVector<TimerDriveClient *> &slot = m_wheel[0][next & SlotMask];
+        if (slot.isEmpty()) {
+            continue;
+        }
+
+        QVector<TimerDriveClient *> due;
+        due.swap(slot);
+        for (TimerDriveClient *client : due) {
+            m_timers.remove(client);
+            m_firing.insert(client);
+        }
+
+        // a client may delete others, or register again, when fired
+        for (TimerDriveClient *client : due) {
+            if (m_firing.remove(client)) {
+                ++m_fired;
+                client->timeout();
+            }
+        }
+    }
+
+    m_dispatching = false;
+}
+
+qint64 TimerWheel::nextTick() const
+{
+    if (m_timers.isEmpty()) {
+        return -1;
+    }
+
+    qint64 next = -1;
+
+    // the slots of level 0 are the next ones, in order
+    for (qint64 tick = m_currentTick + 1; tick <= m_currentTick + SlotsPerLevel; ++tick) {
+        if (!m_wheel[0][tick & SlotMask].isEmpty()) {
+            next = tick;
+            break;
+        }
+    }
+
+    // the first slot of the other levels has to be spread when its time span begins,
+    // none of its timers expires before
+    for (int level = 1; level < Levels; ++level) {
+        const int shift = SlotBits * level;
+        const qint64 firstBlock = (m_currentTick >> shift) + 1;
+        for (qint64 block = firstBlock; block < firstBlock + SlotsPerLevel; ++block) {
+            if (!m_wheel[level][block & SlotMask].isEmpty()) {
+                const qint64 tick = block << shift;
+                if (next < 0 || tick < next) {
+                    next = tick;
+                }
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+qint64 TimerWheel::currentTick() const
+{
+    return m_currentTick;
+}
+
+void TimerWheel::skipTo(qint64 tick)
+{
+    if (m_timers.isEmpty()) {
+        m_currentTick = qMax(m_currentTick, tick);
+    }
+}
+
+bool TimerWheel::isEmpty() const
+{
+    return m_timers.isEmpty();
+}
+
+bool TimerWheel::isDispatching() const
+{
+    return m_dispatching;
+}
+
+quint64 TimerWheel::firedCount() const
+{
+    return m_fired;
+}
+
+class TimerDriveSingleton
+{
+public:
+    TimerDrive self;
+};
+
+Q_GLOBAL_STATIC(TimerDriveSingleton, privateTimerDriveSelf)
+
+class TimerDrive::Private
+{
+public:
+    Private(TimerDrive *drive)
+        : q(drive),
+          scheduledTick(0),
+          wakeups(0)
+    {
+        clock.start();
+        epochOffset = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    void insert(TimerDriveClient *client, qint64 tick);
+    qint64 alignedTick(qint64 msecsSinceEpoch) const;
+    bool reanchor();
+    void realign();
+    void schedule(qint64 tick);
+    void scheduleNext();
+
+    TimerDrive *q;
+    QElapsedTimer clock;
+    // msecs since epoch when the clock started, to map aligned timers to slots
+    qint64 epochOffset;
+    qint64 scheduledTick;
+    TimerWheel wheel;
+    // the points in time the aligned timers are meant for
+    QHash<TimerDriveClient *, qint64> alignedTimers;
+    QBasicTimer timer;
+    quint64 wakeups;
+};
+
+void TimerDrive::Private::insert(TimerDriveClient *client, qint64 tick)
+{
+    // the wheel is empty, skip the slots elapsed since it was last used
+    if (wheel.isEmpty() && !wheel.isDispatching()) {
+        wheel.skipTo(clock.elapsed() / s_slotLength);
+    }
+
+    wheel.insert(client, tick);
+
+    if (!wheel.isDispatching()) {
+        schedule(wheel.expiry(client));
+    }
+}
+
+qint64 TimerDrive::Private::alignedTick(qint64 msecsSinceEpoch) const
+{
+    // computed from the same origin, the same point in time always maps to the same slot
+    const qint64 msec = msecsSinceEpoch - epochOffset;
+    return (msec + s_slotLength - 1) / s_slotLength;
+}
+
+bool TimerDrive::Private::reanchor()
+{
+    // the monotonic clock doesn't count the time spent suspended, and ignores
+    // changes of the wall clock: map the wall clock to it again when they drifted apart
+    const qint64 offset = QDateTime::currentMSecsSinceEpoch() - clock.elapsed();
+    if (qAbs(offset - epochOffset) < s_slotLength) {
+        return false;
+    }
+
+    epochOffset = offset;
+    return true;
+}
+
+void TimerDrive::Private::realign()
+{
+    QHash<TimerDriveClient *, qint64>::iterator it = alignedTimers.begin();
+    while (it != alignedTimers.end()) {
+        // fired already
+        if (wheel.expiry(it.key()) < 0) {
+            it = alignedTimers.erase(it);
+            continue;
+        }
+
+        insert(it.key(), alignedTick(it.value()));
+        ++it;
+    }
+}
+
+void TimerDrive::Private::schedule(qint64 tick)
+{
+    if (timer.isActive() && scheduledTick <= tick) {
+        return;
+    }
+
+    scheduledTick = tick;
+    timer.start(qMax<qint64>(0, tick * s_slotLength - clock.elapsed()), Qt::PreciseTimer, q);
+}
+
+void TimerDrive::Private::scheduleNext()
+{
+    timer.stop();
+
+    const qint64 next = wheel.nextTick();
+    if (next >= 0) {
+        schedule(next);
+    }
+}
+
+TimerDrive::TimerDrive(QObject *parent)
+    : QObject(parent),
+      d(new Private(this))
+{
+}
+
+TimerDrive::~TimerDrive()
+{
+    delete d;
+}
+
+TimerDrive *TimerDrive::self()
+{
+    TimerDriveSingleton *singleton = privateTimerDriveSelf();
+    return singleton ? &singleton->self : nullptr;
+}
+
+void TimerDrive::registerTimer(TimerDriveClient *client, int msec)
+{
+    d->alignedTimers.remove(client);
+
+    // while firing, count from the slot being fired rather than from now,
+    // so that periodic timers keep their pace
+    const qint64 start = d->wheel.isDispatching() ? d->wheel.currentTick() * s_slotLength : d->clock.elapsed();
+    d->insert(client, (start + qMax(0, msec) + s_slotLength - 1) / s_slotLength);
+}
+
+void TimerDrive::registerAlignedTimer(TimerDriveClient *client, qint64 msecsSinceEpoch)
+{
+    if (d->reanchor()) {
+        d->realign();
+    }
+
+    d->alignedTimers.insert(client, msecsSinceEpoch);
+    d->insert(client, d->alignedTick(msecsSinceEpoch));
+}
+
+void TimerDrive::unregisterTimer(TimerDriveClient *client)
+{
+    d->alignedTimers.remove(client);
+    // a useless wakeup is cheaper than looking for the next timer
+    d->wheel.remove(client);
+}
+
+qint64 TimerDrive::expiry(TimerDriveClient *client) const
+{
+    return d->wheel.expiry(client);
+}
+
+quint64 TimerDrive::wakeupCount() const
+{
+    return d->wakeups;
+}
+
+quint64 TimerDrive::firedCount() const
+{
+    return d->wheel.firedCount();
+}
+
+void TimerDrive::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != d->timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    ++d->wakeups;
+    // after a suspend, aligned timers are due according to the wall clock
+    if (d->reanchor()) {
+        d->realign();
+    }
+    // the timer may be a bit early, in which case the slot it was meant for is fired anyway
+    d->wheel.advance(qMax(d->scheduledTick, d->clock.elapsed() / s_slotLength));
+    d->scheduleNext();
+}
+
+} // namespace Plasma
+
+#include "moc_sharedtimer_p.cpp"
@@ -20,24 +20,160 @@
 #ifndef PLASMA_SHAREDTIMER_P_H
 #define PLASMA_SHAREDTIMER_P_H
 
+#include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 
 namespace Plasma
 {
 
-class Timer;
+/**
+ * Something fired by the TimerDrive
+ */
+class TimerDriveClient
+{
+public:
+    virtual void timeout() = 0;
+
+protected:
+    ~TimerDriveClient() {}
+};
+
+/**
+ * A hierarchical timer wheel counting in slots, without any notion of time.
+ *
+ * Every level has 64 slots, each one as long as the whole level below.
+ * Level 0 holds the timers of the next 64 slots; a slot of a higher level is
+ * spread over the level below when its time span begins. Timers are single
+ * shot, and all the timers of the same slot are fired together.
+ */
+class TimerWheel
+{
+public:
+    TimerWheel();
+
+    /**
+     * Fires @p client once the slot @p tick is reached, within the range
+     * of the wheel after the current slot. A timer the client had is replaced.
+     */
+    void insert(TimerDriveClient *client, qint64 tick);
+    void remove(TimerDriveClient *client);
+
+    /**
+     * @return the slot @p client is going to be fired in, -1 if none
+     */
+    qint64 expiry(TimerDriveClient *client) const;
+
+    /**
+     * Fires all the timers up to the slot @p tick, included.
+     * Clients can register or remove timers when fired.
+     */
+    void advance(qint64 tick);
+
+    /**
+     * @return the next slot something has to be done in, -1 if none.
+     * It is either a slot with timers to fire, or the beginning of the
+     * time span of a slot of a higher level that has to be spread.
+     */
+    qint64 nextTick() const;
+
+    /**
+     * @return the last slot that has been fired
+     */
+    qint64 currentTick() const;
+
+    /**
+     * Moves to the slot @p tick without firing anything, for an empty wheel
+     */
+    void skipTo(qint64 tick);
 
+    bool isEmpty() const;
+    bool isDispatching() const;
+
+    /**
+     * @return how many timers were fired
+     */
+    quint64 firedCount() const;
+
+private:
+    struct Position {
+        qint64 expires;
+        int level;
+        int slot;
+    };
+
+    enum {
+        SlotBits = 6,
+        SlotsPerLevel = 1 << SlotBits,
+        SlotMask = SlotsPerLevel - 1,
+        Levels = 4
+    };
+
+    void cascade(qint64 tick);
+
+    qint64 m_currentTick;
+    QVector<TimerDriveClient *> m_wheel[Levels][SlotsPerLevel];
+    QHash<TimerDriveClient *, Position> m_timers;
+    // clients of the slot being fired that didn't get their turn yet
+    QSet<TimerDriveClient *> m_firing;
+    quint64 m_fired;
+    bool m_dispatching;
+};
+
+/**
+ * Drives the timers of all the SignalRelays of the process with a single
+ * system timer.
+ *
+ * Timers are kept in a TimerWheel with slots of 50ms: all the relays due in
+ * the same slot are fired together, and the process only wakes up for slots
+ * that have something to do.
+ * Timers are single shot, relays register again when they fire.
+ */
 class TimerDrive : public QObject
 {
     Q_OBJECT
 
 public:
+    /**
+     * @return the timer drive, or null while the application is exiting
+     */
     static TimerDrive *self();
-    void registerTimer(const Timer *t, int msec);
-    void unregisterTimer(const Timer *t, int msec);
+
+    /**
+     * Fires @p client after @p msec, rounded up to the next slot.
+     * If the client was already registered, the previous timer is replaced.
+     * When called while timers are being fired, the time is counted from
+     * the slot being fired, so periodic timers don't drift.
+     */
+    void registerTimer(TimerDriveClient *client, int msec);
+
+    /**
+     * Fires @p client at @p msecsSinceEpoch, rounded up to the next slot.
+     * All the clients aligned to the same point in time share the same slot.
+     * The timer follows changes of the wall clock and suspends of the system.
+     */
+    void registerAlignedTimer(TimerDriveClient *client, qint64 msecsSinceEpoch);
+
+    void unregisterTimer(TimerDriveClient *client);
+
+    /**
+     * @return the slot @p client is going to be fired in, -1 if none
+     */
+    qint64 expiry(TimerDriveClient *client) const;
+
+    /**
+     * @return how many times the drive woke up to fire relays
+     */
+    quint64 wakeupCount() const;
+
+    /**
+     * @return how many relay timers were fired, over wakeupCount() wakeups
+     */
+    quint64 firedCount() const;
 
 protected:
-    void timerEvent(QTimerEvent *event);
+    void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
 
 private:
     friend class TimerDriveSingleton;
@@ -50,4 +186,3 @@ private:
 } // namespace Plasma
 
 #endif
-
@@ -23,8 +23,6 @@
 #include <QDir>
 #include <QSqlError>
 #include <QSqlQuery>
-#include <QSqlField>
-#include <QSqlDriver>
 #include <QSqlRecord>
 #include <QDataStream>
 
@@ -57,6 +55,12 @@ StorageThread::StorageThread(QObject *parent)
     : QThread(parent)
 {
     qAddPostRoutine(closeConnection);
+
+    // saves queued while the thread is busy, e.g. all the sources of an
+    // engine being stored together, are written in the same transaction
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    connect(&m_flushTimer, &QTimer::timeout, this, &StorageThread::flushSaves);
 }
 
 StorageThread::~StorageThread()
@@ -70,31 +74,61 @@ Plasma::StorageThread *StorageThread::self()
 
 void StorageThread::closeDb()
 {
+    flushSaves();
+
+    m_queries.clear();
+    m_tables.clear();
     QString name = m_db.connectionName();
-    QSqlDatabase::removeDatabase(name);
     m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
 }
 
-void StorageThread::initializeDb(StorageJob *caller)
+bool StorageThread::initializeDb(const QString &clientName)
 {
-    if (!m_db.open()) {
-        m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("plasma-storage-%1").arg((quintptr)this));
-        const QString storageDir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
-        QDir().mkpath(storageDir);
-        m_db.setDatabaseName(storageDir + QLatin1Char('/') + QStringLiteral("plasma-storage2.db"));
+    if (!m_db.isOpen()) {
+        if (!m_db.isValid()) {
+            m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("plasma-storage-%1").arg((quintptr)this));
+            const QString storageDir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+            QDir().mkpath(storageDir);
+            m_db.setDatabaseName(storageDir + QLatin1Char('/') + QStringLiteral("plasma-storage2.db"));
+        }
+
+        if (!m_db.open()) {
+            qCWarning(LOG_PLASMA) << "Unable to open the plasma storage cache database: " << m_db.lastError();
+            return false;
+        }
+
+        // with the write ahead log, transactions don't need to sync the database file
+        QSqlQuery pragma(m_db);
+        pragma.exec(QStringLiteral("PRAGMA journal_mode=WAL"));
+        pragma.exec(QStringLiteral("PRAGMA synchronous=NORMAL"));
+
+        m_queries.clear();
+        m_tables = m_db.tables().toSet();
     }
 
-    if (!m_db.open()) {
-        qCWarning(LOG_PLASMA) << "Unable to open the plasma storage cache database: " << m_db.lastError();
-    } else if (!m_db.tables().contains(caller->clientName())) {
+    if (!m_tables.contains(clientName)) {
         QSqlQuery query(m_db);
-        query.prepare(QStringLiteral("create table ") + caller->clientName() + QStringLiteral(" (valueGroup varchar(256), id varchar(256), txt TEXT, int INTEGER, float REAL, binary BLOB, creationTime datetime, accessTime datetime, primary key (valueGroup, id))"));
+        query.prepare(QStringLiteral("create table ") + clientName + QStringLiteral(" (valueGroup varchar(256), id varchar(256), txt TEXT, int INTEGER, float REAL, binary BLOB, creationTime datetime, accessTime datetime, primary key (valueGroup, id))"));
         if (!query.exec()) {
-            qCWarning(LOG_PLASMA) << "Unable to create table for" << caller->clientName();
-            m_db.close();
+            qCWarning(LOG_PLASMA) << "Unable to create table for" << clientName;
+            return false;
         }
+        m_tables.insert(clientName);
     }
-    m_db.transaction();
+
+    return true;
+}
+
+QSqlQuery &StorageThread::cachedQuery(const QString &statement)
+{
+    QHash<QString, QSqlQuery>::iterator it = m_queries.find(statement);
+    if (it == m_queries.end()) {
+        it = m_queries.insert(statement, QSqlQuery(m_db));
+        it->prepare(statement);
+    }
+
+    return *it;
 }
 
 void StorageThread::save(QWeakPointer<StorageJob> wcaller, const QVariantMap &params)
@@ -104,44 +138,10 @@ void StorageThread::save(QWeakPointer<StorageJob> wcaller, const QVariantMap &pa
         return;
     }
 
-    initializeDb(caller);
     QString valueGroup = params[QStringLiteral("group")].toString();
     if (valueGroup.isEmpty()) {
         valueGroup = QStringLiteral("default");
     }
-    QSqlQuery query(m_db);
-    if (params.value(QStringLiteral("key")).toString().isNull()) {
-        caller->data().insert(params.value(QStringLiteral("key")).toString(), params.value(QStringLiteral("data")));
-    }
-
-    QMapIterator<QString, QVariant> it(caller->data());
-
-    QString ids;
-    while (it.hasNext()) {
-        it.next();
-        QSqlField field(QStringLiteral(":id"), QVariant::String);
-        field.setValue(it.key());
-        if (!ids.isEmpty()) {
-            ids.append(QStringLiteral(", "));
-        }
-        ids.append(m_db.driver()->formatValue(field));
-    }
-
-    query.prepare(QStringLiteral("delete from ") + caller->clientName() + QStringLiteral(" where valueGroup = :valueGroup and id in (") + ids + QStringLiteral(");"));
-    query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
-
-    if (!query.exec()) {
-        m_db.commit();
-        emit newResult(caller, false);
-        return;
-    }
-
-    query.prepare(QStringLiteral("insert into ") + caller->clientName() + QStringLiteral(" values(:valueGroup, :id, :txt, :int, :float, :binary, date('now'), date('now'))"));
-    query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
-    query.bindValue(QStringLiteral(":txt"), QVariant());
-    query.bindValue(QStringLiteral(":int"), QVariant());
-    query.bindValue(QStringLiteral(":float"), QVariant());
-    query.bindValue(QStringLiteral(":binary"), QVariant());
 
     const QString key = params.value(QStringLiteral("key")).toString();
     if (!key.isEmpty()) {
@@ -150,11 +150,31 @@ void StorageThread::save(QWeakPointer<StorageJob> wcaller, const QVariantMap &pa
         caller->setData(data);
     }
 
-    it.toFront();
+    m_pendingSaves.append({wcaller, caller->clientName(), valueGroup, caller->data()});
+    m_flushTimer.start();
+}
+
+bool StorageThread::writeSave(const PendingSave &save)
+{
+    if (!initializeDb(save.clientName)) {
+        return false;
+    }
+
+    // a save replaces the previous values of the same ids, as a whole
+    QSqlQuery &query = cachedQuery(QStringLiteral("insert or replace into ") + save.clientName + QStringLiteral(" values(:valueGroup, :id, :txt, :int, :float, :binary, date('now'), date('now'))"));
+    QSqlQuery &remove = cachedQuery(QStringLiteral("delete from ") + save.clientName + QStringLiteral(" where valueGroup=:valueGroup and id=:key"));
+    query.bindValue(QStringLiteral(":valueGroup"), save.valueGroup);
+    remove.bindValue(QStringLiteral(":valueGroup"), save.valueGroup);
+
+    QMapIterator<QString, QVariant> it(save.data);
     while (it.hasNext()) {
         it.next();
-        //qCDebug(LOG_PLASMA) << "going to insert" << valueGroup << it.key();
+        //qCDebug(LOG_PLASMA) << "going to insert" << save.valueGroup << it.key();
         query.bindValue(QStringLiteral(":id"), it.key());
+        query.bindValue(QStringLiteral(":txt"), QVariant());
+        query.bindValue(QStringLiteral(":int"), QVariant());
+        query.bindValue(QStringLiteral(":float"), QVariant());
+        query.bindValue(QStringLiteral(":binary"), QVariant());
 
         QString field;
         bool binary = false;
@@ -174,6 +194,9 @@ void StorageThread::save(QWeakPointer<StorageJob> wcaller, const QVariantMap &pa
             field = QStringLiteral(":binary");
             break;
         default:
+            // values that can't be stored don't leave the previous one behind
+            remove.bindValue(QStringLiteral(":key"), it.key());
+            remove.exec();
             continue;
             break;
         }
@@ -189,16 +212,43 @@ void StorageThread::save(QWeakPointer<StorageJob> wcaller, const QVariantMap &pa
 
         if (!query.exec()) {
             //qCDebug(LOG_PLASMA) << "query failed:" << query.lastQuery() << query.lastError().text();
-            m_db.commit();
-            emit newResult(caller, false);
-            return;
+            return false;
         }
+    }
 
-        query.bindValue(field, QVariant());
+    return true;
+}
+
+void StorageThread::flushSaves()
+{
+    m_flushTimer.stop();
+    if (m_pendingSaves.isEmpty()) {
+        return;
+    }
+
+    QList<PendingSave> saves;
+    saves.swap(m_pendingSaves);
+
+    QList<QPair<QWeakPointer<StorageJob>, bool> > results;
+    const bool transaction = initializeDb(saves.first().clientName) && m_db.transaction();
+
+    for (const PendingSave &save : saves) {
+        results.append(qMakePair(save.caller, writeSave(save)));
     }
-    m_db.commit();
 
-    emit newResult(caller, true);
+    if (transaction && !m_db.commit()) {
+        qCWarning(LOG_PLASMA) << "Unable to write to the plasma storage cache database: " << m_db.lastError();
+        m_db.rollback();
+        for (auto &result : results) {
+            result.second = false;
+        }
+    }
+
+    for (const auto &result : results) {
+        if (StorageJob *caller = result.first.data()) {
+            emit newResult(caller, result.second);
+        }
+    }
 }
 
 void StorageThread::retrieve(QWeakPointer<StorageJob> wcaller, const QVariantMap &params)
@@ -208,33 +258,39 @@ void StorageThread::retrieve(QWeakPointer<StorageJob> wcaller, const QVariantMap
         return;
     }
 
+    // the data may still be in the queue
+    flushSaves();
+
     const QString clientName = caller->clientName();
-    initializeDb(caller);
+    if (!initializeDb(clientName)) {
+        emit newResult(caller, false);
+        return;
+    }
+
     QString valueGroup = params[QStringLiteral("group")].toString();
     if (valueGroup.isEmpty()) {
         valueGroup = QStringLiteral("default");
     }
 
-    QSqlQuery query(m_db);
-
     //a bit redundant but should be the faster way with less string concatenation as possible
     if (params[QStringLiteral("key")].toString().isEmpty()) {
         //update modification time
-        query.prepare(QStringLiteral("update ") + clientName + QStringLiteral(" set accessTime=date('now') where valueGroup=:valueGroup"));
-        query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
-        query.exec();
-
-        query.prepare(QStringLiteral("select * from ") + clientName + QStringLiteral(" where valueGroup=:valueGroup"));
-        query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+        QSqlQuery &update = cachedQuery(QStringLiteral("update ") + clientName + QStringLiteral(" set accessTime=date('now') where valueGroup=:valueGroup"));
+        update.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+        update.exec();
     } else {
         //update modification time
-        query.prepare(QStringLiteral("update ") + clientName + QStringLiteral(" set accessTime=date('now') where valueGroup=:valueGroup and id=:key"));
-        query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
-        query.bindValue(QStringLiteral(":key"), params[QStringLiteral("key")].toString());
-        query.exec();
+        QSqlQuery &update = cachedQuery(QStringLiteral("update ") + clientName + QStringLiteral(" set accessTime=date('now') where valueGroup=:valueGroup and id=:key"));
+        update.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+        update.bindValue(QStringLiteral(":key"), params[QStringLiteral("key")].toString());
+        update.exec();
+    }
 
-        query.prepare(QStringLiteral("select * from ") + clientName + QStringLiteral(" where valueGroup=:valueGroup and id=:key"));
-        query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+    QSqlQuery &query = params[QStringLiteral("key")].toString().isEmpty() ?
+                       cachedQuery(QStringLiteral("select * from ") + clientName + QStringLiteral(" where valueGroup=:valueGroup")) :
+                       cachedQuery(QStringLiteral("select * from ") + clientName + QStringLiteral(" where valueGroup=:valueGroup and id=:key"));
+    query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+    if (!params[QStringLiteral("key")].toString().isEmpty()) {
         query.bindValue(QStringLiteral(":key"), params[QStringLiteral("key")].toString());
     }
 
@@ -271,6 +327,9 @@ void StorageThread::retrieve(QWeakPointer<StorageJob> wcaller, const QVariantMap
         result = false;
     }
 
+    // the statement is reused, release its read lock on the database
+    query.finish();
+
     emit newResult(caller, result);
 }
 
@@ -281,26 +340,30 @@ void StorageThread::deleteEntry(QWeakPointer<StorageJob> wcaller, const QVariant
         return;
     }
 
-    initializeDb(caller);
+    flushSaves();
+
+    if (!initializeDb(caller->clientName())) {
+        emit newResult(caller, false);
+        return;
+    }
+
     QString valueGroup = params[QStringLiteral("group")].toString();
     if (valueGroup.isEmpty()) {
         valueGroup = QStringLiteral("default");
     }
 
-    QSqlQuery query(m_db);
-
+    bool success;
     if (params[QStringLiteral("key")].toString().isEmpty()) {
-        query.prepare(QStringLiteral("delete from ") + caller->clientName() + QStringLiteral(" where valueGroup=:valueGroup"));
+        QSqlQuery &query = cachedQuery(QStringLiteral("delete from ") + caller->clientName() + QStringLiteral(" where valueGroup=:valueGroup"));
         query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
+        success = query.exec();
     } else {
-        query.prepare(QStringLiteral("delete from ") + caller->clientName() + QStringLiteral(" where valueGroup=:valueGroup and id=:key"));
+        QSqlQuery &query = cachedQuery(QStringLiteral("delete from ") + caller->clientName() + QStringLiteral(" where valueGroup=:valueGroup and id=:key"));
         query.bindValue(QStringLiteral(":valueGroup"), valueGroup);
         query.bindValue(QStringLiteral(":key"), params[QStringLiteral("key")].toString());
+        success = query.exec();
     }
 
-    const bool success = query.exec();
-    m_db.commit();
-
     emit newResult(caller, success);
 }
 
@@ -311,7 +374,13 @@ void StorageThread::expire(QWeakPointer<StorageJob> wcaller, const QVariantMap &
         return;
     }
 
-    initializeDb(caller);
+    flushSaves();
+
+    if (!initializeDb(caller->clientName())) {
+        emit newResult(caller, false);
+        return;
+    }
+
     QString valueGroup = params[QStringLiteral("group")].toString();
     if (valueGroup.isEmpty()) {
         valueGroup = QStringLiteral("default");
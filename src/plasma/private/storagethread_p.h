@@ -21,7 +21,11 @@
 #define STORAGETHREAD_H
 
 #include <QThread>
+#include <QHash>
+#include <QSet>
 #include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTimer>
 #include <QWeakPointer>
 
 #include "storage_p.h"
@@ -51,9 +55,30 @@ public Q_SLOTS:
 Q_SIGNALS:
     void newResult(StorageJob *caller, const QVariant &result);
 
+private Q_SLOTS:
+    /**
+     * Writes all the queued saves in a single transaction
+     */
+    void flushSaves();
+
 private:
-    void initializeDb(StorageJob *caller);
+    struct PendingSave {
+        QWeakPointer<StorageJob> caller;
+        QString clientName;
+        QString valueGroup;
+        QVariantMap data;
+    };
+
+    bool initializeDb(const QString &clientName);
+    bool writeSave(const PendingSave &save);
+    // statements are prepared once, then reused for as long as the database is open
+    QSqlQuery &cachedQuery(const QString &statement);
+
     QSqlDatabase m_db;
+    QSet<QString> m_tables;
+    QHash<QString, QSqlQuery> m_queries;
+    QList<PendingSave> m_pendingSaves;
+    QTimer m_flushTimer;
 };
 
 }
@@ -0,0 +1,156 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "private/stylesheettemplate_p.h"
+
+namespace Plasma
+{
+
+static const char *const s_placeholderNames[StyleSheetTemplate::PlaceholderCount] = {
+    "textcolor",
+    "backgroundcolor",
+    "highlightcolor",
+    "highlightedtextcolor",
+    "visitedlink",
+    "activatedlink",
+    "hoveredlink",
+    "link",
+    "positivetextcolor",
+    "neutraltextcolor",
+    "negativetextcolor",
+
+    "buttontextcolor",
+    "buttonbackgroundcolor",
+    "buttonhovercolor",
+    "buttonfocuscolor",
+    "buttonhighlightedtextcolor",
+    "buttonpositivetextcolor",
+    "buttonneutraltextcolor",
+    "buttonnegativetextcolor",
+
+    "viewtextcolor",
+    "viewbackgroundcolor",
+    "viewhovercolor",
+    "viewfocuscolor",
+    "viewhighlightedtextcolor",
+    "viewpositivetextcolor",
+    "viewneutraltextcolor",
+    "viewnegativetextcolor",
+
+    "complementarytextcolor",
+    "complementarybackgroundcolor",
+    "complementaryhovercolor",
+    "complementaryfocuscolor",
+    "complementaryhighlightedtextcolor",
+    "complementarypositivetextcolor",
+    "complementaryneutraltextcolor",
+    "complementarynegativetextcolor",
+
+    "fontsize",
+    "fontfamily",
+    "smallfontsize"
+};
+
+// the longest placeholder name found at position of css, -1 if none
+static int matchPlaceholder(const QString &css, int position, int *length)
+{
+    int match = -1;
+    *length = 0;
+
+    for (int i = 0; i < StyleSheetTemplate::PlaceholderCount; ++i) {
+        const QLatin1String name(s_placeholderNames[i]);
+        if (name.size() > *length && css.midRef(position, name.size()) == name) {
+            match = i;
+            *length = name.size();
+        }
+    }
+
+    return match;
+}
+
+StyleSheetTemplate::StyleSheetTemplate()
+    : m_literalSize(0)
+{
+}
+
+StyleSheetTemplate::StyleSheetTemplate(const QString &css)
+    : m_literalSize(0)
+{
+    int literalStart = 0;
+    int position = css.indexOf(QLatin1Char('%'));
+
+    while (position >= 0) {
+        int length;
+        const int placeholder = matchPlaceholder(css, position + 1, &length);
+
+        if (placeholder < 0) {
+            position = css.indexOf(QLatin1Char('%'), position + 1);
+            continue;
+        }
+
+        if (position > literalStart) {
+            const Segment literal = {-1, css.mid(literalStart, position - literalStart)};
+            m_segments << literal;
+            m_literalSize += literal.literal.size();
+        }
+
+        const Segment segment = {placeholder, QString()};
+        m_segments << segment;
+
+        literalStart = position + 1 + length;
+        position = css.indexOf(QLatin1Char('%'), literalStart);
+    }
+
+    if (literalStart < css.size()) {
+        const Segment literal = {-1, css.mid(literalStart)};
+        m_segments << literal;
+        m_literalSize += literal.literal.size();
+    }
+}
+
+bool StyleSheetTemplate::isEmpty() const
+{
+    return m_segments.isEmpty();
+}
+
+QString StyleSheetTemplate::render(const Palette &palette) const
+{
+    Q_ASSERT(palette.size() == PlaceholderCount);
+
+    QString stylesheet;
+    // colors are 7 characters long: reserve enough to never reallocate in the common case
+    stylesheet.reserve(m_literalSize + 8 * m_segments.size());
+
+    for (const Segment &segment : m_segments) {
+        if (segment.placeholder < 0) {
+            stylesheet += segment.literal;
+        } else {
+            stylesheet += palette.at(segment.placeholder);
+        }
+    }
+
+    return stylesheet;
+}
+
+QString StyleSheetTemplate::placeholderName(Placeholder placeholder)
+{
+    return QLatin1Char('%') + QLatin1String(s_placeholderNames[placeholder]);
+}
+
+}
@@ -0,0 +1,117 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_STYLESHEETTEMPLATE_P_H
+#define PLASMA_STYLESHEETTEMPLATE_P_H
+
+#include <QString>
+#include <QVector>
+
+namespace Plasma
+{
+
+/**
+ * A stylesheet parsed once into literal and %placeholder segments,
+ * so that it can be rendered against a palette in a single pass.
+ */
+class StyleSheetTemplate
+{
+public:
+    // If you add placeholders here, add their name to the table in the .cpp as well
+    enum Placeholder {
+        TextColor = 0,
+        BackgroundColor,
+        HighlightColor,
+        HighlightedTextColor,
+        VisitedLink,
+        ActivatedLink,
+        HoveredLink,
+        Link,
+        PositiveTextColor,
+        NeutralTextColor,
+        NegativeTextColor,
+
+        ButtonTextColor,
+        ButtonBackgroundColor,
+        ButtonHoverColor,
+        ButtonFocusColor,
+        ButtonHighlightedTextColor,
+        ButtonPositiveTextColor,
+        ButtonNeutralTextColor,
+        ButtonNegativeTextColor,
+
+        ViewTextColor,
+        ViewBackgroundColor,
+        ViewHoverColor,
+        ViewFocusColor,
+        ViewHighlightedTextColor,
+        ViewPositiveTextColor,
+        ViewNeutralTextColor,
+        ViewNegativeTextColor,
+
+        ComplementaryTextColor,
+        ComplementaryBackgroundColor,
+        ComplementaryHoverColor,
+        ComplementaryFocusColor,
+        ComplementaryHighlightedTextColor,
+        ComplementaryPositiveTextColor,
+        ComplementaryNeutralTextColor,
+        ComplementaryNegativeTextColor,
+
+        FontSize,
+        FontFamily,
+        SmallFontSize,
+
+        PlaceholderCount
+    };
+
+    /**
+     * The values of all the placeholders, indexed by Placeholder
+     */
+    typedef QVector<QString> Palette;
+
+    StyleSheetTemplate();
+    explicit StyleSheetTemplate(const QString &css);
+
+    bool isEmpty() const;
+
+    /**
+     * @return the stylesheet with every placeholder replaced by its value in @p palette
+     */
+    QString render(const Palette &palette) const;
+
+    /**
+     * @return the name of @p placeholder, including the leading %
+     */
+    static QString placeholderName(Placeholder placeholder);
+
+private:
+    struct Segment {
+        // -1 for literal text
+        int placeholder;
+        QString literal;
+    };
+
+    QVector<Segment> m_segments;
+    int m_literalSize;
+};
+
+}
+
+#endif
@@ -20,42 +20,26 @@
 #ifndef PLASMA_SVG_P_H
 #define PLASMA_SVG_P_H
 
+#include <QColor>
 #include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPointer>
 #include <QSharedData>
 #include <QSvgRenderer>
 #include <QExplicitlySharedDataPointer>
 #include <QObject>
+#include <QThreadPool>
+#include <QVariant>
+
+#include "private/svgcachekey_p.h"
+#include "private/svgrenderer_p.h"
 
 namespace Plasma
 {
 
 class Svg;
-
-class SharedSvgRenderer : public QSvgRenderer, public QSharedData
-{
-    Q_OBJECT
-public:
-    typedef QExplicitlySharedDataPointer<SharedSvgRenderer> Ptr;
-
-    explicit SharedSvgRenderer(QObject *parent = nullptr);
-    SharedSvgRenderer(
-        const QString &filename,
-        const QString &styleSheet,
-        QHash<QString, QRectF> &interestingElements,
-        QObject *parent = nullptr);
-
-    SharedSvgRenderer(
-        const QByteArray &contents,
-        const QString &styleSheet,
-        QHash<QString, QRectF> &interestingElements,
-        QObject *parent = nullptr);
-
-private:
-    bool load(
-        const QByteArray &contents,
-        const QString &styleSheet,
-        QHash<QString, QRectF> &interestingElements);
-};
+class SvgPrivate;
 
 class SvgPrivate
 {
@@ -63,18 +47,27 @@ public:
     SvgPrivate(Svg *svg);
     ~SvgPrivate();
 
-    //This function is meant for the rects cache
+    //These functions are meant for the rects cache, the string id is the persisted one
     QString cacheId(const QString &elementId) const;
+    SvgCacheKey rectCacheKey(const QString &elementId) const;
 
-    //This function is meant for the pixmap cache
-    QString cachePath(const QString &path, const QSize &size) const;
+    //These functions are meant for the pixmap cache
+    static SvgCacheKey pixmapCacheKey(quint64 path, const QString &elementId, const QSize &size, Svg::Status status, qreal devicePixelRatio, Theme::ColorGroup colorGroup, quint16 styleCrc);
+    static quint16 styleSheetCrc(const QString &styleSheet);
+    quint64 pathKey();
+    quint16 currentStyleCrc();
 
     bool setImagePath(const QString &imagePath);
 
     Theme *actualTheme();
     Theme *cacheAndColorsTheme();
 
+    //Computes the pixmap cache key of elementId rendered at s, the id of the element that
+    //will actually be rendered and its size in device pixels. Returns false if there
+    //is nothing to render
+    bool renderCacheKey(const QString &elementId, qreal ratio, const QSizeF &s, SvgCacheKey &key, QString &actualElementId, QSize &size);
     QPixmap findInCache(const QString &elementId, qreal ratio, const QSizeF &s = QSizeF());
+    bool requestPixmap(const QString &elementId, qreal ratio, const QSizeF &s);
 
     void createRenderer();
     void eraseRenderer();
@@ -87,25 +80,28 @@ public:
 
     //Following two are utility functions to snap rendered elements to the pixel grid
     //to and from are always 0 <= val <= 1
-    qreal closestDistance(qreal to, qreal from);
+    static qreal closestDistance(qreal to, qreal from);
 
-    QRectF makeUniform(const QRectF &orig, const QRectF &dst);
+    static QRectF makeUniform(const QRectF &orig, const QRectF &dst);
 
     //Slots
     void themeChanged();
     void colorsChanged();
+    QVariantMap rendererPoolStatistics() const;
 
-    static QHash<QString, SharedSvgRenderer::Ptr> s_renderers;
     static QWeakPointer<Theme> s_systemColorsCache;
     static qreal s_lastScaleFactor;
 
     Svg *q;
     QWeakPointer<Theme> theme;
-    QHash<QString, QRectF> localRectCache;
+    QHash<SvgCacheKey, QRectF> localRectCache;
     QHash<QString, QSize> elementsWithSizeHints;
     SharedSvgRenderer::Ptr renderer;
     QString themePath;
     QString path;
+    //path as interned in the cache keys
+    QString hashedPath;
+    quint64 pathHash;
     QSizeF size;
     QSizeF naturalSize;
     QChar styleCrc;
@@ -124,6 +120,69 @@ public:
     bool themeFailed : 1;
 };
 
+/**
+ * Renders elements in a thread pool on behalf of Svg::requestPixmap.
+ * QSvgRenderer can't be shared between threads, so every thread of the pool
+ * keeps its own renderers; the results are put in the pixmap cache from the
+ * GUI thread, then the requesting Svg objects are notified with pixmapReady.
+ */
+class SvgRenderQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Request {
+        QString key;
+        QString path;
+        QString styleSheet;
+        QString elementId;
+        QSize size;
+        QColor colorizeColor;
+        QChar styleCrc;
+        bool applyColors;
+    };
+
+    SvgRenderQueue();
+    ~SvgRenderQueue();
+
+    static SvgRenderQueue *self();
+
+    /**
+     * Queues the rendering of @p request for @p svg. Identical requests from
+     * different Svg objects share the same rendering.
+     */
+    void enqueue(SvgPrivate *svg, const Request &request, const QString &elementId, const QSize &size, qreal ratio);
+
+    /**
+     * Called when the renderer of @p path with the given style is released
+     * by the GUI thread, the copies in the pool threads are not reused anymore
+     */
+    void releaseRenderer(QChar styleCrc, const QString &path);
+
+    // called from the pool threads
+    void addResult(const QString &job, const QImage &image);
+
+private Q_SLOTS:
+    void flushResults();
+
+private:
+    struct Waiter {
+        QPointer<Svg> svg;
+        SvgPrivate *d;
+        QString key;
+        QString elementId;
+        QString actualElementId;
+        QSize size;
+        qreal ratio;
+    };
+
+    QThreadPool m_pool;
+    QHash<QString, QList<Waiter> > m_waiters;
+    QHash<QString, int> m_rendererGenerations;
+    QMutex m_resultsMutex;
+    QList<QPair<QString, QImage> > m_results;
+};
+
 }
 
 #endif
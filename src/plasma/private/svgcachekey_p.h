@@ -0,0 +1,143 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_SVGCACHEKEY_P_H
+#define PLASMA_SVGCACHEKEY_P_H
+
+#include <cstddef>
+#include <cstring>
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QStringBuilder>
+
+namespace Plasma
+{
+
+/**
+ * Identifies a rendering of an svg element, or of a whole frame, in the
+ * in-process caches.
+ *
+ * Image paths and element ids are interned as 64 bit hashes, and the hash of
+ * the whole key is computed once when the key is built, so lookups and
+ * comparisons don't involve any string.
+ * The key is turned into a string only to be persisted, e.g. in the
+ * KImageCache shared between processes: there the image path and element id
+ * are spelled out, as a collision of their hashes would serve the wrong image
+ * to every process using the cache.
+ */
+struct SvgCacheKey
+{
+    quint64 path;
+    quint64 element;
+    qint32 width;
+    qint32 height;
+    quint16 styleCrc;
+    quint16 flags;
+    quint8 status;
+    quint8 colorGroup;
+    quint8 devicePixelRatio;
+    quint8 scaleFactor;
+    // hash of all the fields above, set by seal()
+    quint64 hash;
+
+    // width and height of keys referring to the natural size of an element
+    enum { NaturalSize = -1 };
+
+    static SvgCacheKey create(quint64 path, quint64 element, const QSize &size, int status, qreal devicePixelRatio,
+                              int colorGroup = 0, quint16 styleCrc = 0, quint16 flags = 0, qreal scaleFactor = 1)
+    {
+        SvgCacheKey key;
+        key.path = path;
+        key.element = element;
+        key.width = size.width();
+        key.height = size.height();
+        key.styleCrc = styleCrc;
+        key.flags = flags;
+        key.status = quint8(status);
+        key.colorGroup = quint8(colorGroup);
+        key.devicePixelRatio = quint8(devicePixelRatio);
+        key.scaleFactor = quint8(scaleFactor);
+        key.seal();
+        return key;
+    }
+
+    static quint64 hashString(const QString &string)
+    {
+        // FNV-1a, 64 bit
+        quint64 hash = Q_UINT64_C(14695981039346656037);
+        const ushort *data = string.utf16();
+        for (int i = 0; i < string.size(); ++i) {
+            hash ^= data[i];
+            hash *= Q_UINT64_C(1099511628211);
+        }
+        return hash;
+    }
+
+    void seal()
+    {
+        hash = Q_UINT64_C(14695981039346656037);
+        const uchar *data = reinterpret_cast<const uchar *>(this);
+        for (size_t i = 0; i < offsetof(SvgCacheKey, hash); ++i) {
+            hash ^= data[i];
+            hash *= Q_UINT64_C(1099511628211);
+        }
+    }
+
+    /**
+     * @return the persisted form of the key, @p pathString and @p elementString
+     * being the strings the path and element were hashed from
+     */
+    QString toString(const QString &pathString, const QString &elementString) const
+    {
+        Q_ASSERT(hashString(pathString) == path);
+        Q_ASSERT(hashString(elementString) == element);
+
+        const QLatin1Char s('_');
+        return QString::number(width) % s % QString::number(height) % s %
+               QString::number(status) % s % QString::number(colorGroup) % s %
+               QString::number(devicePixelRatio) % s % QString::number(scaleFactor) % s %
+               QString::number(flags, 16) % s % QString::number(styleCrc, 16) % s %
+               elementString % s % pathString;
+    }
+};
+
+Q_STATIC_ASSERT(sizeof(SvgCacheKey) == 40);
+
+inline bool operator==(const SvgCacheKey &a, const SvgCacheKey &b)
+{
+    return a.hash == b.hash && std::memcmp(&a, &b, offsetof(SvgCacheKey, hash)) == 0;
+}
+
+inline bool operator!=(const SvgCacheKey &a, const SvgCacheKey &b)
+{
+    return !(a == b);
+}
+
+inline uint qHash(const SvgCacheKey &key, uint seed = 0)
+{
+    return uint(key.hash ^ (key.hash >> 32)) ^ seed;
+}
+
+}
+
+Q_DECLARE_TYPEINFO(Plasma::SvgCacheKey, Q_PRIMITIVE_TYPE);
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "svgrectscache_p.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+
+#include "debug_p.h"
+#include "private/svgcachekey_p.h"
+
+namespace Plasma
+{
+
+static const char s_magic[4] = { 'P', 'S', 'R', 'C' };
+// bump this every time the layout of Header or Entry changes
+static const quint32 s_version = 1;
+// same limit the KConfig based cache used to have
+static const int s_maxInvalidElements = 1000;
+
+struct SvgRectsCache::Header {
+    char magic[4];
+    quint32 version;
+    quint64 iconTheme;
+    quint32 entryCount;
+    // size of the string table, in QChars
+    quint32 stringSize;
+};
+
+struct SvgRectsCache::Entry {
+    quint64 image;
+    quint64 element;
+    // a negative width marks an element we know doesn't exist
+    float x;
+    float y;
+    float width;
+    float height;
+    quint32 nameOffset;
+    quint32 nameLength;
+};
+
+static_assert(sizeof(SvgRectsCache::Header) == 24, "the cache header must keep entries 8 bytes aligned");
+static_assert(sizeof(SvgRectsCache::Entry) == 40, "the cache entries must be packed");
+
+static inline bool entryLessThan(const SvgRectsCache::Entry &a, const SvgRectsCache::Entry &b);
+
+quint64 SvgRectsCache::hashKey(const QString &key)
+{
+    return SvgCacheKey::hashString(key);
+}
+
+
+SvgRectsCache::Index::Index()
+    : stale(false),
+      m_data(nullptr),
+      m_entries(nullptr),
+      m_strings(nullptr),
+      m_entryCount(0),
+      m_stringSize(0)
+{
+}
+
+SvgRectsCache::Index::~Index()
+{
+    unmap();
+}
+
+bool SvgRectsCache::Index::map(const QString &filePath, quint64 iconTheme)
+{
+    unmap();
+    stale = false;
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    if (size < qint64(sizeof(Header))) {
+        stale = true;
+        unmap();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if (!m_data) {
+        qCWarning(LOG_PLASMA) << "Could not map the svg rects cache" << filePath;
+        unmap();
+        return false;
+    }
+
+    const Header *header = reinterpret_cast<const Header *>(m_data);
+    const qint64 expectedSize = qint64(sizeof(Header)) +
+                                qint64(header->entryCount) * qint64(sizeof(Entry)) +
+                                qint64(header->stringSize) * qint64(sizeof(QChar));
+
+    if (memcmp(header->magic, s_magic, sizeof(s_magic)) != 0 ||
+            header->version != s_version ||
+            header->iconTheme != iconTheme ||
+            size != expectedSize) {
+        stale = true;
+        unmap();
+        return false;
+    }
+
+    m_entryCount = header->entryCount;
+    m_stringSize = header->stringSize;
+    m_entries = reinterpret_cast<const Entry *>(m_data + sizeof(Header));
+    m_strings = reinterpret_cast<const QChar *>(m_data + sizeof(Header) + m_entryCount * sizeof(Entry));
+
+    return true;
+}
+
+void SvgRectsCache::Index::unmap()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+    m_file.close();
+
+    m_data = nullptr;
+    m_entries = nullptr;
+    m_strings = nullptr;
+    m_entryCount = 0;
+    m_stringSize = 0;
+}
+
+const SvgRectsCache::Entry *SvgRectsCache::Index::find(quint64 image, quint64 element) const
+{
+    Entry key;
+    key.image = image;
+    key.element = element;
+
+    const Entry *it = std::lower_bound(begin(), end(), key, entryLessThan);
+    if (it != end() && it->image == image && it->element == element) {
+        return it;
+    }
+
+    return nullptr;
+}
+
+QPair<const SvgRectsCache::Entry *, const SvgRectsCache::Entry *> SvgRectsCache::Index::range(quint64 image) const
+{
+    const auto imageLessThan = [](const Entry &a, const Entry &b) {
+        return a.image < b.image;
+    };
+
+    Entry key;
+    key.image = image;
+
+    const auto r = std::equal_range(begin(), end(), key, imageLessThan);
+    return qMakePair(r.first, r.second);
+}
+
+QString SvgRectsCache::Index::elementName(const Entry *entry) const
+{
+    if (entry->nameOffset + entry->nameLength > m_stringSize) {
+        return QString();
+    }
+
+    return QString(m_strings + entry->nameOffset, entry->nameLength);
+}
+
+const SvgRectsCache::Entry *SvgRectsCache::Index::begin() const
+{
+    return m_entries;
+}
+
+const SvgRectsCache::Entry *SvgRectsCache::Index::end() const
+{
+    return m_entries + m_entryCount;
+}
+
+
+static inline bool entryLessThan(const SvgRectsCache::Entry &a, const SvgRectsCache::Entry &b)
+{
+    return a.image < b.image || (a.image == b.image && a.element < b.element);
+}
+
+static inline QRectF entryRect(const SvgRectsCache::Entry *entry)
+{
+    if (entry->width < 0) {
+        return QRectF();
+    }
+
+    return QRectF(entry->x, entry->y, entry->width, entry->height);
+}
+
+
+SvgRectsCache::SvgRectsCache()
+    : m_iconTheme(0),
+      m_open(false),
+      m_dirty(false)
+{
+}
+
+SvgRectsCache::~SvgRectsCache()
+{
+    close();
+}
+
+bool SvgRectsCache::open(const QString &filePath, const QString &iconThemePath)
+{
+    close();
+
+    m_filePath = filePath;
+    m_iconTheme = hashKey(iconThemePath);
+    m_open = true;
+
+    const bool loaded = m_index.map(m_filePath, m_iconTheme);
+    // a stale index gets replaced at the next save, even if nothing else changed
+    m_dirty = m_index.stale;
+
+    return loaded;
+}
+
+void SvgRectsCache::close()
+{
+    m_index.unmap();
+    m_pending.clear();
+    m_open = false;
+    m_dirty = false;
+}
+
+bool SvgRectsCache::isOpen() const
+{
+    return m_open;
+}
+
+SvgRectsCache::LookupResult SvgRectsCache::find(const QString &image, const QString &element, QRectF &rect) const
+{
+    if (!m_open) {
+        return NotFound;
+    }
+
+    const quint64 imageKey = hashKey(image);
+    const quint64 elementKey = hashKey(element);
+
+    const auto pendingIt = m_pending.constFind(imageKey);
+    if (pendingIt != m_pending.constEnd()) {
+        const auto rectIt = pendingIt->rects.constFind(elementKey);
+        if (rectIt != pendingIt->rects.constEnd()) {
+            rect = rectIt->rect;
+            return rect.isValid() ? Found : KnownInvalid;
+        }
+
+        if (pendingIt->cleared) {
+            return NotFound;
+        }
+    }
+
+    const Entry *entry = m_index.find(imageKey, elementKey);
+    if (!entry) {
+        return NotFound;
+    }
+
+    rect = entryRect(entry);
+    return rect.isValid() ? Found : KnownInvalid;
+}
+
+QStringList SvgRectsCache::keys(const QString &image) const
+{
+    QStringList keys;
+
+    if (!m_open) {
+        return keys;
+    }
+
+    const quint64 imageKey = hashKey(image);
+    const auto pendingIt = m_pending.constFind(imageKey);
+    const bool hasPending = pendingIt != m_pending.constEnd();
+
+    if (!hasPending || !pendingIt->cleared) {
+        const auto range = m_index.range(imageKey);
+        for (const Entry *entry = range.first; entry != range.second; ++entry) {
+            if (entry->width < 0 || (hasPending && pendingIt->rects.contains(entry->element))) {
+                continue;
+            }
+            keys << m_index.elementName(entry);
+        }
+    }
+
+    if (hasPending) {
+        for (const PendingRect &pending : pendingIt->rects) {
+            if (pending.rect.isValid()) {
+                keys << pending.element;
+            }
+        }
+    }
+
+    return keys;
+}
+
+void SvgRectsCache::insert(const QString &image, const QString &element, const QRectF &rect)
+{
+    if (!m_open) {
+        return;
+    }
+
+    // don't schedule any write if we already know about it
+    QRectF oldRect;
+    const LookupResult result = find(image, element, oldRect);
+    if ((result == Found && oldRect == rect) ||
+            (result == KnownInvalid && !rect.isValid())) {
+        return;
+    }
+
+    PendingImage &pending = m_pending[hashKey(image)];
+    const quint64 elementKey = hashKey(element);
+
+    pending.invalidElements.removeOne(elementKey);
+    if (!rect.isValid()) {
+        // the element that was looked for the longest time ago gets forgotten,
+        // it's only looked up again if it's ever asked for
+        if (pending.invalidElements.size() >= s_maxInvalidElements) {
+            pending.rects.remove(pending.invalidElements.takeFirst());
+        }
+        pending.invalidElements.append(elementKey);
+    }
+
+    PendingRect pendingRect;
+    pendingRect.element = element;
+    pendingRect.rect = rect.isValid() ? rect : QRectF();
+    pending.rects.insert(elementKey, pendingRect);
+}
+
+void SvgRectsCache::invalidate(const QString &image)
+{
+    if (!m_open) {
+        return;
+    }
+
+    PendingImage &pending = m_pending[hashKey(image)];
+    pending.rects.clear();
+    pending.invalidElements.clear();
+    pending.cleared = true;
+}
+
+bool SvgRectsCache::hasPendingChanges() const
+{
+    return m_open && (m_dirty || !m_pending.isEmpty());
+}
+
+bool SvgRectsCache::hasPendingChanges(const QString &image) const
+{
+    return m_open && m_pending.contains(hashKey(image));
+}
+
+bool SvgRectsCache::save()
+{
+    if (!hasPendingChanges()) {
+        return true;
+    }
+
+    // Merge with what is on disk right now rather than with what we mapped
+    // at startup, so rects added by other processes in the meantime are kept
+    Index latest;
+    latest.map(m_filePath, m_iconTheme);
+
+    struct Record {
+        Entry entry;
+        QString name;
+    };
+    QVector<Record> records;
+    records.reserve(int(latest.end() - latest.begin()));
+
+    // invalid elements on disk are older than the pending ones, they go first past the limit
+    quint64 image = 0;
+    int invalidElements = 0;
+    for (const Entry *entry = latest.begin(); entry != latest.end(); ++entry) {
+        const auto pendingIt = m_pending.constFind(entry->image);
+        if (pendingIt != m_pending.constEnd() &&
+                (pendingIt->cleared || pendingIt->rects.contains(entry->element))) {
+            continue;
+        }
+
+        if (entry->width < 0) {
+            if (entry == latest.begin() || entry->image != image) {
+                image = entry->image;
+                invalidElements = pendingIt != m_pending.constEnd() ? pendingIt->invalidElements.size() : 0;
+            }
+            if (++invalidElements > s_maxInvalidElements) {
+                continue;
+            }
+        }
+
+        records.append({*entry, latest.elementName(entry)});
+    }
+
+    for (auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+        for (auto rectIt = it->rects.constBegin(); rectIt != it->rects.constEnd(); ++rectIt) {
+            Record record;
+            record.entry.image = it.key();
+            record.entry.element = rectIt.key();
+            if (rectIt->rect.isValid()) {
+                record.entry.x = rectIt->rect.x();
+                record.entry.y = rectIt->rect.y();
+                record.entry.width = rectIt->rect.width();
+                record.entry.height = rectIt->rect.height();
+            } else {
+                record.entry.x = record.entry.y = 0;
+                record.entry.width = record.entry.height = -1;
+            }
+            record.name = rectIt->element;
+            records.append(record);
+        }
+    }
+
+    std::sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+        return entryLessThan(a.entry, b.entry);
+    });
+
+    QVector<Entry> entries;
+    entries.reserve(records.size());
+    QString strings;
+    for (Record &record : records) {
+        record.entry.nameOffset = strings.size();
+        record.entry.nameLength = record.name.size();
+        strings += record.name;
+        entries.append(record.entry);
+    }
+
+    Header header;
+    memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.iconTheme = m_iconTheme;
+    header.entryCount = entries.size();
+    header.stringSize = strings.size();
+
+    latest.unmap();
+
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    // QSaveFile renames over the old index, processes that have it mapped keep the old inode
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(LOG_PLASMA) << "Could not write the svg rects cache" << m_filePath << file.errorString();
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(Entry));
+    file.write(reinterpret_cast<const char *>(strings.constData()), strings.size() * sizeof(QChar));
+
+    if (!file.commit()) {
+        qCWarning(LOG_PLASMA) << "Could not write the svg rects cache" << m_filePath << file.errorString();
+        return false;
+    }
+
+    m_pending.clear();
+    m_dirty = false;
+    m_index.map(m_filePath, m_iconTheme);
+
+    return true;
+}
+
+}
@@ -0,0 +1,146 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_SVGRECTSCACHE_P_H
+#define PLASMA_SVGRECTSCACHE_P_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QRectF>
+#include <QStringList>
+
+namespace Plasma
+{
+
+/**
+ * On-disk index of svg element rects, shared between all the processes
+ * using the same theme.
+ *
+ * The index is a sorted array of packed entries, mapped read-only in memory,
+ * so that lookups are a binary search over the mapped file without any parsing.
+ * Images and elements are interned as 64 bit hashes of their names.
+ * Changes are kept in memory as deltas and merged with the current on-disk
+ * index only when save() is called; the new index atomically replaces the
+ * old file, so other processes keep a consistent view of the version they mapped.
+ */
+class SvgRectsCache
+{
+public:
+    enum LookupResult {
+        NotFound = 0,
+        Found,
+        KnownInvalid
+    };
+
+    SvgRectsCache();
+    ~SvgRectsCache();
+
+    /**
+     * Maps the index at @p filePath.
+     * @return true if a valid index for the given icon theme has been loaded,
+     *         false if there was no index or if it was stale and will be replaced
+     */
+    bool open(const QString &filePath, const QString &iconThemePath);
+    void close();
+    bool isOpen() const;
+
+    LookupResult find(const QString &image, const QString &element, QRectF &rect) const;
+    QStringList keys(const QString &image) const;
+
+    /**
+     * Records the rect of @p element, or that it doesn't exist if @p rect is invalid.
+     * At most 1000 invalid elements are remembered per image, the oldest are
+     * forgotten first.
+     */
+    void insert(const QString &image, const QString &element, const QRectF &rect);
+    void invalidate(const QString &image);
+
+    bool hasPendingChanges() const;
+    bool hasPendingChanges(const QString &image) const;
+    /**
+     * Merges pending changes with the latest on-disk index and writes it back.
+     */
+    bool save();
+
+    static quint64 hashKey(const QString &key);
+
+    // on-disk layout, defined in svgrectscache.cpp
+    struct Header;
+    struct Entry;
+
+private:
+    Q_DISABLE_COPY(SvgRectsCache)
+
+    struct PendingRect {
+        QString element;
+        QRectF rect;
+    };
+
+    struct PendingImage {
+        PendingImage()
+            : cleared(false)
+        {
+        }
+
+        QHash<quint64, PendingRect> rects;
+        // elements of rects that don't exist, oldest first
+        QList<quint64> invalidElements;
+        bool cleared;
+    };
+
+    class Index
+    {
+    public:
+        Index();
+        ~Index();
+
+        bool map(const QString &filePath, quint64 iconTheme);
+        void unmap();
+
+        const Entry *find(quint64 image, quint64 element) const;
+        QPair<const Entry *, const Entry *> range(quint64 image) const;
+        QString elementName(const Entry *entry) const;
+
+        const Entry *begin() const;
+        const Entry *end() const;
+
+        bool stale;
+
+    private:
+        QFile m_file;
+        const uchar *m_data;
+        const Entry *m_entries;
+        const QChar *m_strings;
+        quint32 m_entryCount;
+        quint32 m_stringSize;
+    };
+
+    Index m_index;
+    QHash<quint64, PendingImage> m_pending;
+    QString m_filePath;
+    quint64 m_iconTheme;
+    bool m_open : 1;
+    bool m_dirty : 1;
+};
+
+}
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ *   Copyright 2006-2010 Aaron Seigo <aseigo@kde.org>
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "private/svgrenderer_p.h"
+
+#include <QBuffer>
+#include <QStringList>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include <kfilterdev.h>
+
+namespace Plasma
+{
+
+SharedSvgRenderer::SharedSvgRenderer(QObject *parent)
+    : QSvgRenderer(parent),
+      m_cost(0),
+      m_usesStyleSheet(false)
+{
+}
+
+SharedSvgRenderer::SharedSvgRenderer(
+    const QString &filename,
+    const QString &styleSheet,
+    QHash<QString, QRectF> *interestingElements,
+    QObject *parent)
+    : QSvgRenderer(parent),
+      m_cost(0),
+      m_usesStyleSheet(false)
+{
+    KCompressionDevice file(filename, KCompressionDevice::GZip);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    load(file.readAll(), styleSheet, interestingElements);
+}
+
+SharedSvgRenderer::SharedSvgRenderer(
+    const QByteArray &contents,
+    const QString &styleSheet,
+    QHash<QString, QRectF> *interestingElements,
+    QObject *parent)
+    : QSvgRenderer(parent),
+      m_cost(0),
+      m_usesStyleSheet(false)
+{
+    load(contents, styleSheet, interestingElements);
+}
+
+QString SharedSvgRenderer::sizeHintsScannedId()
+{
+    // '#' can't be part of an xml id, so this never clashes with a real element
+    return QStringLiteral("#sizehints");
+}
+
+// whether id has the NN-NN-elementid form of size hinted elements
+static bool isSizeHintedId(const QStringRef &id)
+{
+    int i = 0;
+    for (int part = 0; part < 2; ++part) {
+        const int start = i;
+        while (i < id.size() && id.at(i).isDigit()) {
+            ++i;
+        }
+        if (i == start || i >= id.size() || id.at(i) != QLatin1Char('-')) {
+            return false;
+        }
+        ++i;
+    }
+
+    return i < id.size();
+}
+
+// The parsed tree is not accessible. Every element becomes a node with its
+// own style, and path data turns into QPainterPath elements, several times
+// bigger than the text describing them.
+static qint64 estimatedCost(const QByteArray &contents)
+{
+    static const qint64 bytesPerTag = 256;
+    static const qint64 bytesPerSourceByte = 3;
+
+    return contents.count('<') * bytesPerTag + contents.size() * bytesPerSourceByte;
+}
+
+bool SharedSvgRenderer::load(
+    const QByteArray &contents,
+    const QString &styleSheet,
+    QHash<QString, QRectF> *interestingElements)
+{
+    m_usesStyleSheet = contents.contains("current-color-scheme");
+    m_cost = estimatedCost(contents);
+
+    const bool applyStyleSheet = !styleSheet.isEmpty() && m_usesStyleSheet;
+
+    if (!applyStyleSheet && !interestingElements) {
+        return QSvgRenderer::load(contents);
+    }
+
+    // A single pass over the document both injects the style sheet
+    // and collects the ids of the size hinted elements.
+    QByteArray processedContents;
+    QBuffer buffer(&processedContents);
+    QXmlStreamWriter writer;
+    if (applyStyleSheet) {
+        buffer.open(QIODevice::WriteOnly);
+        writer.setDevice(&buffer);
+    }
+
+    QStringList sizeHintedIds;
+    QXmlStreamReader reader(contents);
+    while (!reader.atEnd()) {
+        const QXmlStreamReader::TokenType token = reader.readNext();
+
+        if (token == QXmlStreamReader::StartElement) {
+            const QStringRef id = reader.attributes().value(QLatin1String("id"));
+
+            if (interestingElements && isSizeHintedId(id)) {
+                sizeHintedIds << id.toString();
+            }
+
+            if (applyStyleSheet &&
+                id == QLatin1String("current-color-scheme") &&
+                reader.qualifiedName() == QLatin1String("style")) {
+                writer.writeStartElement(QLatin1String("style"));
+                writer.writeAttributes(reader.attributes());
+                writer.writeCharacters(styleSheet);
+                writer.writeEndElement();
+                while (reader.tokenType() != QXmlStreamReader::EndElement) {
+                    reader.readNext();
+                }
+                continue;
+            }
+        }
+
+        if (applyStyleSheet && token != QXmlStreamReader::Invalid) {
+            writer.writeCurrentToken(reader);
+        }
+    }
+
+    if (applyStyleSheet) {
+        buffer.close();
+    }
+
+    if (!QSvgRenderer::load(applyStyleSheet ? processedContents : contents)) {
+        return false;
+    }
+
+    for (const QString &elementId : qAsConst(sizeHintedIds)) {
+        const QRectF elementRect = boundsOnElement(elementId);
+        if (elementRect.isValid()) {
+            interestingElements->insert(elementId, elementRect);
+        }
+    }
+
+    return true;
+}
+
+qint64 SharedSvgRenderer::cost() const
+{
+    return m_cost;
+}
+
+bool SharedSvgRenderer::usesStyleSheet() const
+{
+    return m_usesStyleSheet;
+}
+
+SvgRendererPool::SvgRendererPool(qint64 budget)
+    : m_budget(qMax<qint64>(0, budget)),
+      m_bytes(0),
+      m_idleBytes(0),
+      m_evictedBytes(0),
+      m_evicted(0)
+{
+}
+
+QString SvgRendererPool::key(const QString &path, QChar styleCrc) const
+{
+    if (m_stylelessPaths.contains(path)) {
+        return path;
+    }
+
+    return styleCrc + path;
+}
+
+SharedSvgRenderer::Ptr SvgRendererPool::find(const QString &path, QChar styleCrc)
+{
+    const QString rendererKey = key(path, styleCrc);
+    const SharedSvgRenderer::Ptr renderer = m_renderers.value(rendererKey);
+
+    // only the pool references it: an idle renderer is being used again
+    if (renderer && renderer->ref.load() == 2 && m_idle.removeOne(rendererKey)) {
+        m_idleBytes -= renderer->cost();
+    }
+
+    return renderer;
+}
+
+void SvgRendererPool::insert(const SharedSvgRenderer::Ptr &renderer, const QString &path, QChar styleCrc)
+{
+    if (path.isEmpty() || renderer->usesStyleSheet()) {
+        m_stylelessPaths.remove(path);
+    } else {
+        m_stylelessPaths.insert(path);
+    }
+
+    renderer->m_poolKey = key(path, styleCrc);
+    renderer->m_poolPath = path;
+
+    const SharedSvgRenderer::Ptr old = m_renderers.value(renderer->m_poolKey);
+    if (old) {
+        m_bytes -= old->cost();
+        if (m_idle.removeOne(old->m_poolKey)) {
+            m_idleBytes -= old->cost();
+        }
+    }
+
+    m_renderers.insert(renderer->m_poolKey, renderer);
+    m_bytes += renderer->cost();
+}
+
+void SvgRendererPool::release(const SharedSvgRenderer::Ptr &renderer)
+{
+    // the caller and the pool are the last references
+    if (!renderer || renderer->ref.load() != 2) {
+        return;
+    }
+
+    const auto it = m_renderers.constFind(renderer->m_poolKey);
+    if (it == m_renderers.constEnd() || it->data() != renderer.data()) {
+        return;
+    }
+
+    m_idle.append(renderer->m_poolKey);
+    m_idleBytes += renderer->cost();
+    evict(m_budget);
+}
+
+void SvgRendererPool::clearIdle()
+{
+    evict(0);
+}
+
+void SvgRendererPool::forget(const QString &directory)
+{
+    for (auto it = m_renderers.begin(); it != m_renderers.end();) {
+        const SharedSvgRenderer::Ptr &renderer = it.value();
+        if (!renderer->m_poolPath.startsWith(directory)) {
+            ++it;
+            continue;
+        }
+
+        if (m_idle.removeOne(it.key())) {
+            m_idleBytes -= renderer->cost();
+            m_evictedBytes += renderer->cost();
+            ++m_evicted;
+        }
+        m_bytes -= renderer->cost();
+        it = m_renderers.erase(it);
+    }
+
+    // documents without a color scheme may have got one
+    for (auto it = m_stylelessPaths.begin(); it != m_stylelessPaths.end();) {
+        if (it->startsWith(directory)) {
+            it = m_stylelessPaths.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SvgRendererPool::evict(qint64 budget)
+{
+    while (!m_idle.isEmpty() && (m_idleBytes > budget || budget == 0)) {
+        const SharedSvgRenderer::Ptr renderer = m_renderers.take(m_idle.takeFirst());
+        m_idleBytes -= renderer->cost();
+        m_bytes -= renderer->cost();
+        m_evictedBytes += renderer->cost();
+        ++m_evicted;
+    }
+}
+
+void SvgRendererPool::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    evict(m_budget);
+}
+
+qint64 SvgRendererPool::budget() const
+{
+    return m_budget;
+}
+
+SvgRendererPool::Statistics SvgRendererPool::statistics() const
+{
+    Statistics statistics;
+    statistics.live = m_renderers.count() - m_idle.count();
+    statistics.idle = m_idle.count();
+    statistics.evicted = m_evicted;
+    statistics.liveBytes = m_bytes - m_idleBytes;
+    statistics.idleBytes = m_idleBytes;
+    statistics.evictedBytes = m_evictedBytes;
+    return statistics;
+}
+
+QString SvgRendererPool::statisticsString() const
+{
+    const Statistics s = statistics();
+    return QStringLiteral("%1 live renderers (%2 KiB), %3 idle (%4 KiB), %5 evicted (%6 KiB)")
+           .arg(s.live).arg(s.liveBytes / 1024).arg(s.idle).arg(s.idleBytes / 1024)
+           .arg(s.evicted).arg(s.evictedBytes / 1024);
+}
+
+} // Plasma namespace
+
+#include "moc_svgrenderer_p.cpp"
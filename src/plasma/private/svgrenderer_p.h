@@ -0,0 +1,155 @@
+/*
+ *   Copyright 2006-2010 Aaron Seigo <aseigo@kde.org>
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_SVGRENDERER_P_H
+#define PLASMA_SVGRENDERER_P_H
+
+#include <QExplicitlySharedDataPointer>
+#include <QHash>
+#include <QList>
+#include <QRectF>
+#include <QSet>
+#include <QSharedData>
+#include <QSvgRenderer>
+
+namespace Plasma
+{
+
+class SharedSvgRenderer : public QSvgRenderer, public QSharedData
+{
+    Q_OBJECT
+public:
+    typedef QExplicitlySharedDataPointer<SharedSvgRenderer> Ptr;
+
+    explicit SharedSvgRenderer(QObject *parent = nullptr);
+    /**
+     * When @p interestingElements is not null, the rects of all the size
+     * hinted elements (NN-NN-id) of the document are collected in it.
+     */
+    SharedSvgRenderer(
+        const QString &filename,
+        const QString &styleSheet,
+        QHash<QString, QRectF> *interestingElements,
+        QObject *parent = nullptr);
+
+    SharedSvgRenderer(
+        const QByteArray &contents,
+        const QString &styleSheet,
+        QHash<QString, QRectF> *interestingElements,
+        QObject *parent = nullptr);
+
+    //rects cache element marking an image whose size hinted elements have been collected
+    static QString sizeHintsScannedId();
+
+    //estimated memory used by the parsed document, in bytes
+    qint64 cost() const;
+    //whether the document has a current-color-scheme style the stylesheet is injected into
+    bool usesStyleSheet() const;
+
+private:
+    bool load(
+        const QByteArray &contents,
+        const QString &styleSheet,
+        QHash<QString, QRectF> *interestingElements);
+
+    friend class SvgRendererPool;
+    QString m_poolKey;
+    QString m_poolPath;
+    qint64 m_cost;
+    bool m_usesStyleSheet;
+};
+
+/**
+ * The renderers used by the Svg objects of the GUI thread.
+ * Renderers that no Svg uses anymore stay idle in a least recently used list
+ * within a byte budget, so that images coming back soon are not parsed again.
+ * Documents without a current-color-scheme style render the same with every
+ * stylesheet, so a single renderer is shared by all the color groups and states
+ * until the theme changes.
+ */
+class SvgRendererPool
+{
+public:
+    struct Statistics {
+        int live;
+        int idle;
+        int evicted;
+        qint64 liveBytes;
+        qint64 idleBytes;
+        qint64 evictedBytes;
+    };
+
+    explicit SvgRendererPool(qint64 budget = 0);
+
+    /**
+     * @return the pool of the process, with the budget of the theme settings
+     */
+    static SvgRendererPool *self();
+
+    /**
+     * @return the renderer of @p path for the stylesheet with checksum @p styleCrc,
+     *         null if it has to be created
+     */
+    SharedSvgRenderer::Ptr find(const QString &path, QChar styleCrc);
+    void insert(const SharedSvgRenderer::Ptr &renderer, const QString &path, QChar styleCrc);
+
+    /**
+     * Called by an Svg before dropping its reference to @p renderer:
+     * when it was the last user, the renderer becomes idle.
+     */
+    void release(const SharedSvgRenderer::Ptr &renderer);
+
+    /**
+     * Deletes the idle renderers
+     */
+    void clearIdle();
+
+    /**
+     * Forgets the renderers of the files in @p directory, all of them if empty,
+     * when those files change. The idle ones are deleted, the ones still in use
+     * go away with their Svg.
+     */
+    void forget(const QString &directory);
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+
+    Statistics statistics() const;
+    QString statisticsString() const;
+
+private:
+    QString key(const QString &path, QChar styleCrc) const;
+    void evict(qint64 budget);
+
+    QHash<QString, SharedSvgRenderer::Ptr> m_renderers;
+    //keys of the idle renderers, the least recently used first
+    QList<QString> m_idle;
+    //paths whose document doesn't depend on the stylesheet
+    QSet<QString> m_stylelessPaths;
+    qint64 m_budget;
+    qint64 m_bytes;
+    qint64 m_idleBytes;
+    qint64 m_evictedBytes;
+    int m_evicted;
+};
+
+} // Plasma namespace
+
+#endif
@@ -21,6 +21,8 @@
 #include "theme_p.h"
 #include "framesvg.h"
 #include "framesvg_p.h"
+#include "themewarmup_p.h"
+#include "private/svg_p.h"
 #include "debug_p.h"
 
 #include <QGuiApplication>
@@ -63,6 +65,10 @@ ThemePrivate::ThemePrivate(QObject *parent)
       defaultWallpaperWidth(DEFAULT_WALLPAPER_WIDTH),
       defaultWallpaperHeight(DEFAULT_WALLPAPER_HEIGHT),
       pixmapCache(0),
+      memoryCacheHits(0),
+      pendingCacheHits(0),
+      sharedCacheHits(0),
+      pixmapCacheMisses(0),
       cacheSize(0),
       cachesToDiscard(NoCache),
       compositingActive(KWindowSystem::self()->compositingActive()),
@@ -71,6 +77,7 @@ ThemePrivate::ThemePrivate(QObject *parent)
       useGlobal(true),
       hasWallpapers(false),
       fixedName(false),
+      rectsSaveQueued(false),
       backgroundContrast(0),
       backgroundIntensity(0),
       backgroundSaturation(0),
@@ -81,6 +88,8 @@ ThemePrivate::ThemePrivate(QObject *parent)
 {
     ThemeConfig config;
     cacheTheme = config.cacheTheme();
+    //the cost of the pixmaps is in kilobytes
+    memoryPixmapCache.setMaxCost(config.memoryPixmapCacheKb());
 
     pixmapSaveTimer = new QTimer(this);
     pixmapSaveTimer->setSingleShot(true);
@@ -98,6 +107,8 @@ ThemePrivate::ThemePrivate(QObject *parent)
     updateNotificationTimer->setInterval(100);
     QObject::connect(updateNotificationTimer, SIGNAL(timeout()), this, SLOT(notifyOfChanged()));
 
+    warmUp = new ThemeWarmUp(this);
+
     if (QPixmap::defaultDepth() > 8) {
 #if HAVE_X11
         //watch for background contrast effect property changes as well
@@ -133,9 +144,11 @@ ThemePrivate::ThemePrivate(QObject *parent)
 
 ThemePrivate::~ThemePrivate()
 {
+    delete warmUp;
     saveSvgElementsCache();
-    QHash<QString, FrameData*> data = FrameSvgPrivate::s_sharedFrames.take(this);
+    QHash<SvgCacheKey, FrameData*> data = FrameSvgPrivate::s_sharedFrames.take(this);
     qDeleteAll(data);
+    cacheWriter.setCache(0);
     delete pixmapCache;
 }
 
@@ -251,62 +264,212 @@ bool ThemePrivate::useCache()
 
         ThemeConfig config;
         pixmapCache = new KImageCache(cacheFile, config.themeCacheKb() * 1024);
+        cacheWriter.setCache(pixmapCache);
 
         if (cachesTooOld) {
+            forgetSvgRenderers();
             discardCache(PixmapCache | SvgElementsCache);
         }
     }
 
-    if (cacheTheme && !svgElementsCache) {
+    if (cacheTheme && !rectsCache.isOpen()) {
         const QString svgElementsFileNameBase = QLatin1String("plasma-svgelements-") + themeName;
         QString svgElementsFileName = svgElementsFileNameBase;
         if (!themeVersion.isEmpty()) {
             svgElementsFileName += QLatin1String("_v") + themeVersion;
         }
+        const QString rectsFileName = svgElementsFileName + QLatin1String(".rects");
 
         // now we check for (and remove) old caches
         QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation));
         cacheDir.setNameFilters(QStringList({svgElementsFileNameBase + QLatin1Char('*')}));
 
         for (const QFileInfo &file : cacheDir.entryInfoList()) {
-            if (!file.absoluteFilePath().endsWith(svgElementsFileName)) {
-                QFile::remove(file.absoluteFilePath());
+            const QString filePath = file.absoluteFilePath();
+            if (!filePath.endsWith(svgElementsFileName) && !filePath.endsWith(rectsFileName)) {
+                QFile::remove(filePath);
             }
         }
 
-        const QString svgElementsFile = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1Char('/') + svgElementsFileName;
-        svgElementsCache = KSharedConfig::openConfig(svgElementsFile, KConfig::SimpleConfig);
+        const QString cacheLocation = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1Char('/');
+        const QString svgElementsFile = cacheLocation + svgElementsFileName;
         QString currentIconThemePath;
         const auto *iconTheme = KIconLoader::global()->theme();
         if (iconTheme) {
             currentIconThemePath = iconTheme->dir();
         }
-        KConfigGroup globalGroup(svgElementsCache, QLatin1String("Global"));
-        const QString oldIconThemePath = globalGroup.readEntry("currentIconThemePath", QString());
-        if (oldIconThemePath != currentIconThemePath) {
-            discardCache(PixmapCache | SvgElementsCache);
-            globalGroup.writeEntry("currentIconThemePath", currentIconThemePath);
+
+        if (!rectsCache.open(cacheLocation + rectsFileName, currentIconThemePath)) {
+            // No usable binary index: if there is a cache in the old KConfig format,
+            // keep reading from it until its content has been migrated.
+            // It's also where the icon theme of a cache without index was recorded.
             svgElementsCache = KSharedConfig::openConfig(svgElementsFile, KConfig::SimpleConfig);
+            KConfigGroup globalGroup(svgElementsCache, QLatin1String("Global"));
+            const QString oldIconThemePath = globalGroup.readEntry("currentIconThemePath", QString());
+            if (oldIconThemePath != currentIconThemePath) {
+                discardCache(PixmapCache);
+                svgElementsCache = 0;
+                QFile::remove(svgElementsFile);
+            } else if (QFile::exists(svgElementsFile) && migrateSvgElementsCache()) {
+                // everything it knew is in the index now
+                svgElementsCache = 0;
+                QFile::remove(svgElementsFile);
+            }
         }
     }
 
     return cacheTheme;
 }
 
+bool ThemePrivate::migrateSvgElementsCache()
+{
+    const QStringList images = svgElementsCache->groupList();
+    for (const QString &image : images) {
+        if (image == QLatin1String("Global")) {
+            continue;
+        }
+
+        KConfigGroup imageGroup(svgElementsCache, image);
+        const QStringList keys = imageGroup.keyList();
+        for (const QString &key : keys) {
+            if (key.endsWith(QLatin1String("Size"))) {
+                const QRectF rect = imageGroup.readEntry(key, QRectF());
+                if (rect.isValid()) {
+                    rectsCache.insert(image, key.left(key.size() - 4), rect);
+                }
+            }
+        }
+
+        const QStringList invalidElements = imageGroup.readEntry("invalidElements", QStringList());
+        for (const QString &element : invalidElements) {
+            rectsCache.insert(image, element, QRectF());
+        }
+    }
+
+    return rectsCache.save();
+}
+
+bool ThemePrivate::hasCachedPixmap(const QString &key)
+{
+    // same lookup as Theme::findInCache, without decoding the pixmap
+    return useCache() && (memoryPixmapCache.contains(key) || pixmapsToCache.contains(keysToCache.value(key)) || cacheWriter.isPending(key) || pixmapCache->contains(key));
+}
+
+void ThemePrivate::insertIntoMemoryCache(const QString &key, const QPixmap &pix)
+{
+    if (pix.isNull()) {
+        return;
+    }
+
+    // big pixmaps are evicted first, a pixmap bigger than the whole cache is just not kept
+    const int cost = qMax(1, int(qint64(pix.width()) * pix.height() * pix.depth() / 8 / 1024));
+    memoryPixmapCache.insert(key, new QPixmap(pix), cost);
+}
+
+QString ThemePrivate::pixmapCacheStatistics() const
+{
+    const quint64 lookups = memoryCacheHits + pendingCacheHits + sharedCacheHits + pixmapCacheMisses;
+    if (lookups == 0) {
+        return QStringLiteral("no lookups");
+    }
+
+    auto ratio = [lookups](quint64 hits) {
+        return QString::number(100.0 * hits / lookups, 'f', 1) + QLatin1Char('%');
+    };
+
+    return QStringLiteral("%1 lookups, memory: %2, pending: %3, shared: %4, misses: %5")
+           .arg(lookups)
+           .arg(ratio(memoryCacheHits), ratio(pendingCacheHits), ratio(sharedCacheHits), ratio(pixmapCacheMisses));
+}
+
+QVariantMap ThemePrivate::pixmapCacheCounters() const
+{
+    QVariantMap map;
+    map[QStringLiteral("memoryHits")] = memoryCacheHits;
+    map[QStringLiteral("pendingHits")] = pendingCacheHits;
+    map[QStringLiteral("sharedHits")] = sharedCacheHits;
+    map[QStringLiteral("misses")] = pixmapCacheMisses;
+    map[QStringLiteral("memoryCount")] = memoryPixmapCache.count();
+    map[QStringLiteral("memoryCost")] = memoryPixmapCache.totalCost();
+    map[QStringLiteral("memoryMaxCost")] = memoryPixmapCache.maxCost();
+    return map;
+}
+
 void ThemePrivate::onAppExitCleanup()
 {
-    pixmapsToCache.clear();
+    warmUp->cancel();
+    // persist what is still waiting for the save timer
+    pixmapSaveTimer->stop();
+    scheduledCacheUpdate();
+    cacheWriter.setCache(0);
+    qCDebug(LOG_PLASMA) << "Pixmap cache of theme" << themeName << pixmapCacheStatistics();
+    qCDebug(LOG_PLASMA) << "Pixmap cache writer of theme" << themeName << cacheWriter.statisticsString();
+    qCDebug(LOG_PLASMA) << "Svg renderer pool" << SvgRendererPool::self()->statisticsString();
+    memoryPixmapCache.clear();
     delete pixmapCache;
     pixmapCache = 0;
     cacheTheme = false;
 }
 
+void ThemePrivate::forgetSvgRenderers()
+{
+    for (const QString &metadataPath : {themeMetadataPath, iconThemeMetadataPath}) {
+        if (!metadataPath.isEmpty()) {
+            SvgRendererPool::self()->forget(QFileInfo(metadataPath).absolutePath() + QLatin1Char('/'));
+        }
+    }
+}
+
 QString ThemePrivate::imagePath(const QString& theme, const QString& type, const QString& image)
 {
     QString subdir = QLatin1Literal(PLASMA_RELATIVE_DATA_INSTALL_DIR "/desktoptheme/") % theme % type % image;
     return QStandardPaths::locate(QStandardPaths::GenericDataLocation, subdir);
 }
 
+QString ThemePrivate::svgPath(const QString &name)
+{
+    // look for a compressed svg file in the theme
+    if (name.contains(QLatin1String("../")) || name.isEmpty()) {
+        // we don't support relative paths
+        //qCDebug(LOG_PLASMA) << "Theme says: bad image path " << name;
+        return QString();
+    }
+
+    const QString svgzName = name % QLatin1Literal(".svgz");
+    QString path = findInTheme(svgzName, themeName);
+
+    if (path.isEmpty()) {
+        // try for an uncompressed svg file
+        const QString svgName = name % QLatin1Literal(".svg");
+        path = findInTheme(svgName, themeName);
+
+        // search in fallback themes if necessary
+        for (int i = 0; path.isEmpty() && i < fallbackThemes.count(); ++i) {
+            if (themeName == fallbackThemes[i]) {
+                continue;
+            }
+
+            // try a compressed svg file in the fallback theme
+            path = findInTheme(svgzName, fallbackThemes[i]);
+
+            if (path.isEmpty()) {
+                // try an uncompressed svg file in the fallback theme
+                path = findInTheme(svgName, fallbackThemes[i]);
+            }
+        }
+    }
+
+    /*
+    if (path.isEmpty()) {
+    #ifndef NDEBUG
+        // qCDebug(LOG_PLASMA) << "Theme says: bad image path " << name;
+    #endif
+    }
+    */
+
+    return path;
+}
+
 QString ThemePrivate::findInTheme(const QString &image, const QString &theme, bool cache)
 {
     if (cache) {
@@ -351,25 +514,30 @@ void ThemePrivate::compositingChanged(bool active)
 void ThemePrivate::discardCache(CacheTypes caches)
 {
     if (caches & PixmapCache) {
+        memoryPixmapCache.clear();
         pixmapsToCache.clear();
         pixmapSaveTimer->stop();
-        if (pixmapCache) {
-            pixmapCache->clear();
-        }
+        cacheWriter.clear();
+        // the renderers still in use are valid, changed files are forgotten by forgetSvgRenderers
+        SvgRendererPool::self()->clearIdle();
+        // render the common frames again while the ui catches up with the change
+        warmUp->schedule();
     } else {
         // This deletes the object but keeps the on-disk cache for later use
+        cacheWriter.setCache(0);
         delete pixmapCache;
         pixmapCache = 0;
     }
 
-    cachedDefaultStyleSheet = QString();
-    cachedSvgStyleSheets.clear();
-    cachedSelectedSvgStyleSheets.clear();
+    discardStyleSheets();
 
     if (caches & SvgElementsCache) {
         discoveries.clear();
-        invalidElements.clear();
 
+        // write out what we learned so far, the index will be mapped again on the next useCache()
+        rectsCache.save();
+        rectsCache.close();
+        rectSaveTimer->stop();
         svgElementsCache = 0;
     }
 }
@@ -380,7 +548,8 @@ void ThemePrivate::scheduledCacheUpdate()
         QHashIterator<QString, QPixmap> it(pixmapsToCache);
         while (it.hasNext()) {
             it.next();
-            pixmapCache->insertPixmap(idsToCache[it.key()], it.value());
+            // encoded and written by the writer thread
+            cacheWriter.write(idsToCache[it.key()], it.value().toImage());
         }
     }
 
@@ -400,6 +569,8 @@ void ThemePrivate::colorsChanged()
     buttonColorScheme = KColorScheme(QPalette::Active, KColorScheme::Button, colors);
     viewColorScheme = KColorScheme(QPalette::Active, KColorScheme::View, colors);
     selectionColorScheme = KColorScheme(QPalette::Active, KColorScheme::Selection, colors);
+    // the palette snapshot is rebuilt from the new colors the next time a stylesheet is asked
+    discardStyleSheets();
     scheduleThemeChangeNotification(PixmapCache | SvgElementsCache);
     emit applicationPaletteChange();
 }
@@ -418,13 +589,82 @@ void ThemePrivate::notifyOfChanged()
     emit themeChanged();
 }
 
+StyleSheetTemplate::Palette ThemePrivate::buildStyleSheetPalette(Plasma::Svg::Status status) const
+{
+    const bool selected = status == Svg::Status::Selected;
+    StyleSheetTemplate::Palette palette(StyleSheetTemplate::PlaceholderCount);
+
+    palette[StyleSheetTemplate::TextColor] = color(selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::BackgroundColor] = color(selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::HighlightColor] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::HighlightedTextColor] = color(Theme::HighlightedTextColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::VisitedLink] = color(Theme::VisitedLinkColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::ActivatedLink] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::HoveredLink] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::Link] = color(Theme::LinkColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::PositiveTextColor] = color(Theme::PositiveTextColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::NeutralTextColor] = color(Theme::NeutralTextColor, Theme::NormalColorGroup).name();
+    palette[StyleSheetTemplate::NegativeTextColor] = color(Theme::NegativeTextColor, Theme::NormalColorGroup).name();
+
+    palette[StyleSheetTemplate::ButtonTextColor] = color(selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonBackgroundColor] = color(selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonHoverColor] = color(Theme::HoverColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonFocusColor] = color(Theme::FocusColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonHighlightedTextColor] = color(Theme::HighlightedTextColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonPositiveTextColor] = color(Theme::PositiveTextColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonNeutralTextColor] = color(Theme::NeutralTextColor, Theme::ButtonColorGroup).name();
+    palette[StyleSheetTemplate::ButtonNegativeTextColor] = color(Theme::NegativeTextColor, Theme::ButtonColorGroup).name();
+
+    palette[StyleSheetTemplate::ViewTextColor] = color(selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewBackgroundColor] = color(selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewHoverColor] = color(Theme::HoverColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewFocusColor] = color(Theme::FocusColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewHighlightedTextColor] = color(Theme::HighlightedTextColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewPositiveTextColor] = color(Theme::PositiveTextColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewNeutralTextColor] = color(Theme::NeutralTextColor, Theme::ViewColorGroup).name();
+    palette[StyleSheetTemplate::ViewNegativeTextColor] = color(Theme::NegativeTextColor, Theme::ViewColorGroup).name();
+
+    palette[StyleSheetTemplate::ComplementaryTextColor] = color(selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryBackgroundColor] = color(selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryHoverColor] = color(Theme::HoverColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryFocusColor] = color(Theme::FocusColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryHighlightedTextColor] = color(Theme::HighlightedTextColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryPositiveTextColor] = color(Theme::PositiveTextColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryNeutralTextColor] = color(Theme::NeutralTextColor, Theme::ComplementaryColorGroup).name();
+    palette[StyleSheetTemplate::ComplementaryNegativeTextColor] = color(Theme::NegativeTextColor, Theme::ComplementaryColorGroup).name();
+
+    QFont font = QGuiApplication::font();
+    palette[StyleSheetTemplate::FontSize] = QStringLiteral("%1pt").arg(font.pointSize());
+    palette[StyleSheetTemplate::FontFamily] = font.family().splitRef(QLatin1Char('[')).first().toString();
+    palette[StyleSheetTemplate::SmallFontSize] = QStringLiteral("%1pt").arg(QFontDatabase::systemFont(QFontDatabase::SmallestReadableFont).pointSize());
+
+    return palette;
+}
+
+const StyleSheetTemplate::Palette &ThemePrivate::styleSheetPalette(Plasma::Svg::Status status)
+{
+    StyleSheetTemplate::Palette &palette = (status == Svg::Status::Selected) ? selectedStyleSheetPalette : normalStyleSheetPalette;
+    if (palette.isEmpty()) {
+        palette = buildStyleSheetPalette(status);
+    }
+
+    return palette;
+}
+
+void ThemePrivate::discardStyleSheets()
+{
+    normalStyleSheetPalette.clear();
+    selectedStyleSheetPalette.clear();
+    cachedDefaultStyleSheet = QString();
+    cachedSvgStyleSheets.clear();
+    cachedSelectedSvgStyleSheets.clear();
+}
+
 const QString ThemePrivate::processStyleSheet(const QString &css, Plasma::Svg::Status status)
 {
-    QString stylesheet;
     if (css.isEmpty()) {
-        stylesheet = cachedDefaultStyleSheet;
-        if (stylesheet.isEmpty()) {
-            stylesheet = QStringLiteral("\n\
+        if (cachedDefaultStyleSheet.isEmpty()) {
+            static const StyleSheetTemplate defaultStyleSheet(QStringLiteral("\n\
                         body {\n\
                             color: %textcolor;\n\
                             generalfont-size: %fontsize;\n\
@@ -434,151 +674,118 @@ const QString ThemePrivate::processStyleSheet(const QString &css, Plasma::Svg::S
                         a:link    { color: %link; }\n\
                         a:visited { color: %visitedlink; }\n\
                         a:hover   { color: %hoveredlink; text-decoration: none; }\n\
-                        ");
-            stylesheet = cachedDefaultStyleSheet = processStyleSheet(stylesheet, status);
+                        "));
+            cachedDefaultStyleSheet = defaultStyleSheet.render(styleSheetPalette(status));
         }
 
-        return stylesheet;
-    } else {
-        stylesheet = css;
-    }
-
-    QHash<QString, QString> elements;
-    // If you add elements here, make sure their names are sufficiently unique to not cause
-    // clashes between element keys
-    elements[QStringLiteral("%textcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%backgroundcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%highlightcolor")] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%highlightedtextcolor")] = color(Theme::HighlightedTextColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%visitedlink")] = color(Theme::VisitedLinkColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%activatedlink")] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%hoveredlink")] = color(Theme::HighlightColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%link")] = color(Theme::LinkColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%positivetextcolor")] = color(Theme::PositiveTextColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%neutraltextcolor")] = color(Theme::NeutralTextColor, Theme::NormalColorGroup).name();
-    elements[QStringLiteral("%negativetextcolor")] = color(Theme::NegativeTextColor, Theme::NormalColorGroup).name();
-
-    elements[QStringLiteral("%buttontextcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonbackgroundcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonhovercolor")] = color(Theme::HoverColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonfocuscolor")] = color(Theme::FocusColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonhighlightedtextcolor")] = color(Theme::HighlightedTextColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonpositivetextcolor")] = color(Theme::PositiveTextColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonneutraltextcolor")] = color(Theme::NeutralTextColor, Theme::ButtonColorGroup).name();
-    elements[QStringLiteral("%buttonnegativetextcolor")] = color(Theme::NegativeTextColor, Theme::ButtonColorGroup).name();
-
-    elements[QStringLiteral("%viewtextcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewbackgroundcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewhovercolor")] = color(Theme::HoverColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewfocuscolor")] = color(Theme::FocusColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewhighlightedtextcolor")] = color(Theme::HighlightedTextColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewpositivetextcolor")] = color(Theme::PositiveTextColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewneutraltextcolor")] = color(Theme::NeutralTextColor, Theme::ViewColorGroup).name();
-    elements[QStringLiteral("%viewnegativetextcolor")] = color(Theme::NegativeTextColor, Theme::ViewColorGroup).name();
-
-    elements[QStringLiteral("%complementarytextcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightedTextColor : Theme::TextColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementarybackgroundcolor")] = color(status == Svg::Status::Selected ? Theme::HighlightColor : Theme::BackgroundColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementaryhovercolor")] = color(Theme::HoverColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementaryfocuscolor")] = color(Theme::FocusColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementaryhighlightedtextcolor")] = color(Theme::HighlightedTextColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementarypositivetextcolor")] = color(Theme::PositiveTextColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementaryneutraltextcolor")] = color(Theme::NeutralTextColor, Theme::ComplementaryColorGroup).name();
-    elements[QStringLiteral("%complementarynegativetextcolor")] = color(Theme::NegativeTextColor, Theme::ComplementaryColorGroup).name();
-
-    QFont font = QGuiApplication::font();
-    elements[QStringLiteral("%fontsize")] = QStringLiteral("%1pt").arg(font.pointSize());
-    elements[QStringLiteral("%fontfamily")] = font.family().splitRef(QLatin1Char('[')).first().toString();
-    elements[QStringLiteral("%smallfontsize")] = QStringLiteral("%1pt").arg(QFontDatabase::systemFont(QFontDatabase::SmallestReadableFont).pointSize());
+        return cachedDefaultStyleSheet;
+    }
 
-    QHash<QString, QString>::const_iterator it = elements.constBegin();
-    QHash<QString, QString>::const_iterator itEnd = elements.constEnd();
-    for (; it != itEnd; ++it) {
-        stylesheet.replace(it.key(), it.value());
+    // applications tend to pass the same few stylesheets over and over
+    auto it = styleSheetTemplates.constFind(css);
+    if (it == styleSheetTemplates.constEnd()) {
+        if (styleSheetTemplates.size() >= 32) {
+            styleSheetTemplates.clear();
+        }
+        it = styleSheetTemplates.insert(css, StyleSheetTemplate(css));
     }
-    return stylesheet;
+
+    return it->render(styleSheetPalette(status));
 }
 
-const QString ThemePrivate::svgStyleSheet(Plasma::Theme::ColorGroup group, Plasma::Svg::Status status)
+const StyleSheetTemplate &ThemePrivate::svgStyleSheetTemplate(Plasma::Theme::ColorGroup group)
 {
-    QString stylesheet = (status == Svg::Status::Selected) ? cachedSelectedSvgStyleSheets.value(group) : cachedSvgStyleSheets.value(group);
-    if (stylesheet.isEmpty()) {
-        QString skel = QStringLiteral(".ColorScheme-%1{color:%2;}");
+    auto it = svgStyleSheetTemplates.constFind(group);
+    if (it != svgStyleSheetTemplates.constEnd()) {
+        return *it;
+    }
+
+    // the .ColorScheme-Foo classes of the group, mapped to the placeholders of their color
+    static const struct {
+        const char *name;
+        StyleSheetTemplate::Placeholder normal;
+        StyleSheetTemplate::Placeholder button;
+        StyleSheetTemplate::Placeholder view;
+        StyleSheetTemplate::Placeholder complementary;
+    } groupClasses[] = {
+        {"Text", StyleSheetTemplate::TextColor, StyleSheetTemplate::ButtonTextColor, StyleSheetTemplate::ViewTextColor, StyleSheetTemplate::ComplementaryTextColor},
+        {"Background", StyleSheetTemplate::BackgroundColor, StyleSheetTemplate::ButtonBackgroundColor, StyleSheetTemplate::ViewBackgroundColor, StyleSheetTemplate::ComplementaryBackgroundColor},
+        {"Highlight", StyleSheetTemplate::HighlightColor, StyleSheetTemplate::ButtonHoverColor, StyleSheetTemplate::ViewHoverColor, StyleSheetTemplate::ComplementaryHoverColor},
+        {"HighlightedText", StyleSheetTemplate::HighlightedTextColor, StyleSheetTemplate::ButtonHighlightedTextColor, StyleSheetTemplate::ViewHighlightedTextColor, StyleSheetTemplate::ComplementaryHighlightedTextColor},
+        {"PositiveText", StyleSheetTemplate::PositiveTextColor, StyleSheetTemplate::ButtonPositiveTextColor, StyleSheetTemplate::ViewPositiveTextColor, StyleSheetTemplate::ComplementaryPositiveTextColor},
+        {"NeutralText", StyleSheetTemplate::NeutralTextColor, StyleSheetTemplate::ButtonNeutralTextColor, StyleSheetTemplate::ViewNeutralTextColor, StyleSheetTemplate::ComplementaryNeutralTextColor},
+        {"NegativeText", StyleSheetTemplate::NegativeTextColor, StyleSheetTemplate::ButtonNegativeTextColor, StyleSheetTemplate::ViewNegativeTextColor, StyleSheetTemplate::ComplementaryNegativeTextColor}
+    };
+
+    // the classes that always refer to a specific color group
+    static const struct {
+        const char *name;
+        StyleSheetTemplate::Placeholder placeholder;
+    } fixedClasses[] = {
+        {"ButtonText", StyleSheetTemplate::ButtonTextColor},
+        {"ButtonBackground", StyleSheetTemplate::ButtonBackgroundColor},
+        {"ButtonHover", StyleSheetTemplate::ButtonHoverColor},
+        {"ButtonFocus", StyleSheetTemplate::ButtonFocusColor},
+        {"ButtonHighlightedText", StyleSheetTemplate::ButtonHighlightedTextColor},
+        {"ButtonPositiveText", StyleSheetTemplate::ButtonPositiveTextColor},
+        {"ButtonNeutralText", StyleSheetTemplate::ButtonNeutralTextColor},
+        {"ButtonNegativeText", StyleSheetTemplate::ButtonNegativeTextColor},
+
+        {"ViewText", StyleSheetTemplate::ViewTextColor},
+        {"ViewBackground", StyleSheetTemplate::ViewBackgroundColor},
+        {"ViewHover", StyleSheetTemplate::ViewHoverColor},
+        {"ViewFocus", StyleSheetTemplate::ViewFocusColor},
+        {"ViewHighlightedText", StyleSheetTemplate::ViewHighlightedTextColor},
+        {"ViewPositiveText", StyleSheetTemplate::ViewPositiveTextColor},
+        {"ViewNeutralText", StyleSheetTemplate::ViewNeutralTextColor},
+        {"ViewNegativeText", StyleSheetTemplate::ViewNegativeTextColor},
+
+        {"ComplementaryText", StyleSheetTemplate::ComplementaryTextColor},
+        {"ComplementaryBackground", StyleSheetTemplate::ComplementaryBackgroundColor},
+        {"ComplementaryHover", StyleSheetTemplate::ComplementaryHoverColor},
+        {"ComplementaryFocus", StyleSheetTemplate::ComplementaryFocusColor},
+        {"ComplementaryHighlightedText", StyleSheetTemplate::ComplementaryHighlightedTextColor},
+        {"ComplementaryPositiveText", StyleSheetTemplate::ComplementaryPositiveTextColor},
+        {"ComplementaryNeutralText", StyleSheetTemplate::ComplementaryNeutralTextColor},
+        {"ComplementaryNegativeText", StyleSheetTemplate::ComplementaryNegativeTextColor}
+    };
 
+    QString stylesheet;
+    auto appendClass = [&stylesheet](const char *name, StyleSheetTemplate::Placeholder placeholder) {
+        stylesheet += QLatin1String(".ColorScheme-") + QLatin1String(name) + QLatin1String("{color:")
+                      + StyleSheetTemplate::placeholderName(placeholder) + QLatin1String(";}");
+    };
+
+    for (const auto &groupClass : groupClasses) {
         switch (group) {
         case Theme::ButtonColorGroup:
-            stylesheet += skel.arg(QStringLiteral("Text"), QStringLiteral("%buttontextcolor"));
-            stylesheet += skel.arg(QStringLiteral("Background"), QStringLiteral("%buttonbackgroundcolor"));
-
-            stylesheet += skel.arg(QStringLiteral("Highlight"), QStringLiteral("%buttonhovercolor"));
-            stylesheet += skel.arg(QStringLiteral("HighlightedText"), QStringLiteral("%buttonhighlightedtextcolor"));
-            stylesheet += skel.arg(QStringLiteral("PositiveText"), QStringLiteral("%buttonpositivetextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NeutralText"), QStringLiteral("%buttonneutraltextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NegativeText"), QStringLiteral("%buttonnegativetextcolor"));
+            appendClass(groupClass.name, groupClass.button);
             break;
         case Theme::ViewColorGroup:
-            stylesheet += skel.arg(QStringLiteral("Text"), QStringLiteral("%viewtextcolor"));
-            stylesheet += skel.arg(QStringLiteral("Background"), QStringLiteral("%viewbackgroundcolor"));
-
-            stylesheet += skel.arg(QStringLiteral("Highlight"), QStringLiteral("%viewhovercolor"));
-            stylesheet += skel.arg(QStringLiteral("HighlightedText"), QStringLiteral("%viewhighlightedtextcolor"));
-            stylesheet += skel.arg(QStringLiteral("PositiveText"), QStringLiteral("%viewpositivetextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NeutralText"), QStringLiteral("%viewneutraltextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NegativeText"), QStringLiteral("%viewnegativetextcolor"));
+            appendClass(groupClass.name, groupClass.view);
             break;
         case Theme::ComplementaryColorGroup:
-            stylesheet += skel.arg(QStringLiteral("Text"), QStringLiteral("%complementarytextcolor"));
-            stylesheet += skel.arg(QStringLiteral("Background"), QStringLiteral("%complementarybackgroundcolor"));
-
-            stylesheet += skel.arg(QStringLiteral("Highlight"), QStringLiteral("%complementaryhovercolor"));
-            stylesheet += skel.arg(QStringLiteral("HighlightedText"), QStringLiteral("%complementaryhighlightedtextcolor"));
-            stylesheet += skel.arg(QStringLiteral("PositiveText"), QStringLiteral("%complementarypositivetextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NeutralText"), QStringLiteral("%complementaryneutraltextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NegativeText"), QStringLiteral("%complementarynegativetextcolor"));
+            appendClass(groupClass.name, groupClass.complementary);
             break;
         default:
-            stylesheet += skel.arg(QStringLiteral("Text"), QStringLiteral("%textcolor"));
-            stylesheet += skel.arg(QStringLiteral("Background"), QStringLiteral("%backgroundcolor"));
-
-            stylesheet += skel.arg(QStringLiteral("Highlight"), QStringLiteral("%highlightcolor"));
-            stylesheet += skel.arg(QStringLiteral("HighlightedText"), QStringLiteral("%highlightedtextcolor"));
-            stylesheet += skel.arg(QStringLiteral("PositiveText"), QStringLiteral("%positivetextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NeutralText"), QStringLiteral("%neutraltextcolor"));
-            stylesheet += skel.arg(QStringLiteral("NegativeText"), QStringLiteral("%negativetextcolor"));
+            appendClass(groupClass.name, groupClass.normal);
         }
+    }
 
-        stylesheet += skel.arg(QStringLiteral("ButtonText"), QStringLiteral("%buttontextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonBackground"), QStringLiteral("%buttonbackgroundcolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonHover"), QStringLiteral("%buttonhovercolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonFocus"), QStringLiteral("%buttonfocuscolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonHighlightedText"), QStringLiteral("%buttonhighlightedtextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonPositiveText"), QStringLiteral("%buttonpositivetextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonNeutralText"), QStringLiteral("%buttonneutraltextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ButtonNegativeText"), QStringLiteral("%buttonnegativetextcolor"));
-
-        stylesheet += skel.arg(QStringLiteral("ViewText"), QStringLiteral("%viewtextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewBackground"), QStringLiteral("%viewbackgroundcolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewHover"), QStringLiteral("%viewhovercolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewFocus"), QStringLiteral("%viewfocuscolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewHighlightedText"), QStringLiteral("%viewhighlightedtextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewPositiveText"), QStringLiteral("%viewpositivetextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewNeutralText"), QStringLiteral("%viewneutraltextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ViewNegativeText"), QStringLiteral("%viewnegativetextcolor"));
-
-        stylesheet += skel.arg(QStringLiteral("ComplementaryText"), QStringLiteral("%complementarytextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryBackground"), QStringLiteral("%complementarybackgroundcolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryHover"), QStringLiteral("%complementaryhovercolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryFocus"), QStringLiteral("%complementaryfocuscolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryHighlightedText"), QStringLiteral("%complementaryhighlightedtextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryPositiveText"), QStringLiteral("%complementarypositivetextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryNeutralText"), QStringLiteral("%complementaryneutraltextcolor"));
-        stylesheet += skel.arg(QStringLiteral("ComplementaryNegativeText"), QStringLiteral("%complementarynegativetextcolor"));
-
-        stylesheet = processStyleSheet(stylesheet, status);
-        if (status == Svg::Status::Selected) {
-            cachedSelectedSvgStyleSheets.insert(group, stylesheet);
-        } else {
-            cachedSvgStyleSheets.insert(group, stylesheet);
-        }
+    for (const auto &fixedClass : fixedClasses) {
+        appendClass(fixedClass.name, fixedClass.placeholder);
+    }
+
+    return *svgStyleSheetTemplates.insert(group, StyleSheetTemplate(stylesheet));
+}
+
+const QString ThemePrivate::svgStyleSheet(Plasma::Theme::ColorGroup group, Plasma::Svg::Status status)
+{
+    QHash<Theme::ColorGroup, QString> &cache = (status == Svg::Status::Selected) ? cachedSelectedSvgStyleSheets : cachedSvgStyleSheets;
+    QString stylesheet = cache.value(group);
+    if (stylesheet.isEmpty()) {
+        stylesheet = svgStyleSheetTemplate(group).render(styleSheetPalette(status));
+        cache.insert(group, stylesheet);
     }
 
     return stylesheet;
@@ -590,6 +797,7 @@ void ThemePrivate::settingsFileChanged(const QString &file)
     if (file == themeMetadataPath) {
         const KPluginInfo pluginInfo(themeMetadataPath);
         if (!pluginInfo.isValid() || themeVersion != pluginInfo.version()) {
+            forgetSvgRenderers();
             scheduleThemeChangeNotification(SvgElementsCache);
         }
     } else if (file.endsWith(QLatin1String(themeRcFile))) {
@@ -610,16 +818,10 @@ void ThemePrivate::settingsChanged(bool emitChanges)
 
 void ThemePrivate::saveSvgElementsCache()
 {
-    if (svgElementsCache) {
-        QHashIterator<QString, QSet<QString> > it(invalidElements);
-        while (it.hasNext()) {
-            it.next();
-            KConfigGroup imageGroup(svgElementsCache, it.key());
-            imageGroup.writeEntry("invalidElements", it.value().toList()); //FIXME: add QSet support to KConfig
-        }
-
-        //Pretty drastic, but this is executed only very rarely
-        svgElementsCache->sync();
+    //Only the rects that changed since the last save get merged into the on-disk index
+    rectsSaveQueued = false;
+    if (rectsCache.save()) {
+        rectSaveTimer->stop();
     }
 }
 
@@ -869,6 +1071,9 @@ void ThemePrivate::setThemeName(const QString &tempThemeName, bool writeSettings
 
     if(emitChanged) {
         scheduleThemeChangeNotification(PixmapCache | SvgElementsCache);
+    } else if (realTheme) {
+        // otherwise the warm up starts when the pixmap cache is discarded
+        warmUp->schedule();
     }
 }
 
@@ -879,6 +1084,7 @@ bool ThemePrivate::eventFilter(QObject *watched, QEvent *event)
             colorsChanged();
         }
         if (event->type() == QEvent::ApplicationFontChange || event->type() == QEvent::FontChange) {
+            discardStyleSheets();
             Q_EMIT defaultFontChanged();
             Q_EMIT smallestFontChanged();
         }
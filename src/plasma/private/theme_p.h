@@ -23,6 +23,7 @@
 
 #include "theme.h"
 #include "svg.h"
+#include <QCache>
 #include <QHash>
 
 #include <QDebug>
@@ -38,11 +39,15 @@
 #endif
 
 #include "libplasma-theme-global.h"
+#include "private/stylesheettemplate_p.h"
+#include "private/themecachewriter_p.h"
+#include "private/svgrectscache_p.h"
 
 namespace Plasma
 {
 
 class Theme;
+class ThemeWarmUp;
 
 //NOTE: Default wallpaper can be set from the theme configuration
 #define DEFAULT_WALLPAPER_THEME "default"
@@ -69,16 +74,36 @@ public:
     KConfigGroup &config();
 
     QString imagePath(const QString &theme, const QString &type, const QString &image);
+    QString svgPath(const QString &name);
     QString findInTheme(const QString &image, const QString &theme, bool cache = true);
     void discardCache(CacheTypes caches);
+    /**
+     * Forgets the svg renderers of the files of the theme and of the icon theme,
+     * when those files changed on disk
+     */
+    void forgetSvgRenderers();
     void scheduleThemeChangeNotification(CacheTypes caches);
     bool useCache();
+    /**
+     * Moves the content of the svg elements cache in the old KConfig format
+     * into the rects index
+     * @return true if the index has been written
+     */
+    bool migrateSvgElementsCache();
+    bool hasCachedPixmap(const QString &key);
+    void insertIntoMemoryCache(const QString &key, const QPixmap &pix);
+    QString pixmapCacheStatistics() const;
+    QVariantMap pixmapCacheCounters() const;
     void setThemeName(const QString &themeName, bool writeSettings, bool emitChanged);
     void processWallpaperSettings(KConfigBase *metadata);
     void processContrastSettings(KConfigBase *metadata);
 
     const QString processStyleSheet(const QString &css, Plasma::Svg::Status status);
     const QString svgStyleSheet(Plasma::Theme::ColorGroup group, Plasma::Svg::Status status);
+    const StyleSheetTemplate &svgStyleSheetTemplate(Plasma::Theme::ColorGroup group);
+    StyleSheetTemplate::Palette buildStyleSheetPalette(Plasma::Svg::Status status) const;
+    const StyleSheetTemplate::Palette &styleSheetPalette(Plasma::Svg::Status status);
+    void discardStyleSheets();
     QColor color(Theme::ColorRole role, Theme::ColorGroup group = Theme::NormalColorGroup) const;
 
 public Q_SLOTS:
@@ -126,18 +151,34 @@ public:
     int defaultWallpaperWidth;
     int defaultWallpaperHeight;
     KImageCache *pixmapCache;
+    //writes into pixmapCache from a background thread
+    ThemeCacheWriter cacheWriter;
+    SvgRectsCache rectsCache;
+    //the old KConfig based rects cache, only read to migrate it to rectsCache
     KSharedConfigPtr svgElementsCache;
     QString cachedDefaultStyleSheet;
-    QHash<QString, QSet<QString> > invalidElements;
     QHash<QString, QPixmap> pixmapsToCache;
+    //ready pixmaps, in front of the shared pixmapCache to not decode hot elements again
+    QCache<QString, QPixmap> memoryPixmapCache;
+    //lookups served by each tier of the pixmap cache
+    quint64 memoryCacheHits;
+    quint64 pendingCacheHits;
+    quint64 sharedCacheHits;
+    quint64 pixmapCacheMisses;
     QHash<QString, QString> keysToCache;
     QHash<QString, QString> idsToCache;
     QHash<Theme::ColorGroup, QString> cachedSvgStyleSheets;
     QHash<Theme::ColorGroup, QString> cachedSelectedSvgStyleSheets;
+    //placeholder values, rebuilt only when colors or fonts change
+    StyleSheetTemplate::Palette normalStyleSheetPalette;
+    StyleSheetTemplate::Palette selectedStyleSheetPalette;
+    QHash<Theme::ColorGroup, StyleSheetTemplate> svgStyleSheetTemplates;
+    QHash<QString, StyleSheetTemplate> styleSheetTemplates;
     QHash<QString, QString> discoveries;
     QTimer *pixmapSaveTimer;
     QTimer *rectSaveTimer;
     QTimer *updateNotificationTimer;
+    ThemeWarmUp *warmUp;
     unsigned cacheSize;
     CacheTypes cachesToDiscard;
     QString themeVersion;
@@ -151,6 +192,7 @@ public:
     bool hasWallpapers : 1;
     bool cacheTheme : 1;
     bool fixedName : 1;
+    bool rectsSaveQueued : 1;
 
     qreal backgroundContrast;
     qreal backgroundIntensity;
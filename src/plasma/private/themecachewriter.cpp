@@ -0,0 +1,227 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "private/themecachewriter_p.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include <kimagecache.h>
+
+namespace Plasma
+{
+
+// bytes waiting to be written above which the GUI thread waits for the writer
+static const qint64 s_maxPendingBytes = 32 * 1024 * 1024;
+
+class ThemeCacheWriteJob : public QRunnable
+{
+public:
+    explicit ThemeCacheWriteJob(ThemeCacheWriter *writer)
+        : m_writer(writer)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        m_writer->run();
+    }
+
+private:
+    ThemeCacheWriter *m_writer;
+};
+
+ThemeCacheWriter::ThemeCacheWriter()
+    : m_cache(0),
+      m_pendingBytes(0),
+      m_running(false),
+      m_lastModified(0),
+      m_statistics({0, 0, 0, 0, 0})
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+ThemeCacheWriter::~ThemeCacheWriter()
+{
+    flush();
+}
+
+void ThemeCacheWriter::setCache(KImageCache *cache)
+{
+    flush();
+
+    QMutexLocker locker(&m_mutex);
+    m_cache = cache;
+    // nothing is being written, the cache can be asked
+    m_lastModified.storeRelease(cache ? cache->lastModifiedTime().toTime_t() : 0);
+}
+
+qint64 ThemeCacheWriter::entrySize(const Entry &entry)
+{
+    return entry.image.isNull() ? entry.data.size() : entry.image.byteCount();
+}
+
+void ThemeCacheWriter::write(const QString &key, const QImage &image)
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    enqueue(key, {image, QByteArray()});
+}
+
+void ThemeCacheWriter::write(const QString &key, const QByteArray &data)
+{
+    enqueue(key, {QImage(), data});
+}
+
+void ThemeCacheWriter::enqueue(const QString &key, const Entry &entry)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_cache) {
+        return;
+    }
+
+    // back-pressure: don't let the queue grow without bounds
+    while (m_running && m_pendingBytes > s_maxPendingBytes) {
+        m_drained.wait(&m_mutex);
+    }
+
+    auto it = m_pending.find(key);
+    if (it != m_pending.end()) {
+        m_pendingBytes -= entrySize(*it);
+        *it = entry;
+        ++m_statistics.superseded;
+    } else {
+        m_pending.insert(key, entry);
+        m_order << key;
+    }
+    m_pendingBytes += entrySize(entry);
+    m_statistics.peakPendingBytes = qMax(m_statistics.peakPendingBytes, m_pendingBytes);
+
+    if (!m_running) {
+        m_running = true;
+        m_pool.start(new ThemeCacheWriteJob(this));
+    }
+}
+
+QImage ThemeCacheWriter::pendingImage(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_pending.constFind(key);
+    if (it != m_pending.constEnd()) {
+        return it->image;
+    }
+    return key == m_writingKey ? m_writingEntry.image : QImage();
+}
+
+bool ThemeCacheWriter::isPending(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending.contains(key) || key == m_writingKey;
+}
+
+void ThemeCacheWriter::flush()
+{
+    // the job returns only once the queue is empty
+    m_pool.waitForDone();
+}
+
+void ThemeCacheWriter::clear()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.clear();
+        m_order.clear();
+        m_pendingBytes = 0;
+        m_drained.wakeAll();
+    }
+
+    m_pool.waitForDone();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_cache) {
+        m_cache->clear();
+        m_lastModified.storeRelease(m_cache->lastModifiedTime().toTime_t());
+    }
+}
+
+uint ThemeCacheWriter::lastModifiedTime() const
+{
+    return m_lastModified.loadAcquire();
+}
+
+ThemeCacheWriter::Statistics ThemeCacheWriter::statistics()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+QString ThemeCacheWriter::statisticsString()
+{
+    const Statistics stats = statistics();
+    return QStringLiteral("%1 entries written, %2 superseded, %3 KiB before encoding in %4 ms, at most %5 KiB waiting")
+           .arg(stats.written).arg(stats.superseded).arg(stats.writtenBytes / 1024)
+           .arg(stats.writeTime).arg(stats.peakPendingBytes / 1024);
+}
+
+void ThemeCacheWriter::run()
+{
+    QElapsedTimer timer;
+
+    QMutexLocker locker(&m_mutex);
+    while (!m_order.isEmpty()) {
+        const QString key = m_order.takeFirst();
+        const Entry entry = m_pending.take(key);
+        const qint64 size = entrySize(entry);
+        m_pendingBytes -= size;
+        m_drained.wakeAll();
+        KImageCache *cache = m_cache;
+        // keep the entry visible to the lookups until the cache has it
+        m_writingKey = key;
+        m_writingEntry = entry;
+
+        // the cache is only replaced after a flush, so it can't go away while writing
+        locker.unlock();
+        timer.start();
+        if (entry.image.isNull()) {
+            cache->insert(key, entry.data);
+        } else {
+            cache->insertImage(key, entry.image);
+        }
+        const qint64 elapsed = timer.elapsed();
+        // what KImageCache stores as its own last modified time
+        m_lastModified.storeRelease(QDateTime::currentDateTime().toTime_t());
+        locker.relock();
+
+        m_writingKey.clear();
+        m_writingEntry = Entry();
+        m_statistics.writtenBytes += size;
+        m_statistics.writeTime += elapsed;
+        ++m_statistics.written;
+    }
+
+    m_running = false;
+    m_drained.wakeAll();
+}
+
+}
@@ -0,0 +1,130 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_THEMECACHEWRITER_P_H
+#define PLASMA_THEMECACHEWRITER_P_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class KImageCache;
+
+namespace Plasma
+{
+
+/**
+ * Persists images in the theme pixmap cache from a background thread,
+ * so that encoding them and writing them in the mapped cache file
+ * doesn't block the GUI thread.
+ *
+ * Entries are written in the order they were first queued; queueing
+ * a key again replaces the entry still waiting for it.
+ * When too many bytes are waiting, write() blocks until the
+ * writer catches up.
+ */
+class ThemeCacheWriter
+{
+public:
+    ThemeCacheWriter();
+    ~ThemeCacheWriter();
+
+    /**
+     * Sets the cache entries are written into. Entries still waiting
+     * are written in the previous cache first.
+     */
+    void setCache(KImageCache *cache);
+
+    void write(const QString &key, const QImage &image);
+    void write(const QString &key, const QByteArray &data);
+
+    /**
+     * @return the image waiting to be written for @p key, a null image if none.
+     * An entry stays pending until it can be found in the cache.
+     */
+    QImage pendingImage(const QString &key);
+    bool isPending(const QString &key);
+
+    /**
+     * Blocks until every waiting entry has been written
+     */
+    void flush();
+    /**
+     * Drops every waiting entry, blocks until the one being written is done,
+     * then empties the cache
+     */
+    void clear();
+
+    /**
+     * @return when the cache was last written, in seconds since the epoch.
+     * Unlike KImageCache::lastModifiedTime(), safe to call while the writer
+     * thread is writing.
+     */
+    uint lastModifiedTime() const;
+
+    struct Statistics {
+        int written;
+        int superseded;
+        //size of the written images and data before they get encoded in the cache
+        qint64 writtenBytes;
+        qint64 writeTime;
+        //the most bytes that have been waiting at once
+        qint64 peakPendingBytes;
+    };
+
+    Statistics statistics();
+    QString statisticsString();
+
+    // called from the writer thread
+    void run();
+
+private:
+    struct Entry {
+        QImage image;
+        QByteArray data;
+    };
+
+    void enqueue(const QString &key, const Entry &entry);
+    static qint64 entrySize(const Entry &entry);
+
+    QThreadPool m_pool;
+    QMutex m_mutex;
+    QWaitCondition m_drained;
+    KImageCache *m_cache;
+    QHash<QString, Entry> m_pending;
+    //keys of m_pending, the oldest first
+    QStringList m_order;
+    qint64 m_pendingBytes;
+    //the entry being inserted in the cache, out of m_pending but not in the cache yet
+    QString m_writingKey;
+    Entry m_writingEntry;
+    bool m_running;
+    QAtomicInteger<quint32> m_lastModified;
+
+    Statistics m_statistics;
+};
+
+}
+
+#endif
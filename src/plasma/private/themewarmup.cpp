@@ -0,0 +1,332 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "themewarmup_p.h"
+
+#include <cmath>
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QThread>
+#include <QStringBuilder>
+
+#include <kiconeffect.h>
+#include <kimagecache.h>
+
+#include "svg.h"
+#include "theme.h"
+#include "private/svg_p.h"
+#include "private/theme_p.h"
+#include "debug_p.h"
+
+namespace Plasma
+{
+
+// elements painted by FrameSvg at their natural size, the center is painted
+// at the size of the frame, so there is no point in rendering it in advance
+static const char *const s_frameElements[] = {
+    "topleft", "top", "topright", "left", "right", "bottomleft", "bottom", "bottomright"
+};
+
+class ThemeWarmUpJob : public QRunnable
+{
+public:
+    ThemeWarmUpJob(ThemeWarmUp *warmUp, int generation)
+        : scaleFactor(1.0),
+          m_warmUp(warmUp),
+          m_generation(generation),
+          m_pathKey(0),
+          m_styleCrc(0),
+          m_applyColors(false)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE;
+
+    QString path;
+    QStringList markers;
+    QStringList prefixes;
+    QString styleSheet;
+    QColor colorizeColor;
+    QList<int> devicePixelRatios;
+    qreal scaleFactor;
+
+private:
+    QSize elementSize(const QString &elementId) const;
+    void render(const QString &elementId, const QSize &size, int devicePixelRatio, QHash<QString, QImage> &images);
+
+    ThemeWarmUp *m_warmUp;
+    int m_generation;
+    quint64 m_pathKey;
+    quint16 m_styleCrc;
+    // the renderer is private to the thread running this job
+    QScopedPointer<SharedSvgRenderer> m_renderer;
+    QHash<QString, QRectF> m_sizeHintedElements;
+    bool m_applyColors;
+};
+
+QSize ThemeWarmUpJob::elementSize(const QString &elementId) const
+{
+    if (!m_renderer->elementExists(elementId)) {
+        return QSize();
+    }
+
+    // same as SvgPrivate::findAndCacheElementRect at the natural size of the svg
+    const QRectF rect = m_renderer->matrixForElement(elementId).map(m_renderer->boundsOnElement(elementId)).boundingRect();
+    return QSizeF(rect.width() * scaleFactor, rect.height() * scaleFactor).toSize();
+}
+
+void ThemeWarmUpJob::render(const QString &elementId, const QSize &size, int devicePixelRatio, QHash<QString, QImage> &images)
+{
+    if (size.isEmpty() || !m_renderer->elementExists(elementId)) {
+        return;
+    }
+
+    // if the theme provides size hinted versions of this element, Svg may pick
+    // one of those, rendering the generic one would likely be wasted
+    for (auto it = m_sizeHintedElements.constBegin(); it != m_sizeHintedElements.constEnd(); ++it) {
+        if (it.key().endsWith(QLatin1Char('-') % elementId)) {
+            return;
+        }
+    }
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+    m_renderer->render(&painter, elementId, SvgPrivate::makeUniform(m_renderer->boundsOnElement(elementId), QRect(QPoint(0, 0), size)));
+    painter.end();
+
+    if (m_applyColors) {
+        KIconEffect::colorize(image, colorizeColor, 1.0);
+    }
+
+    images.insert(SvgPrivate::pixmapCacheKey(m_pathKey, elementId, size, Svg::Normal, devicePixelRatio, Theme::NormalColorGroup, m_styleCrc).toString(path, elementId), image);
+}
+
+void ThemeWarmUpJob::run()
+{
+    m_renderer.reset(new SharedSvgRenderer(path, styleSheet, &m_sizeHintedElements));
+    if (!m_renderer->isValid()) {
+        return;
+    }
+
+    m_applyColors = m_renderer->elementExists(QStringLiteral("hint-apply-color-scheme"));
+    m_pathKey = SvgCacheKey::hashString(path);
+    m_styleCrc = SvgPrivate::styleSheetCrc(styleSheet);
+
+    QHash<QString, QImage> images;
+
+    for (QString prefix : prefixes) {
+        if (!prefix.isEmpty()) {
+            prefix += QLatin1Char('-');
+        }
+
+        if (!m_renderer->elementExists(prefix % QLatin1String("center"))) {
+            continue;
+        }
+
+        // Reproduce the sizes FrameSvgPrivate::generateFrameBackground paints
+        // the elements at, with all the borders enabled, as that's part of the cache key
+        const QSize left = elementSize(prefix % QLatin1String("left"));
+        const QSize top = elementSize(prefix % QLatin1String("top"));
+        const QSize right = elementSize(prefix % QLatin1String("right"));
+        const QSize bottom = elementSize(prefix % QLatin1String("bottom"));
+        const bool stretchBorders = m_renderer->elementExists(QStringLiteral("hint-stretch-borders")) ||
+                                    m_renderer->elementExists(prefix % QLatin1String("hint-stretch-borders"));
+
+        for (const int ratio : devicePixelRatios) {
+            for (const char *element : s_frameElements) {
+                const QString elementId = prefix % QLatin1String(element);
+                QSize size;
+
+                if (qstrcmp(element, "topleft") == 0) {
+                    size = QSize(left.width(), top.height());
+                } else if (qstrcmp(element, "topright") == 0) {
+                    size = QSize(right.width(), top.height());
+                } else if (qstrcmp(element, "bottomleft") == 0) {
+                    size = QSize(left.width(), bottom.height());
+                } else if (qstrcmp(element, "bottomright") == 0) {
+                    size = QSize(right.width(), bottom.height());
+                } else if (stretchBorders) {
+                    // stretched borders are painted at the size of the frame
+                    continue;
+                } else if (qstrcmp(element, "left") == 0) {
+                    size = left;
+                } else if (qstrcmp(element, "right") == 0) {
+                    size = QSize(right.width(), left.height());
+                } else if (qstrcmp(element, "top") == 0) {
+                    size = top;
+                } else {
+                    size = QSize(top.width(), bottom.height());
+                }
+
+                render(elementId, size * ratio, ratio, images);
+            }
+        }
+    }
+
+    m_renderer.reset();
+    m_warmUp->addResults(m_generation, markers, images);
+}
+
+
+ThemeWarmUp::ThemeWarmUp(ThemePrivate *theme)
+    : QObject(theme),
+      m_theme(theme),
+      m_generation(0)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+
+    m_startTimer.setSingleShot(true);
+    m_startTimer.setInterval(0);
+    connect(&m_startTimer, &QTimer::timeout, this, &ThemeWarmUp::start);
+}
+
+ThemeWarmUp::~ThemeWarmUp()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void ThemeWarmUp::schedule()
+{
+    cancel();
+    m_startTimer.start();
+}
+
+void ThemeWarmUp::cancel()
+{
+    m_startTimer.stop();
+    m_pool.clear();
+
+    // results of jobs already running get discarded when they arrive
+    ++m_generation;
+    QMutexLocker locker(&m_resultsMutex);
+    m_results.clear();
+}
+
+void ThemeWarmUp::start()
+{
+    // useCache() may discard a stale pixmap cache, which reschedules us
+    const bool useCache = m_theme->useCache();
+    m_startTimer.stop();
+    if (!qGuiApp || !useCache) {
+        return;
+    }
+
+    ThemeConfig config;
+    if (!config.warmUp()) {
+        return;
+    }
+
+    QList<int> ratios = config.warmUpDevicePixelRatios();
+    if (ratios.isEmpty()) {
+        ratios << qMax(1, int(floor(qGuiApp->devicePixelRatio())));
+    }
+
+    const QString styleSheet = m_theme->svgStyleSheet(Theme::NormalColorGroup, Svg::Normal);
+    const QColor colorizeColor = m_theme->color(Theme::BackgroundColor);
+
+    for (const QString &entry : config.warmUpFrames()) {
+        // entries are in the form imagePath[:prefix[|prefix...]]
+        const int separator = entry.indexOf(QLatin1Char(':'));
+        const QString imagePath = entry.left(separator);
+        QStringList prefixes = separator > 0 ? entry.mid(separator + 1).split(QLatin1Char('|'), QString::SkipEmptyParts) : QStringList();
+        prefixes.prepend(QString());
+
+        const QString path = m_theme->svgPath(imagePath);
+        if (path.isEmpty()) {
+            continue;
+        }
+
+        // markers tell what has already been rendered by this or any other process
+        QList<int> missingRatios;
+        QStringList markers;
+        for (const int ratio : ratios) {
+            const QString marker = QLatin1String("warmup_") % QString::number(ratio) % QLatin1Char('_') % entry % QLatin1Char('_') % path;
+            if (!m_theme->pixmapCache->contains(marker) && !m_theme->cacheWriter.isPending(marker)) {
+                missingRatios << ratio;
+                markers << marker;
+            }
+        }
+
+        if (missingRatios.isEmpty()) {
+            continue;
+        }
+
+        ThemeWarmUpJob *job = new ThemeWarmUpJob(this, m_generation);
+        job->path = path;
+        job->markers = markers;
+        job->prefixes = prefixes;
+        job->styleSheet = styleSheet;
+        job->colorizeColor = colorizeColor;
+        job->devicePixelRatios = missingRatios;
+        job->scaleFactor = SvgPrivate::s_lastScaleFactor;
+        m_pool.start(job);
+    }
+}
+
+void ThemeWarmUp::addResults(int generation, const QStringList &markers, const QHash<QString, QImage> &images)
+{
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        m_results.append({generation, markers, images});
+    }
+
+    QMetaObject::invokeMethod(this, "flushResults", Qt::QueuedConnection);
+}
+
+void ThemeWarmUp::flushResults()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        results.swap(m_results);
+    }
+
+    if (!m_theme->useCache()) {
+        return;
+    }
+
+    for (const Result &result : results) {
+        if (result.generation != m_generation) {
+            continue;
+        }
+
+        for (auto it = result.images.constBegin(); it != result.images.constEnd(); ++it) {
+            // don't overwrite what an Svg already rendered in the meantime
+            if (m_theme->keysToCache.contains(it.key()) || m_theme->cacheWriter.isPending(it.key()) || m_theme->pixmapCache->contains(it.key())) {
+                continue;
+            }
+            m_theme->cacheWriter.write(it.key(), it.value());
+        }
+
+        // written after the images, so other processes never see a marker without them
+        for (const QString &marker : result.markers) {
+            m_theme->cacheWriter.write(marker, QByteArray("1"));
+        }
+    }
+}
+
+}
+
+#include "moc_themewarmup_p.cpp"
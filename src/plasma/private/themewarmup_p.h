@@ -0,0 +1,83 @@
+/*
+ *   Copyright 2018 agent <agent@local>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License as
+ *   published by the Free Software Foundation; either version 2, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef PLASMA_THEMEWARMUP_P_H
+#define PLASMA_THEMEWARMUP_P_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace Plasma
+{
+
+class ThemePrivate;
+
+/**
+ * Renders the elements of the most used frame svgs in a thread pool
+ * right after a theme gets loaded, and puts them in the pixmap cache
+ * before any Svg asks for them.
+ *
+ * What gets rendered is listed in the WarmUpFrames and
+ * WarmUpDevicePixelRatios entries of the CachePolicies group of plasmarc.
+ */
+class ThemeWarmUp : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ThemeWarmUp(ThemePrivate *theme);
+    ~ThemeWarmUp();
+
+    /**
+     * Starts a warm up as soon as the event loop is reached.
+     * Any warm up still running is discarded.
+     */
+    void schedule();
+    void cancel();
+
+    // called from the worker threads
+    void addResults(int generation, const QStringList &markers, const QHash<QString, QImage> &images);
+
+private Q_SLOTS:
+    void start();
+    void flushResults();
+
+private:
+    struct Result {
+        int generation;
+        QStringList markers;
+        QHash<QString, QImage> images;
+    };
+
+    ThemePrivate *m_theme;
+    QThreadPool m_pool;
+    QTimer m_startTimer;
+    QMutex m_resultsMutex;
+    QList<Result> m_results;
+    int m_generation;
+};
+
+}
+
+#endif
@@ -24,19 +24,19 @@
 
 #include <cmath>
 
+#include <QCache>
 #include <QCoreApplication>
 #include <QDir>
 #include <QMatrix>
 #include <QPainter>
+#include <QRunnable>
 #include <QStringBuilder>
-#include <QXmlStreamReader>
-#include <QXmlStreamWriter>
-#include <QBuffer>
+#include <QThread>
+#include <QThreadStorage>
 
 #include <kcolorscheme.h>
 #include <kconfiggroup.h>
 #include <QDebug>
-#include <kfilterdev.h>
 #include <kiconeffect.h>
 #include <KIconLoader>
 #include <KIconTheme>
@@ -49,99 +49,188 @@
 namespace Plasma
 {
 
+static qint64 configuredIdleRenderersBudget()
+{
+    ThemeConfig config;
+    return qint64(config.idleSvgRenderersKb()) * 1024;
+}
+
+Q_GLOBAL_STATIC_WITH_ARGS(SvgRendererPool, s_rendererPool, (configuredIdleRenderersBudget()))
 
-SharedSvgRenderer::SharedSvgRenderer(QObject *parent)
-    : QSvgRenderer(parent)
+SvgRendererPool *SvgRendererPool::self()
 {
+    return s_rendererPool();
 }
 
-SharedSvgRenderer::SharedSvgRenderer(
-    const QString &filename,
-    const QString &styleSheet,
-    QHash<QString, QRectF> &interestingElements,
-    QObject *parent)
-    : QSvgRenderer(parent)
+#define QLSEP QLatin1Char('_')
+#define CACHE_ID_WITH_SIZE(size, id, status, devicePixelRatio) QString::number(int(size.width())) % QLSEP % QString::number(int(size.height())) % QLSEP % id % QLSEP % QString::number(status) % QLSEP % QString::number(int(devicePixelRatio))
+#define CACHE_ID_NATURAL_SIZE(id, status, devicePixelRatio) QLatin1String("Natural") % QLSEP % id % QLSEP % QString::number(status) % QLSEP % QString::number(int(devicePixelRatio))
+
+class SvgRenderJob : public QRunnable
 {
-    KCompressionDevice file(filename, KCompressionDevice::GZip);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return;
+public:
+    SvgRenderJob(SvgRenderQueue *queue, const QString &job, const QString &rendererKey, const SvgRenderQueue::Request &request)
+        : m_queue(queue),
+          m_job(job),
+          m_rendererKey(rendererKey),
+          m_request(request)
+    {
     }
-    load(file.readAll(), styleSheet, interestingElements);
-}
-
-SharedSvgRenderer::SharedSvgRenderer(
-    const QByteArray &contents,
-    const QString &styleSheet,
-    QHash<QString, QRectF> &interestingElements,
-    QObject *parent)
-    : QSvgRenderer(parent)
-{
-    load(contents, styleSheet, interestingElements);
-}
-
-bool SharedSvgRenderer::load(
-    const QByteArray &contents,
-    const QString &styleSheet,
-    QHash<QString, QRectF> &interestingElements)
-{
-    // Apply the style sheet.
-    if (!styleSheet.isEmpty() && contents.contains("current-color-scheme")) {
-        QByteArray processedContents;
-        QXmlStreamReader reader(contents);
-
-        QBuffer buffer(&processedContents);
-        buffer.open(QIODevice::WriteOnly);
-        QXmlStreamWriter writer(&buffer);
-        while (!reader.atEnd()) {
-            if (reader.readNext() == QXmlStreamReader::StartElement &&
-                reader.qualifiedName() == QLatin1String("style") &&
-                reader.attributes().value(QLatin1String("id")) == QLatin1String("current-color-scheme")) {
-                writer.writeStartElement(QLatin1String("style"));
-                writer.writeAttributes(reader.attributes());
-                writer.writeCharacters(styleSheet);
-                writer.writeEndElement();
-                while (reader.tokenType() != QXmlStreamReader::EndElement) {
-                    reader.readNext();
-                }
-            } else if (reader.tokenType() != QXmlStreamReader::Invalid) {
-                writer.writeCurrentToken(reader);
-            }
+
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    SvgRenderQueue *m_queue;
+    QString m_job;
+    QString m_rendererKey;
+    SvgRenderQueue::Request m_request;
+};
+
+// renderers owned by the pool threads, deleted when a thread expires
+static QThreadStorage<QCache<QString, SharedSvgRenderer> *> s_threadRenderers;
+
+void SvgRenderJob::run()
+{
+    if (!s_threadRenderers.hasLocalData()) {
+        s_threadRenderers.setLocalData(new QCache<QString, SharedSvgRenderer>(4));
+    }
+
+    QCache<QString, SharedSvgRenderer> *renderers = s_threadRenderers.localData();
+    SharedSvgRenderer *renderer = renderers->object(m_rendererKey);
+
+    if (!renderer) {
+        // size hints are already known by the Svg that asked for the rendering
+        renderer = new SharedSvgRenderer(m_request.path, m_request.styleSheet, nullptr);
+        renderers->insert(m_rendererKey, renderer);
+    }
+
+    QImage image;
+
+    if (renderer->isValid()) {
+        image = QImage(m_request.size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+
+        // same as SvgPrivate::findInCache
+        const QRectF finalRect = SvgPrivate::makeUniform(renderer->boundsOnElement(m_request.elementId), QRect(QPoint(0, 0), m_request.size));
+        QPainter renderPainter(&image);
+        if (m_request.elementId.isEmpty()) {
+            renderer->render(&renderPainter, finalRect);
+        } else {
+            renderer->render(&renderPainter, m_request.elementId, finalRect);
         }
-        buffer.close();
-        if (!QSvgRenderer::load(processedContents)) {
-            return false;
+        renderPainter.end();
+
+        if (m_request.applyColors) {
+            KIconEffect::colorize(image, m_request.colorizeColor, 1.0);
         }
-    } else if (!QSvgRenderer::load(contents)) {
-        return false;
     }
 
-    // Search the SVG to find and store all ids that contain size hints.
-    const QString contentsAsString(QString::fromLatin1(contents));
-    QRegExp idExpr(QLatin1String("id\\s*=\\s*(['\"])(\\d+-\\d+-.*)\\1"));
-    idExpr.setMinimal(true);
+    m_queue->addResult(m_job, image);
+}
+
+Q_GLOBAL_STATIC(SvgRenderQueue, s_renderQueue)
+
+SvgRenderQueue::SvgRenderQueue()
+{
+    //results are handed to the Svgs in the GUI thread, even when the first request
+    //comes from the render thread, e.g. through FrameSvgItem::updatePaintNode
+    if (QCoreApplication::instance()) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+SvgRenderQueue::~SvgRenderQueue()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+SvgRenderQueue *SvgRenderQueue::self()
+{
+    return s_renderQueue();
+}
 
-    int pos = 0;
-    while ((pos = idExpr.indexIn(contentsAsString, pos)) != -1) {
-        QString elementId = idExpr.cap(2);
+void SvgRenderQueue::enqueue(SvgPrivate *svg, const Request &request, const QString &elementId, const QSize &size, qreal ratio)
+{
+    // a renderer released by the GUI thread may come back with a different content,
+    // so the copies in the pool threads are versioned
+    const QString rendererKey = request.styleCrc % request.path % QLSEP % QString::number(m_rendererGenerations.value(request.styleCrc + request.path));
+    const QString job = rendererKey % QLatin1Char('/') % request.key;
 
-        QRectF elementRect = boundsOnElement(elementId);
-        if (elementRect.isValid()) {
-            interestingElements.insert(elementId, elementRect);
+    QList<Waiter> &waiters = m_waiters[job];
+
+    for (const Waiter &waiter : qAsConst(waiters)) {
+        if (waiter.d == svg && waiter.svg) {
+            return;
         }
+    }
 
-        pos += idExpr.matchedLength();
+    waiters << Waiter{svg->q, svg, request.key, elementId, request.elementId, size, ratio};
+
+    if (waiters.count() == 1) {
+        m_pool.start(new SvgRenderJob(this, job, rendererKey, request));
     }
+}
 
-    return true;
+void SvgRenderQueue::releaseRenderer(QChar styleCrc, const QString &path)
+{
+    ++m_rendererGenerations[styleCrc + path];
 }
 
-#define QLSEP QLatin1Char('_')
-#define CACHE_ID_WITH_SIZE(size, id, status, devicePixelRatio) QString::number(int(size.width())) % QLSEP % QString::number(int(size.height())) % QLSEP % id % QLSEP % QString::number(status) % QLSEP % QString::number(int(devicePixelRatio))
-#define CACHE_ID_NATURAL_SIZE(id, status, devicePixelRatio) QLatin1String("Natural") % QLSEP % id % QLSEP % QString::number(status) % QLSEP % QString::number(int(devicePixelRatio))
+void SvgRenderQueue::addResult(const QString &job, const QImage &image)
+{
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        m_results.append(qMakePair(job, image));
+    }
+
+    QMetaObject::invokeMethod(this, "flushResults", Qt::QueuedConnection);
+}
+
+void SvgRenderQueue::flushResults()
+{
+    QList<QPair<QString, QImage> > results;
+    {
+        QMutexLocker locker(&m_resultsMutex);
+        results.swap(m_results);
+    }
+
+    for (const auto &result : qAsConst(results)) {
+        const QList<Waiter> waiters = m_waiters.take(result.first);
+        bool cached = result.second.isNull();
+
+        for (const Waiter &waiter : waiters) {
+            if (!waiter.svg) {
+                continue;
+            }
+
+            if (!cached) {
+                QPixmap p = QPixmap::fromImage(result.second);
+                p.setDevicePixelRatio(waiter.ratio);
+                waiter.d->cacheAndColorsTheme()->insertIntoCache(waiter.key, p, QString::number((qint64)waiter.d->q, 16) % QLSEP % waiter.actualElementId);
+                cached = true;
+            }
+
+            //the device pixel ratio, the colors or the file of the Svg may have changed
+            //since the request: it's only ready if image() would return this rendering
+            SvgCacheKey key;
+            QString actualElementId;
+            QSize size;
+            if (!waiter.d->renderCacheKey(waiter.elementId, waiter.d->devicePixelRatio, waiter.size, key, actualElementId, size) ||
+                key.toString(waiter.d->path, actualElementId) != waiter.key) {
+                continue;
+            }
+
+            emit waiter.svg->pixmapReady(waiter.elementId, waiter.size);
+        }
+    }
+}
 
 SvgPrivate::SvgPrivate(Svg *svg)
     : q(svg),
       renderer(0),
+      pathHash(SvgCacheKey::hashString(QString())),
       styleCrc(0),
       colorGroup(Plasma::Theme::NormalColorGroup),
       lastModified(0),
@@ -174,10 +263,45 @@ QString SvgPrivate::cacheId(const QString &elementId) const
     }
 }
 
+SvgCacheKey SvgPrivate::rectCacheKey(const QString &elementId) const
+{
+    // the rects cache is per Svg and gets cleared when the path changes
+    if (size.isValid() && size != naturalSize) {
+        return SvgCacheKey::create(0, SvgCacheKey::hashString(elementId), QSize(int(size.width()), int(size.height())), status, devicePixelRatio);
+    } else {
+        return SvgCacheKey::create(0, SvgCacheKey::hashString(elementId), QSize(SvgCacheKey::NaturalSize, SvgCacheKey::NaturalSize), status, devicePixelRatio);
+    }
+}
+
 //This function is meant for the pixmap cache
-QString SvgPrivate::cachePath(const QString &path, const QSize &size) const
+SvgCacheKey SvgPrivate::pixmapCacheKey(quint64 path, const QString &elementId, const QSize &size, Svg::Status status, qreal devicePixelRatio, Theme::ColorGroup colorGroup, quint16 styleCrc)
+{
+    return SvgCacheKey::create(path, SvgCacheKey::hashString(elementId), size, status, devicePixelRatio, colorGroup, styleCrc);
+}
+
+quint16 SvgPrivate::styleSheetCrc(const QString &styleSheet)
+{
+    return qChecksum(styleSheet.toUtf8().constData(), styleSheet.size());
+}
+
+quint64 SvgPrivate::pathKey()
+{
+    if (path != hashedPath) {
+        hashedPath = path;
+        pathHash = SvgCacheKey::hashString(path);
+    }
+
+    return pathHash;
+}
+
+quint16 SvgPrivate::currentStyleCrc()
 {
-    return CACHE_ID_WITH_SIZE(size, path, status, devicePixelRatio) % QLSEP % QString::number(colorGroup);
+    // computed by createRenderer as well, this is for lookups done before having a renderer
+    if (styleCrc.isNull()) {
+        styleCrc = styleSheetCrc(cacheAndColorsTheme()->d->svgStyleSheet(colorGroup, status));
+    }
+
+    return styleCrc.unicode();
 }
 
 bool SvgPrivate::setImagePath(const QString &imagePath)
@@ -301,11 +425,8 @@ Theme *SvgPrivate::cacheAndColorsTheme()
     }
 }
 
-QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSizeF &s)
+bool SvgPrivate::renderCacheKey(const QString &elementId, qreal ratio, const QSizeF &s, SvgCacheKey &key, QString &actualElementId, QSize &size)
 {
-    QSize size;
-    QString actualElementId;
-
     if (elementsWithSizeHints.isEmpty()) {
         // Fetch all size hinted element ids from the theme's rect cache
         // and store them locally.
@@ -364,15 +485,25 @@ QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSi
     }
 
     if (size.isEmpty()) {
-        return QPixmap();
+        return false;
     }
 
-    QString id = cachePath(path, size);
+    key = pixmapCacheKey(pathKey(), actualElementId, size, status, devicePixelRatio, colorGroup, currentStyleCrc());
+    return true;
+}
+
+QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSizeF &s)
+{
+    QSize size;
+    QString actualElementId;
+    SvgCacheKey key;
 
-    if (!actualElementId.isEmpty()) {
-        id.append(actualElementId);
+    if (!renderCacheKey(elementId, ratio, s, key, actualElementId, size)) {
+        return QPixmap();
     }
 
+    const QString id = key.toString(path, actualElementId);
+
     //qCDebug(LOG_PLASMA) << "id is " << id;
 
     QPixmap p;
@@ -421,6 +552,53 @@ QPixmap SvgPrivate::findInCache(const QString &elementId, qreal ratio, const QSi
     return p;
 }
 
+bool SvgPrivate::requestPixmap(const QString &elementId, qreal ratio, const QSizeF &s)
+{
+    if (!cacheRendering) {
+        return false;
+    }
+
+    // the result has to be found by findInCache once ready, otherwise just render synchronously
+    ThemePrivate *themePrivate = cacheAndColorsTheme()->d;
+    if (!themePrivate->useCache() ||
+        (lastModified != 0 && lastModified > themePrivate->cacheWriter.lastModifiedTime())) {
+        return false;
+    }
+
+    QSize size;
+    QString actualElementId;
+    SvgCacheKey key;
+
+    if (!renderCacheKey(elementId, ratio, s, key, actualElementId, size)) {
+        return false;
+    }
+
+    const QString id = key.toString(path, actualElementId);
+
+    if (themePrivate->hasCachedPixmap(id)) {
+        return false;
+    }
+
+    createRenderer();
+
+    if (path.isEmpty()) {
+        return false;
+    }
+
+    SvgRenderQueue::Request request;
+    request.key = id;
+    request.path = path;
+    request.styleSheet = themePrivate->svgStyleSheet(colorGroup, status);
+    request.elementId = actualElementId;
+    request.size = size;
+    request.colorizeColor = cacheAndColorsTheme()->color(Theme::BackgroundColor);
+    request.styleCrc = styleCrc;
+    request.applyColors = applyColors;
+
+    SvgRenderQueue::self()->enqueue(this, request, elementId, s.toSize(), ratio);
+    return true;
+}
+
 void SvgPrivate::createRenderer()
 {
     if (renderer) {
@@ -456,35 +634,44 @@ void SvgPrivate::createRenderer()
     //qCDebug(LOG_PLASMA) << path << "**";
 
     QString styleSheet = cacheAndColorsTheme()->d->svgStyleSheet(colorGroup, status);
-    styleCrc = qChecksum(styleSheet.toUtf8().constData(), styleSheet.size());
+    styleCrc = styleSheetCrc(styleSheet);
 
-    QHash<QString, SharedSvgRenderer::Ptr>::const_iterator it = s_renderers.constFind(styleCrc + path);
+    SvgRendererPool *pool = SvgRendererPool::self();
+    renderer = pool->find(path, styleCrc);
 
-    if (it != s_renderers.constEnd()) {
-        //qCDebug(LOG_PLASMA) << "gots us an existing one!";
-        renderer = it.value();
-    } else {
+    if (!renderer) {
         if (path.isEmpty()) {
             renderer = new SharedSvgRenderer();
         } else {
+            // On warm starts the size hinted elements of this image are
+            // already in the theme's rect cache, don't scan the document again
+            Theme *theme = cacheAndColorsTheme();
+            const QString scannedId = CACHE_ID_NATURAL_SIZE(SharedSvgRenderer::sizeHintsScannedId(), status, devicePixelRatio);
+            QRectF scannedRect;
+            const bool scanned = theme->findInRectsCache(path, scannedId, scannedRect);
+
             QHash<QString, QRectF> interestingElements;
-            renderer = new SharedSvgRenderer(path, styleSheet, interestingElements);
+            renderer = new SharedSvgRenderer(path, styleSheet, scanned ? nullptr : &interestingElements);
 
-            // Add interesting elements to the theme's rect cache.
-            QHashIterator<QString, QRectF> i(interestingElements);
+            if (!scanned && renderer->isValid()) {
+                // Add interesting elements to the theme's rect cache.
+                QHashIterator<QString, QRectF> i(interestingElements);
 
-            while (i.hasNext()) {
-                i.next();
-                const QString &elementId = i.key();
-                const QRectF &elementRect = i.value();
+                while (i.hasNext()) {
+                    i.next();
+                    const QString &elementId = i.key();
+                    const QRectF &elementRect = i.value();
 
-                const QString cacheId = CACHE_ID_NATURAL_SIZE(elementId, status, devicePixelRatio);
-                localRectCache.insert(cacheId, elementRect);
-                cacheAndColorsTheme()->insertIntoRectsCache(path, cacheId, elementRect);
+                    const QString cacheId = CACHE_ID_NATURAL_SIZE(elementId, status, devicePixelRatio);
+                    localRectCache.insert(SvgCacheKey::create(0, SvgCacheKey::hashString(elementId), QSize(SvgCacheKey::NaturalSize, SvgCacheKey::NaturalSize), status, devicePixelRatio), elementRect);
+                    theme->insertIntoRectsCache(path, cacheId, elementRect);
+                }
+
+                theme->insertIntoRectsCache(path, scannedId, QRectF(0, 0, 1, 1));
             }
         }
 
-        s_renderers[styleCrc + path] = renderer;
+        pool->insert(renderer, path, styleCrc);
     }
 
     if (size == QSizeF()) {
@@ -495,8 +682,13 @@ void SvgPrivate::createRenderer()
 void SvgPrivate::eraseRenderer()
 {
     if (renderer && renderer->ref.load() == 2) {
-        // this and the cache reference it
-        s_renderers.erase(s_renderers.find(styleCrc + path));
+        // this and the pool reference it: it becomes idle
+        if (s_rendererPool.exists() && !s_rendererPool.isDestroyed()) {
+            s_rendererPool->release(renderer);
+        }
+        if (s_renderQueue.exists() && !s_renderQueue.isDestroyed()) {
+            s_renderQueue->releaseRenderer(styleCrc, path);
+        }
 
         if (theme) {
             theme.data()->releaseRectsCache(path);
@@ -528,19 +720,19 @@ QRectF SvgPrivate::elementRect(const QString &elementId)
         return QRectF();
     }
 
-    const QString id = cacheId(elementId);
-    const auto it = localRectCache.constFind(id);
+    const SvgCacheKey key = rectCacheKey(elementId);
+    const auto it = localRectCache.constFind(key);
     if (it != localRectCache.constEnd()) {
         return *it;
     }
 
     QRectF rect;
-    bool found = cacheAndColorsTheme()->findInRectsCache(path, id, rect);
+    bool found = cacheAndColorsTheme()->findInRectsCache(path, cacheId(elementId), rect);
     //This is a corner case where we are *sure* the element is not valid
     if (found && rect == QRectF()) {
         return rect;
     } else if (found) {
-        localRectCache.insert(id, rect);
+        localRectCache.insert(key, rect);
     } else {
         rect = findAndCacheElementRect(elementId);
     }
@@ -552,10 +744,11 @@ QRectF SvgPrivate::findAndCacheElementRect(const QString &elementId)
 {
     //we need to check the id before createRenderer(), otherwise it may generate a different id compared to the previous cacheId)( call
     const QString id = cacheId(elementId);
+    const SvgCacheKey key = rectCacheKey(elementId);
     createRenderer();
 
-    if (localRectCache.contains(id)) {
-        return localRectCache.value(id);
+    if (localRectCache.contains(key)) {
+        return localRectCache.value(key);
     }
 
     QRectF elementRect = renderer->elementExists(elementId) ?
@@ -692,7 +885,20 @@ void SvgPrivate::colorsChanged()
     emit q->repaintNeeded();
 }
 
-QHash<QString, SharedSvgRenderer::Ptr> SvgPrivate::s_renderers;
+QVariantMap SvgPrivate::rendererPoolStatistics() const
+{
+    const SvgRendererPool::Statistics statistics = s_rendererPool->statistics();
+
+    QVariantMap map;
+    map[QStringLiteral("live")] = statistics.live;
+    map[QStringLiteral("idle")] = statistics.idle;
+    map[QStringLiteral("evicted")] = statistics.evicted;
+    map[QStringLiteral("liveBytes")] = statistics.liveBytes;
+    map[QStringLiteral("idleBytes")] = statistics.idleBytes;
+    map[QStringLiteral("evictedBytes")] = statistics.evictedBytes;
+    return map;
+}
+
 QWeakPointer<Theme> SvgPrivate::s_systemColorsCache;
 qreal SvgPrivate::s_lastScaleFactor = 1.0;
 
@@ -770,7 +976,8 @@ void Svg::setColorGroup(Plasma::Theme::ColorGroup group)
     }
 
     d->colorGroup = group;
-    d->renderer = 0;
+    // the renderer of the previous color group becomes idle in the pool
+    d->eraseRenderer();
     emit colorGroupChanged();
     emit repaintNeeded();
 }
@@ -795,6 +1002,11 @@ QImage Svg::image(const QSize &size, const QString &elementID)
     return pix.toImage();
 }
 
+bool Svg::requestPixmap(const QSize &size, const QString &elementId)
+{
+    return d->requestPixmap(elementId, d->devicePixelRatio, size);
+}
+
 void Svg::paint(QPainter *painter, const QPointF &point, const QString &elementID)
 {
     Q_ASSERT(painter->device());
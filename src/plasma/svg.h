@@ -160,6 +160,27 @@ public:
      */
     Q_INVOKABLE QImage image(const QSize &size, const QString &elementID = QString());
 
+    /**
+     * Requests the rendering of an element without blocking.
+     *
+     * If the element still has to be rendered at this size, it is rendered
+     * in a separate thread and pixmapReady is emitted once it's in the
+     * rendering cache: from then on image() and pixmap() return it
+     * without rendering again. In the meantime the previous rendering
+     * can be kept on screen.
+     *
+     * @param size the size of the requested image, as in image()
+     * @param elementId the ID string of the element to render, or an empty
+     *                  string for the whole SVG
+     * @return @c true if the rendering has been started or is already in progress,
+     *         @c false if image() can be called right away, as the element
+     *         is already cached or can't be rendered asynchronously, e.g. when
+     *         the rendering cache is not in use
+     * @see pixmapReady
+     * @since 5.44
+     */
+    bool requestPixmap(const QSize &size, const QString &elementId = QString());
+
     /**
      * Paints all or part of the SVG represented by this object
      *
@@ -499,12 +520,25 @@ Q_SIGNALS:
      */
     void statusChanged(Plasma::Svg::Status status);
 
+    /**
+     * Emitted when an element requested with requestPixmap has been rendered.
+     * It's not emitted if the device pixel ratio, the color group, the status
+     * or the image of the Svg changed in the meantime, as image() would not
+     * return that rendering anymore.
+     * @param elementId the requested element
+     * @param size the requested size
+     * @since 5.44
+     */
+    void pixmapReady(const QString &elementId, const QSize &size);
+
 private:
     SvgPrivate *const d;
     bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
 
     Q_PRIVATE_SLOT(d, void themeChanged())
     Q_PRIVATE_SLOT(d, void colorsChanged())
+    // statistics of the renderers shared by all the Svgs, for the autotests
+    Q_PRIVATE_SLOT(d, QVariantMap rendererPoolStatistics())
 
     friend class SvgPrivate;
     friend class FrameSvgPrivate;
@@ -24,7 +24,6 @@
 #include <QFont>
 #include <QFontDatabase>
 #include <QFileInfo>
-#include <QMutableListIterator>
 #include <QPair>
 #include <QStringBuilder>
 #include <QTimer>
@@ -147,46 +146,7 @@ QString Theme::themeName() const
 
 QString Theme::imagePath(const QString &name) const
 {
-    // look for a compressed svg file in the theme
-    if (name.contains(QLatin1String("../")) || name.isEmpty()) {
-        // we don't support relative paths
-        //qCDebug(LOG_PLASMA) << "Theme says: bad image path " << name;
-        return QString();
-    }
-
-    const QString svgzName = name % QLatin1Literal(".svgz");
-    QString path = d->findInTheme(svgzName, d->themeName);
-
-    if (path.isEmpty()) {
-        // try for an uncompressed svg file
-        const QString svgName = name % QLatin1Literal(".svg");
-        path = d->findInTheme(svgName, d->themeName);
-
-        // search in fallback themes if necessary
-        for (int i = 0; path.isEmpty() && i < d->fallbackThemes.count(); ++i) {
-            if (d->themeName == d->fallbackThemes[i]) {
-                continue;
-            }
-
-            // try a compressed svg file in the fallback theme
-            path = d->findInTheme(svgzName, d->fallbackThemes[i]);
-
-            if (path.isEmpty()) {
-                // try an uncompressed svg file in the fallback theme
-                path = d->findInTheme(svgName, d->fallbackThemes[i]);
-            }
-        }
-    }
-
-    /*
-    if (path.isEmpty()) {
-    #ifndef NDEBUG
-        // qCDebug(LOG_PLASMA) << "Theme says: bad image path " << name;
-    #endif
-    }
-    */
-
-    return path;
+    return d->svgPath(name);
 }
 
 QString Theme::backgroundPath(const QString& image) const
@@ -294,22 +254,46 @@ bool Theme::useGlobalSettings() const
 
 bool Theme::findInCache(const QString &key, QPixmap &pix, unsigned int lastModified)
 {
-    if (lastModified != 0 && d->useCache() && lastModified > uint(d->pixmapCache->lastModifiedTime().toTime_t())) {
+    if (lastModified != 0 && d->useCache() && lastModified > d->cacheWriter.lastModifiedTime()) {
         return false;
     }
 
     if (d->useCache()) {
+        if (const QPixmap *cached = d->memoryPixmapCache.object(key)) {
+            ++d->memoryCacheHits;
+            pix = *cached;
+            return true;
+        }
+
         const QString id = d->keysToCache.value(key);
         if (d->pixmapsToCache.contains(id)) {
             pix = d->pixmapsToCache.value(id);
-            return !pix.isNull();
+            if (!pix.isNull()) {
+                ++d->pendingCacheHits;
+                d->insertIntoMemoryCache(key, pix);
+                return true;
+            }
+            ++d->pixmapCacheMisses;
+            return false;
+        }
+
+        const QImage pending = d->cacheWriter.pendingImage(key);
+        if (!pending.isNull()) {
+            ++d->pendingCacheHits;
+            pix = QPixmap::fromImage(pending);
+            d->insertIntoMemoryCache(key, pix);
+            return true;
         }
 
         QPixmap temp;
         if (d->pixmapCache->findPixmap(key, &temp) && !temp.isNull()) {
+            ++d->sharedCacheHits;
+            d->insertIntoMemoryCache(key, temp);
             pix = temp;
             return true;
         }
+
+        ++d->pixmapCacheMisses;
     }
 
     return false;
@@ -318,13 +302,15 @@ bool Theme::findInCache(const QString &key, QPixmap &pix, unsigned int lastModif
 void Theme::insertIntoCache(const QString &key, const QPixmap &pix)
 {
     if (d->useCache()) {
-        d->pixmapCache->insertPixmap(key, pix);
+        d->insertIntoMemoryCache(key, pix);
+        d->cacheWriter.write(key, pix.toImage());
     }
 }
 
 void Theme::insertIntoCache(const QString &key, const QPixmap &pix, const QString &id)
 {
     if (d->useCache()) {
+        d->insertIntoMemoryCache(key, pix);
         d->pixmapsToCache.insert(id, pix);
 
         if (d->idsToCache.contains(id)) {
@@ -345,31 +331,42 @@ bool Theme::findInRectsCache(const QString &image, const QString &element, QRect
         return false;
     }
 
+    switch (d->rectsCache.find(image, element, rect)) {
+    case SvgRectsCache::Found:
+        return true;
+    case SvgRectsCache::KnownInvalid:
+        //Name starting by _ means the element is empty and we're asked for the size of
+        //the whole image, so the whole image is never invalid
+        return element.indexOf(QLatin1Char('_')) > 0;
+    case SvgRectsCache::NotFound:
+        break;
+    }
+
+    if (!d->svgElementsCache) {
+        return false;
+    }
+
+    //Not in the index yet, look in the old cache we are migrating from
     KConfigGroup imageGroup(d->svgElementsCache, image);
     rect = imageGroup.readEntry(element % QLatin1Literal("Size"), QRectF());
 
     if (rect.isValid()) {
+        d->rectsCache.insert(image, element, rect);
+        QMetaObject::invokeMethod(d->rectSaveTimer, "start");
         return true;
     }
 
-    //Name starting by _ means the element is empty and we're asked for the size of
-    //the whole image, so the whole image is never invalid
     if (element.indexOf(QLatin1Char('_')) <= 0) {
         return false;
     }
 
-    bool invalid = false;
-
-    QHash<QString, QSet<QString> >::iterator it = d->invalidElements.find(image);
-    if (it == d->invalidElements.end()) {
-        QSet<QString> elements = imageGroup.readEntry("invalidElements", QStringList()).toSet();
-        d->invalidElements.insert(image, elements);
-        invalid = elements.contains(element);
-    } else {
-        invalid = it.value().contains(element);
+    if (imageGroup.readEntry("invalidElements", QStringList()).contains(element)) {
+        d->rectsCache.insert(image, element, QRectF());
+        QMetaObject::invokeMethod(d->rectSaveTimer, "start");
+        return true;
     }
 
-    return invalid;
+    return false;
 }
 
 QStringList Theme::listCachedRectKeys(const QString &image) const
@@ -378,20 +375,22 @@ QStringList Theme::listCachedRectKeys(const QString &image) const
         return QStringList();
     }
 
-    KConfigGroup imageGroup(d->svgElementsCache, image);
-    QStringList keys = imageGroup.keyList();
-
-    QMutableListIterator<QString> i(keys);
-    while (i.hasNext()) {
-        QString key = i.next();
-        if (key.endsWith(QLatin1String("Size"))) {
-            // The actual cache id used from outside doesn't end on "Size".
-            key.resize(key.size() - 4);
-            i.setValue(key);
-        } else {
-            i.remove();
+    QStringList keys = d->rectsCache.keys(image);
+
+    if (d->svgElementsCache) {
+        KConfigGroup imageGroup(d->svgElementsCache, image);
+        const QStringList oldKeys = imageGroup.keyList();
+        for (const QString &key : oldKeys) {
+            if (key.endsWith(QLatin1String("Size"))) {
+                // The actual cache id used from outside doesn't end on "Size".
+                const QString id = key.left(key.size() - 4);
+                if (!keys.contains(id)) {
+                    keys << id;
+                }
+            }
         }
     }
+
     return keys;
 }
 
@@ -401,21 +400,7 @@ void Theme::insertIntoRectsCache(const QString &image, const QString &element, c
         return;
     }
 
-    if (rect.isValid()) {
-        KConfigGroup imageGroup(d->svgElementsCache, image);
-        imageGroup.writeEntry(element % QLatin1Literal("Size"), rect);
-    } else {
-        QHash<QString, QSet<QString> >::iterator it = d->invalidElements.find(image);
-        if (it == d->invalidElements.end()) {
-            d->invalidElements[image].insert(element);
-        } else if (!it.value().contains(element)) {
-            if (it.value().count() > 1000) {
-                it.value().erase(it.value().begin());
-            }
-
-            it.value().insert(element);
-        }
-    }
+    d->rectsCache.insert(image, element, rect);
 
     QMetaObject::invokeMethod(d->rectSaveTimer, "start");
 }
@@ -423,29 +408,32 @@ void Theme::insertIntoRectsCache(const QString &image, const QString &element, c
 void Theme::invalidateRectsCache(const QString &image)
 {
     if (d->useCache()) {
-        KConfigGroup imageGroup(d->svgElementsCache, image);
-        imageGroup.deleteGroup();
-    }
+        d->rectsCache.invalidate(image);
+
+        if (d->svgElementsCache) {
+            KConfigGroup imageGroup(d->svgElementsCache, image);
+            imageGroup.deleteGroup();
+        }
 
-    d->invalidElements.remove(image);
+        QMetaObject::invokeMethod(d->rectSaveTimer, "start");
+    }
 }
 
 void Theme::releaseRectsCache(const QString &image)
 {
-    QHash<QString, QSet<QString> >::iterator it = d->invalidElements.find(image);
-    if (it != d->invalidElements.end()) {
-        if (d->useCache()) {
-            KConfigGroup imageGroup(d->svgElementsCache, it.key());
-            imageGroup.writeEntry("invalidElements", it.value().toList());
-        }
-
-        d->invalidElements.erase(it);
+    //once nothing renders the image anymore, its rects are usually all known:
+    //write them out with the ones of the images released in the same pass
+    //of the event loop, instead of keeping them in memory until the save timer
+    if (d->rectsCache.hasPendingChanges(image) && !d->rectsSaveQueued) {
+        d->rectsSaveQueued = true;
+        QMetaObject::invokeMethod(d, "saveSvgElementsCache", Qt::QueuedConnection);
     }
 }
 
 void Theme::setCacheLimit(int kbytes)
 {
     d->cacheSize = kbytes;
+    d->cacheWriter.setCache(0);
     delete d->pixmapCache;
     d->pixmapCache = 0;
 }
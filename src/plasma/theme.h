@@ -424,6 +424,9 @@ private:
     friend class FrameSvgPrivate;
     friend class ThemePrivate;
     ThemePrivate *d;
+
+    // lookups of the pixmap caches and content of the in-memory one, for the autotests
+    Q_PRIVATE_SLOT(d, QVariantMap pixmapCacheCounters())
 };
 
 } // Plasma namespace
@@ -27,6 +27,7 @@
 #include <QQmlContext>
 
 #include <QDebug>
+#include <QElapsedTimer>
 
 #include <klocalizedstring.h>
 
@@ -38,10 +39,13 @@
 #include <packageurlinterceptor.h>
 #include <private/package_p.h>
 
+#include "debug_p.h"
+
 namespace PlasmaQuick
 {
 
 QHash<QObject *, AppletQuickItem *> AppletQuickItemPrivate::s_rootObjects = QHash<QObject *, AppletQuickItem *>();
+QHash<QQmlEngine *, QHash<QUrl, QQmlComponent *> > AppletQuickItemPrivate::s_componentCache = QHash<QQmlEngine *, QHash<QUrl, QQmlComponent *> >();
 
 
 AppletQuickItemPrivate::AppletQuickItemPrivate(Plasma::Applet *a, AppletQuickItem *item)
@@ -70,6 +74,31 @@ void AppletQuickItemPrivate::init()
     }
 }
 
+QQmlComponent *AppletQuickItemPrivate::cachedComponent(QQmlEngine *engine, const QUrl &url)
+{
+    if (!engine || url.isEmpty()) {
+        return 0;
+    }
+
+    //components are parented to the engine and shared between all the applets
+    //living in it: the url already identifies the package the file comes from
+    auto it = s_componentCache.find(engine);
+    if (it == s_componentCache.end()) {
+        QObject::connect(engine, &QObject::destroyed, [engine]() {
+            s_componentCache.remove(engine);
+        });
+        it = s_componentCache.insert(engine, QHash<QUrl, QQmlComponent *>());
+    }
+
+    QQmlComponent *component = it->value(url);
+    if (!component) {
+        component = new QQmlComponent(engine, url, engine);
+        it->insert(url, component);
+    }
+
+    return component;
+}
+
 void AppletQuickItemPrivate::connectLayoutAttached(QObject *item)
 {
     QObject *layout = 0;
@@ -519,7 +548,13 @@ void AppletQuickItem::init()
         engine->setProperty(("_plasma_qqc_style_set"), true);
     }
 
+    //identical mainscripts are compiled only once: the engine type loader
+    //caches the compilation unit by url and, when the package ships one,
+    //loads the ahead of time compiled .qmlc file instead of the source
+    QElapsedTimer timer;
+    timer.start();
     d->qmlObject->setSource(d->applet->kPackage().fileUrl("mainscript"));
+    const qint64 compileTime = timer.elapsed();
 
     if (!engine || !engine->rootContext() || !engine->rootContext()->isValid() || !d->qmlObject->mainComponent() || d->qmlObject->mainComponent()->isError() || d->applet->failedToLaunch()) {
         QString reason;
@@ -559,7 +594,9 @@ void AppletQuickItem::init()
         initialProperties[QStringLiteral("height")] = h;
     }
     d->qmlObject->setInitializationDelayed(false);
+    timer.restart();
     d->qmlObject->completeInitialization(initialProperties);
+    const qint64 instantiateTime = timer.elapsed();
 
     //otherwise, initialize our size to root object's size
     if (d->qmlObject->rootObject() && (width() <= 0 || height() <= 0)) {
@@ -576,25 +613,29 @@ void AppletQuickItem::init()
         emit fullRepresentationChanged(d->fullRepresentation);
     }
 
+    timer.restart();
+
     //default compactRepresentation is a simple icon provided by the shell package
     if (!d->compactRepresentation) {
-        d->compactRepresentation = new QQmlComponent(engine, this);
-        d->compactRepresentation->loadUrl(d->coronaPackage.fileUrl("defaultcompactrepresentation"));
+        d->compactRepresentation = AppletQuickItemPrivate::cachedComponent(engine, d->coronaPackage.fileUrl("defaultcompactrepresentation"));
         emit compactRepresentationChanged(d->compactRepresentation);
     }
 
     //default compactRepresentationExpander is the popup in which fullRepresentation goes
     if (!d->compactRepresentationExpander) {
-        d->compactRepresentationExpander = new QQmlComponent(engine, this);
         QUrl compactExpanderUrl = d->containmentPackage.fileUrl("compactapplet");
 
         if (compactExpanderUrl.isEmpty()) {
             compactExpanderUrl = d->coronaPackage.fileUrl("compactapplet");
         }
 
-        d->compactRepresentationExpander->loadUrl(compactExpanderUrl);
+        d->compactRepresentationExpander = AppletQuickItemPrivate::cachedComponent(engine, compactExpanderUrl);
     }
 
+    qCDebug(LOG_PLASMAQUICK) << "Applet" << d->applet->pluginMetaData().pluginId() << d->applet->id()
+                             << "compile:" << compileTime + timer.elapsed() << "ms"
+                             << "instantiate:" << instantiateTime << "ms";
+
     d->compactRepresentationCheck();
     qmlObject()->engine()->rootContext()->setBaseUrl(qmlObject()->source());
     qmlObject()->engine()->setContextForObject(this, qmlObject()->engine()->rootContext());
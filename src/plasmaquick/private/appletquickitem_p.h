@@ -59,6 +59,9 @@ public:
 
     void init();
 
+    //returns the component for url shared by all the applets in engine
+    static QQmlComponent *cachedComponent(QQmlEngine *engine, const QUrl &url);
+
     QQuickItem *createCompactRepresentationItem();
     QQuickItem *createFullRepresentationItem();
     QQuickItem *createCompactRepresentationExpanderItem();
@@ -109,6 +112,7 @@ public:
     bool activationTogglesExpanded : 1;
 
     static QHash<QObject *, AppletQuickItem *> s_rootObjects;
+    static QHash<QQmlEngine *, QHash<QUrl, QQmlComponent *> > s_componentCache;
 };
 
 }